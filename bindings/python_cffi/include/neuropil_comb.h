@@ -21,6 +21,7 @@
         np_invalid_argument,
         np_invalid_operation,
         np_startup,
+        np_operation_would_block,
     } ;
     const char *np_error_str(enum np_return e);
     struct version_t {
@@ -75,6 +76,7 @@
         np_log_write_callback log_write_fn;
         size_t jobqueue_size;
         size_t max_msgs_per_sec;
+        uint8_t ingress_shards;
     } ;
    struct np_settings * np_default_settings(struct np_settings *settings);
    np_context* np_new_context(struct np_settings *settings);
@@ -3,6 +3,7 @@
 // Licensed under the Open Software License (OSL 3.0), please see LICENSE file
 // for details
 //
+#include <ctype.h>
 #include <dirent.h>
 #include <errno.h>
 #include <fcntl.h>
@@ -15,6 +16,8 @@
 #include <sys/types.h>
 #include <unistd.h>
 
+#include "sodium.h"
+
 // neuropil core include files
 #include "util/np_serialization.h"
 #include "util/np_tree.h"
@@ -32,6 +35,18 @@
 // define max memory we will allocate for mmap'ed files
 // TODO: only load file content up to the defined upper max (lazy loading)
 #define NP_FILE_MEMORY_MAX 1024 * 1000 * 64 // 64 MB
+// pacing interval of the segment stream of each transfer
+#define NP_FILE_STREAM_INTERVAL 0.031415
+// time to wait for "have" reports of receivers before streaming starts
+#define NP_FILE_HAVE_TIMEOUT 3.1415
+#define NP_FILE_HAVE_SUBJECT "files/have"
+// local directory of the content addressed chunk store
+#define NP_FILE_CHUNK_DIR "np_chunks"
+// size of the manifest header (file size, chunk count) and of each entry
+#define NP_FILE_MANIFEST_HEADER 12
+#define NP_FILE_MANIFEST_ENTRY  (12 + crypto_generichash_BYTES)
+// upper bound of chunks in a received manifest (8 GB at the segment size)
+#define NP_FILE_MANIFEST_MAX_CHUNKS (1 << 20)
 
 enum mime_types {
   application_graphql = 0,
@@ -132,6 +147,50 @@ struct np_dir_info {
   np_id  **file_entries;
 };
 
+// a content defined chunk of a file, as listed in the manifest
+struct np_file_chunk {
+  uint64_t      offset;
+  uint32_t      length;
+  uint16_t      have_count; // number of receivers already holding the chunk
+  unsigned char hash[crypto_generichash_BYTES];
+};
+
+// state of a streaming file transfer. The file is read chunk by chunk,
+// content and serialization buffer are re-used for each chunk. Before
+// streaming starts the transfer waits NP_FILE_HAVE_TIMEOUT for the receivers
+// to report the chunks they already hold.
+struct np_file_transfer {
+  struct np_file_info *info;
+
+  int      fd;
+  double   started_at;
+  bool     chunked;
+  bool     streaming;
+  bool     busy;
+  bool     failed;
+  uint16_t receivers;
+  uint16_t reports;
+
+  uint32_t              segment;
+  uint32_t              segments;
+  struct np_file_chunk *chunks;
+
+  unsigned char content[NP_FILE_SEGMENT_SIZE];
+  unsigned char buffer[NP_FILE_SEGMENT_SIZE + NP_FILE_SEGMENT_HEADER];
+
+  struct np_file_transfer *next;
+  // transfers claimed by the stream pump, only valid while busy
+  struct np_file_transfer *work_next;
+};
+
+// state of a file on the receiving side, received is a bitmap of the chunks
+// present in the local chunk store
+struct np_file_receive {
+  uint32_t       chunks;
+  uint32_t       missing;
+  unsigned char *received;
+};
+
 struct np_files {
   np_context *context;
   np_id       seed;
@@ -140,6 +199,13 @@ struct np_files {
   np_spinlock_t _lock;
 
   size_t bytes_in_memory;
+
+  bool                     streaming_disabled;
+  bool                     stream_pump_started;
+  struct np_file_transfer *transfers;
+
+  np_tree_t    *_receive_tree;
+  np_spinlock_t _receive_lock;
 };
 /*
 urn:files:filename => HF1
@@ -481,12 +547,435 @@ void __send_dir(np_state_t *ac, const char *id) {
   np_send(ac, _info->ci.subject, buffer, buffer_size);
 }
 
+// the np_id of a received file is part of the manifest and file path. Only
+// the hex form of a np_id is accepted, id_str is re-encoded from the parsed
+// id and never contains anything else.
+bool __file_id_from_str(const char *str, np_id *id, char id_str[65]) {
+  if (NULL == str ||
+      NP_FINGERPRINT_BYTES * 2 != strnlen(str, NP_FINGERPRINT_BYTES * 2 + 1))
+    return false;
+  for (uint8_t i = 0; i < NP_FINGERPRINT_BYTES * 2; i++)
+    if (!isxdigit((unsigned char)str[i])) return false;
+
+  np_str_id(id, str);
+  if (NULL != id_str) np_id_str(id_str, *id);
+  return true;
+}
+
+bool __file_id_parse(np_tree_elem_t *elem, np_id *id, char id_str[65]) {
+  return NULL != elem && np_treeval_type_char_ptr == elem->val.type &&
+         __file_id_from_str(elem->val.value.s, id, id_str);
+}
+
+void __put_u32(unsigned char *buf, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++) buf[i] = (value >> (24 - 8 * i)) & 0xFF;
+}
+
+void __put_u64(unsigned char *buf, uint64_t value) {
+  __put_u32(buf, value >> 32);
+  __put_u32(buf + 4, value & 0xFFFFFFFF);
+}
+
+uint32_t __get_u32(const unsigned char *buf) {
+  return ((uint32_t)buf[0] << 24) | ((uint32_t)buf[1] << 16) |
+         ((uint32_t)buf[2] << 8) | buf[3];
+}
+
+uint64_t __get_u64(const unsigned char *buf) {
+  return ((uint64_t)__get_u32(buf) << 32) | __get_u32(buf + 4);
+}
+
+// the gear table has to be the same on all nodes, otherwise chunk boundaries
+// (and therefore chunk hashes) of identical files would differ
+static uint64_t __gear_table[256];
+
+void __gear_table_init() {
+  uint64_t seed = 0x6E6575726F70696CULL; // "neuropil"
+  for (uint16_t i = 0; i < 256; i++) {
+    // splitmix64
+    uint64_t z = (seed += 0x9E3779B97F4A7C15ULL);
+    z          = (z ^ (z >> 30)) * 0xBF58476D1CE4E5B9ULL;
+    z          = (z ^ (z >> 27)) * 0x94D049BB133111EBULL;
+    __gear_table[i] = z ^ (z >> 31);
+  }
+}
+
+bool __add_chunk(struct np_file_transfer  *transfer,
+                 uint64_t                  offset,
+                 uint32_t                  length,
+                 crypto_generichash_state *gh_state) {
+  struct np_file_chunk *chunks =
+      realloc(transfer->chunks,
+              sizeof(struct np_file_chunk) * (transfer->segments + 1));
+  if (NULL == chunks) return false;
+  transfer->chunks = chunks;
+
+  struct np_file_chunk *chunk = &transfer->chunks[transfer->segments];
+  chunk->offset               = offset;
+  chunk->length               = length;
+  chunk->have_count           = 0;
+  crypto_generichash_final(gh_state, chunk->hash, crypto_generichash_BYTES);
+  crypto_generichash_init(gh_state, NULL, 0, crypto_generichash_BYTES);
+
+  transfer->segments++;
+  return true;
+}
+
+// splits the file into content defined chunks. Boundaries are set where the
+// gear rolling hash matches NP_FILE_CHUNK_MASK, so an insertion into a file
+// only changes the chunks around the modification.
+bool __chunk_file(struct np_file_transfer *transfer) {
+  crypto_generichash_state gh_state;
+  crypto_generichash_init(&gh_state, NULL, 0, crypto_generichash_BYTES);
+
+  uint64_t rolling_hash = 0;
+  uint64_t chunk_start  = 0;
+  uint32_t chunk_length = 0;
+  uint64_t offset       = 0;
+
+  while (offset < (uint64_t)transfer->info->file_size) {
+    ssize_t bytes_read =
+        pread(transfer->fd, transfer->content, NP_FILE_SEGMENT_SIZE, offset);
+    if (bytes_read <= 0) return false;
+
+    ssize_t block_start = 0;
+    for (ssize_t i = 0; i < bytes_read; i++) {
+      rolling_hash = (rolling_hash << 1) + __gear_table[transfer->content[i]];
+      chunk_length++;
+
+      if ((chunk_length >= NP_FILE_CHUNK_MIN &&
+           (rolling_hash & NP_FILE_CHUNK_MASK) == 0) ||
+          chunk_length >= NP_FILE_SEGMENT_SIZE) {
+        crypto_generichash_update(&gh_state,
+                                  transfer->content + block_start,
+                                  i + 1 - block_start);
+        if (!__add_chunk(transfer, chunk_start, chunk_length, &gh_state))
+          return false;
+
+        chunk_start += chunk_length;
+        chunk_length = 0;
+        rolling_hash = 0;
+        block_start  = i + 1;
+      }
+    }
+    crypto_generichash_update(&gh_state,
+                              transfer->content + block_start,
+                              bytes_read - block_start);
+    offset += bytes_read;
+  }
+  if (chunk_length > 0)
+    return __add_chunk(transfer, chunk_start, chunk_length, &gh_state);
+
+  return true;
+}
+
+void __send_manifest(np_state_t *context, struct np_file_transfer *transfer) {
+  struct np_file_info *_info = transfer->info;
+
+  size_t         manifest_size = NP_FILE_MANIFEST_HEADER +
+                         transfer->segments * NP_FILE_MANIFEST_ENTRY;
+  unsigned char *manifest      = malloc(manifest_size);
+  __put_u64(manifest, _info->file_size);
+  __put_u32(manifest + 8, transfer->segments);
+
+  unsigned char *entry = manifest + NP_FILE_MANIFEST_HEADER;
+  for (uint32_t i = 0; i < transfer->segments; i++) {
+    __put_u64(entry, transfer->chunks[i].offset);
+    __put_u32(entry + 8, transfer->chunks[i].length);
+    memcpy(entry + 12, transfer->chunks[i].hash, crypto_generichash_BYTES);
+    entry += NP_FILE_MANIFEST_ENTRY;
+  }
+
+  char       id_str[65];
+  np_tree_t *manifest_tree = np_tree_create();
+  np_tree_insert_str(manifest_tree,
+                     "np_id",
+                     np_treeval_new_s(np_id_str(id_str, (_info->ci.id))));
+  np_tree_insert_str(manifest_tree, "name", np_treeval_new_s(_info->ci.name));
+  np_tree_insert_str(manifest_tree,
+                     "mimetype",
+                     np_treeval_new_s(mime_type_str[_info->mime_type]));
+  np_tree_insert_str(manifest_tree,
+                     "manifest",
+                     np_treeval_new_bin(manifest, manifest_size));
+
+  size_t         buffer_size = np_tree_get_byte_size(manifest_tree);
+  unsigned char *buffer      = malloc(buffer_size);
+  np_tree2buffer(context, manifest_tree, buffer);
+  np_send(context, _info->ci.subject, buffer, buffer_size);
+
+  free(buffer);
+  free(manifest);
+  np_tree_free(manifest_tree);
+}
+
+// returns np_operation_would_block if the send queue is full, the segment is
+// then sent again with the next interval
+enum np_return __send_segment(np_state_t              *context,
+                              struct np_file_transfer *transfer) {
+  struct np_file_info  *_info = transfer->info;
+  struct np_file_chunk *chunk = &transfer->chunks[transfer->segment];
+
+  ssize_t bytes_read =
+      pread(transfer->fd, transfer->content, chunk->length, chunk->offset);
+  if (bytes_read != (ssize_t)chunk->length) {
+    log_msg(LOG_WARNING,
+            "unable to read segment %" PRIu32 " of file %s (%s)",
+            transfer->segment,
+            _info->ci.name,
+            strerror(errno));
+    return np_unknown_error;
+  }
+
+  char       id_str[65];
+  np_tree_t *segment_tree = np_tree_create();
+  np_tree_insert_str(segment_tree,
+                     "np_id",
+                     np_treeval_new_s(np_id_str(id_str, (_info->ci.id))));
+  np_tree_insert_str(segment_tree,
+                     "segment",
+                     np_treeval_new_ul(transfer->segment));
+  np_tree_insert_str(segment_tree,
+                     "segments",
+                     np_treeval_new_ul(transfer->segments));
+  np_tree_insert_str(segment_tree,
+                     "segment_hash",
+                     np_treeval_new_bin(chunk->hash, crypto_generichash_BYTES));
+  np_tree_insert_str(segment_tree,
+                     "content",
+                     np_treeval_new_bin(transfer->content, bytes_read));
+
+  enum np_return ret         = np_invalid_argument;
+  size_t         buffer_size = np_tree_get_byte_size(segment_tree);
+  if (buffer_size <= sizeof(transfer->buffer)) {
+    np_tree2buffer(context, segment_tree, transfer->buffer);
+    ret = np_send(context, _info->ci.subject, transfer->buffer, buffer_size);
+  } else {
+    log_msg(LOG_WARNING,
+            "segment %" PRIu32 " of file %s exceeds the segment buffer",
+            transfer->segment,
+            _info->ci.name);
+  }
+  np_tree_free(segment_tree);
+
+  if (ret == np_ok) transfer->segment++;
+  return ret;
+}
+
+void __free_transfer(struct np_file_transfer *transfer) {
+  close(transfer->fd);
+  free(transfer->chunks);
+  free(transfer);
+}
+
+// sends the next segments of a streaming transfer. The stream is paced and
+// not acknowledged: at most NP_FILE_SEGMENTS_PER_INTERVAL segments are handed
+// over to the neuropil library per interval, chunks held by all receivers are
+// skipped. A full send queue keeps the position until the next interval, only
+// other errors abort the transfer.
+void __stream_segments(np_state_t *context, struct np_file_transfer *transfer) {
+  uint16_t sent = 0;
+  while (sent < NP_FILE_SEGMENTS_PER_INTERVAL &&
+         transfer->segment < transfer->segments) {
+    if (transfer->chunks[transfer->segment].have_count >=
+        transfer->receivers) {
+      transfer->segment++;
+      continue;
+    }
+    enum np_return ret = __send_segment(context, transfer);
+    if (ret == np_operation_would_block) break;
+    if (ret != np_ok) {
+      transfer->failed = true;
+      break;
+    }
+    sent++;
+  }
+}
+
+// claims the transfers with pending work under the lock, reading, chunking
+// and sending is done outside of it so that "have" reports and new requests
+// do not wait for the file I/O. A new transfer is chunked and announced with
+// its manifest first, streaming starts once all receivers reported the chunks
+// they hold or after NP_FILE_HAVE_TIMEOUT. Finished and failed transfers are
+// removed.
+bool __np_files_stream_pump(np_state_t               *context,
+                            NP_UNUSED np_util_event_t event) {
+  double                   now      = np_time_now();
+  struct np_file_transfer *work     = NULL;
+  struct np_file_transfer *transfer = NULL;
+
+  np_spinlock_lock(&__files._lock);
+  for (transfer = __files.transfers; transfer != NULL;
+       transfer = transfer->next) {
+    if (transfer->busy) continue;
+
+    if (transfer->chunked && !transfer->streaming) {
+      if (transfer->reports < transfer->receivers &&
+          (now - transfer->started_at) < NP_FILE_HAVE_TIMEOUT)
+        continue;
+      transfer->streaming = true;
+    }
+    transfer->busy      = true;
+    transfer->work_next = work;
+    work                = transfer;
+  }
+  np_spinlock_unlock(&__files._lock);
+
+  if (work == NULL) return true;
+
+  for (transfer = work; transfer != NULL; transfer = transfer->work_next) {
+    if (transfer->streaming) {
+      __stream_segments(context, transfer);
+    } else if (__chunk_file(transfer)) {
+      __send_manifest(context, transfer);
+    } else {
+      log_msg(LOG_WARNING,
+              "unable to chunk file %s (%s)",
+              transfer->info->ci.name,
+              strerror(errno));
+      transfer->failed = true;
+    }
+  }
+
+  struct np_file_transfer *done = NULL;
+
+  np_spinlock_lock(&__files._lock);
+  for (transfer = work; transfer != NULL; transfer = transfer->work_next) {
+    // the timeout for "have" reports starts with the manifest
+    if (!transfer->chunked) {
+      transfer->chunked    = true;
+      transfer->started_at = np_time_now();
+    }
+    transfer->busy = false;
+  }
+
+  struct np_file_transfer **iter = &__files.transfers;
+  while (*iter != NULL) {
+    transfer = *iter;
+    if (!transfer->busy &&
+        (transfer->failed ||
+         (transfer->streaming && transfer->segment == transfer->segments))) {
+      *iter               = transfer->next;
+      transfer->work_next = done;
+      done                = transfer;
+    } else {
+      iter = &transfer->next;
+    }
+  }
+  np_spinlock_unlock(&__files._lock);
+
+  while (done != NULL) {
+    transfer = done;
+    done     = transfer->work_next;
+    log_debug_msg(LOG_DEBUG,
+                  "file transfer of %s %s after %" PRIu32 " segments",
+                  transfer->info->ci.name,
+                  transfer->failed ? "aborted" : "finished",
+                  transfer->segment);
+    __free_transfer(transfer);
+  }
+  return true;
+}
+
+// receives the bitmap of chunks a receiver already holds for a file
+bool __np_files_have_cb(np_context *context, struct np_message *msg) {
+  np_tree_t *have_info = np_tree_create();
+  np_buffer2tree(context, msg->data, msg->data_length, have_info);
+
+  np_tree_elem_t *_np_id  = np_tree_find_str(have_info, "np_id");
+  np_tree_elem_t *_chunks = np_tree_find_str(have_info, "chunks");
+  np_tree_elem_t *_have   = np_tree_find_str(have_info, "have");
+
+  np_id file_id = {0};
+  if (__file_id_parse(_np_id, &file_id, NULL) && NULL != _chunks &&
+      np_treeval_type_unsigned_long == _chunks->val.type && NULL != _have &&
+      np_treeval_type_bin == _have->val.type &&
+      _have->val.size == (_chunks->val.value.ul + 7) / 8) {
+    np_spinlock_lock(&__files._lock);
+    struct np_file_transfer *transfer = __files.transfers;
+    while (transfer != NULL) {
+      if (transfer->chunked && !transfer->streaming &&
+          transfer->segments == _chunks->val.value.ul &&
+          0 == memcmp(transfer->info->ci.id, file_id, NP_FINGERPRINT_BYTES)) {
+        unsigned char *have = _have->val.value.bin;
+        for (uint32_t i = 0; i < transfer->segments; i++) {
+          if (have[i / 8] & (1 << (i % 8))) transfer->chunks[i].have_count++;
+        }
+        transfer->reports++;
+        break;
+      }
+      transfer = transfer->next;
+    }
+    np_spinlock_unlock(&__files._lock);
+  }
+
+  np_tree_free(have_info);
+  return true;
+}
+
+void __stream_file(np_state_t *context, struct np_file_info *_info) {
+  // a transfer that is still collecting "have" reports will serve the new
+  // receiver as well
+  np_spinlock_lock(&__files._lock);
+  struct np_file_transfer *iter = __files.transfers;
+  while (iter != NULL) {
+    if (iter->info == _info && !iter->streaming) {
+      iter->receivers++;
+      break;
+    }
+    iter = iter->next;
+  }
+  np_spinlock_unlock(&__files._lock);
+  if (iter != NULL) return;
+
+  char path[PATH_MAX];
+  snprintf(path, PATH_MAX, "%s/%s", _info->cwd, _info->ci.name);
+
+  int fd = open(path, O_RDONLY);
+  if (-1 == fd) {
+    fprintf(stdout, "unable to open file (%s)\n", strerror(errno));
+    return;
+  }
+
+  struct np_file_transfer *transfer =
+      calloc(1, sizeof(struct np_file_transfer));
+  transfer->info       = _info;
+  transfer->fd         = fd;
+  transfer->started_at = np_time_now();
+  transfer->receivers  = 1;
+
+  // the file is chunked and its manifest is sent by the stream pump, not on
+  // the thread of the requesting callback
+  np_spinlock_lock(&__files._lock);
+  transfer->next    = __files.transfers;
+  __files.transfers = transfer;
+
+  bool start_pump             = !__files.stream_pump_started;
+  __files.stream_pump_started = true;
+  np_spinlock_unlock(&__files._lock);
+
+  if (start_pump) {
+    np_jobqueue_submit_event_periodic(context,
+                                      PRIORITY_MOD_USER_DEFAULT,
+                                      0.0,
+                                      NP_FILE_STREAM_INTERVAL,
+                                      __np_files_stream_pump,
+                                      "__np_files_stream_pump");
+  }
+}
+
 void __send_file(np_state_t *ac, const char *id) {
   np_tree_elem_t *elem = np_tree_find_str(__files._file_tree, id);
   if (elem == NULL) return;
 
   struct np_file_info *_info = (struct np_file_info *)elem->val.value.v;
 
+  if (!__files.streaming_disabled && _info->file_size > NP_FILE_SEGMENT_SIZE) {
+    fprintf(stdout, "np request for: %s (streaming)\n", _info->ci.name);
+    __stream_file(ac, _info);
+    return;
+  }
+
   if (false == _info->loaded) __load_file(_info);
 
   if (true == _info->loaded) {
@@ -497,10 +986,11 @@ void __send_file(np_state_t *ac, const char *id) {
 
     size_t buffer_size = np_tree_get_byte_size(file_tree);
     // np_serializer_add_map_bytesize(file_tree, &buffer_size);
-    char file_buffer[buffer_size];
+    char *file_buffer = malloc(buffer_size);
     np_tree2buffer(ac, file_tree, file_buffer);
     np_send(ac, _info->ci.subject, file_buffer, buffer_size);
 
+    free(file_buffer);
     np_tree_free(file_tree);
   }
 
@@ -828,6 +1318,7 @@ void np_files_open(np_context *ac,
     __files._file_tree = np_tree_create();
     np_spinlock_init(&__files._lock, PTHREAD_PROCESS_PRIVATE);
     memcpy(__files.seed, identifier_seed, NP_FINGERPRINT_BYTES);
+    __gear_table_init();
     fprintf(stdout,
             "initialized file server, seed is %s\n",
             np_id_str(id_seed_str, identifier_seed));
@@ -874,6 +1365,13 @@ void np_files_open(np_context *ac,
                             __np_file_handle_http_get_dir);
     }
 
+    // receivers report the chunks they already hold on this subject
+    np_subject have_subject_id = {0};
+    np_generate_subject(&have_subject_id,
+                        NP_FILE_HAVE_SUBJECT,
+                        strnlen(NP_FILE_HAVE_SUBJECT, 12));
+    np_add_receive_cb(ac, have_subject_id, __np_files_have_cb);
+
   } else {
     dir_info = np_tree_find_str(__files._file_tree, subject)->val.value.v;
   }
@@ -910,34 +1408,377 @@ void np_files_open(np_context *ac,
   chdir(cwd);
 }
 
+void np_files_set_streaming(np_context *ac, bool enable) {
+  __files.streaming_disabled = !enable;
+}
+
 void np_files_close(np_context *ac, const char *alias) {}
 
 void np_files_list(np_context *ac, const char *alias) {}
 
+static pthread_once_t __files_receive_once = PTHREAD_ONCE_INIT;
+
+void __files_receive_init() {
+  __files._receive_tree = np_tree_create();
+  np_spinlock_init(&__files._receive_lock, PTHREAD_PROCESS_PRIVATE);
+}
+
+void __chunk_path(char (*path)[PATH_MAX], const unsigned char *hash) {
+  char hash_str[crypto_generichash_BYTES * 2 + 1];
+  sodium_bin2hex(hash_str, sizeof(hash_str), hash, crypto_generichash_BYTES);
+  snprintf(*path, PATH_MAX, "%s/%s", NP_FILE_CHUNK_DIR, hash_str);
+}
+
+void __manifest_path(char (*path)[PATH_MAX], const char *id_str) {
+  snprintf(*path, PATH_MAX, "%s/%s.manifest", NP_FILE_CHUNK_DIR, id_str);
+}
+
+// reads entry i of a stored manifest, returns false if there is no manifest
+// for the file or if the file has less than i + 1 chunks
+bool __manifest_entry(const char   *id_str,
+                      uint32_t      i,
+                      unsigned char entry[NP_FILE_MANIFEST_ENTRY]) {
+  char path[PATH_MAX];
+  __manifest_path(&path, id_str);
+
+  int fd = open(path, O_RDONLY);
+  if (-1 == fd) return false;
+
+  unsigned char header[NP_FILE_MANIFEST_HEADER];
+  bool          ret =
+      (NP_FILE_MANIFEST_HEADER ==
+       pread(fd, header, NP_FILE_MANIFEST_HEADER, 0)) &&
+      i < __get_u32(header + 8);
+  if (ret)
+    ret = (NP_FILE_MANIFEST_ENTRY ==
+           pread(fd,
+                 entry,
+                 NP_FILE_MANIFEST_ENTRY,
+                 NP_FILE_MANIFEST_HEADER + (off_t)i * NP_FILE_MANIFEST_ENTRY));
+  close(fd);
+  return ret;
+}
+
+bool np_files_materialize(np_context *context,
+                          const char *np_id,
+                          const char *target) {
+  // the manifest is only looked up by the re-encoded form of the id
+  char          id_str[65];
+  unsigned char file_id[NP_FINGERPRINT_BYTES];
+  if (!__file_id_from_str(np_id, &file_id, id_str)) return false;
+
+  char path[PATH_MAX];
+  __manifest_path(&path, id_str);
+
+  int manifest_fd = open(path, O_RDONLY);
+  if (-1 == manifest_fd) return false;
+
+  int fd = open(target, O_CREAT | O_WRONLY, S_IRUSR | S_IWUSR);
+  if (-1 == fd) {
+    close(manifest_fd);
+    return false;
+  }
+
+  bool          ret = false;
+  unsigned char header[NP_FILE_MANIFEST_HEADER];
+  unsigned char entry[NP_FILE_MANIFEST_ENTRY];
+  unsigned char content[NP_FILE_SEGMENT_SIZE];
+
+  if (NP_FILE_MANIFEST_HEADER ==
+      read(manifest_fd, header, NP_FILE_MANIFEST_HEADER)) {
+    uint64_t file_size = __get_u64(header);
+    uint32_t chunks    = __get_u32(header + 8);
+
+    ret = true;
+    for (uint32_t i = 0; ret && i < chunks; i++) {
+      ret = (NP_FILE_MANIFEST_ENTRY ==
+             read(manifest_fd, entry, NP_FILE_MANIFEST_ENTRY));
+      if (!ret) break;
+
+      uint64_t offset = __get_u64(entry);
+      uint32_t length = __get_u32(entry + 8);
+      if (length > NP_FILE_SEGMENT_SIZE || length > file_size ||
+          offset > file_size - length) {
+        ret = false;
+        break;
+      }
+
+      __chunk_path(&path, entry + 12);
+      int chunk_fd = open(path, O_RDONLY);
+      if (-1 == chunk_fd) {
+        log_msg(LOG_WARNING,
+                "chunk %" PRIu32 " of file %s is missing",
+                i,
+                id_str);
+        ret = false;
+        break;
+      }
+      ret = ((ssize_t)length == read(chunk_fd, content, length)) &&
+            ((ssize_t)length == pwrite(fd, content, length, offset));
+      close(chunk_fd);
+    }
+    if (ret) ret = (0 == ftruncate(fd, file_size));
+  }
+  close(fd);
+  close(manifest_fd);
+
+  return ret;
+}
+
+// stores the manifest of a streamed file and reports the chunks which are
+// already present in the chunk store back to the sender
+bool __store_manifest(np_context *context, np_tree_t *file_info) {
+  np_tree_elem_t *_np_id    = np_tree_find_str(file_info, "np_id");
+  np_tree_elem_t *_name     = np_tree_find_str(file_info, "name");
+  np_tree_elem_t *_manifest = np_tree_find_str(file_info, "manifest");
+
+  np_id file_id;
+  char  id_str[65];
+  if (!__file_id_parse(_np_id, &file_id, id_str) || NULL == _manifest ||
+      np_treeval_type_bin != _manifest->val.type ||
+      _manifest->val.size < NP_FILE_MANIFEST_HEADER) {
+    log_msg(LOG_WARNING, "received incomplete file manifest, dropping it");
+    return false;
+  }
+
+  // the chunk count is sent by the peer, check it before it is used
+  unsigned char *manifest = _manifest->val.value.bin;
+  uint32_t       chunks   = __get_u32(manifest + 8);
+  uint64_t       expected_size =
+      NP_FILE_MANIFEST_HEADER + (uint64_t)chunks * NP_FILE_MANIFEST_ENTRY;
+  if (chunks > NP_FILE_MANIFEST_MAX_CHUNKS ||
+      (uint64_t)_manifest->val.size != expected_size) {
+    log_msg(LOG_WARNING, "received corrupted file manifest, dropping it");
+    return false;
+  }
+
+  mkdir(NP_FILE_CHUNK_DIR, S_IRWXU);
+
+  char path[PATH_MAX];
+  __manifest_path(&path, id_str);
+  int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+  if (fd == -1 || (ssize_t)_manifest->val.size !=
+                       write(fd, manifest, _manifest->val.size)) {
+    fprintf(stdout, "error: %s for filename %s", strerror(errno), path);
+    if (fd != -1) close(fd);
+    return false;
+  }
+  close(fd);
+
+  struct np_file_receive *receive = calloc(1, sizeof(struct np_file_receive));
+  receive->chunks                 = chunks;
+  receive->missing                = chunks;
+  receive->received               = calloc(1, (chunks + 7) / 8);
+
+  unsigned char *entry = manifest + NP_FILE_MANIFEST_HEADER;
+  for (uint32_t i = 0; i < chunks; i++) {
+    __chunk_path(&path, entry + 12);
+    if (0 == access(path, F_OK)) {
+      receive->received[i / 8] |= (1 << (i % 8));
+      receive->missing--;
+    }
+    entry += NP_FILE_MANIFEST_ENTRY;
+  }
+
+  np_tree_t *have_tree = np_tree_create();
+  np_tree_insert_str(have_tree, "np_id", np_treeval_new_s(id_str));
+  np_tree_insert_str(have_tree, "chunks", np_treeval_new_ul(chunks));
+  np_tree_insert_str(have_tree,
+                     "have",
+                     np_treeval_new_bin(receive->received, (chunks + 7) / 8));
+
+  size_t         buffer_size = np_tree_get_byte_size(have_tree);
+  unsigned char *buffer      = malloc(buffer_size);
+  np_tree2buffer(context, have_tree, buffer);
+
+  np_subject have_subject_id = {0};
+  np_generate_subject(&have_subject_id,
+                      NP_FILE_HAVE_SUBJECT,
+                      strnlen(NP_FILE_HAVE_SUBJECT, 12));
+  np_send(context, have_subject_id, buffer, buffer_size);
+
+  free(buffer);
+  np_tree_free(have_tree);
+
+  log_msg(LOG_INFO,
+          "received manifest of file %s -> %s (%" PRIu32 " of %" PRIu32
+          " chunks missing)",
+          (NULL != _name && np_treeval_type_char_ptr == _name->val.type)
+              ? _name->val.value.s
+              : "",
+          id_str,
+          receive->missing,
+          chunks);
+
+  if (receive->missing == 0) {
+    np_files_materialize(context, id_str, id_str);
+    free(receive->received);
+    free(receive);
+    return true;
+  }
+
+  np_spinlock_lock(&__files._receive_lock);
+  np_tree_elem_t *old = np_tree_find_str(__files._receive_tree,
+                                         id_str);
+  if (NULL != old) {
+    struct np_file_receive *old_receive = old->val.value.v;
+    free(old_receive->received);
+    free(old_receive);
+    np_tree_del_str(__files._receive_tree, id_str);
+  }
+  np_tree_insert_str(__files._receive_tree,
+                     id_str,
+                     np_treeval_new_v(receive));
+  np_spinlock_unlock(&__files._receive_lock);
+
+  return true;
+}
+
+// stores a single chunk of a streamed file in the content addressed chunk
+// store. Chunks may arrive in any order, the file is assembled from the
+// manifest once all chunks are present.
+bool __store_segment(np_context *context, np_tree_t *file_info) {
+  np_tree_elem_t *_np_id   = np_tree_find_str(file_info, "np_id");
+  np_tree_elem_t *_content = np_tree_find_str(file_info, "content");
+  np_tree_elem_t *_segment = np_tree_find_str(file_info, "segment");
+
+  np_id file_id;
+  char  id_str[65];
+  if (!__file_id_parse(_np_id, &file_id, id_str) || NULL == _content ||
+      np_treeval_type_bin != _content->val.type || NULL == _segment ||
+      np_treeval_type_unsigned_long != _segment->val.type) {
+    log_msg(LOG_WARNING, "received incomplete file segment, dropping it");
+    return false;
+  }
+
+  // only the chunk listed in the manifest is accepted for an index, any other
+  // chunk would complete the file with the wrong content
+  uint32_t      i = _segment->val.value.ul;
+  unsigned char entry[NP_FILE_MANIFEST_ENTRY];
+  if (!__manifest_entry(id_str, i, entry)) {
+    log_msg(LOG_WARNING,
+            "received segment %" PRIu32 " of unknown file %s, dropping it",
+            i,
+            id_str);
+    return false;
+  }
+
+  unsigned char segment_hash[crypto_generichash_BYTES];
+  crypto_generichash(segment_hash,
+                     crypto_generichash_BYTES,
+                     _content->val.value.bin,
+                     _content->val.size,
+                     NULL,
+                     0);
+  if (_content->val.size != __get_u32(entry + 8) ||
+      0 != memcmp(segment_hash, entry + 12, crypto_generichash_BYTES)) {
+    log_msg(LOG_WARNING,
+            "hash mismatch for segment %" PRIu32 " of file %s",
+            i,
+            id_str);
+    return false;
+  }
+
+  char path[PATH_MAX];
+  __chunk_path(&path, segment_hash);
+  if (0 != access(path, F_OK)) {
+    // write to a temporary file first, a chunk in the store is always complete
+    char tmp_path[PATH_MAX];
+    snprintf(tmp_path, PATH_MAX, "%s.%" PRIu32 ".tmp", path, i);
+
+    mkdir(NP_FILE_CHUNK_DIR, S_IRWXU);
+    int fd = open(tmp_path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    if (fd == -1) {
+      fprintf(stdout, "error: %s for filename %s", strerror(errno), tmp_path);
+      return false;
+    }
+    ssize_t bytes_written =
+        write(fd, _content->val.value.bin, _content->val.size);
+    close(fd);
+
+    if (bytes_written != (ssize_t)_content->val.size ||
+        0 != rename(tmp_path, path)) {
+      log_msg(LOG_WARNING,
+              "unable to store segment %" PRIu32 " of file %s (%s)",
+              i,
+              id_str,
+              strerror(errno));
+      unlink(tmp_path);
+      return false;
+    }
+  }
+
+  bool complete = false;
+  np_spinlock_lock(&__files._receive_lock);
+  np_tree_elem_t *elem = np_tree_find_str(__files._receive_tree, id_str);
+  if (NULL != elem) {
+    struct np_file_receive *receive = elem->val.value.v;
+    if (i < receive->chunks &&
+        0 == (receive->received[i / 8] & (1 << (i % 8)))) {
+      receive->received[i / 8] |= (1 << (i % 8));
+      receive->missing--;
+    }
+    if (receive->missing == 0) {
+      complete = true;
+      free(receive->received);
+      free(receive);
+      np_tree_del_str(__files._receive_tree, id_str);
+    }
+  }
+  np_spinlock_unlock(&__files._receive_lock);
+
+  if (complete) {
+    if (np_files_materialize(context, id_str, id_str)) {
+      log_msg(LOG_INFO, "received file %s", id_str);
+    } else {
+      log_msg(LOG_WARNING, "unable to assemble file %s", id_str);
+    }
+  }
+  return true;
+}
+
 // a callback function that can be passed to the neuropil library
 bool np_files_store_cb(np_context *context, struct np_message *msg) {
   np_tree_t *file_info = np_tree_create();
   np_buffer2tree(context, msg->data, msg->data_length, file_info);
 
-  // char id_str[65];
+  if (NULL != np_tree_find_str(file_info, "manifest") ||
+      NULL != np_tree_find_str(file_info, "segment")) {
+    pthread_once(&__files_receive_once, __files_receive_init);
+
+    if (NULL != np_tree_find_str(file_info, "manifest"))
+      __store_manifest(context, file_info);
+    else
+      __store_segment(context, file_info);
+
+    np_tree_free(file_info);
+    return true;
+  }
+
+  np_id           file_id;
+  char            id_str[65];
   np_tree_elem_t *_np_id   = np_tree_find_str(file_info, "np_id");
   np_tree_elem_t *_content = np_tree_find_str(file_info, "content");
   np_tree_elem_t *_name    = np_tree_find_str(file_info, "name");
 
+  if (!__file_id_parse(_np_id, &file_id, id_str) || NULL == _content ||
+      np_treeval_type_bin != _content->val.type) {
+    log_msg(LOG_WARNING, "received incomplete file, dropping it");
+    np_tree_free(file_info);
+    return true;
+  }
+
   // open the hash filename
-  int fd = open(_np_id->val.value.s,
-                O_CREAT | O_WRONLY | O_TRUNC,
-                S_IRUSR | S_IWUSR);
+  int fd = open(id_str, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
   if (fd == -1) {
-    fprintf(stdout,
-            "error: %s for filename %s",
-            strerror(errno),
-            _np_id->val.value.s);
+    fprintf(stdout, "error: %s for filename %s", strerror(errno), id_str);
+    np_tree_free(file_info);
     return true;
   }
   // and write the file contents
   uint32_t bytes_written =
       write(fd, _content->val.value.bin, _content->val.size);
+  close(fd);
 
   // TODO: hardlink the real filename to the hashed one
   // link(_np_id->val.value.s, _name->val.value.s);
@@ -949,8 +1790,11 @@ bool np_files_store_cb(np_context *context, struct np_message *msg) {
 
   log_msg(LOG_INFO,
           "received file %s -> %s",
-          _name->val.value.s,
-          _np_id->val.value.s);
+          (NULL != _name && np_treeval_type_char_ptr == _name->val.type)
+              ? _name->val.value.s
+              : "",
+          id_str);
 
+  np_tree_free(file_info);
   return true;
 }
@@ -24,10 +24,29 @@ extern "C" {
  * receive a file has to "apply" for sharing and explicitly subscribe to each
  * hash (aka file).
  *
- * TODO: chunk files before sending and enable partial re-delivery of chunks
- * TODO: file receiver storing the file in disk
+ * Files larger than a single segment are streamed: the sender splits the file
+ * into content defined chunks (gear rolling hash, at least NP_FILE_CHUNK_MIN
+ * and at most NP_FILE_SEGMENT_SIZE bytes) and first sends a manifest listing
+ * offset, length and blake2b hash of each chunk. The receiver stores chunks
+ * by their hash in a local chunk store and answers on the "files/have"
+ * subject with a bitmap of the chunks it already holds. The sender then only
+ * streams the missing chunks. The stream is paced, not acknowledged: each
+ * transfer hands at most NP_FILE_SEGMENTS_PER_INTERVAL segments per interval
+ * to the neuropil library. Once all chunks are present the receiver assembles
+ * the file from its manifest. Memory usage is therefore bound by the segment
+ * size and not by the file size, repeated or slightly modified files only
+ * transfer and store the changed chunks.
+ *
+ * TODO: enable partial re-delivery of missing / corrupted segments
  */
-enum np_file_enum { DATABLOCK_SIZE = 10240 };
+enum np_file_enum {
+  DATABLOCK_SIZE                = 10240,
+  NP_FILE_SEGMENT_SIZE          = 8192,
+  NP_FILE_SEGMENTS_PER_INTERVAL = 8,
+  NP_FILE_SEGMENT_HEADER        = 1024, // serialization overhead of a segment
+  NP_FILE_CHUNK_MIN             = 1024,
+  NP_FILE_CHUNK_MASK            = 0x0FFF, // average chunk size of 4k
+};
 
 struct np_filestorage {
   struct np_token *identity;
@@ -62,6 +81,17 @@ void np_files_open(np_context *context,
 // a callback function that can be passed to the neuropil library
 bool np_files_store_cb(np_context *context, struct np_message *msg);
 
+// (re-)assembles the file identified by np_id (hex string) from its manifest
+// and the local chunk store into the file target. Returns false if np_id is
+// not the 64 digit hex form of a np_id.
+bool np_files_materialize(np_context *ac,
+                          const char *np_id,
+                          const char *target);
+
+// enable or disable the segmented streaming transfer mode (default: enabled).
+// When disabled each file is send as one single message.
+void np_files_set_streaming(np_context *ac, bool enable);
+
 // close files and stop sharing files previsoulsy shared using np_files_open
 void np_files_close(np_context *ac, const char *alias);
 
@@ -9,8 +9,10 @@
 #include <fcntl.h>
 #include <math.h>
 #include <pthread.h>
+#include <stdarg.h>
 #include <stdio.h>
 #include <stdlib.h>
+#include <string.h>
 #include <unistd.h>
 
 #include "../framework/http/htparse.c"
@@ -18,6 +20,7 @@
 #include "inttypes.h"
 #include "parson/parson.h"
 #include "sys/socket.h"
+#include "sys/uio.h"
 
 #include "neuropil.h"
 #include "neuropil_log.h"
@@ -55,6 +58,15 @@ static char *HTML_NOT_IMPLEMENTED =
   (strncmp("/" prefix, client->ht_request.ht_path, strlen(prefix)) == 0)
 #define HTTP_CRLF "\r\n"
 
+// each pending response contributes its header and its body
+#define NP_HTTP_IOV_MAX 32
+
+#ifdef MSG_NOSIGNAL
+#define NP_HTTP_SEND_FLAGS MSG_NOSIGNAL
+#else
+#define NP_HTTP_SEND_FLAGS 0
+#endif
+
 typedef enum np_http_status_e {
   UNUSED = 0,
   ACCEPTED,
@@ -65,10 +77,33 @@ typedef enum np_http_status_e {
   SHUTDOWN
 } np_http_status_e;
 
+// growable buffer, the memory is kept when the buffer is reset
+struct np_http_buffer_s {
+  char  *data;
+  size_t size;
+  size_t len;
+};
+
+// a response waiting to be written to the client. The header is located in
+// the header buffer of the client, the body is freed (or released) after it
+// has been sent if cleanup_body is set.
+struct np_http_pending_s {
+  size_t                  header_offset;
+  size_t                  header_len;
+  char                   *body;
+  size_t                  body_len;
+  size_t                  written; // bytes of header and body already sent
+  bool                    cleanup_body;
+  _np_http_release_func_t release_body;
+  void                   *release_arg;
+  bool close; // close the connection after the response has been sent
+};
+
 struct np_http_client_s {
-  int          client_fd;
-  struct ev_io client_watcher_in;
-  struct ev_io client_watcher_out;
+  int             client_fd;
+  struct ev_io    client_watcher_in;
+  struct ev_io    client_watcher_out;
+  struct ev_timer client_timeout;
 
   // http parser and callbacks
   htparser *parser;
@@ -76,6 +111,14 @@ struct np_http_client_s {
   ht_request_t ht_request;
   // http response structure
   ht_response_t ht_response;
+  // keep alive flag of the request in PROCESSING state
+  bool keep_alive;
+  // responses of pipelined requests, written in the order of the requests
+  struct np_http_buffer_s   header_buffer;
+  struct np_http_pending_s *pending;
+  uint32_t                  pending_size;
+  uint32_t                  pending_head;
+  uint32_t                  pending_count;
   // global status and last update time
   np_http_status_e status;
   np_state_t      *context;
@@ -91,6 +134,22 @@ NP_SLL_GENERATE_IMPLEMENTATION_COMPARATOR(np_http_client_ptr);
 NP_SLL_GENERATE_IMPLEMENTATION(np_http_client_ptr);
 #pragma clang diagnostic pop
 
+typedef struct _np_http_callback_s {
+  _np_http_callback_func_t callback;
+  void                    *user_arg;
+} _np_http_callback_t;
+
+// a node of the route trie, there is one node per path segment. Nodes are
+// only added (lock free) and never removed before the module is destroyed,
+// a lookup runs concurrently to new registrations without locking.
+struct np_http_route_s {
+  char                   *segment;
+  size_t                  segment_len;
+  _np_http_callback_t    *callbacks[htp_method_UNKNOWN];
+  struct np_http_route_s *children;
+  struct np_http_route_s *next;
+};
+
 np_module_struct(http) {
   np_context *context;
   // network io handling
@@ -98,8 +157,8 @@ np_module_struct(http) {
 
   np_sll_t(np_http_client_ptr, clients);
 
-  htparse_hooks *hooks;
-  np_tree_t     *user_hooks;
+  htparse_hooks          *hooks;
+  struct np_http_route_s *routes;
 };
 
 typedef struct http_return_t {
@@ -132,10 +191,148 @@ http_return_t http_return_codes[] = {
     {  "HTTP_CODE_SERVICE_UNAVAILABLE", 503}
 };
 
-typedef struct _np_http_callback_s {
-  _np_http_callback_func_t callback;
-  void                    *user_arg;
-} _np_http_callback_t;
+static void __np_http_buffer_reserve(struct np_http_buffer_s *buffer,
+                                     size_t                   len) {
+  if (buffer->len + len < buffer->size) return;
+
+  size_t size = (buffer->size > 0) ? buffer->size : 1024;
+  while (size <= buffer->len + len)
+    size <<= 1;
+
+  buffer->data = realloc(buffer->data, size);
+  CHECK_MALLOC(buffer->data);
+  buffer->size = size;
+}
+
+static void __np_http_buffer_append(struct np_http_buffer_s *buffer,
+                                    const char              *data,
+                                    size_t                   len) {
+  __np_http_buffer_reserve(buffer, len);
+  memcpy(buffer->data + buffer->len, data, len);
+  buffer->len += len;
+  buffer->data[buffer->len] = '\0';
+}
+
+static void __np_http_buffer_printf(struct np_http_buffer_s *buffer,
+                                    const char              *format,
+                                    ...) {
+  va_list args;
+  va_start(args, format);
+  int len = vsnprintf(NULL, 0, format, args);
+  va_end(args);
+  if (len < 0) return;
+
+  __np_http_buffer_reserve(buffer, len);
+  va_start(args, format);
+  vsnprintf(buffer->data + buffer->len, len + 1, format, args);
+  va_end(args);
+  buffer->len += len;
+}
+
+// returns the next segment of the path and its length, NULL at the end of the
+// path. Slashes and empty segments are skipped.
+static const char *__np_http_path_segment(const char **path, size_t *len) {
+  const char *segment = *path;
+  while ('/' == *segment)
+    segment++;
+  if ('\0' == *segment) return NULL;
+
+  *len  = strcspn(segment, "/");
+  *path = segment + *len;
+  return segment;
+}
+
+static struct np_http_route_s *__np_http_route_child(
+    struct np_http_route_s *parent, const char *segment, size_t len,
+    bool create) {
+  struct np_http_route_s *head =
+      __atomic_load_n(&parent->children, __ATOMIC_ACQUIRE);
+  for (struct np_http_route_s *iter = head; iter != NULL; iter = iter->next) {
+    if (iter->segment_len == len && 0 == memcmp(iter->segment, segment, len))
+      return iter;
+  }
+  if (!create) return NULL;
+
+  struct np_http_route_s *route = calloc(1, sizeof(struct np_http_route_s));
+  CHECK_MALLOC(route);
+  route->segment     = strndup(segment, len);
+  route->segment_len = len;
+  route->next        = head;
+
+  // another registration may have added nodes in the meantime, one of them
+  // could be the same segment
+  while (!__atomic_compare_exchange_n(&parent->children,
+                                      &route->next,
+                                      route,
+                                      false,
+                                      __ATOMIC_RELEASE,
+                                      __ATOMIC_ACQUIRE)) {
+    for (struct np_http_route_s *iter = route->next; iter != head;
+         iter                         = iter->next) {
+      if (iter->segment_len == len &&
+          0 == memcmp(iter->segment, segment, len)) {
+        free(route->segment);
+        free(route);
+        return iter;
+      }
+    }
+    head = route->next;
+  }
+  return route;
+}
+
+static struct np_http_route_s *__np_http_route_find(
+    struct np_http_route_s *route, const char *path, bool create) {
+  const char *segment = NULL;
+  size_t      len     = 0;
+  if (path == NULL) return route;
+
+  while (route != NULL &&
+         NULL != (segment = __np_http_path_segment(&path, &len))) {
+    route = __np_http_route_child(route, segment, len, create);
+  }
+  return route;
+}
+
+static void __np_http_route_list(struct np_http_route_s  *route,
+                                 struct np_http_buffer_s *path,
+                                 struct np_http_buffer_s *out,
+                                 bool                    *first) {
+  for (uint8_t method = 0; method < htp_method_UNKNOWN; method++) {
+    if (NULL == __atomic_load_n(&route->callbacks[method], __ATOMIC_ACQUIRE))
+      continue;
+    __np_http_buffer_printf(out,
+                            "%s\"%s %s\"",
+                            *first ? "" : ",",
+                            htparser_get_methodstr_m(method),
+                            path->len > 0 ? path->data : "/");
+    *first = false;
+  }
+
+  size_t path_len = path->len;
+  for (struct np_http_route_s *iter =
+           __atomic_load_n(&route->children, __ATOMIC_ACQUIRE);
+       iter != NULL;
+       iter = iter->next) {
+    __np_http_buffer_append(path, "/", 1);
+    __np_http_buffer_append(path, iter->segment, iter->segment_len);
+    __np_http_route_list(iter, path, out, first);
+    path->len             = path_len;
+    path->data[path->len] = '\0';
+  }
+}
+
+static void __np_http_route_free(struct np_http_route_s *route) {
+  while (route != NULL) {
+    struct np_http_route_s *next = route->next;
+    __np_http_route_free(route->children);
+    for (uint8_t method = 0; method < htp_method_UNKNOWN; method++)
+      free(route->callbacks[method]);
+    free(route->segment);
+    free(route);
+    route = next;
+  }
+}
 
 int _np_http_on_msg_begin(htparser *parser) {
   log_trace_msg(
@@ -145,9 +342,16 @@ int _np_http_on_msg_begin(htparser *parser) {
   np_http_client_t *client = (np_http_client_t *)parser->userdata;
   client->status           = REQUEST;
 
+  // a pipelined request must not see the body or arguments of its predecessor
+  if (NULL != client->ht_request.ht_body) {
+    free(client->ht_request.ht_body);
+    client->ht_request.ht_body = NULL;
+  }
+  if (NULL != client->ht_request.ht_query_args)
+    np_tree_clear(client->ht_request.ht_query_args);
+
   return 0;
 }
-
 int _np_http_query_args(htparser *parser, const char *data, size_t in_len) {
   log_trace_msg(LOG_TRACE | LOG_HTTP,
                 "start: int _np_http_query_args(NP_UNUSED htparser * parser, "
@@ -256,6 +460,7 @@ int _np_http_on_msg_complete(htparser *parser) {
   np_http_client_t *client     = (np_http_client_t *)parser->userdata;
   client->ht_request.ht_method = htparser_get_method(parser);
   client->ht_request.ht_length = htparser_get_content_length(parser);
+  client->keep_alive           = htparser_should_keep_alive(parser);
 
   client->status = PROCESSING;
 
@@ -267,200 +472,334 @@ void _np_http_dispatch(np_state_t *context, np_http_client_t *client) {
 
   assert(PROCESSING == client->status);
 
-  char key[128];
-  snprintf(key,
-           128,
-           "%d:%s",
-           client->ht_request.ht_method,
-           client->ht_request.ht_path + 1);
-
-  log_msg(LOG_DEBUG, "lookup   of http callback for key %s", key);
-
-  client->ht_response.ht_header = np_tree_create();
-  np_tree_insert_str(client->ht_response.ht_header,
-                     "Access-Control-Allow-Origin",
-                     np_treeval_new_s("*"));
-  np_tree_insert_str(client->ht_response.ht_header,
-                     "Access-Control-Allow-Methods",
-                     np_treeval_new_s("GET"));
-
-  np_tree_elem_t *user_callback =
-      np_tree_find_str(np_module(http)->user_hooks, key);
-  if (NULL != user_callback) {
+  const char *path   = client->ht_request.ht_path;
+  htp_method  method = client->ht_request.ht_method;
+  log_debug_msg(LOG_HTTP | LOG_DEBUG,
+                "lookup   of http callback for %s %s",
+                htparser_get_methodstr_m(method),
+                path);
+
+  _np_http_callback_t    *callback_data = NULL;
+  struct np_http_route_s *route =
+      __np_http_route_find(np_module(http)->routes, path, false);
+  if (NULL != route && method < htp_method_UNKNOWN)
+    callback_data =
+        __atomic_load_n(&route->callbacks[method], __ATOMIC_ACQUIRE);
+
+  if (NULL != callback_data) {
     client->ht_response.cleanup_body = true;
-
-    _np_http_callback_t *callback_data =
-        (_np_http_callback_t *)user_callback->val.value.v;
     client->ht_response.ht_status =
         callback_data->callback(&client->ht_request,
                                 &client->ht_response,
                                 callback_data->user_arg);
-
-    client->status = RESPONSE;
   } else {
-    switch (client->ht_request.ht_method) {
+    switch (method) {
     case (htp_method_GET): {
-      uint32_t        buf_max = 8000;
-      char            buffer[buf_max];
-      uint32_t        len       = snprintf(buffer,
-                              buf_max,
+      struct np_http_buffer_s body = {0}, route_path = {0};
+      bool                    first = true;
+      __np_http_buffer_printf(&body,
                               "{ \"status\":\"not_found\", \"requestd_path\": "
-                                           "\"%s\", \"available_paths\": [",
-                              key);
-      np_tree_elem_t *iter_tree = NULL;
-      RB_FOREACH (iter_tree, np_tree_s, np_module(http)->user_hooks) {
-        len += snprintf(buffer + len,
-                        buf_max - len,
-                        "\"%s\",",
-                        iter_tree->key.value.s);
-      }
+                              "\"%s\", \"available_paths\": [",
+                              path != NULL ? path : "");
+      __np_http_route_list(np_module(http)->routes, &route_path, &body, &first);
+      __np_http_buffer_append(&body, "]}", 2);
+      free(route_path.data);
 
-      len += snprintf(buffer + len, buf_max - len, "]}");
-
-      client->ht_response.ht_body   = strndup(buffer, buf_max);
+      client->ht_response.ht_body   = body.data;
       client->ht_response.ht_status = HTTP_CODE_NOT_FOUND;
       np_tree_insert_str(client->ht_response.ht_header,
                          "X-Content-Type-Options",
                          np_treeval_new_s("nosniff"));
-      np_tree_insert_str(client->ht_response.ht_header,
-                         "Content-Type",
-                         np_treeval_new_s("application/json"));
-
       client->ht_response.cleanup_body = true;
-      client->status                   = RESPONSE;
       break;
     }
     default: {
-      client->ht_response.ht_body      = strdup(HTML_NOT_IMPLEMENTED);
-      client->ht_response.ht_header    = np_tree_create();
+      client->ht_response.ht_body      = HTML_NOT_IMPLEMENTED;
       client->ht_response.ht_status    = HTTP_CODE_NOT_IMPLEMENTED;
       client->ht_response.cleanup_body = false;
-      client->status                   = RESPONSE;
+      np_tree_insert_str(client->ht_response.ht_header,
+                         "Content-Type",
+                         np_treeval_new_s("text/html"));
     }
     }
   }
+  client->status = RESPONSE;
 }
 
-void _np_http_write_callback(struct ev_loop  *loop,
-                             NP_UNUSED ev_io *ev,
-                             int              event_type) {
-  np_state_t       *context = ev_userdata(loop);
-  np_http_client_t *client  = (np_http_client_t *)ev->data;
+static void __np_http_release_body(char                   *body,
+                                   bool                    cleanup_body,
+                                   _np_http_release_func_t release_body,
+                                   void                   *release_arg) {
+  if (!cleanup_body) return;
+  if (release_body != NULL) release_body(body, release_arg);
+  else free(body);
+}
 
-  if ((FLAG_CMP(event_type, EV_WRITE) && !FLAG_CMP(event_type, EV_ERROR)) &&
-      RESPONSE == client->status) {
-    log_debug_msg(LOG_HTTP | LOG_DEBUG, "start writing response");
-    // create http reply
-    char data[2048];
-
-    char *ht_body = client->ht_response.ht_body;
-    // HTTP start
-    int pos =
-        snprintf(data,
-                 2048,
-                 "%s %d %s" HTTP_CRLF,
-                 "HTTP/1.1",
-                 http_return_codes[client->ht_response.ht_status].http_code,
-                 http_return_codes[client->ht_response.ht_status].text);
-    // add content length header
-    uint32_t s_contentlength = strlen(ht_body);
-    char     body_length[255];
-    snprintf(body_length, 254, "%" PRIu32, s_contentlength);
-    np_tree_insert_str(client->ht_response.ht_header,
-                       "Content-Length",
-                       np_treeval_new_s(body_length));
-    np_tree_insert_str(client->ht_response.ht_header,
-                       "Content-Type",
-                       np_treeval_new_s("application/json"));
-    // add keep alive header
-    np_tree_insert_str(
-        client->ht_response.ht_header,
-        "Connection",
-        np_treeval_new_s(htparser_should_keep_alive(client->parser)
-                             ? "Keep-Alive"
-                             : "close"));
-
-    // HTTP header
-    np_tree_elem_t *iter = RB_MIN(np_tree_s, client->ht_response.ht_header);
-    while (NULL != iter) {
-      pos += snprintf(data + pos,
-                      snprintf(NULL,
-                               0,
-                               "%s: %s" HTTP_CRLF,
-                               np_treeval_to_str(iter->key, NULL),
-                               np_treeval_to_str(iter->val, NULL)) +
-                          1,
-                      "%s: %s" HTTP_CRLF,
-                      np_treeval_to_str(iter->key, NULL),
-                      np_treeval_to_str(iter->val, NULL));
-      iter = RB_NEXT(np_tree_s, np_module(http)->ht_response.ht_header, iter);
+// builds the header of the current response into the header buffer of the
+// client and appends the response to the pending responses
+static void __np_http_queue_response(np_http_client_t *client) {
+  ht_response_t           *response = &client->ht_response;
+  struct np_http_buffer_s *buffer   = &client->header_buffer;
+
+  if (client->pending_head + client->pending_count == client->pending_size) {
+    if (client->pending_head > 0) {
+      memmove(client->pending,
+              client->pending + client->pending_head,
+              client->pending_count * sizeof(struct np_http_pending_s));
+      client->pending_head = 0;
+    } else {
+      client->pending_size = (client->pending_size > 0)
+                                 ? 2 * client->pending_size
+                                 : NP_HTTP_MAX_PENDING_RESPONSES;
+      client->pending      = realloc(client->pending,
+                                client->pending_size *
+                                    sizeof(struct np_http_pending_s));
+      CHECK_MALLOC(client->pending);
     }
-    pos +=
-        snprintf(data + pos, snprintf(NULL, 0, "" HTTP_CRLF) + 1, "" HTTP_CRLF);
-    // send header
-#ifdef MSG_NOSIGNAL
-    send(client->client_fd, data, pos, MSG_NOSIGNAL);
-#else
-    send(client->client_fd, data, pos, 0);
-#endif
-    np_tree_free(client->ht_response.ht_header);
-
-    log_debug_msg(LOG_HTTP | LOG_DEBUG, "send http header success");
+  }
 
-    // HTTP body
-    // memset(data, 0, 2048);
+  int status = response->ht_status;
+  if (status < 0 || status >= ARRAY_SIZE(http_return_codes))
+    status = HTTP_CODE_INTERNAL_SERVER_ERROR;
+
+  struct np_http_pending_s *pending =
+      &client->pending[client->pending_head + client->pending_count];
+  pending->header_offset = buffer->len;
+  pending->body          = response->ht_body;
+  pending->body_len =
+      (response->ht_body != NULL) ? strlen(response->ht_body) : 0;
+  pending->written      = 0;
+  pending->cleanup_body = response->cleanup_body && response->ht_body != NULL;
+  pending->release_body = response->release_body;
+  pending->release_arg  = response->release_arg;
+  pending->close        = !client->keep_alive;
+
+  __np_http_buffer_printf(buffer,
+                          "HTTP/1.1 %d %s" HTTP_CRLF
+                          "Access-Control-Allow-Origin: *" HTTP_CRLF
+                          "Access-Control-Allow-Methods: GET" HTTP_CRLF
+                          "Content-Length: %" PRIsizet HTTP_CRLF
+                          "Connection: %s" HTTP_CRLF,
+                          http_return_codes[status].http_code,
+                          http_return_codes[status].text,
+                          pending->body_len,
+                          pending->close ? "close" : "Keep-Alive");
+  if (NULL == np_tree_find_str(response->ht_header, "Content-Type")) {
+    const char content_type[] = "Content-Type: application/json" HTTP_CRLF;
+    __np_http_buffer_append(buffer, content_type, sizeof(content_type) - 1);
+  }
+  np_tree_elem_t *iter = NULL;
+  RB_FOREACH (iter, np_tree_s, response->ht_header) {
+    bool  free_value = false;
+    char *value      = np_treeval_to_str(iter->val, &free_value);
+    __np_http_buffer_printf(buffer,
+                            "%s: %s" HTTP_CRLF,
+                            iter->key.value.s,
+                            value);
+    if (free_value) free(value);
+  }
+  __np_http_buffer_append(buffer, HTTP_CRLF, 2);
+  pending->header_len = buffer->len - pending->header_offset;
+  client->pending_count++;
+
+  np_tree_clear(response->ht_header);
+  response->ht_body      = NULL;
+  response->cleanup_body = false;
+  response->release_body = NULL;
+  response->release_arg  = NULL;
+  response->ht_status    = HTTP_NO_RESPONSE;
+
+  // requests following a "Connection: close" are not answered anymore
+  client->status = pending->close ? SHUTDOWN : CONNECTED;
+}
 
-    uint32_t bytes_send = 0;
-    double   t1         = np_time_now();
-    int      retry      = 0;
-    while (bytes_send < s_contentlength) {
-      if ((np_time_now() - t1) >= 30) {
-        log_debug_msg(LOG_HTTP | LOG_DEBUG, "http timeout");
-        break;
-      } else if (retry > 3) {
-        log_debug_msg(LOG_HTTP | LOG_DEBUG, "http too many errors");
-        break;
+// writes as much of the pending responses as the socket accepts with a single
+// gathering write per round. Returns false if the connection has to be
+// closed, either because of an error or because a response asked for it.
+static bool __np_http_flush(np_state_t *context, np_http_client_t *client) {
+  while (client->pending_count > 0) {
+    struct iovec iov[NP_HTTP_IOV_MAX];
+    int          iov_count = 0;
+    for (uint32_t i = 0;
+         i < client->pending_count && iov_count + 2 <= NP_HTTP_IOV_MAX;
+         i++) {
+      struct np_http_pending_s *pending =
+          &client->pending[client->pending_head + i];
+      size_t written = pending->written;
+      if (written < pending->header_len) {
+        iov[iov_count].iov_base =
+            client->header_buffer.data + pending->header_offset + written;
+        iov[iov_count].iov_len = pending->header_len - written;
+        iov_count++;
+        written = 0;
+      } else {
+        written -= pending->header_len;
+      }
+      if (written < pending->body_len) {
+        iov[iov_count].iov_base = pending->body + written;
+        iov[iov_count].iov_len  = pending->body_len - written;
+        iov_count++;
       }
+      if (pending->close) break;
+    }
 
-#ifdef MSG_NOSIGNAL
-      int send_return = send(client->client_fd,
-                             ht_body + bytes_send,
-                             fmin(2048, s_contentlength - bytes_send),
-                             MSG_NOSIGNAL);
-#else
-      int send_return = send(client->client_fd,
-                             ht_body + bytes_send,
-                             fmin(2048, s_contentlength - bytes_send),
-                             0);
-#endif
+    struct msghdr msg = {.msg_iov = iov, .msg_iovlen = iov_count};
+    ssize_t sent = sendmsg(client->client_fd, &msg, NP_HTTP_SEND_FLAGS);
+    if (sent < 0) {
+      // we need to wait for the output buffer to be free
+      if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno)
+        return true;
+      log_msg(LOG_HTTP | LOG_WARNING,
+              "Sending http data error. %s",
+              strerror(errno));
+      return false;
+    }
 
-      if (send_return >= 0) {
-        bytes_send += send_return;
-        log_debug_msg(LOG_HTTP | LOG_DEBUG, "send http body part success");
-      } else {
-        // we may need to wait for the output buffer to be free
-        if (EAGAIN != errno) {
-          log_msg(LOG_HTTP | LOG_WARNING,
-                  "Sending http data error. %s",
-                  strerror(errno));
-          retry++;
-        }
+    size_t left = sent;
+    while (client->pending_count > 0) {
+      struct np_http_pending_s *pending =
+          &client->pending[client->pending_head];
+      size_t remaining =
+          pending->header_len + pending->body_len - pending->written;
+      if (left < remaining) {
+        pending->written += left;
+        break;
       }
+      left -= remaining;
+
+      bool close = pending->close;
+      __np_http_release_body(pending->body,
+                             pending->cleanup_body,
+                             pending->release_body,
+                             pending->release_arg);
+      client->pending_head++;
+      client->pending_count--;
+      log_debug_msg(LOG_HTTP | LOG_DEBUG, "send http response success");
+      if (close) return false;
     }
+  }
+  client->pending_head      = 0;
+  client->header_buffer.len = 0;
+  return true;
+}
 
-    if (bytes_send == s_contentlength) {
-      log_debug_msg(LOG_HTTP | LOG_DEBUG, "send http body success");
-    } else {
+static void __np_http_client_free(EV_P_ np_http_client_t *client) {
+  ev_io_stop(EV_A_ & client->client_watcher_in);
+  ev_io_stop(EV_A_ & client->client_watcher_out);
+  ev_timer_stop(EV_A_ & client->client_timeout);
+  close(client->client_fd);
+
+  for (uint32_t i = 0; i < client->pending_count; i++) {
+    struct np_http_pending_s *pending =
+        &client->pending[client->pending_head + i];
+    __np_http_release_body(pending->body,
+                           pending->cleanup_body,
+                           pending->release_body,
+                           pending->release_arg);
+  }
+  free(client->pending);
+  free(client->header_buffer.data);
+
+  __np_http_release_body(client->ht_response.ht_body,
+                         client->ht_response.cleanup_body &&
+                             client->ht_response.ht_body != NULL,
+                         client->ht_response.release_body,
+                         client->ht_response.release_arg);
+  if (client->ht_response.ht_header)
+    np_tree_free(client->ht_response.ht_header);
+
+  if (client->ht_request.ht_body) free(client->ht_request.ht_body);
+  if (client->ht_request.ht_path) free(client->ht_request.ht_path);
+  if (client->ht_request.current_key) free(client->ht_request.current_key);
+  if (client->ht_request.ht_header) np_tree_free(client->ht_request.ht_header);
+  if (client->ht_request.ht_query_args)
+    np_tree_free(client->ht_request.ht_query_args);
+
+  free(client->parser);
+  free(client);
+}
+
+static void __np_http_client_close(EV_P_ np_http_client_t *client) {
+  np_state_t *context = ev_userdata(EV_A);
+  log_debug_msg(LOG_HTTP | LOG_DEBUG,
+                "closing http connection (client fd: %" PRIi32 ")",
+                client->client_fd);
+  sll_remove(np_http_client_ptr,
+             np_module(http)->clients,
+             client,
+             np_http_client_ptr_sll_compare_type);
+  __np_http_client_free(EV_A_ client);
+}
+
+static void _np_http_timeout_callback(struct ev_loop *loop,
+                                      ev_timer       *ev,
+                                      NP_UNUSED int   event_type) {
+  np_http_client_t *client = (np_http_client_t *)ev->data;
+  __np_http_client_close(EV_A_ client);
+}
+
+// the write watcher is only active while responses are pending, the read
+// watcher is paused while too many responses of a client are pending. The
+// timeout is restarted on progress only (a complete request or a written
+// response), a client that sends or reads a few bytes at a time still expires
+static void __np_http_client_update_watchers(EV_P_ np_http_client_t *client,
+                                             bool progress) {
+  if (progress) ev_timer_again(EV_A_ & client->client_timeout);
+
+  if (client->pending_count > 0)
+    ev_io_start(EV_A_ & client->client_watcher_out);
+  else ev_io_stop(EV_A_ & client->client_watcher_out);
+
+  if (SHUTDOWN != client->status &&
+      client->pending_count < NP_HTTP_MAX_PENDING_RESPONSES)
+    ev_io_start(EV_A_ & client->client_watcher_in);
+  else ev_io_stop(EV_A_ & client->client_watcher_in);
+}
+
+// parses all requests contained in data, pipelined requests are answered in
+// order. Returns true if at least one response has been queued.
+static bool __np_http_parse(np_state_t       *context,
+                            np_http_client_t *client,
+                            const char       *data,
+                            size_t            len) {
+  bool   queued = false;
+  size_t parsed = 0;
+  while (parsed < len && SHUTDOWN != client->status) {
+    // the parser returns after each complete request
+    parsed += htparser_run(client->parser,
+                           np_module(http)->hooks,
+                           data + parsed,
+                           len - parsed);
+    if (htparser_get_error(client->parser) != htparse_error_none) {
       log_msg(LOG_HTTP | LOG_WARNING,
-              "send http body NO success (%" PRIu32 "/%" PRIu32 ")",
-              bytes_send,
-              s_contentlength);
+              "error parsing http request: %s",
+              htparser_get_strerror(client->parser));
+      client->ht_response.ht_status = HTTP_CODE_BAD_REQUEST;
+      client->keep_alive            = false;
+      __np_http_queue_response(client);
+      queued = true;
+    } else if (PROCESSING == client->status) {
+      _np_http_dispatch(context, client);
+      __np_http_queue_response(client);
+      queued = true;
     }
+  }
+  return queued;
+}
+
+void _np_http_write_callback(struct ev_loop  *loop,
+                             NP_UNUSED ev_io *ev,
+                             int              event_type) {
+  np_state_t       *context = ev_userdata(loop);
+  np_http_client_t *client  = (np_http_client_t *)ev->data;
 
-    if (client->ht_response.cleanup_body) {
-      free(ht_body);
+  if (FLAG_CMP(event_type, EV_WRITE) && !FLAG_CMP(event_type, EV_ERROR)) {
+    log_debug_msg(LOG_HTTP | LOG_DEBUG, "start writing response");
+    if (!__np_http_flush(context, client)) {
+      __np_http_client_close(EV_A_ client);
+      return;
     }
-    client->status = CONNECTED;
+    __np_http_client_update_watchers(EV_A_ client, true);
   }
 }
 
@@ -471,38 +810,40 @@ void _np_http_read_callback(struct ev_loop  *loop,
   np_http_client_t *client  = (np_http_client_t *)ev->data;
 
   if ((event_type & EV_READ) == EV_READ &&
-      (event_type & EV_ERROR) != EV_ERROR && CONNECTED <= client->status &&
-      REQUEST >= client->status) {
-    char data[2048];
-    /* receive the new data */
-    int16_t in_msg_len = recv(client->client_fd, data, 2048, 0);
-
-    if (0 == in_msg_len) {
-      // tcp disconnect
-      log_debug_msg(LOG_HTTP | LOG_DEBUG, "received disconnect");
-      close(client->client_fd);
-      ev_io_stop(EV_A_ & client->client_watcher_in);
-      ev_io_stop(EV_A_ & client->client_watcher_out);
-      client->status = UNUSED;
-    }
+      (event_type & EV_ERROR) != EV_ERROR && SHUTDOWN != client->status) {
+    char data[NP_HTTP_RECV_BUFFER_SIZE];
+    bool progress = false;
+
+    // read until the socket is drained, the responses are written right away
+    // to keep the pending responses (and the header buffer) small
+    while (SHUTDOWN != client->status &&
+           client->pending_count < NP_HTTP_MAX_PENDING_RESPONSES) {
+      /* receive the new data */
+      ssize_t in_msg_len = recv(client->client_fd, data, sizeof(data), 0);
+
+      if (0 == in_msg_len) {
+        // tcp disconnect
+        log_debug_msg(LOG_HTTP | LOG_DEBUG, "received disconnect");
+        __np_http_client_close(EV_A_ client);
+        return;
+      }
 
-    if (0 > in_msg_len) {
-      log_msg(LOG_ERROR, "http receive failed: %s", strerror(errno));
-      log_trace_msg(LOG_TRACE | LOG_HTTP, ".end  .np_network_read");
-      return;
-    }
+      if (0 > in_msg_len) {
+        if (EAGAIN == errno || EWOULDBLOCK == errno || EINTR == errno) break;
+        log_msg(LOG_ERROR, "http receive failed: %s", strerror(errno));
+        __np_http_client_close(EV_A_ client);
+        return;
+      }
 
-    log_debug_msg(LOG_HTTP | LOG_DEBUG, "parsing http request");
-    htparser_run(client->parser, np_module(http)->hooks, data, in_msg_len);
-    if (htparser_get_error(client->parser) != htparse_error_none) {
-      log_msg(LOG_ERROR, "error parsing http request");
-      client->ht_response.ht_status = HTTP_CODE_BAD_REQUEST;
-      client->status                = RESPONSE;
-    }
+      log_debug_msg(LOG_HTTP | LOG_DEBUG, "parsing http request");
+      progress |= __np_http_parse(context, client, data, in_msg_len);
 
-    if (PROCESSING == client->status) {
-      _np_http_dispatch(context, client);
+      if (!__np_http_flush(context, client)) {
+        __np_http_client_close(EV_A_ client);
+        return;
+      }
     }
+    __np_http_client_update_watchers(EV_A_ client, progress);
 
   } else {
     // log_debug_msg(LOG_MISC, "local http status now %d, but should be %d or
@@ -526,28 +867,18 @@ void _np_http_accept(struct ev_loop  *loop,
   new_client->ht_request.ht_query_args = NULL;
   new_client->ht_request.ht_path       = NULL;
   new_client->ht_request.current_key   = NULL;
+  new_client->ht_response.ht_header    = np_tree_create();
   new_client->status                   = UNUSED;
   new_client->context                  = context;
 
-  /*
-  if (UNUSED < np_module(http)->status) {	// check if connection expired
-      if (new_client->last_update < (ev_time() - __np_http_timeout)) {
-          close(new_client);
-          // _np_suspend_event_loop();
-          ev_io_stop(EV_A_&new_client->client_watcher_in);
-          ev_io_stop(EV_A_&new_client->client_watcher_out);
-          // _np_resume_event_loop();
-          np_module(http)->status = UNUSED;
-      }
-  }
-   */
-
   if (UNUSED == new_client->status) {
     new_client->client_fd = accept(np_module(http)->network->socket,
                                    (struct sockaddr *)&from,
                                    &fromlen);
 
     if (new_client->client_fd < 0) {
+      np_tree_free(new_client->ht_response.ht_header);
+      free(new_client->parser);
       free(new_client);
 
       log_msg(LOG_HTTP | LOG_WARNING,
@@ -602,8 +933,16 @@ void _np_http_accept(struct ev_loop  *loop,
         free(new_client->client_watcher_out.data);
       new_client->client_watcher_out.data = new_client;
 
+      // idle and slow clients are closed after NP_HTTP_TIMEOUT_SEC
+      ev_timer_init(&new_client->client_timeout,
+                    _np_http_timeout_callback,
+                    0.0,
+                    NP_HTTP_TIMEOUT_SEC);
+      new_client->client_timeout.data = new_client;
+
+      // the write watcher is started once a response is pending
       ev_io_start(EV_A_ & new_client->client_watcher_in);
-      ev_io_start(EV_A_ & new_client->client_watcher_out);
+      ev_timer_again(EV_A_ & new_client->client_timeout);
 
       _np_event_resume_loop_http(context);
     }
@@ -619,8 +958,9 @@ void _np_http_module_init(np_state_t *context) {
 
     CHECK_MALLOC(_module);
 
-    _module->user_hooks = np_tree_create();
-    _module->network    = NULL;
+    _module->routes = calloc(1, sizeof(struct np_http_route_s));
+    CHECK_MALLOC(_module->routes);
+    _module->network = NULL;
 
     _module->hooks = (htparse_hooks *)malloc(sizeof(htparse_hooks));
     CHECK_MALLOC(_module->hooks);
@@ -695,12 +1035,19 @@ bool _np_http_init(np_state_t *context, char *in_domain, char *port) {
     ev_io_start(EV_A_ & _module->network->watcher_in);
     _np_event_resume_loop_http(context);
 
-    np_jobqueue_submit_event_periodic(context,
-                                      NP_PRIORITY_LOWEST,
-                                      0.0,
-                                      MISC_READ_HTTP_SEC,
-                                      _np_events_read_http,
-                                      "_np_events_read_http");
+    if (NP_EVENT_LOOP_EVENT_DRIVEN) {
+      // the loop blocks in its own thread until a client sends data, the
+      // async wakeup lets it pick up the new listening socket
+      _np_threads_start_eventloop(context, _np_event_http_run);
+      _np_event_reconfigure_loop_http(context);
+    } else {
+      np_jobqueue_submit_event_periodic(context,
+                                        NP_PRIORITY_LOWEST,
+                                        0.0,
+                                        MISC_READ_HTTP_SEC,
+                                        _np_events_read_http,
+                                        "_np_events_read_http");
+    }
   }
   if (in_domain == NULL) {
     free(domain);
@@ -720,28 +1067,14 @@ void _np_http_destroy(np_state_t *context) {
     while (iter != NULL) {
       np_http_client_t *client = iter->val;
       client->status           = SHUTDOWN;
-
-      ev_io_stop(EV_A_ & client->client_watcher_in);
-      ev_io_stop(EV_A_ & client->client_watcher_out);
-      close(iter->val->client_fd);
-
-      if (client->ht_request.ht_body) free(client->ht_request.ht_body);
-      if (client->ht_request.ht_path) free(client->ht_request.ht_path);
-      if (client->ht_request.current_key) free(client->ht_request.current_key);
-      if (client->ht_request.ht_header)
-        np_tree_free(client->ht_request.ht_header);
-      if (client->ht_request.ht_query_args)
-        np_tree_free(client->ht_request.ht_query_args);
-
-      free(client->parser);
-      free(client);
+      __np_http_client_free(EV_A_ client);
       sll_next(iter);
     }
     sll_free(np_http_client_ptr, _module->clients);
 
     _np_event_resume_loop_http(context);
 
-    np_tree_free(_module->user_hooks);
+    __np_http_route_free(_module->routes);
 
     free(np_module(http)->hooks);
 
@@ -765,16 +1098,38 @@ void _np_add_http_callback(np_state_t              *context,
   if (!np_module_initiated(http)) {
     _np_http_module_init(context);
   }
-  char key[128];
-  snprintf(key, 128, "%d:%s", method, path);
-  log_msg(LOG_DEBUG, "register of http callback for key %s", key);
+  if (method >= htp_method_UNKNOWN) {
+    log_msg(LOG_HTTP | LOG_WARNING,
+            "cannot register http callback for unknown method (path %s)",
+            path);
+    return;
+  }
+  log_msg(LOG_DEBUG,
+          "register of http callback for %s %s",
+          htparser_get_methodstr_m(method),
+          path);
+
+  struct np_http_route_s *route =
+      __np_http_route_find(np_module(http)->routes, path, true);
 
   _np_http_callback_t *callback_data = malloc(sizeof(_np_http_callback_t));
   CHECK_MALLOC(callback_data);
 
   callback_data->user_arg = user_args;
   callback_data->callback = func;
-  np_tree_insert_str(np_module(http)->user_hooks,
-                     key,
-                     np_treeval_new_v(callback_data));
-}
\ No newline at end of file
+
+  // the first registration of a path and method is kept
+  _np_http_callback_t *expected = NULL;
+  if (!__atomic_compare_exchange_n(&route->callbacks[method],
+                                   &expected,
+                                   callback_data,
+                                   false,
+                                   __ATOMIC_RELEASE,
+                                   __ATOMIC_RELAXED)) {
+    log_debug_msg(LOG_HTTP | LOG_DEBUG,
+                  "http callback for %s %s already registered",
+                  htparser_get_methodstr_m(method),
+                  path);
+    free(callback_data);
+  }
+}
@@ -56,19 +56,29 @@ struct ht_request_s {
 };
 typedef struct ht_request_s ht_request_t;
 
+// called instead of free() once a body with cleanup_body set has been sent
+typedef void (*_np_http_release_func_t)(char *body, void *release_arg);
+
 // http response structure
 struct ht_response_s {
-  int        ht_status;
-  char      *ht_reason;
-  np_tree_t *ht_header;
-  uint16_t   ht_length;
-  char      *ht_body;
-  bool       cleanup_body;
+  int                     ht_status;
+  char                   *ht_reason;
+  np_tree_t              *ht_header;
+  uint16_t                ht_length;
+  char                   *ht_body;
+  bool                    cleanup_body;
+  _np_http_release_func_t release_body;
+  void                   *release_arg;
 };
 typedef struct ht_response_s ht_response_t;
 
 typedef struct np_http_s np_http_t;
 
+// a callback returns the http status and sets the body of the response, which
+// is freed after it has been sent unless cleanup_body is reset. A callback
+// which reuses its body buffer sets release_body to get it back instead.
+// Additional headers are added to ht_header, the response headers default to
+// json.
 typedef int (*_np_http_callback_func_t)(ht_request_t  *request,
                                         ht_response_t *response,
                                         void          *user_arg);
@@ -8,6 +8,7 @@
 #include <assert.h>
 #include <errno.h>
 #include <fcntl.h>
+#include <limits.h>
 #include <stdio.h>
 #include <stdlib.h>
 #include <string.h>
@@ -20,7 +21,6 @@
 #include "identity/np_identity.h"
 #include "util/np_bloom.h"
 #include "util/np_serialization.h"
-#include "util/np_skiplist.h"
 #include "util/np_tree.h"
 
 #include "np_dhkey.h"
@@ -32,11 +32,55 @@
 
 // TODO: use file attributes to store mac // nonce // fingerprints
 
+/**
+ * on disk format of the keystore:
+ *
+ * .npks.log : append only log of fixed size records. Each record is encrypted
+ *             on its own with a random nonce: | nonce | mac | type | np_id |
+ * .npks.idx : open addressing hash table (host byte order) which maps a keyed
+ *             hash of each fingerprint to the offset of its record in the
+ *             log. The index is mmap'ed, a lookup is a single probe sequence.
+ *             The header records size and inode of the log it covers, a
+ *             stale index is brought up to date by replaying the log.
+ *
+ * Removing an identity appends a tombstone record, dead records are dropped by
+ * a periodic compaction which copies all live records into a new log and
+ * writes a new index for it. Both are synced to disk before they replace the
+ * current files by rename, a crash leaves either the old or the new log behind.
+ */
+enum np_keystore_record_type {
+  NP_KEYSTORE_RECORD_ADD    = 1,
+  NP_KEYSTORE_RECORD_REMOVE = 2,
+};
+
+#define NP_KEYSTORE_RECORD_PLAIN_SIZE (1 + NP_FINGERPRINT_BYTES)
+#define NP_KEYSTORE_RECORD_SIZE                                                \
+  (crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES +                   \
+   NP_KEYSTORE_RECORD_PLAIN_SIZE)
+
+#define NP_KEYSTORE_INDEX_MAGIC        "npksidx1"
+#define NP_KEYSTORE_INDEX_MIN_CAPACITY 64
+#define NP_KEYSTORE_SLOT_EMPTY         0
+#define NP_KEYSTORE_SLOT_DELETED       UINT64_MAX
+
+struct np_keystore_index_header {
+  char     magic[8];
+  uint32_t capacity; // number of slots, always a power of two
+  uint32_t used;     // live and deleted slots
+  uint32_t live;     // live slots
+  uint32_t _reserved;
+  uint64_t log_size;  // size of the log covered by this index
+  uint64_t log_inode; // inode of the log covered by this index
+};
+
+struct np_keystore_index_slot {
+  unsigned char tag[NP_FINGERPRINT_BYTES]; // keyed hash of the fingerprint
+  uint64_t      record;                    // record offset + 1, 0 if empty
+};
+
 struct np_keystore {
-  np_skiplist_t _denied_identities;
-  np_skiplist_t _allowed_identities;
-  np_bloom_t   *_denied_identities_filter;
-  np_bloom_t   *_allowed_identities_filter;
+  np_tree_t  *_identities; // cache of loaded identity tokens
+  np_bloom_t *_denied_identities_filter;
 
   bool          is_initialized;
   np_spinlock_t lock;
@@ -45,256 +89,709 @@ struct np_keystore {
   np_id       keystore_id;
   np_context *context;
 
-  int    _file_descriptor;
-  void  *_mmap_region;
-  size_t _mmap_size;
+  int      _log_fd;
+  uint64_t _log_size;
+  bool     _log_dirty;
+  bool     _saving; // a save copies and syncs files outside of the lock
 
-  unsigned char _passphrase[NP_KEY_BYTES];
+  int                              _index_fd;
+  struct np_keystore_index_header *_index;
+  size_t                           _index_size;
 
-  size_t            identities_size;
-  struct np_token **identities;
+  unsigned char _passphrase[NP_KEY_BYTES];
+  unsigned char _record_key[NP_KEY_BYTES];
+  unsigned char _index_key[NP_FINGERPRINT_BYTES];
 };
 typedef struct np_keystore np_keystore_t;
 
 static double            NP_KEYSTORE_SAVE_INTERVAL = 60.0;
 static const char *const _np_hidden_filename       = ".npks";
-static const uint8_t     keystore_filename_length =
-    8 /* strnlen("np:npks:", 10) */ + 2 * NP_FINGERPRINT_BYTES + 1;
-static np_keystore_t __keystore = {0};
+static const char *const _np_log_filename          = ".npks.log";
+static const char *const _np_index_filename        = ".npks.idx";
+static const char *const _np_tmp_log_filename      = ".npks.log.tmp";
+static const char *const _np_tmp_index_filename    = ".npks.idx.tmp";
+static np_keystore_t     __keystore                = {0};
+
+static void __keystore_path(char (*path)[PATH_MAX], const char *filename) {
+  snprintf(*path, PATH_MAX, "%s/%s", __keystore._dirname, filename);
+}
 
-static enum np_return __munmap_keystore_file(size_t size) {
+static void __derive_subkey(uint64_t       subkey_id,
+                            unsigned char *subkey,
+                            size_t         subkey_length) {
+  crypto_kdf_derive_from_key(subkey,
+                             subkey_length,
+                             subkey_id,
+                             (char *)__keystore.keystore_id,
+                             __keystore._passphrase);
+}
+
+static void __derive_token_key(const np_id   fingerprint,
+                               unsigned char subkey[NP_FINGERPRINT_BYTES]) {
+  uint64_t subkey_id = 0;
+  memcpy(&subkey_id, fingerprint, sizeof(uint64_t));
+  __derive_subkey(subkey_id, subkey, NP_FINGERPRINT_BYTES);
+}
 
-  if (__keystore._mmap_region) {
-    munlock(__keystore._mmap_region, __keystore._mmap_size);
-    munmap(__keystore._mmap_region, __keystore._mmap_size);
-    __keystore._mmap_region = NULL;
+static struct np_keystore_index_slot *__index_slots() {
+  return (struct np_keystore_index_slot *)(__keystore._index + 1);
+}
+
+static size_t __index_file_size(uint32_t capacity) {
+  return sizeof(struct np_keystore_index_header) +
+         capacity * sizeof(struct np_keystore_index_slot);
+}
+
+static void __index_tag(const np_id   fingerprint,
+                        unsigned char tag[NP_FINGERPRINT_BYTES]) {
+  crypto_generichash(tag,
+                     NP_FINGERPRINT_BYTES,
+                     fingerprint,
+                     NP_FINGERPRINT_BYTES,
+                     __keystore._index_key,
+                     NP_FINGERPRINT_BYTES);
+}
+
+// returns the slot of the tag, or the first free slot of its probe sequence
+static struct np_keystore_index_slot *
+__index_probe(const unsigned char tag[NP_FINGERPRINT_BYTES], bool for_insert) {
+  struct np_keystore_index_slot *slots    = __index_slots();
+  uint32_t                       mask     = __keystore._index->capacity - 1;
+  struct np_keystore_index_slot *tombstone = NULL;
+
+  uint32_t pos = 0;
+  memcpy(&pos, tag, sizeof(uint32_t));
+
+  for (uint32_t i = 0; i < __keystore._index->capacity; i++) {
+    struct np_keystore_index_slot *slot = &slots[(pos + i) & mask];
+
+    if (slot->record == NP_KEYSTORE_SLOT_EMPTY)
+      return (for_insert && tombstone != NULL) ? tombstone : slot;
+
+    if (slot->record == NP_KEYSTORE_SLOT_DELETED) {
+      if (tombstone == NULL) tombstone = slot;
+      continue;
+    }
+    if (0 == memcmp(slot->tag, tag, NP_FINGERPRINT_BYTES)) return slot;
   }
-  if (size > 0) {
-    ftruncate(__keystore._file_descriptor, size);
+  return for_insert ? tombstone : NULL;
+}
+
+static enum np_return __index_map(uint32_t capacity, bool reset) {
+  if (__keystore._index != NULL) {
+    munmap(__keystore._index, __keystore._index_size);
+    __keystore._index = NULL;
   }
-  if (__keystore._file_descriptor) {
-    close(__keystore._file_descriptor);
-    __keystore._file_descriptor = 0;
+
+  __keystore._index_size = __index_file_size(capacity);
+  if (reset && 0 != ftruncate(__keystore._index_fd, 0)) return np_unknown_error;
+  if (0 != ftruncate(__keystore._index_fd, __keystore._index_size))
+    return np_unknown_error;
+
+  __keystore._index = mmap(NULL,
+                           __keystore._index_size,
+                           PROT_READ | PROT_WRITE,
+                           MAP_SHARED | MAP_NORESERVE,
+                           __keystore._index_fd,
+                           0);
+  if (__keystore._index == MAP_FAILED) {
+    fprintf(stdout, "unable to mmap file (%s)\n", strerror(errno));
+    __keystore._index = NULL;
+    return np_unknown_error;
   }
-  __keystore._mmap_size = 0;
 
+  if (reset) {
+    memcpy(__keystore._index->magic, NP_KEYSTORE_INDEX_MAGIC, 8);
+    __keystore._index->capacity = capacity;
+  }
   return np_ok;
 }
 
-static enum np_return __mmap_keystore_file(size_t size) {
+static enum np_return
+__index_insert(const unsigned char tag[NP_FINGERPRINT_BYTES],
+               uint64_t            record_offset);
+
+// doubles the capacity of the index, deleted slots are dropped. If the index
+// cannot be grown the old one is mapped again.
+static enum np_return __index_grow() {
+  uint32_t capacity = __keystore._index->capacity;
+  size_t   size     = capacity * sizeof(struct np_keystore_index_slot);
+
+  struct np_keystore_index_slot *old_slots = malloc(size);
+  CHECK_MALLOC(old_slots);
+  memcpy(old_slots, __index_slots(), size);
+
+  struct np_keystore_index_header old_header = *__keystore._index;
+  if (np_ok != __index_map(capacity * 2, true)) {
+    if (np_ok == __index_map(capacity, true)) {
+      *__keystore._index = old_header;
+      memcpy(__index_slots(), old_slots, size);
+    }
+    free(old_slots);
+    return np_unknown_error;
+  }
+  __keystore._index->log_size  = old_header.log_size;
+  __keystore._index->log_inode = old_header.log_inode;
 
-  char keystore_id_str[2 * NP_FINGERPRINT_BYTES + 1];
-  np_id_str(keystore_id_str, __keystore.keystore_id);
-  char keystore_filename[keystore_filename_length];
-  snprintf(keystore_filename,
-           keystore_filename_length,
-           "np:npks:%s",
-           keystore_id_str);
-  bool new_file = false;
+  for (uint32_t i = 0; i < capacity; i++) {
+    if (old_slots[i].record != NP_KEYSTORE_SLOT_EMPTY &&
+        old_slots[i].record != NP_KEYSTORE_SLOT_DELETED)
+      __index_insert(old_slots[i].tag, old_slots[i].record - 1);
+  }
+  free(old_slots);
+  return np_ok;
+}
 
-  char cwd[PATH_MAX];
-  getcwd(cwd, sizeof(cwd));
-  chdir(__keystore._dirname);
+static enum np_return
+__index_insert(const unsigned char tag[NP_FINGERPRINT_BYTES],
+               uint64_t            record_offset) {
+  if ((__keystore._index->used + 1) * 4 >= __keystore._index->capacity * 3 &&
+      np_ok != __index_grow())
+    return np_unknown_error;
 
-  size_t page_size = sysconf(_SC_PAGE_SIZE);
+  struct np_keystore_index_slot *slot = __index_probe(tag, true);
+  if (slot == NULL) return np_unknown_error;
 
-  struct stat fileinfo;
-  if (0 == stat(_np_hidden_filename, &fileinfo)) {
-    __keystore._mmap_size = fileinfo.st_size;
-  } else if (errno == ENOENT) { // file does not exists, create it!
-                                //    __keystore._mmap_size = page_size;
-    new_file = true;
-  }
-
-  if (0 == __keystore._file_descriptor) {
-    __keystore._file_descriptor =
-        open(_np_hidden_filename, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR);
-    if (-1 == __keystore._file_descriptor) {
-      fprintf(stdout, "unable to open file (%s)\n", strerror(errno));
-      close(__keystore._file_descriptor);
-      return np_unknown_error;
-    }
+  if (slot->record == NP_KEYSTORE_SLOT_EMPTY) __keystore._index->used++;
+  if (slot->record == NP_KEYSTORE_SLOT_EMPTY ||
+      slot->record == NP_KEYSTORE_SLOT_DELETED)
+    __keystore._index->live++;
 
-    if (__keystore._mmap_size == 0) {
-      ftruncate(__keystore._file_descriptor, page_size);
-      __keystore._mmap_size = page_size;
-    }
+  memcpy(slot->tag, tag, NP_FINGERPRINT_BYTES);
+  slot->record = record_offset + 1;
+  return np_ok;
+}
+
+static void __index_remove(const unsigned char tag[NP_FINGERPRINT_BYTES]) {
+  struct np_keystore_index_slot *slot = __index_probe(tag, false);
+  if (slot != NULL && slot->record != NP_KEYSTORE_SLOT_EMPTY) {
+    slot->record = NP_KEYSTORE_SLOT_DELETED;
+    __keystore._index->live--;
   }
+}
 
-  if (size > __keystore._mmap_size) {
-    // __munmap_keystore_file(0);
+static bool __index_contains(const np_id fingerprint) {
+  unsigned char tag[NP_FINGERPRINT_BYTES];
+  __index_tag(fingerprint, tag);
+  struct np_keystore_index_slot *slot = __index_probe(tag, false);
+  return (slot != NULL && slot->record != NP_KEYSTORE_SLOT_EMPTY);
+}
 
-    uint8_t sizing_factor = floor((float)size / page_size) + 1;
-    __keystore._mmap_size = page_size * sizing_factor;
+static enum np_return __log_append(enum np_keystore_record_type type,
+                                   const np_id                  fingerprint,
+                                   uint64_t                    *record_offset) {
+  np_context *context = __keystore.context;
+
+  unsigned char plain[NP_KEYSTORE_RECORD_PLAIN_SIZE];
+  unsigned char record[NP_KEYSTORE_RECORD_SIZE];
+
+  plain[0] = type;
+  memcpy(plain + 1, fingerprint, NP_FINGERPRINT_BYTES);
+
+  randombytes_buf(record, crypto_secretbox_NONCEBYTES);
+  if (0 != crypto_secretbox_easy(record + crypto_secretbox_NONCEBYTES,
+                                 plain,
+                                 NP_KEYSTORE_RECORD_PLAIN_SIZE,
+                                 record,
+                                 __keystore._record_key)) {
+    log_msg(LOG_ERROR, "encryption of np_keystore record failed");
+    return np_unknown_error;
+  }
 
-    ftruncate(__keystore._file_descriptor, __keystore._mmap_size);
+  if (NP_KEYSTORE_RECORD_SIZE != pwrite(__keystore._log_fd,
+                                        record,
+                                        NP_KEYSTORE_RECORD_SIZE,
+                                        __keystore._log_size)) {
+    log_msg(LOG_ERROR,
+            "writing of np_keystore record failed (%s)",
+            strerror(errno));
+    return np_unknown_error;
   }
 
-  if (__keystore._mmap_region == NULL) {
-    __keystore._mmap_region = mmap(NULL,
-                                   __keystore._mmap_size,
-                                   PROT_READ | PROT_WRITE,
-                                   MAP_SHARED | MAP_NORESERVE,
-                                   __keystore._file_descriptor,
-                                   0); // MAP_32BIT |
-    if (__keystore._mmap_region == MAP_FAILED) {
-      fprintf(stdout, "unable to mmap file (%s)\n", strerror(errno));
-      close(__keystore._file_descriptor);
-      return np_unknown_error;
-    }
-    mlock(__keystore._mmap_region, __keystore._mmap_size);
+  *record_offset        = __keystore._log_size;
+  __keystore._log_size += NP_KEYSTORE_RECORD_SIZE;
+  __keystore._log_dirty = true;
 
-    if (new_file) {
-      memset(__keystore._mmap_region, 0, __keystore._mmap_size);
+  return np_ok;
+}
+
+static bool __log_read(int       fd,
+                       uint64_t  record_offset,
+                       uint8_t  *type,
+                       np_id    *fingerprint) {
+  unsigned char plain[NP_KEYSTORE_RECORD_PLAIN_SIZE];
+  unsigned char record[NP_KEYSTORE_RECORD_SIZE];
+
+  if (NP_KEYSTORE_RECORD_SIZE !=
+      pread(fd, record, NP_KEYSTORE_RECORD_SIZE, record_offset))
+    return false;
+
+  if (0 != crypto_secretbox_open_easy(plain,
+                                      record + crypto_secretbox_NONCEBYTES,
+                                      NP_KEYSTORE_RECORD_SIZE -
+                                          crypto_secretbox_NONCEBYTES,
+                                      record,
+                                      __keystore._record_key))
+    return false;
+
+  *type = plain[0];
+  memcpy(fingerprint, plain + 1, NP_FINGERPRINT_BYTES);
+  return true;
+}
+
+// brings the index up to date with the log, starting at the record offset
+static enum np_return __log_replay(uint64_t from) {
+  np_context *context = __keystore.context;
+
+  for (uint64_t offset = from;
+       offset + NP_KEYSTORE_RECORD_SIZE <= __keystore._log_size;
+       offset += NP_KEYSTORE_RECORD_SIZE) {
+    uint8_t type        = 0;
+    np_id   fingerprint = {0};
+    if (!__log_read(__keystore._log_fd, offset, &type, &fingerprint)) {
+      log_warn(LOG_WARNING, "could not read/decrypt keystore record");
+      continue;
     }
+
+    unsigned char tag[NP_FINGERPRINT_BYTES];
+    __index_tag(fingerprint, tag);
+    if (type == NP_KEYSTORE_RECORD_ADD && np_ok != __index_insert(tag, offset))
+      return np_unknown_error;
+    if (type == NP_KEYSTORE_RECORD_REMOVE) __index_remove(tag);
+  }
+  __keystore._index->log_size = __keystore._log_size;
+  return np_ok;
+}
+
+static enum np_return __keystore_open() {
+  char path[PATH_MAX];
+
+  __keystore_path(&path, _np_log_filename);
+  __keystore._log_fd = open(path, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR);
+  if (-1 == __keystore._log_fd) {
+    fprintf(stdout, "unable to open file (%s)\n", strerror(errno));
+    return np_unknown_error;
+  }
+
+  __keystore_path(&path, _np_index_filename);
+  __keystore._index_fd = open(path, O_CREAT | O_RDWR, S_IWUSR | S_IRUSR);
+  if (-1 == __keystore._index_fd) {
+    fprintf(stdout, "unable to open file (%s)\n", strerror(errno));
+    return np_unknown_error;
   }
-  chdir(cwd);
 
+  struct stat log_info, index_info;
+  fstat(__keystore._log_fd, &log_info);
+  fstat(__keystore._index_fd, &index_info);
+
+  // ignore a torn record at the end of the log
+  __keystore._log_size =
+      log_info.st_size - (log_info.st_size % NP_KEYSTORE_RECORD_SIZE);
+
+  bool     valid    = false;
+  uint32_t capacity = NP_KEYSTORE_INDEX_MIN_CAPACITY;
+  if ((size_t)index_info.st_size >= sizeof(struct np_keystore_index_header)) {
+    struct np_keystore_index_header header = {0};
+    pread(__keystore._index_fd, &header, sizeof(header), 0);
+
+    valid = 0 == memcmp(header.magic, NP_KEYSTORE_INDEX_MAGIC, 8) &&
+            header.capacity >= NP_KEYSTORE_INDEX_MIN_CAPACITY &&
+            0 == (header.capacity & (header.capacity - 1)) &&
+            (size_t)index_info.st_size == __index_file_size(header.capacity) &&
+            header.log_inode == (uint64_t)log_info.st_ino &&
+            header.log_size <= __keystore._log_size;
+    if (valid) capacity = header.capacity;
+  }
+
+  if (np_ok != __index_map(capacity, !valid)) return np_unknown_error;
+
+  if (!valid) {
+    __keystore._index->log_inode = log_info.st_ino;
+    return __log_replay(0);
+  } else if (__keystore._index->log_size < __keystore._log_size) {
+    return __log_replay(__keystore._index->log_size);
+  }
   return np_ok;
 }
 
-static int8_t __compare_nptoken_by_fingerprint(const void *t1, const void *t2) {
-  np_id fp_1, fp_2;
-  np_token_fingerprint(__keystore.context,
-                       *(struct np_token *)t1,
-                       false,
-                       &fp_1);
-  np_token_fingerprint(__keystore.context,
-                       *(struct np_token *)t2,
-                       false,
-                       &fp_2);
-  return memcmp(fp_1, fp_2, NP_FINGERPRINT_BYTES);
-}
-
-static int8_t __cmp_nptoken_by_fingerprint(np_map_reduce_t *mr_args,
-                                           const void      *t2) {
-  np_id fp_2 = {0};
-  np_token_fingerprint(__keystore.context,
-                       *(struct np_token *)t2,
-                       false,
-                       &fp_2);
-  return memcmp(mr_args->map_args.io, fp_2, NP_FINGERPRINT_BYTES);
-}
-
-static int8_t __all_nptoken_by_fingerprint(NP_UNUSED np_map_reduce_t *mr_args,
-                                           NP_UNUSED const void      *t2) {
-  return -1;
-}
-
-static bool __map_nptoken_by_fingerprint(np_map_reduce_t *mr_args,
-                                         const void      *t2) {
-  if (t2 == NULL) return true;
-
-  np_dhkey_t fp_2 = {0};
-  np_token_fingerprint(__keystore.context,
-                       *(struct np_token *)t2,
-                       false,
-                       (np_id *)&fp_2);
-  if (0 == memcmp(mr_args->map_args.io, &fp_2, NP_FINGERPRINT_BYTES)) {
-    if (np_tree_find_dhkey(mr_args->reduce_result, fp_2) == NULL) {
-      np_tree_insert_dhkey(mr_args->reduce_result,
-                           (np_dhkey_t)fp_2,
-                           np_treeval_new_v((void *)t2));
-      return false;
-    }
-    return true;
+// unmaps the index and hands both file descriptors to the caller, which syncs
+// and closes them outside of the lock
+static void __keystore_close(int *log_fd, int *index_fd) {
+  if (__keystore._index != NULL) {
+    __keystore._index->log_size = __keystore._log_size;
+    munmap(__keystore._index, __keystore._index_size);
+    __keystore._index = NULL;
   }
-  return false;
+  *log_fd              = __keystore._log_fd;
+  *index_fd            = __keystore._index_fd;
+  __keystore._index_fd = 0;
+  __keystore._log_fd   = 0;
 }
 
-static bool __store_nptoken_fingerprint(np_map_reduce_t *mr_args,
-                                        const void      *t2) {
-  if (t2 == NULL) return false;
-  np_dhkey_t fp_2 = {0};
-  np_token_fingerprint(__keystore.context,
-                       *(struct np_token *)t2,
-                       false,
-                       (np_id *)&fp_2);
-  size_t *write_pos = (size_t *)mr_args->map_args.io;
-  memcpy(__keystore._mmap_region + *write_pos, &fp_2, NP_FINGERPRINT_BYTES);
-  *write_pos = *write_pos + NP_FINGERPRINT_BYTES;
+static void __keystore_sync_dir() {
+  int fd = open(__keystore._dirname, O_RDONLY | O_DIRECTORY);
+  if (-1 == fd) return;
+  fsync(fd);
+  close(fd);
+}
 
-  // sll_append(void_ptr, mr_args->map_result, (void *)t2);
-  return true;
+// converts a keystore file of the previous format (one encrypted array of
+// fingerprints) into log records
+static void __keystore_migrate() {
+  np_context *context = __keystore.context;
+
+  char path[PATH_MAX];
+  __keystore_path(&path, _np_hidden_filename);
+
+  int fd = open(path, O_RDONLY);
+  if (-1 == fd) return;
+
+  struct stat fileinfo;
+  fstat(fd, &fileinfo);
+  size_t full_size = fileinfo.st_size;
+  size_t cbor_size = 8 + crypto_box_NONCEBYTES;
+  size_t data_size = full_size - cbor_size;
+
+  unsigned char *region = NULL;
+  if (full_size > cbor_size + crypto_secretbox_MACBYTES)
+    region = mmap(NULL, full_size, PROT_READ | PROT_WRITE, MAP_PRIVATE, fd, 0);
+  if (region == NULL || region == MAP_FAILED) {
+    close(fd);
+    return;
+  }
+
+  unsigned char _nonce[crypto_box_NONCEBYTES];
+  if (np_serializer_read_encrypted(region,
+                                   &full_size,
+                                   _nonce,
+                                   region + cbor_size,
+                                   &data_size) &&
+      0 == crypto_secretbox_open_easy(region + cbor_size +
+                                          crypto_secretbox_MACBYTES,
+                                      region + cbor_size,
+                                      data_size,
+                                      _nonce,
+                                      __keystore._record_key)) {
+    unsigned char *current_pos =
+        region + cbor_size + crypto_secretbox_MACBYTES;
+    unsigned char *end_pos = region + cbor_size + data_size;
+
+    while (current_pos + NP_FINGERPRINT_BYTES <= end_pos) {
+      np_id fingerprint = {0};
+      memcpy(fingerprint, current_pos, NP_FINGERPRINT_BYTES);
+      // the previous format did not shrink the file, skip zero padding
+      if (!_np_dhkey_equal((np_dhkey_t *)&fingerprint, &dhkey_zero) &&
+          !__index_contains(fingerprint)) {
+        unsigned char tag[NP_FINGERPRINT_BYTES];
+        uint64_t      record_offset = 0;
+        __index_tag(fingerprint, tag);
+        if (np_ok != __log_append(NP_KEYSTORE_RECORD_ADD,
+                                  fingerprint,
+                                  &record_offset) ||
+            np_ok != __index_insert(tag, record_offset)) {
+          // keep the previous file, the migration is repeated on next start
+          log_warn(LOG_WARNING, "could not migrate previous keystore file");
+          munmap(region, fileinfo.st_size);
+          close(fd);
+          return;
+        }
+      }
+      current_pos += NP_FINGERPRINT_BYTES;
+    }
+    char migrated_path[PATH_MAX];
+    snprintf(migrated_path, PATH_MAX, "%s.migrated", path);
+    rename(path, migrated_path);
+  } else {
+    log_warn(LOG_WARNING, "could not read/decrypt previous keystore file");
+  }
+
+  munmap(region, fileinfo.st_size);
+  close(fd);
 }
 
-bool __np_keystore_save(NP_UNUSED np_state_t     *context,
-                        NP_UNUSED np_util_event_t args) {
-  bool ret = false;
+// copies the token of the fingerprint into token. A cached token is copied
+// under the lock, otherwise the token file is loaded and decrypted outside of
+// it. The loaded token is only cached if the identity has not been removed
+// meanwhile. Has to be called without holding the lock.
+static enum np_return __keystore_token(const np_id      fingerprint,
+                                       struct np_token *token) {
+  np_dhkey_t fp_dhkey = {0};
+  memcpy(&fp_dhkey, fingerprint, NP_FINGERPRINT_BYTES);
+
+  unsigned char subkey[NP_FINGERPRINT_BYTES];
+  bool          cached = false;
 
   np_spinlock_lock(&__keystore.lock);
-  if (np_skiplist_size(&__keystore._allowed_identities) == 0) {
-    ret = true;
-    goto __np_finally;
+  bool contained = __keystore._index != NULL && __index_contains(fingerprint);
+  if (contained) {
+    np_tree_elem_t *elem =
+        np_tree_find_dhkey(__keystore._identities, fp_dhkey);
+    cached = (elem != NULL);
+    if (cached) memcpy(token, elem->val.value.v, sizeof(struct np_token));
+    else __derive_token_key(fingerprint, subkey);
   }
+  np_spinlock_unlock(&__keystore.lock);
 
-  // calculate size of np_id array and mmap file with new size
-  size_t data_size =
-      np_skiplist_size(&__keystore._allowed_identities) * NP_FINGERPRINT_BYTES;
-  size_t cbor_size = 8 + crypto_box_NONCEBYTES;
-  size_t full_size = data_size + cbor_size + crypto_secretbox_MACBYTES;
+  if (!contained) return np_invalid_operation;
+  if (cached) return np_ok;
+
+  enum np_return ret = np_identity_load_token(__keystore.context,
+                                              __keystore._dirname,
+                                              (unsigned char *)fingerprint,
+                                              subkey,
+                                              token);
+  sodium_memzero(subkey, NP_FINGERPRINT_BYTES);
+  if (np_ok != ret) return ret;
+
+  np_spinlock_lock(&__keystore.lock);
+  if (__keystore._index != NULL && __index_contains(fingerprint) &&
+      NULL == np_tree_find_dhkey(__keystore._identities, fp_dhkey)) {
+    struct np_token *cached = malloc(sizeof(struct np_token));
+    CHECK_MALLOC(cached);
+    memcpy(cached, token, sizeof(struct np_token));
+    np_tree_insert_dhkey(__keystore._identities,
+                         fp_dhkey,
+                         np_treeval_new_v(cached));
+  }
+  np_spinlock_unlock(&__keystore.lock);
+  return np_ok;
+}
 
-  if (np_ok != __mmap_keystore_file(full_size)) {
-    goto __np_catch;
+static void __keystore_uncache(const np_id fingerprint) {
+  np_dhkey_t fp_dhkey = {0};
+  memcpy(&fp_dhkey, fingerprint, NP_FINGERPRINT_BYTES);
+
+  np_tree_elem_t *elem = np_tree_find_dhkey(__keystore._identities, fp_dhkey);
+  if (elem != NULL) {
+    free(elem->val.value.v);
+    np_tree_del_dhkey(__keystore._identities, fp_dhkey);
   }
+}
 
-  size_t          write_pos = cbor_size;
-  np_map_reduce_t mr        = {0};
-  mr.cmp                    = __all_nptoken_by_fingerprint;
-  mr.map                    = __store_nptoken_fingerprint;
-  mr.map_args.io            = &write_pos;
-  // mr.map_result               = sll_init_part(void_ptr);
-  // mr.reduce                   = __encrypt_keystore_fingerprints;
-  // mr.reduce_args.io           = __keystore.keystore_id;
-  // mr.reduce_result            = np_tree_create();
+struct np_keystore_compaction {
+  int      src_fd; // duplicate of the compacted log
+  int      log_fd;
+  int      index_fd;
+  uint32_t capacity;
+  uint64_t log_size;  // size of the compacted log
+  uint64_t log_inode; // inode of the compacted log
+  uint64_t new_log_size;
+
+  struct np_keystore_index_header header;
+  struct np_keystore_index_slot  *slots;
+};
 
-  np_skiplist_map(&__keystore._allowed_identities, &mr);
-  // np_skiplist_reduce(&mr);
+static void
+__keystore_compact_abort(struct np_keystore_compaction *compaction) {
+  char path[PATH_MAX];
+  if (compaction->src_fd > 0) close(compaction->src_fd);
+  if (compaction->log_fd > 0) close(compaction->log_fd);
+  if (compaction->index_fd > 0) close(compaction->index_fd);
+  __keystore_path(&path, _np_tmp_log_filename);
+  unlink(path);
+  __keystore_path(&path, _np_tmp_index_filename);
+  unlink(path);
+  free(compaction->slots);
+  compaction->slots    = NULL;
+  compaction->src_fd   = 0;
+  compaction->log_fd   = 0;
+  compaction->index_fd = 0;
+}
 
-  uint64_t subkey_id = 0;
-  memcpy(&subkey_id, __keystore.keystore_id, sizeof(uint64_t));
+// takes a snapshot of the index and a duplicate of the log file descriptor.
+// Called with the lock held, the records are copied outside of the lock.
+static enum np_return
+__keystore_compact_prepare(struct np_keystore_compaction *compaction) {
+  compaction->capacity  = __keystore._index->capacity;
+  compaction->log_size  = __keystore._log_size;
+  compaction->log_inode = __keystore._index->log_inode;
+  compaction->header    = *__keystore._index;
+
+  compaction->src_fd = dup(__keystore._log_fd);
+  if (-1 == compaction->src_fd) {
+    compaction->src_fd = 0;
+    return np_unknown_error;
+  }
 
-  unsigned char _nonce[crypto_box_NONCEBYTES];
-  randombytes_buf(_nonce, crypto_box_NONCEBYTES);
+  size_t slots_size =
+      compaction->capacity * sizeof(struct np_keystore_index_slot);
+  compaction->slots = malloc(slots_size);
+  CHECK_MALLOC(compaction->slots);
+  memcpy(compaction->slots, __index_slots(), slots_size);
+  return np_ok;
+}
 
-  unsigned char subkey[NP_FINGERPRINT_BYTES];
-  crypto_kdf_derive_from_key(subkey,
-                             (size_t)NP_FINGERPRINT_BYTES,
-                             subkey_id,
-                             (char *)__keystore.keystore_id,
-                             __keystore._passphrase);
-  // in place encryption of skiplist fingerprint items
-  if (0 != crypto_secretbox_easy(__keystore._mmap_region + cbor_size,
-                                 __keystore._mmap_region + cbor_size,
-                                 data_size,
-                                 _nonce,
-                                 subkey)) {
-    log_msg(LOG_ERROR, "encryption of np_keystore failed, exiting");
-    goto __np_catch;
-  }
-
-  if (!np_serializer_write_encrypted(__keystore._mmap_region,
-                                     &full_size,
-                                     _nonce,
-                                     __keystore._mmap_region + cbor_size,
-                                     data_size + crypto_secretbox_MACBYTES)) {
-    log_msg(LOG_ERROR, "writing of encrypted np_keystore failed, exiting");
-    goto __np_catch;
-  }
-
-  __munmap_keystore_file(full_size);
-  ret = true;
-  goto __np_finally;
-  // np_spinlock_unlock(&__keystore.lock);
-  // sll_free(void_ptr, mr.map_result);
-  // np_tree_free(mr.reduce_result);
+// copies all live records of the snapshot into a new log, writes the index
+// for it into a new file and syncs both. Runs without the lock, the log is
+// append only and the snapshot covers records which do not change anymore.
+// __keystore_compact_commit switches over if the log did not grow meanwhile.
+static enum np_return
+__keystore_compact_copy(struct np_keystore_compaction *compaction) {
+  char log_path[PATH_MAX], index_path[PATH_MAX];
+  __keystore_path(&log_path, _np_tmp_log_filename);
+  __keystore_path(&index_path, _np_tmp_index_filename);
+
+  compaction->log_fd =
+      open(log_path, O_CREAT | O_RDWR | O_TRUNC, S_IWUSR | S_IRUSR);
+  compaction->index_fd =
+      open(index_path, O_CREAT | O_RDWR | O_TRUNC, S_IWUSR | S_IRUSR);
+  bool ok = (-1 != compaction->log_fd && -1 != compaction->index_fd);
+
+  // records are copied verbatim, no need to re-encrypt them. Deleted slots
+  // are kept, they are part of the probe sequences of other slots.
+  struct np_keystore_index_slot *slots    = compaction->slots;
+  uint64_t                       new_size = 0;
+  unsigned char                  record[NP_KEYSTORE_RECORD_SIZE];
+  for (uint32_t i = 0; ok && i < compaction->capacity; i++) {
+    if (slots[i].record == NP_KEYSTORE_SLOT_EMPTY ||
+        slots[i].record == NP_KEYSTORE_SLOT_DELETED)
+      continue;
+
+    ok = NP_KEYSTORE_RECORD_SIZE == pread(compaction->src_fd,
+                                          record,
+                                          NP_KEYSTORE_RECORD_SIZE,
+                                          slots[i].record - 1) &&
+         NP_KEYSTORE_RECORD_SIZE == pwrite(compaction->log_fd,
+                                           record,
+                                           NP_KEYSTORE_RECORD_SIZE,
+                                           new_size);
+    slots[i].record  = new_size + 1;
+    new_size        += NP_KEYSTORE_RECORD_SIZE;
+  }
 
-__np_catch:
-  __munmap_keystore_file(0);
-__np_finally:
+  // the new index covers the new log, which keeps its inode when renamed
+  struct stat log_info;
+  size_t      slots_size =
+      compaction->capacity * sizeof(struct np_keystore_index_slot);
+  if (ok) ok = 0 == fstat(compaction->log_fd, &log_info);
+  if (ok) {
+    struct np_keystore_index_header header = compaction->header;
+    header.log_size                        = new_size;
+    header.log_inode                       = log_info.st_ino;
+    ok = sizeof(header) ==
+             pwrite(compaction->index_fd, &header, sizeof(header), 0) &&
+         slots_size == pwrite(compaction->index_fd,
+                              slots,
+                              slots_size,
+                              sizeof(header));
+  }
+  if (ok)
+    ok = 0 == fsync(compaction->log_fd) && 0 == fsync(compaction->index_fd);
+
+  if (!ok) {
+    __keystore_compact_abort(compaction);
+    return np_unknown_error;
+  }
+  close(compaction->src_fd);
+  free(compaction->slots);
+  compaction->src_fd       = 0;
+  compaction->slots        = NULL;
+  compaction->new_log_size = new_size;
+  return np_ok;
+}
+
+// replaces log and index with the synced files of the compaction. A crash
+// between both renames leaves an index of another log behind, which is
+// rebuilt from the log on the next start.
+static enum np_return
+__keystore_compact_commit(struct np_keystore_compaction *compaction) {
+  // records appended while syncing are not part of the new log, try again
+  if (__keystore._index == NULL ||
+      __keystore._log_size != compaction->log_size ||
+      __keystore._index->log_inode != compaction->log_inode) {
+    __keystore_compact_abort(compaction);
+    return np_operation_would_block;
+  }
+
+  char log_path[PATH_MAX], tmp_log_path[PATH_MAX];
+  char index_path[PATH_MAX], tmp_index_path[PATH_MAX];
+  __keystore_path(&log_path, _np_log_filename);
+  __keystore_path(&tmp_log_path, _np_tmp_log_filename);
+  __keystore_path(&index_path, _np_index_filename);
+  __keystore_path(&tmp_index_path, _np_tmp_index_filename);
+
+  if (0 != rename(tmp_log_path, log_path)) {
+    __keystore_compact_abort(compaction);
+    return np_unknown_error;
+  }
+  close(__keystore._log_fd);
+  __keystore._log_fd   = compaction->log_fd;
+  __keystore._log_size = compaction->new_log_size;
+
+  if (0 != rename(tmp_index_path, index_path)) {
+    // the current index does not match the new log anymore, rebuild it
+    close(compaction->index_fd);
+    unlink(tmp_index_path);
+    if (np_ok != __index_map(compaction->capacity, true))
+      return np_unknown_error;
+    struct stat log_info;
+    fstat(__keystore._log_fd, &log_info);
+    __keystore._index->log_inode = log_info.st_ino;
+    return __log_replay(0);
+  }
+
+  munmap(__keystore._index, __keystore._index_size);
+  __keystore._index = NULL;
+  close(__keystore._index_fd);
+  __keystore._index_fd = compaction->index_fd;
+  return __index_map(compaction->capacity, false);
+}
+
+bool __np_keystore_save(NP_UNUSED np_state_t     *context,
+                        NP_UNUSED np_util_event_t args) {
+  struct np_keystore_compaction compaction = {0};
+
+  bool     compact   = false;
+  int      sync_fd   = -1;
+  uint64_t sync_size = 0, sync_inode = 0;
+
+  np_spinlock_lock(&__keystore.lock);
+  if (__keystore._index != NULL && !__keystore._saving) {
+    uint64_t records = __keystore._log_size / NP_KEYSTORE_RECORD_SIZE;
+    uint64_t dead    = records - __keystore._index->live;
+
+    if (dead > 0 && dead >= __keystore._index->live) {
+      compact = np_ok == __keystore_compact_prepare(&compaction);
+      if (!compact) log_warn(LOG_WARNING, "compaction of np_keystore failed");
+    } else if (__keystore._log_dirty) {
+      sync_fd    = dup(__keystore._log_fd);
+      sync_size  = __keystore._log_size;
+      sync_inode = __keystore._index->log_inode;
+    }
+    __keystore._saving = compact || sync_fd != -1;
+    if (__keystore._saving) __keystore._log_dirty = false;
+  }
   np_spinlock_unlock(&__keystore.lock);
 
-  return ret;
+  if (!compact && sync_fd == -1) return true;
+
+  // copying and syncing may take a while, the keystore stays usable meanwhile
+  enum np_return ret = np_ok;
+  if (compact) {
+    ret = __keystore_compact_copy(&compaction);
+  } else {
+    fdatasync(sync_fd);
+    close(sync_fd);
+  }
+
+  np_spinlock_lock(&__keystore.lock);
+  if (compact && np_ok == ret) {
+    ret = __keystore_compact_commit(&compaction);
+  } else if (!compact && __keystore._index != NULL &&
+             __keystore._index->log_inode == sync_inode) {
+    // the index must not cover records which have not been synced yet
+    __keystore._index->log_size = sync_size;
+    msync(__keystore._index, __keystore._index_size, MS_ASYNC);
+  }
+  if (np_ok != ret) __keystore._log_dirty = true;
+  __keystore._saving = false;
+  np_spinlock_unlock(&__keystore.lock);
+
+  if (compact && np_ok == ret) __keystore_sync_dir();
+  if (compact && np_ok != ret && np_operation_would_block != ret)
+    log_warn(LOG_WARNING, "compaction of np_keystore failed");
+
+  return true;
 }
 
 void __shutdown_keystore(np_context *context) {
@@ -305,27 +802,37 @@ enum np_return np_keystore_init(np_context   *context,
                                 np_id         keystore_id,
                                 const char   *dirname,
                                 unsigned char passphrase[NP_KEY_BYTES]) {
+  enum np_return ret = np_ok;
+
   if (!__keystore.is_initialized) {
     np_spinlock_init(&__keystore.lock, PTHREAD_PROCESS_PRIVATE);
 
     np_spinlock_lock(&__keystore.lock);
-    __keystore.context          = context;
-    __keystore._file_descriptor = 0;
-    __keystore._mmap_region     = NULL;
-    __keystore._mmap_size       = 0;
+    __keystore.context   = context;
+    __keystore._log_fd   = 0;
+    __keystore._index_fd = 0;
+    __keystore._index    = NULL;
+    __keystore._saving   = false;
     realpath(dirname, __keystore._dirname);
 
     memcpy(__keystore.keystore_id, keystore_id, NP_FINGERPRINT_BYTES);
     memcpy(__keystore._passphrase, passphrase, NP_KEY_BYTES);
 
+    uint64_t subkey_id = 0;
+    memcpy(&subkey_id, __keystore.keystore_id, sizeof(uint64_t));
+    __derive_subkey(subkey_id, __keystore._record_key, NP_KEY_BYTES);
+    __derive_subkey(subkey_id + 1,
+                    __keystore._index_key,
+                    NP_FINGERPRINT_BYTES);
+
     // TODO: create for each keystore_id
-    np_skiplist_init(&__keystore._allowed_identities,
-                     __compare_nptoken_by_fingerprint);
-    __keystore._allowed_identities_filter =
-        _np_neuropil_bloom_create(); // 512 identities
+    __keystore._identities = np_tree_create();
     __keystore._denied_identities_filter =
         _np_neuropil_bloom_create(); // 512 identities
 
+    ret = __keystore_open();
+    if (np_ok == ret) __keystore_migrate();
+
     __keystore.is_initialized = true;
 
     np_spinlock_unlock(&__keystore.lock);
@@ -338,23 +845,43 @@ enum np_return np_keystore_init(np_context   *context,
                                       "__np_keystore_save");
     np_add_shutdown_cb(context, __shutdown_keystore);
   }
-  return np_ok;
+  return ret;
 }
 
 enum np_return np_keystore_destroy(NP_UNUSED np_context *context,
                                    NP_UNUSED np_id       keystore_id) {
+  // the shutdown callback destroys a keystore which is still initialized
+  if (!__keystore.is_initialized) return np_invalid_operation;
 
-  __munmap_keystore_file(0);
+  int log_fd = 0, index_fd = 0;
+  np_spinlock_lock(&__keystore.lock);
+  __keystore_close(&log_fd, &index_fd);
+  np_spinlock_unlock(&__keystore.lock);
 
   np_spinlock_destroy(&__keystore.lock);
 
-  np_skiplist_destroy(&__keystore._allowed_identities);
+  // the unmapped index pages are written back by syncing the file
+  if (index_fd > 0) {
+    fsync(index_fd);
+    close(index_fd);
+  }
+  if (log_fd > 0) {
+    fsync(log_fd);
+    close(log_fd);
+  }
+
   _np_bloom_free(__keystore._denied_identities_filter);
-  _np_bloom_free(__keystore._allowed_identities_filter);
 
-  for (uint16_t x = 0; x < __keystore.identities_size; x++)
-    free(__keystore.identities[x]);
-  if (__keystore.identities != NULL) free(__keystore.identities);
+  np_tree_elem_t *iter = NULL;
+  RB_FOREACH (iter, np_tree_s, __keystore._identities) {
+    free(iter->val.value.v);
+  }
+  np_tree_free(__keystore._identities);
+
+  sodium_memzero(__keystore._passphrase, NP_KEY_BYTES);
+  sodium_memzero(__keystore._record_key, NP_KEY_BYTES);
+  sodium_memzero(__keystore._index_key, NP_FINGERPRINT_BYTES);
+  __keystore.is_initialized = false;
 
   return np_ok;
 }
@@ -362,8 +889,6 @@ enum np_return np_keystore_destroy(NP_UNUSED np_context *context,
 enum np_return np_keystore_check_identity(np_context      *context,
                                           np_id            keystore_id,
                                           struct np_token *identity) {
-  enum np_return ret = np_unknown_error;
-
   np_id      identity_fp    = {0};
   np_dhkey_t identity_dhkey = {0};
 
@@ -373,233 +898,75 @@ enum np_return np_keystore_check_identity(np_context      *context,
   memcpy(&identity_dhkey, identity_fp, NP_FINGERPRINT_BYTES);
 
   np_spinlock_lock(&__keystore.lock);
-  bool in_allow_list =
-      _np_neuropil_bloom_check(__keystore._allowed_identities_filter,
-                               identity_dhkey);
   bool in_denied_list =
       _np_neuropil_bloom_check(__keystore._denied_identities_filter,
                                identity_dhkey);
-  if (in_allow_list && !in_denied_list) {
-    np_map_reduce_t mr = {0};
-    mr.cmp             = __cmp_nptoken_by_fingerprint;
-    mr.map             = __map_nptoken_by_fingerprint;
-    mr.map_args.io     = identity_fp;
-    mr.reduce          = NULL;
-    mr.reduce_result   = np_tree_create();
-
-    np_skiplist_map(&__keystore._allowed_identities, &mr);
-    if (mr.reduce_result->size == 1) {
-      struct np_token *stored_token =
-          np_tree_find_dhkey(mr.reduce_result, identity_dhkey)->val.value.v;
-      if (0 == memcmp(stored_token->public_key,
-                      identity->public_key,
-                      NP_PUBLIC_KEY_BYTES))
-        ret = np_ok;
-    }
-    np_tree_free(mr.reduce_result);
-  }
   np_spinlock_unlock(&__keystore.lock);
+  if (in_denied_list) return np_unknown_error;
+
+  // the token file is loaded without holding the lock
+  struct np_token stored_token = {0};
+  if (np_ok == __keystore_token(identity_fp, &stored_token) &&
+      0 == memcmp(stored_token.public_key,
+                  identity->public_key,
+                  NP_PUBLIC_KEY_BYTES))
+    return np_ok;
 
-  return ret;
+  return np_unknown_error;
 }
 
 enum np_return np_keystore_load_identity(np_context      *context,
                                          np_id            keystore_id,
                                          np_id            fingerprint,
                                          struct np_token *identity) {
-  enum np_return ret = np_invalid_operation;
-
-  // __np_try: // noop line, syntactic sugar
-
-  np_spinlock_lock(&__keystore.lock);
-  if (np_ok != __mmap_keystore_file(0)) {
-    goto __np_catch;
-  }
-
-  // calculate size of np_id array and mmap file with new size
-  size_t full_size = __keystore._mmap_size;
-  size_t cbor_size = 8 + crypto_box_NONCEBYTES;
-  size_t data_size = full_size - cbor_size;
-
-  if (full_size == 0) {
-    goto __np_catch;
-  }
-
-  unsigned char _nonce[crypto_box_NONCEBYTES];
-  if (false == np_serializer_read_encrypted(__keystore._mmap_region,
-                                            &full_size,
-                                            _nonce,
-                                            __keystore._mmap_region + cbor_size,
-                                            &data_size)) {
-    log_warn(LOG_WARNING, "could not read/decrypt keystore file");
-    goto __np_catch;
-  }
-
-  uint64_t subkey_id = 0;
-  memcpy(&subkey_id, __keystore.keystore_id, sizeof(uint64_t));
-
-  unsigned char subkey[NP_FINGERPRINT_BYTES];
-  crypto_kdf_derive_from_key(subkey,
-                             (size_t)NP_FINGERPRINT_BYTES,
-                             subkey_id,
-                             (char *)__keystore.keystore_id,
-                             __keystore._passphrase);
-
-  if (0 != crypto_secretbox_open_easy(__keystore._mmap_region + cbor_size +
-                                          crypto_box_MACBYTES,
-                                      __keystore._mmap_region + cbor_size,
-                                      data_size,
-                                      _nonce,
-                                      subkey)) {
-    log_msg(LOG_ERROR, "decryption of np_keystore failed, exiting");
-    goto __np_catch;
-  }
-
-  void *current_pos = __keystore._mmap_region + cbor_size + crypto_box_MACBYTES;
-  void *end_pos     = __keystore._mmap_region + full_size;
-
-  // lookup fingerprint in the identity array
-  while (current_pos < end_pos) {
-    np_dhkey_t keystore_member = {0};
-    memcpy(&keystore_member, current_pos, NP_FINGERPRINT_BYTES);
-
-    if (0 == memcmp(&keystore_member, &fingerprint, NP_FINGERPRINT_BYTES)) {
-      // found the fingeprint, open its file and load the token into the core
-      // library
-      memcpy(&subkey_id, &keystore_member, sizeof(uint64_t));
-      crypto_kdf_derive_from_key(subkey,
-                                 (size_t)NP_FINGERPRINT_BYTES,
-                                 subkey_id,
-                                 (char *)__keystore.keystore_id,
-                                 __keystore._passphrase);
-
-      ret = np_identity_load_token(context,
-                                   __keystore._dirname,
-                                   *(np_id *)&keystore_member,
-                                   subkey,
-                                   identity);
-      break;
-    }
-
-    current_pos += NP_FINGERPRINT_BYTES;
-  }
-
-__np_catch:
-  __munmap_keystore_file(0);
-
-__np_finally: // noop line, syntactic sugar
-  np_spinlock_unlock(&__keystore.lock);
-
-  return ret;
+  if (np_ok != __keystore_token(fingerprint, identity))
+    return np_invalid_operation;
+  return np_ok;
 }
 
 enum np_return np_keystore_load_identities(np_context *context,
                                            np_id       keystore_id) {
   assert(context != NULL);
 
-  enum np_return ret = np_invalid_operation;
-
-  // __np_try: // noop line, syntactic sugar
+  // the record offsets of the index are collected under the lock, records and
+  // tokens are read from a duplicate of the log outside of it
+  uint32_t  count   = 0;
+  uint64_t *records = NULL;
+  int       log_fd  = -1;
 
   np_spinlock_lock(&__keystore.lock);
-  if (np_ok != __mmap_keystore_file(0)) {
-    goto __np_catch;
-  }
-
-  // calculate size of np_id array and mmap file with new size
-  size_t full_size = __keystore._mmap_size;
-  size_t cbor_size = 8 + crypto_box_NONCEBYTES;
-  size_t data_size = full_size - cbor_size;
-
-  if (full_size == 0) {
-    goto __np_catch;
-  }
-
-  unsigned char _nonce[crypto_box_NONCEBYTES];
-  if (false == np_serializer_read_encrypted(__keystore._mmap_region,
-                                            &full_size,
-                                            _nonce,
-                                            __keystore._mmap_region + cbor_size,
-                                            &data_size)) {
-    log_warn(LOG_WARNING, "could not read/decrypt keystore file");
-    goto __np_catch;
+  // an empty keystore is reported as invalid operation
+  if (__keystore._index != NULL && __keystore._index->live > 0) {
+    records = malloc(__keystore._index->live * sizeof(uint64_t));
+    CHECK_MALLOC(records);
+
+    struct np_keystore_index_slot *slots = __index_slots();
+    for (uint32_t i = 0; i < __keystore._index->capacity &&
+                         count < __keystore._index->live;
+         i++) {
+      if (slots[i].record != NP_KEYSTORE_SLOT_EMPTY &&
+          slots[i].record != NP_KEYSTORE_SLOT_DELETED)
+        records[count++] = slots[i].record - 1;
+    }
+    log_fd = dup(__keystore._log_fd);
   }
+  np_spinlock_unlock(&__keystore.lock);
 
-  uint64_t subkey_id = 0;
-  memcpy(&subkey_id, __keystore.keystore_id, sizeof(uint64_t));
-
-  unsigned char subkey[NP_FINGERPRINT_BYTES];
-  crypto_kdf_derive_from_key(subkey,
-                             (size_t)NP_FINGERPRINT_BYTES,
-                             subkey_id,
-                             (char *)__keystore.keystore_id,
-                             __keystore._passphrase);
-
-  if (0 != crypto_secretbox_open_easy(__keystore._mmap_region + cbor_size +
-                                          crypto_box_MACBYTES,
-                                      __keystore._mmap_region + cbor_size,
-                                      data_size,
-                                      _nonce,
-                                      subkey)) {
-    log_msg(LOG_ERROR, "decryption of np_keystore failed, exiting");
-    goto __np_catch;
-  }
-
-  // delete old content if present
-  if (np_skiplist_size(&__keystore._allowed_identities) > 0) {
-    _np_neuropil_bloom_clear(__keystore._allowed_identities_filter);
-    np_skiplist_destroy(&__keystore._allowed_identities);
-    for (uint16_t x = 0; x < __keystore.identities_size; x++)
-      free(__keystore.identities[x]);
-    free(__keystore.identities);
-    __keystore.identities_size = 0;
-  }
-
-  np_skiplist_init(&__keystore._allowed_identities,
-                   __compare_nptoken_by_fingerprint);
-
-  void *current_pos = __keystore._mmap_region + cbor_size + crypto_box_MACBYTES;
-  void *end_pos     = __keystore._mmap_region + full_size;
-
-  // rebuild the identity array
-  while (current_pos < end_pos) {
-    np_dhkey_t keystore_member = {0};
-    memcpy(&keystore_member, current_pos, NP_FINGERPRINT_BYTES);
-
-    uint16_t pos = __keystore.identities_size;
-    __keystore.identities_size++;
-    __keystore.identities =
-        realloc(__keystore.identities,
-                __keystore.identities_size * sizeof(struct np_token *));
-    CHECK_MALLOC(__keystore.identities);
-
-    __keystore.identities[pos] = calloc(1, sizeof(struct np_token));
-    CHECK_MALLOC(__keystore.identities[pos]);
-
-    memcpy(&subkey_id, &keystore_member, sizeof(uint64_t));
-    crypto_kdf_derive_from_key(subkey,
-                               (size_t)NP_FINGERPRINT_BYTES,
-                               subkey_id,
-                               (char *)__keystore.keystore_id,
-                               __keystore._passphrase);
-    if (np_ok == np_identity_load_token(context,
-                                        __keystore._dirname,
-                                        *(np_id *)&keystore_member,
-                                        subkey,
-                                        __keystore.identities[pos])) {
-      np_skiplist_add(&__keystore._allowed_identities,
-                      __keystore.identities[pos]);
-      _np_neuropil_bloom_add(__keystore._allowed_identities_filter,
-                             keystore_member);
+  if (records == NULL) return np_invalid_operation;
+
+  enum np_return ret = (-1 != log_fd) ? np_ok : np_unknown_error;
+  for (uint32_t i = 0; -1 != log_fd && i < count; i++) {
+    uint8_t         type        = 0;
+    np_id           fingerprint = {0};
+    struct np_token token       = {0};
+    if (!__log_read(log_fd, records[i], &type, &fingerprint) ||
+        np_ok != __keystore_token(fingerprint, &token)) {
+      log_warn(LOG_WARNING, "could not load identity from keystore");
+      ret = np_unknown_error;
     }
-    current_pos += NP_FINGERPRINT_BYTES;
   }
-
-__np_catch:
-  __munmap_keystore_file(0);
-
-__np_finally: // noop line, syntactic sugar
-  np_spinlock_unlock(&__keystore.lock);
+  if (-1 != log_fd) close(log_fd);
+  free(records);
 
   return ret;
 }
@@ -621,18 +988,17 @@ enum np_return np_keystore_store_identity(np_context      *context,
     return np_ok;
 
   // store identity in file
-  uint64_t subkey_id = 0;
-  memcpy(&subkey_id, &identity_fp, sizeof(uint64_t));
   unsigned char subkey[NP_FINGERPRINT_BYTES];
-  crypto_kdf_derive_from_key(subkey,
-                             (size_t)NP_FINGERPRINT_BYTES,
-                             subkey_id,
-                             (char *)__keystore.keystore_id,
-                             __keystore._passphrase);
+
+  np_spinlock_lock(&__keystore.lock);
+  bool initialized = __keystore._index != NULL;
+  if (initialized) __derive_token_key(identity_fp, subkey);
+  np_spinlock_unlock(&__keystore.lock);
+  if (!initialized) goto __np_catch;
 
   // __np_try: // noop line, syntactic sugar
 
-  np_spinlock_lock(&__keystore.lock);
+  // the token file is written and checked without holding the lock
   if (np_ok != np_identity_save_token(__keystore.context,
                                       __keystore._dirname,
                                       subkey,
@@ -667,29 +1033,63 @@ enum np_return np_keystore_store_identity(np_context      *context,
     }
   }
 
-  uint16_t pos = __keystore.identities_size;
-  __keystore.identities_size++;
-  __keystore.identities =
-      realloc(__keystore.identities,
-              __keystore.identities_size * sizeof(struct np_token *));
-  CHECK_MALLOC(__keystore.identities);
+  struct np_token *token = calloc(1, sizeof(struct np_token));
+  CHECK_MALLOC(token);
+  memcpy(token, identity, sizeof(struct np_token));
 
-  __keystore.identities[pos] = calloc(1, sizeof(struct np_token));
-  CHECK_MALLOC(__keystore.identities[pos]);
-
-  memcpy(__keystore.identities[pos], identity, sizeof(struct np_token));
-  if (np_skiplist_add(&__keystore._allowed_identities,
-                      __keystore.identities[pos])) {
-    _np_neuropil_bloom_add(__keystore._allowed_identities_filter,
-                           *(np_dhkey_t *)identity_fp);
-    ret = np_ok;
-    goto __np_finally;
+  np_spinlock_lock(&__keystore.lock);
+  uint64_t record_offset = 0;
+  if (__keystore._index == NULL) {
+    ret = np_invalid_operation;
+  } else if (np_ok == __log_append(NP_KEYSTORE_RECORD_ADD,
+                                   identity_fp,
+                                   &record_offset)) {
+    unsigned char tag[NP_FINGERPRINT_BYTES];
+    __index_tag(identity_fp, tag);
+    // an error means the index could not be grown
+    ret = __index_insert(tag, record_offset);
+    if (np_ok == ret) {
+      __keystore_uncache(identity_fp);
+      np_tree_insert_dhkey(__keystore._identities,
+                           *(np_dhkey_t *)identity_fp,
+                           np_treeval_new_v(token));
+      token = NULL;
+    }
+  } else {
+    ret = np_unknown_error;
   }
+  np_spinlock_unlock(&__keystore.lock);
+  free(token);
+
+  if (np_ok == ret) goto __np_finally;
 
 __np_catch:
   log_warn(LOG_WARNING, "error while storing token in keystore");
 
 __np_finally: // noop line, syntactic sugar
+  sodium_memzero(subkey, NP_FINGERPRINT_BYTES);
+
+  return ret;
+}
+
+enum np_return np_keystore_remove_identity(np_context *context,
+                                           np_id       keystore_id,
+                                           np_id       fingerprint) {
+  assert(context != NULL);
+
+  enum np_return ret = np_invalid_operation;
+
+  np_spinlock_lock(&__keystore.lock);
+  if (__keystore._index != NULL && __index_contains(fingerprint)) {
+    uint64_t record_offset = 0;
+    ret = __log_append(NP_KEYSTORE_RECORD_REMOVE, fingerprint, &record_offset);
+    if (np_ok == ret) {
+      unsigned char tag[NP_FINGERPRINT_BYTES];
+      __index_tag(fingerprint, tag);
+      __index_remove(tag);
+      __keystore_uncache(fingerprint);
+    }
+  }
   np_spinlock_unlock(&__keystore.lock);
 
   return ret;
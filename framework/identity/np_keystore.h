@@ -18,11 +18,13 @@ extern "C" {
  * A keystore holds one or more identities (np_token), that are known to the
  * issuing party. There can be more than one keystore, e.g. you could have one
  * keystore for bootstrap nodes, one for family members and one for business
- * contacts. A keystore is stored in a cbor encrypted file, the filename is
- * prefixed with "np:npks:<hash value>", where hash value is actually the
- * fingerprint of the signature over all known identities. The contents of the
- * file are loaded into memory. When identities are added to the keystore, the
- * file is written directly back to the disk.
+ * contacts. A keystore is stored as an append-only log of individually
+ * encrypted records (".npks.log") plus a mmap'ed hash index (".npks.idx") of
+ * the contained fingerprints. Adding an identity appends a single record and
+ * updates the index, checking an identity is a single index lookup. Identity
+ * tokens are loaded lazily and cached in memory. Removed identities are
+ * dropped from the log by a periodic compaction. A keystore file of the
+ * previous format (".npks") is converted on initialization.
  */
 
 // initialize the npks module with the filename to store/load identities from
@@ -46,6 +48,10 @@ enum np_return np_keystore_load_identity(np_context      *context,
 enum np_return np_keystore_store_identity(np_context      *context,
                                           np_id            keystore_id,
                                           struct np_token *token);
+// remove an identity from the store, the token file itself is not deleted
+enum np_return np_keystore_remove_identity(np_context *context,
+                                           np_id       keystore_id,
+                                           np_id       fingerprint);
 // check whether an identity is contained in the npks store
 enum np_return np_keystore_check_identity(np_context      *context,
                                           np_id            keystore_id,
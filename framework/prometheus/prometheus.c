@@ -6,6 +6,7 @@
 
 #include <inttypes.h>
 #include <pthread.h>
+#include <stdarg.h>
 #include <stdbool.h>
 #include <stdio.h>
 #include <stdlib.h>
@@ -18,25 +19,46 @@ struct prometheus_item_s {
 };
 
 struct prometheus_context_s {
-  pthread_mutex_t     w_lock;
+  pthread_mutex_t     w_lock; // serializes scrapes
   pthread_mutexattr_t w_lock_attr;
+  // protects the metric list, sub metric lists and labels. A scrape only takes
+  // it for a moment, registering a metric never waits for a running scrape.
+  pthread_mutex_t     r_lock;
+  pthread_mutexattr_t r_lock_attr;
 
-  prometheus_item  *metrics;
+  prometheus_item  *metrics; // prepended only, published with release order
   get_time_callback time;
 };
 
 struct prometheus_metric_s {
 
   char                name[255];
-  pthread_mutex_t     rw_lock;
+  pthread_mutex_t     rw_lock; // protects the rollup of the sub metrics
   pthread_mutexattr_t rw_lock_attr;
 
-  float               value;
-  uint64_t            time_ms;
+  // the value of counters and gauges, the sum of observations of histograms.
+  // Only accessed with atomic operations, writers never take a lock.
+  double   value;
+  uint64_t updates; // incremented by each update of a counter
+  uint64_t scraped_updates;
+  uint64_t time_ms; // time of the first scrape which saw an update
+
   prometheus_item    *labels;
   prometheus_context *context;
 
+  // labels rendered as name="value" pairs, rebuilt on the next scrape
+  // after a label has been changed
+  char    *label_str;
+  uint32_t label_str_length;
+  bool     labels_changed;
+
   prometheus_item *sub_metrics;
+  bool             output_disabled; // left out of the exposition
+
+  enum prometheus_metric_types type;
+  double                      *bounds;
+  uint8_t                      bounds_count;
+  uint64_t *buckets; // bounds_count + 1 (+Inf) non cumulative buckets
 };
 
 enum prometheus_sub_metric_type { prometheus_sub_metric_type_time };
@@ -44,7 +66,7 @@ typedef struct prometheus_sub_metric_time_config_s {
 
   uint64_t interval_ms;
   uint64_t last_update;
-  float    last_value;
+  double   last_value;
 
 } prometheus_sub_metric_time_config;
 typedef struct prometheus_sub_metric_s {
@@ -60,6 +82,9 @@ prometheus_context *prometheus_create_context(get_time_callback time) {
   pthread_mutexattr_init(&ret->w_lock_attr);
   pthread_mutexattr_settype(&ret->w_lock_attr, PTHREAD_MUTEX_RECURSIVE);
   pthread_mutex_init(&ret->w_lock, &ret->w_lock_attr);
+  pthread_mutexattr_init(&ret->r_lock_attr);
+  pthread_mutexattr_settype(&ret->r_lock_attr, PTHREAD_MUTEX_RECURSIVE);
+  pthread_mutex_init(&ret->r_lock, &ret->r_lock_attr);
   ret->time = time;
   return ret;
 }
@@ -86,6 +111,9 @@ void prometheus_destroy_metric(prometheus_metric *m) {
 
   pthread_mutexattr_destroy(&m->rw_lock_attr);
   pthread_mutex_destroy(&m->rw_lock);
+  free(m->label_str);
+  free(m->bounds);
+  free(m->buckets);
   free(m);
 }
 void prometheus_destroy_sub_metric(prometheus_sub_metric *sm) { free(sm); }
@@ -103,6 +131,8 @@ void prometheus_destroy_context(prometheus_context *c) {
 
   pthread_mutexattr_destroy(&c->w_lock_attr);
   pthread_mutex_destroy(&c->w_lock);
+  pthread_mutexattr_destroy(&c->r_lock_attr);
+  pthread_mutex_destroy(&c->r_lock);
   free(c);
 }
 
@@ -117,22 +147,42 @@ prometheus_metric *prometheus_register_metric(prometheus_context *c,
   pthread_mutex_init(&ret->rw_lock, &ret->rw_lock_attr);
 
   prometheus_item *n_item = calloc(1, sizeof(prometheus_item));
-  if (pthread_mutex_lock(&c->w_lock) == 0) {
+  if (pthread_mutex_lock(&c->r_lock) == 0) {
     n_item->next = c->metrics;
     n_item->data = ret;
-    c->metrics   = n_item;
-    pthread_mutex_unlock(&c->w_lock);
+    __atomic_store_n(&c->metrics, n_item, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&c->r_lock);
   }
 
   return ret;
 }
 
+prometheus_metric *prometheus_register_gauge(prometheus_context *c,
+                                             char                name[255]) {
+  prometheus_metric *ret = prometheus_register_metric(c, name);
+  ret->type              = prometheus_metric_type_gauge;
+  return ret;
+}
+
+prometheus_metric *prometheus_register_histogram(prometheus_context *c,
+                                                 char          name[255],
+                                                 const double *bounds,
+                                                 uint8_t       bounds_count) {
+  prometheus_metric *ret = prometheus_register_metric(c, name);
+  ret->bounds            = calloc(bounds_count, sizeof(double));
+  ret->buckets           = calloc(bounds_count + 1, sizeof(uint64_t));
+  memcpy(ret->bounds, bounds, bounds_count * sizeof(double));
+  ret->bounds_count = bounds_count;
+  ret->type         = prometheus_metric_type_histogram;
+  return ret;
+}
+
 prometheus_metric *prometheus_register_sub_metric_time(prometheus_metric *base,
                                                        uint16_t interval_sec) {
   prometheus_sub_metric *ret = calloc(1, sizeof(prometheus_sub_metric));
   ret->type                  = prometheus_sub_metric_type_time;
   ret->time.interval_ms      = interval_sec * (uint64_t)1000;
-  ret->time.last_value       = base->value;
+  __atomic_load(&base->value, &ret->time.last_value, __ATOMIC_RELAXED);
 
   char new_name[255];
   snprintf(new_name, 255, "%s_per_secs", base->name);
@@ -151,22 +201,26 @@ prometheus_metric *prometheus_register_sub_metric_time(prometheus_metric *base,
   }
 
   prometheus_item *n_item = calloc(1, sizeof(prometheus_item));
-  n_item->next            = base->sub_metrics;
-  n_item->data            = ret;
-  base->sub_metrics       = n_item;
+  if (pthread_mutex_lock(&base->context->r_lock) == 0) {
+    n_item->next = base->sub_metrics;
+    n_item->data = ret;
+    __atomic_store_n(&base->sub_metrics, n_item, __ATOMIC_RELEASE);
+    pthread_mutex_unlock(&base->context->r_lock);
+  }
 
   return ret->self;
 }
 
 void prometheus_metric_add_label(prometheus_metric *self,
                                  prometheus_label   label) {
-  if (pthread_mutex_lock(&self->context->w_lock) == 0) {
+  if (pthread_mutex_lock(&self->context->r_lock) == 0) {
 
     prometheus_item *n_item = calloc(1, sizeof(prometheus_item));
     n_item->next            = self->labels;
     n_item->data            = calloc(1, sizeof(prometheus_label));
     memcpy(n_item->data, &label, sizeof(prometheus_label));
     self->labels = n_item;
+    __atomic_store_n(&self->labels_changed, true, __ATOMIC_RELEASE);
 
     prometheus_item *sub_metric_iterator = self->sub_metrics;
     while (sub_metric_iterator != NULL) {
@@ -175,12 +229,12 @@ void prometheus_metric_add_label(prometheus_metric *self,
           label);
       sub_metric_iterator = sub_metric_iterator->next;
     }
-    pthread_mutex_unlock(&self->context->w_lock);
+    pthread_mutex_unlock(&self->context->r_lock);
   }
 }
 void prometheus_metric_replace_label(prometheus_metric *self,
                                      prometheus_label   label) {
-  if (pthread_mutex_lock(&self->context->w_lock) == 0) {
+  if (pthread_mutex_lock(&self->context->r_lock) == 0) {
     bool             replaced = false;
     prometheus_item *n_item   = self->labels;
     while (n_item != NULL) {
@@ -194,6 +248,8 @@ void prometheus_metric_replace_label(prometheus_metric *self,
     if (!replaced) {
       prometheus_metric_add_label(self, label);
     } else {
+      __atomic_store_n(&self->labels_changed, true, __ATOMIC_RELEASE);
+
       prometheus_item *sub_metric_iterator = self->sub_metrics;
       while (sub_metric_iterator != NULL) {
         prometheus_metric_replace_label(
@@ -202,27 +258,65 @@ void prometheus_metric_replace_label(prometheus_metric *self,
         sub_metric_iterator = sub_metric_iterator->next;
       }
     }
-    pthread_mutex_unlock(&self->context->w_lock);
+    pthread_mutex_unlock(&self->context->r_lock);
   }
 }
 
-void __prometheus_metric_update_sub_metrics(prometheus_metric *self,
-                                            uint64_t           now) {
-  prometheus_item *n_item = self->sub_metrics;
+void prometheus_disable_value_output(prometheus_metric *self) {
+  __atomic_store_n(&self->output_disabled, true, __ATOMIC_RELEASE);
+}
+
+void prometheus_enable_value_output(prometheus_metric *self) {
+  __atomic_store_n(&self->output_disabled, false, __ATOMIC_RELEASE);
+}
+
+void prometheus_metric_reset(prometheus_metric *self) {
+  double zero = 0.0;
+  __atomic_store(&self->value, &zero, __ATOMIC_RELAXED);
+  for (uint16_t i = 0; self->buckets != NULL && i <= self->bounds_count; i++)
+    __atomic_store_n(&self->buckets[i], 0, __ATOMIC_RELAXED);
+}
+
+static double __prometheus_atomic_get(double *source) {
+  double ret;
+  __atomic_load(source, &ret, __ATOMIC_RELAXED);
+  return ret;
+}
+
+static void __prometheus_atomic_add(double *target, double value) {
+  double old_value, new_value;
+  __atomic_load(target, &old_value, __ATOMIC_RELAXED);
+  do {
+    new_value = old_value + value;
+  } while (!__atomic_compare_exchange(target,
+                                      &old_value,
+                                      &new_value,
+                                      true,
+                                      __ATOMIC_RELAXED,
+                                      __ATOMIC_RELAXED));
+}
+
+// the rate of the sub metrics is calculated when the metrics are read, the
+// caller has to hold the rw_lock of the metric
+static void __prometheus_metric_update_sub_metrics(prometheus_metric *self,
+                                                   uint64_t           now) {
+  prometheus_item *n_item =
+      __atomic_load_n(&self->sub_metrics, __ATOMIC_ACQUIRE);
   while (n_item != NULL) {
     prometheus_sub_metric *sub_metric = n_item->data;
     if (sub_metric->type == prometheus_sub_metric_type_time &&
         self->context->time != NULL) {
       if ((sub_metric->time.last_update + sub_metric->time.interval_ms) <=
           now) {
-        float value_diff = self->value - sub_metric->time.last_value;
-        float timeframe  = now - sub_metric->time.last_update;
-        float per_interval_avg =
+        double value      = __prometheus_atomic_get(&self->value);
+        double value_diff = value - sub_metric->time.last_value;
+        double timeframe  = now - sub_metric->time.last_update;
+        double per_interval_avg =
             value_diff / (timeframe / (sub_metric->time.interval_ms));
 
         prometheus_metric_set(sub_metric->self, per_interval_avg);
         sub_metric->time.last_update = now;
-        sub_metric->time.last_value  = self->value;
+        sub_metric->time.last_value  = value;
       }
     }
     n_item = n_item->next;
@@ -230,118 +324,275 @@ void __prometheus_metric_update_sub_metrics(prometheus_metric *self,
 }
 
 void prometheus_metric_inc(prometheus_metric *self, float value) {
-  if (pthread_mutex_lock(&self->rw_lock) == 0) {
-    self->value += value;
-    if (self->context->time != NULL) {
-      self->time_ms = self->context->time();
-    }
-    __prometheus_metric_update_sub_metrics(self, self->time_ms);
-    pthread_mutex_unlock(&self->rw_lock);
-  }
+  __prometheus_atomic_add(&self->value, value);
+  __atomic_fetch_add(&self->updates, 1, __ATOMIC_RELAXED);
 }
 
 void prometheus_metric_set(prometheus_metric *self, float value) {
-  if (pthread_mutex_lock(&self->rw_lock) == 0) {
-    self->value = value;
-    if (self->context->time != NULL) {
-      self->time_ms = self->context->time();
-    }
-    __prometheus_metric_update_sub_metrics(self, self->time_ms);
-    pthread_mutex_unlock(&self->rw_lock);
-  }
+  double new_value = value;
+  __atomic_store(&self->value, &new_value, __ATOMIC_RELAXED);
+  __atomic_fetch_add(&self->updates, 1, __ATOMIC_RELAXED);
 }
 
 float prometheus_metric_get(prometheus_metric *self) {
-  float ret = 0;
-  if (pthread_mutex_lock(&self->rw_lock) == 0) {
+  if (self->sub_metrics != NULL && self->context->time != NULL &&
+      pthread_mutex_lock(&self->rw_lock) == 0) {
     __prometheus_metric_update_sub_metrics(self, self->context->time());
-    ret = self->value;
     pthread_mutex_unlock(&self->rw_lock);
   }
-  return ret;
+  return __prometheus_atomic_get(&self->value);
 }
 
-char *prometheus_format(prometheus_context *c) {
-  char *ret = NULL;
-  if (pthread_mutex_lock(&c->w_lock) == 0) {
+void prometheus_gauge_set(prometheus_metric *self, double value) {
+  __atomic_store(&self->value, &value, __ATOMIC_RELAXED);
+}
 
-    /*
-        Format:
-        metric_name[{label_name="label_value",...}] metric_value [timestamp]
-    */
-    // Calculate size of return string
-    uint32_t           size = 1; /*NULL TERMINATOR*/
-    prometheus_item   *metric_iterator, *label_iterator;
-    prometheus_metric *metric;
-    prometheus_label  *label;
-    metric_iterator = c->metrics;
+void prometheus_gauge_inc(prometheus_metric *self, double value) {
+  __prometheus_atomic_add(&self->value, value);
+}
 
-    while (metric_iterator != NULL) {
-      metric = (prometheus_metric *)metric_iterator->data;
+double prometheus_gauge_get(prometheus_metric *self) {
+  return __prometheus_atomic_get(&self->value);
+}
 
-      size += strnlen(metric->name, 255);
-      size += 21; // value size + space
+void prometheus_histogram_observe(prometheus_metric *self, double value) {
+  uint8_t bucket = 0;
+  while (bucket < self->bounds_count && value > self->bounds[bucket])
+    bucket++;
 
-      if (metric->time_ms != 0) size += 14; // timestamp size
+  __atomic_fetch_add(&self->buckets[bucket], 1, __ATOMIC_RELAXED);
+  __prometheus_atomic_add(&self->value, value);
+}
 
-      label_iterator = metric->labels;
-      if (label_iterator != NULL) {
-        size += 2; // {}
-      }
-      while (label_iterator != NULL) {
-        label = (prometheus_label *)label_iterator->data;
+typedef struct prometheus_buffer_s {
+  char  *data;
+  size_t size;
+  size_t length;
+  bool   failed; // set once growing the buffer failed, all writes are skipped
+} prometheus_buffer;
+
+// grows the buffer to hold add more bytes and the terminating zero. The old
+// memory is kept if it cannot be grown.
+static bool __prometheus_buffer_reserve(prometheus_buffer *buffer,
+                                        size_t             add) {
+  if (buffer->failed) return false;
+  if (buffer->length + add + 1 <= buffer->size) return true;
+
+  size_t size = buffer->size > 0 ? buffer->size : 4096;
+  while (size < buffer->length + add + 1)
+    size *= 2;
+  char *data = realloc(buffer->data, size);
+  if (data == NULL) {
+    buffer->failed = true;
+    return false;
+  }
+  buffer->data = data;
+  buffer->size = size;
+  return true;
+}
+
+static void __prometheus_buffer_append(prometheus_buffer *buffer,
+                                       const char        *data,
+                                       size_t             length) {
+  if (!__prometheus_buffer_reserve(buffer, length)) return;
+  memcpy(buffer->data + buffer->length, data, length);
+  buffer->length += length;
+}
+
+static void
+__prometheus_buffer_printf(prometheus_buffer *buffer, const char *format, ...) {
+  va_list args;
+  if (!__prometheus_buffer_reserve(buffer, 64)) return;
+
+  va_start(args, format);
+  int length = vsnprintf(buffer->data + buffer->length,
+                         buffer->size - buffer->length,
+                         format,
+                         args);
+  va_end(args);
+
+  if (length >= 0 && (size_t)length >= buffer->size - buffer->length) {
+    if (!__prometheus_buffer_reserve(buffer, length)) return;
+    va_start(args, format);
+    vsnprintf(buffer->data + buffer->length,
+              buffer->size - buffer->length,
+              format,
+              args);
+    va_end(args);
+  }
+  if (length > 0) buffer->length += length;
+}
+
+// integral values are rendered without the printf machinery
+static void __prometheus_buffer_append_value(prometheus_buffer *buffer,
+                                             double             value) {
+  if (value > -1e15 && value < 1e15 && value == (double)(int64_t)value) {
+    char     digits[24];
+    uint8_t  pos       = sizeof(digits);
+    int64_t  integral  = (int64_t)value;
+    uint64_t magnitude = integral < 0 ? -integral : integral;
+    do {
+      digits[--pos] = '0' + magnitude % 10;
+      magnitude /= 10;
+    } while (magnitude > 0);
+    if (integral < 0) digits[--pos] = '-';
+    digits[--pos] = ' ';
+    __prometheus_buffer_append(buffer, digits + pos, sizeof(digits) - pos);
+  } else {
+    __prometheus_buffer_printf(buffer, " %.9g", value);
+  }
+}
+
+// the caller has to hold the r_lock of the context
+static void __prometheus_render_labels(prometheus_metric *metric) {
+  prometheus_buffer label_str = {0};
 
-        size += strnlen(label->name, 255);
-        size += 3; // =""
-        size += strnlen(label->value, 255);
+  prometheus_item *label_iterator = metric->labels;
+  while (label_iterator != NULL) {
+    prometheus_label *label = (prometheus_label *)label_iterator->data;
+
+    __prometheus_buffer_printf(&label_str,
+                               "%s%s=\"%s\"",
+                               label_str.length > 0 ? "," : "",
+                               label->name,
+                               label->value);
+    label_iterator = label_iterator->next;
+  }
+  // the previous labels are kept and rendered again by the next scrape
+  if (label_str.failed) {
+    free(label_str.data);
+    return;
+  }
+  free(metric->label_str);
+  metric->label_str        = label_str.data;
+  metric->label_str_length = label_str.length;
+  metric->labels_changed   = false;
+}
 
-        label_iterator = label_iterator->next;
-        if (label_iterator != NULL) size += 1; // ,
+static void __prometheus_format_series(prometheus_buffer *buffer,
+                                       prometheus_metric *metric,
+                                       const char        *suffix,
+                                       const char        *le) {
+  __prometheus_buffer_append(buffer, metric->name, strnlen(metric->name, 255));
+  if (suffix != NULL)
+    __prometheus_buffer_append(buffer, suffix, strlen(suffix));
+
+  if (metric->label_str_length == 0 && le == NULL) return;
+
+  __prometheus_buffer_append(buffer, "{", 1);
+  if (metric->label_str_length > 0)
+    __prometheus_buffer_append(buffer,
+                               metric->label_str,
+                               metric->label_str_length);
+  if (le != NULL)
+    __prometheus_buffer_printf(buffer,
+                               "%sle=\"%s\"",
+                               metric->label_str_length > 0 ? "," : "",
+                               le);
+  __prometheus_buffer_append(buffer, "}", 1);
+}
+
+static void __prometheus_format_histogram(prometheus_buffer *buffer,
+                                          prometheus_metric *metric) {
+  uint64_t cumulative = 0;
+  char     le[24];
+
+  for (uint16_t i = 0; i <= metric->bounds_count; i++) {
+    cumulative += __atomic_load_n(&metric->buckets[i], __ATOMIC_RELAXED);
+    if (i < metric->bounds_count) snprintf(le, 24, "%.9g", metric->bounds[i]);
+    else snprintf(le, 24, "%s", "+Inf");
+
+    __prometheus_format_series(buffer, metric, "_bucket", le);
+    __prometheus_buffer_append_value(buffer, cumulative);
+    __prometheus_buffer_append(buffer, "\n", 1);
+  }
+  __prometheus_format_series(buffer, metric, "_sum", NULL);
+  __prometheus_buffer_append_value(buffer,
+                                   __prometheus_atomic_get(&metric->value));
+  __prometheus_buffer_append(buffer, "\n", 1);
+  __prometheus_format_series(buffer, metric, "_count", NULL);
+  __prometheus_buffer_append_value(buffer, cumulative);
+  __prometheus_buffer_append(buffer, "\n", 1);
+}
+
+size_t prometheus_format_into(prometheus_context *c,
+                              char              **buffer,
+                              size_t             *buffer_size) {
+  prometheus_buffer ret = {.data = *buffer, .size = *buffer_size};
+
+  if (pthread_mutex_lock(&c->w_lock) == 0) {
+    /*
+        Format:
+        metric_name[{label_name="label_value",...}] metric_value [timestamp]
+    */
+    uint64_t         now = c->time != NULL ? c->time() : 0;
+    prometheus_item *metric_iterator;
+
+    // metrics registered while the scrape runs are part of the next scrape
+    prometheus_item *metrics = __atomic_load_n(&c->metrics, __ATOMIC_ACQUIRE);
+
+    // roll up the sub metrics first, they are listed before their base metric
+    metric_iterator = metrics;
+    while (metric_iterator != NULL) {
+      prometheus_metric *metric = (prometheus_metric *)metric_iterator->data;
+      if (__atomic_load_n(&metric->sub_metrics, __ATOMIC_RELAXED) != NULL &&
+          pthread_mutex_lock(&metric->rw_lock) == 0) {
+        __prometheus_metric_update_sub_metrics(metric, now);
+        pthread_mutex_unlock(&metric->rw_lock);
       }
-      size += 1; // newline
       metric_iterator = metric_iterator->next;
     }
-    ret                  = malloc(size);
-    uint32_t ret_pointer = 0;
-
-    metric_iterator = c->metrics;
 
+    metric_iterator = metrics;
     while (metric_iterator != NULL) {
-      metric = (prometheus_metric *)metric_iterator->data;
+      prometheus_metric *metric = (prometheus_metric *)metric_iterator->data;
+      metric_iterator           = metric_iterator->next;
 
-      ret_pointer += sprintf(ret + ret_pointer, "%s", metric->name);
+      if (__atomic_load_n(&metric->output_disabled, __ATOMIC_ACQUIRE)) continue;
 
-      label_iterator = metric->labels;
-      bool has_label = label_iterator != NULL;
-      if (has_label) {
-        ret_pointer += sprintf(ret + ret_pointer, "%c", '{');
+      if (__atomic_load_n(&metric->labels_changed, __ATOMIC_ACQUIRE) &&
+          pthread_mutex_lock(&c->r_lock) == 0) {
+        __prometheus_render_labels(metric);
+        pthread_mutex_unlock(&c->r_lock);
       }
-      while (label_iterator != NULL) {
-        label = (prometheus_label *)label_iterator->data;
-
-        ret_pointer +=
-            sprintf(ret + ret_pointer, "%s=\"%s\"", label->name, label->value);
 
-        label_iterator = label_iterator->next;
-        if (label_iterator != NULL)
-          ret_pointer += sprintf(ret + ret_pointer, "%c", ',');
-      }
-      if (has_label) {
-        ret_pointer += sprintf(ret + ret_pointer, "%s", "}");
+      if (metric->type == prometheus_metric_type_histogram) {
+        __prometheus_format_histogram(&ret, metric);
+        continue;
       }
 
-      pthread_mutex_lock(&metric->rw_lock);
-      ret_pointer += sprintf(ret + ret_pointer, " %f", metric->value);
-      if (metric->time_ms != 0)
-        ret_pointer += sprintf(ret + ret_pointer, " %" PRIu64, metric->time_ms);
-      pthread_mutex_unlock(&metric->rw_lock);
-
-      ret_pointer += sprintf(ret + ret_pointer, "%c", '\n');
-      metric_iterator = metric_iterator->next;
+      __prometheus_format_series(&ret, metric, NULL, NULL);
+      __prometheus_buffer_append_value(&ret,
+                                       __prometheus_atomic_get(&metric->value));
+
+      if (metric->type == prometheus_metric_type_counter) {
+        // the timestamp is taken by the first scrape after an update
+        uint64_t updates =
+            __atomic_load_n(&metric->updates, __ATOMIC_RELAXED);
+        if (updates != metric->scraped_updates) {
+          metric->scraped_updates = updates;
+          metric->time_ms         = now;
+        }
+        if (metric->time_ms != 0)
+          __prometheus_buffer_printf(&ret, " %" PRIu64, metric->time_ms);
+      }
+      __prometheus_buffer_append(&ret, "\n", 1);
     }
-    ret[size - 1] = 0; // for sanity
     pthread_mutex_unlock(&c->w_lock);
   }
 
+  // a truncated exposition is not handed out, the buffer itself is kept
+  if (!__prometheus_buffer_reserve(&ret, 0)) ret.length = 0;
+  if (ret.data != NULL) ret.data[ret.length] = '\0';
+
+  *buffer      = ret.data;
+  *buffer_size = ret.size;
+  return ret.length;
+}
+
+char *prometheus_format(prometheus_context *c) {
+  char  *ret  = NULL;
+  size_t size = 0;
+  prometheus_format_into(c, &ret, &size);
   return ret;
 }
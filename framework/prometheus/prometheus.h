@@ -5,12 +5,17 @@
 #ifndef _NP_PROMETHEUS_H_
 #define _NP_PROMETHEUS_H_
 
+#include <stddef.h>
 #include <stdint.h>
 
 #ifdef __cplusplus
 extern "C" {
 #endif
-enum prometheus_metric_types { prometheus_metric_type_counter };
+enum prometheus_metric_types {
+  prometheus_metric_type_counter,
+  prometheus_metric_type_gauge,
+  prometheus_metric_type_histogram,
+};
 typedef struct prometheus_context_s prometheus_context;
 typedef struct prometheus_metric_s  prometheus_metric;
 typedef struct prometheus_label_s {
@@ -26,6 +31,23 @@ void                prometheus_destroy_context(prometheus_context *c);
 prometheus_metric *prometheus_register_metric(prometheus_context *c,
                                               char                name[255]);
 
+/*
+ * all metrics are updated with atomic operations only and never take a lock,
+ * which makes them suitable for hot code paths. Sub metrics (rates) and the
+ * timestamps of counters are calculated when the metrics are scraped.
+ * Gauges and histograms do not support sub metrics and are exported without
+ * a timestamp. A histogram
+ * counts each observation into the first bucket whose upper bound is greater
+ * or equal to the value, the export adds the cumulative "_bucket" series
+ * (including le="+Inf") as well as "_sum" and "_count".
+ */
+prometheus_metric *prometheus_register_gauge(prometheus_context *c,
+                                             char                name[255]);
+prometheus_metric *prometheus_register_histogram(prometheus_context *c,
+                                                 char          name[255],
+                                                 const double *bounds,
+                                                 uint8_t       bounds_count);
+
 prometheus_metric *prometheus_register_sub_metric_time(prometheus_metric *main,
                                                        uint16_t interval_sec);
 
@@ -38,8 +60,26 @@ void prometheus_metric_inc(prometheus_metric *self, float value);
 
 void  prometheus_metric_set(prometheus_metric *self, float value);
 float prometheus_metric_get(prometheus_metric *self);
+
+void   prometheus_gauge_set(prometheus_metric *self, double value);
+void   prometheus_gauge_inc(prometheus_metric *self, double value);
+double prometheus_gauge_get(prometheus_metric *self);
+void   prometheus_histogram_observe(prometheus_metric *self, double value);
+
+// returns the exposition in a new buffer, which has to be freed by the caller
 char *prometheus_format(prometheus_context *self);
-void  prometheus_disable_value_output(prometheus_metric *self);
+// renders the exposition into *buffer, which is (re)allocated as needed and
+// can be reused by the next call. Returns the length of the exposition, or 0
+// if the buffer could not be grown, *buffer is kept in that case.
+size_t prometheus_format_into(prometheus_context *self,
+                              char              **buffer,
+                              size_t             *buffer_size);
+
+// metrics with disabled output are kept, but left out of the exposition
+void prometheus_disable_value_output(prometheus_metric *self);
+void prometheus_enable_value_output(prometheus_metric *self);
+// sets the value of a counter or gauge and all buckets of a histogram to zero
+void prometheus_metric_reset(prometheus_metric *self);
 
 #ifdef __cplusplus
 }
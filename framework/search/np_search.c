@@ -2348,6 +2348,7 @@ void np_search_query(np_context *ac, np_searchquery_t *query) {
   np_message_t *new_query_msg = NULL;
   np_new_obj(np_message_t, new_query_msg, ref_obj_creation);
   strncpy(new_query_msg->uuid, query->result_uuid, NP_UUID_BYTES);
+  _np_uuid_from_str(new_query_msg->uuid, &new_query_msg->uuid_key);
 
   _np_message_create(new_query_msg,
                      pipeline->search_subject,
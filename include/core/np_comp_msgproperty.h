@@ -12,8 +12,10 @@
 
 #include "util/np_bloom.h"
 #include "util/np_event.h"
+#include "util/np_heap.h"
 #include "util/np_list.h"
 #include "util/np_statemachine.h"
+#include "util/np_uuidmap.h"
 
 #include "np_dhkey.h"
 #include "np_memory.h"
@@ -61,6 +63,7 @@ static const char *_NP_MSG_PING_REQUEST     = "_NP.PING.REQUEST";     // 17
 static const char *_NP_MSG_PIGGY_REQUEST    = "_NP.NODES.PIGGY";      // 16
 static const char *_NP_MSG_UPDATE_REQUEST   = "_NP.NODES.UPDATE";     // 17
 static const char *_NP_MSG_PHEROMONE_UPDATE = "_NP.PHEROMONE.UPDATE"; // 21
+static const char *_NP_MSG_CONTROL_BUNDLE   = "_NP.CONTROL.BUNDLE";   // 19
 static const char *_NP_MSG_AVAILABLE_RECEIVER =
     "_NP.MESSAGE.RECEIVER.TOKEN";                                         // 27
 static const char *_NP_MSG_AVAILABLE_SENDER = "_NP.MESSAGE.SENDER.TOKEN"; // 25
@@ -284,6 +287,30 @@ typedef enum np_msg_ack_enum {
                           // processing the message on receiver side
 } NP_API_EXPORT np_msg_ack_type;
 
+/**
+ * precomputed parts of outbound messages for a single subject. The template is
+ * built lazily from the msgproperty and the attribute cache and rebuilt once
+ * either of them changed, new messages copy the prefilled header and
+ * instructions and only patch uuid, timestamp and part counters. The static
+ * header is serialized once and copied into every chunk of a message.
+ */
+typedef struct np_msgproperty_template_s np_msgproperty_template_t;
+struct np_msgproperty_template_s {
+  uint32_t conf_generation;
+  uint32_t attr_generation;
+
+  np_tree_t *header;       // subject
+  np_tree_t *instructions; // ttl, ack, parts, send_counter and seq
+
+  // serialized key/value pairs of header, empty if they do not fit
+  size_t        header_prefix_size;
+  unsigned char header_prefix[MSG_HEADER_PREFIX_SIZE];
+
+  // merged user message attributes
+  size_t          attributes_size;
+  np_attributes_t attributes;
+} NP_API_INTERN;
+
 /**
 .. c:type:: np_msgproperty_conf_t
 
@@ -350,8 +377,28 @@ struct np_msgproperty_conf_s {
   np_dhkey_t subject_dhkey_out; // combination of 'final_subject_dhkey' and
                                 // 'local_tx' // internal only
 
+  // outbound message template, see _np_msgproperty_template_apply
+  uint32_t conf_generation;
+  TSP(np_msgproperty_template_t *, out_template);
 } NP_API_EXPORT;
 
+// a message waiting for its acknowledgement, ordered by redelivery_at
+typedef struct np_redelivery_data_s np_redelivery_data_t;
+typedef np_redelivery_data_t       *np_redelivery_data_ptr;
+NP_BINHEAP_GENERATE_PROTOTYPES(np_redelivery_data_ptr);
+
+/**
+ * bounded ring of cached messages, ordered from the oldest to the newest
+ * message. The capacity follows the cache_size of the msgproperty, adding and
+ * removing at either end is O(1).
+ */
+struct np_msgcache_s {
+  np_message_t **slots;
+  uint16_t       capacity;
+  uint16_t       first; // slot of the oldest message
+  uint16_t       count;
+};
+
 /**
  * runtime section of the np_msgproperty_conf_t structure
  * based on the settings above the following field are required during runtime
@@ -371,7 +418,9 @@ struct np_msgproperty_run_s {
 
   uint32_t msg_threshold; // current threshold size
 
-  np_sll_t(np_message_ptr, msg_cache);
+  struct np_msgcache_s msg_cache;
+  // user supplied hook for messages dropped from the msg_cache
+  np_discard_callback discard_cb;
 
   // callback function(s) to invoke when a message is received
   np_sll_t(np_evt_callback_t, callbacks); // internal neuropil supplied
@@ -383,9 +432,11 @@ struct np_msgproperty_run_s {
 
   uint32_t unique_uuids_max;
 
-  np_tree_t *response_handler;    // handler for ack messages
-  np_tree_t *redelivery_messages; // storage for redelivery of messages
-  np_tree_t *unique_uuids;        // uuid check incoming messages
+  np_uuidmap_t *response_handler;    // handler for ack messages
+  np_uuidmap_t *redelivery_messages; // storage for redelivery of messages
+  // redelivery_messages ordered by their next redelivery time
+  np_pheap_t(np_redelivery_data_ptr, redelivery_schedule);
+  np_uuidmap_t *unique_uuids; // uuid check incoming messages
 
   // a set of attributes for this data channel
   np_attributes_t attributes;
@@ -451,6 +502,54 @@ NP_API_INTERN
 np_msgproperty_run_t *_np_msgproperty_run_get(np_state_t      *context,
                                               np_msg_mode_type mode_type,
                                               np_dhkey_t       subject);
+// true if the msgproperty has more messages in flight than its max_threshold,
+// false if there is no such msgproperty
+NP_API_INTERN
+bool _np_msgproperty_is_threshold_breached(np_state_t      *context,
+                                           np_msg_mode_type mode_type,
+                                           np_dhkey_t       subject);
+
+// copies the outbound template of the msgproperty into header and
+// instructions of msg, the template is (re-)built if it is outdated
+NP_API_INTERN
+void _np_msgproperty_template_apply(np_state_t            *context,
+                                    np_msgproperty_conf_t *self,
+                                    np_message_t          *msg);
+// appends the cached user message attributes to the message body, returns the
+// size of the attributes
+NP_API_INTERN
+size_t _np_msgproperty_template_attributes(np_state_t            *context,
+                                           np_msgproperty_conf_t *self,
+                                           np_tree_t             *body);
+// keeps a reference to msg until it is acknowledged and schedules it for
+// redelivery at redelivery_at
+NP_API_INTERN
+bool _np_msgproperty_redelivery_add(np_state_t           *context,
+                                    np_msgproperty_run_t *self,
+                                    np_message_t         *msg,
+                                    np_dhkey_t            target,
+                                    double                redelivery_at);
+// removes an acknowledged or timed out message, returns false if the uuid is
+// not waiting for redelivery. hop (if not NULL) is set to the first hop the
+// message has been sent to
+NP_API_INTERN
+bool _np_msgproperty_redelivery_remove(np_state_t           *context,
+                                       np_msgproperty_run_t *self,
+                                       const np_uuid_t      *msg_uuid,
+                                       np_dhkey_t           *hop);
+// returns the next message which is due for redelivery at "now" and
+// reschedules it resend_interval later, or NULL if no message is due. The
+// returned message is still owned by the redelivery schedule.
+NP_API_INTERN
+np_message_t *
+_np_msgproperty_redelivery_next(np_state_t           *context,
+                                np_msgproperty_run_t *self,
+                                double                now,
+                                double                resend_interval,
+                                np_dhkey_t           *target);
+// forces a rebuild of the outbound template on the next use
+NP_API_INTERN
+void _np_msgproperty_template_invalidate(np_msgproperty_conf_t *self);
 
 /**
     .. c:function:: void
@@ -503,6 +602,14 @@ void _np_msgproperty_check_msgcache_for(np_util_statemachine_t *statemachine,
 NP_API_INTERN
 void _np_msgproperty_cleanup_cache(np_util_statemachine_t         *statemachine,
                                    NP_UNUSED const np_util_event_t event);
+// the next cached message in the order of the cache_policy (FIFO: oldest,
+// LIFO: newest), NULL if the msg_cache is empty. With take the message is
+// removed and its ref_msgproperty_msgcache reference passes to the caller.
+NP_API_INTERN
+np_message_t *
+_np_msgproperty_msgcache_next(np_msgproperty_conf_t *property_conf,
+                              np_msgproperty_run_t  *property_run,
+                              bool                   take);
 
 /**
  ** check redelivery of already encrypted messages
@@ -551,6 +658,9 @@ np_dhkey_t _np_msgproperty_dhkey(np_msg_mode_type mode_type,
 NP_API_INTERN
 np_dhkey_t _np_msgproperty_tweaked_dhkey(np_msg_mode_type mode_type,
                                          np_dhkey_t       subject_dhkey);
+// the subject dhkey of _FORWARD, generated once by _np_msgproperty_init
+NP_API_INTERN
+np_dhkey_t _np_msgproperty_forward_dhkey();
 
 /**
  ** state machine functions and definitions
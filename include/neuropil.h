@@ -113,6 +113,7 @@ enum np_return {
   np_invalid_argument,
   np_invalid_operation,
   np_startup,
+  np_operation_would_block,
 } NP_CONST_ENUM;
 
 NP_API_EXPORT
@@ -190,6 +191,7 @@ struct np_settings {
   np_log_write_callback log_write_fn;
   size_t                jobqueue_size;
   size_t                max_msgs_per_sec;
+  uint8_t               ingress_shards;
   // ...
 } NP_PACKED(1);
 
@@ -325,8 +327,63 @@ enum np_return np_send_to(np_context          *ac,
                           size_t               length,
                           np_id(*target));
 
+// called once the message does not need the buffer passed to
+// np_send_zerocopy anymore
+typedef void (*np_release_callback)(np_context          *ac,
+                                    const unsigned char *message,
+                                    size_t               length,
+                                    void                *release_arg);
+
+NP_API_EXPORT
+enum np_return np_send_zerocopy(np_context          *ac,
+                                np_subject           subject,
+                                const unsigned char *message,
+                                size_t               length,
+                                np_release_callback  release,
+                                void                *release_arg);
+
+struct np_iovec {
+  const unsigned char *data;
+  size_t               length;
+};
+
+NP_API_EXPORT
+enum np_return np_send_many(np_context            *ac,
+                            np_subject             subject,
+                            const struct np_iovec *messages,
+                            size_t                 count);
+
 typedef bool (*np_receive_callback)(np_context *ac, struct np_message *message);
 
+// a received message without copies, the pointers are only valid during the
+// callback
+struct np_message_view {
+  const char          *uuid;
+  np_id                from;
+  np_subject           subject;
+  double               received_at;
+  const unsigned char *data;
+  size_t               data_length;
+  const unsigned char *attributes;
+  size_t               attributes_length;
+};
+
+typedef bool (*np_receive_view_callback)(np_context                   *ac,
+                                         const struct np_message_view *message);
+
+NP_API_EXPORT
+enum np_return np_add_receive_view_cb(np_context              *ac,
+                                      np_subject               subject,
+                                      np_receive_view_callback callback);
+
+typedef void (*np_discard_callback)(np_context                   *ac,
+                                    const struct np_message_view *message);
+
+NP_API_EXPORT
+enum np_return np_set_mx_discard_cb(np_context         *ac,
+                                    np_subject          subject,
+                                    np_discard_callback callback);
+
 // There can be more than one receive callback, hence "add".
 NP_API_EXPORT
 enum np_return np_add_receive_cb(np_context         *ac,
@@ -439,6 +496,12 @@ value)
 depending on the number of threads this should be sufficient for many use cases.
 High throuput cloud nodes could need larger jobqueues.
 
+.. c:member:: uint8_t ingress_shards
+
+   The number of threads receiving data on a listening port. Each shard has
+its own event loop and ``SO_REUSEPORT`` socket, the kernel keeps the packets of
+a peer on the same shard. The default is 1, values are capped at 16.
+
 
 
 Identity management
@@ -594,12 +657,66 @@ message could be, for instance, encoded using `MessagePack
 <https://msgpack.org/>`_. :param length:   the length of *message* in bytes.
    :return:         :c:data:`np_ok` on success.
 
-   ===============================  ===========================================
-   Status                           Meaning
-   ===============================  ===========================================
-   :c:data:`np_invalid_argument`    *Length* exceeds the maximum message size
-supported by this implementation.
-   ===============================  ===========================================
+   ===================================  =======================================
+   Status                               Meaning
+   ===================================  =======================================
+   :c:data:`np_invalid_argument`        *Length* exceeds the maximum message
+size supported by this implementation.
+   :c:data:`np_operation_would_block`   The send queue towards a peer of the
+subject is full, the message has not been sent. Retry later.
+   ===================================  =======================================
+
+
+.. c:function:: enum np_return np_send_zerocopy(np_context* ac, np_subject
+subject, const uint8_t* message, size_t length, np_release_callback release,
+void* release_arg)
+
+   Sends a message on a given subject without copying *message*. The buffer
+   must not be changed or freed until *release* has been called, which happens
+   once all chunks of the message have been serialized and sent (or the
+   message was dropped).
+
+   :param ac:          a neuropil application context.
+   :param subject:     the subject to send on.
+   :param message:     a pointer to a buffer containing the message to be sent.
+   :param length:      the length of *message* in bytes.
+   :param release:     a :c:type:`np_release_callback` that hands back the
+buffer. :param release_arg: passed to *release* unchanged.
+   :return:            :c:data:`np_ok` on success.
+
+   ===================================  =======================================
+   Status                               Meaning
+   ===================================  =======================================
+   :c:data:`np_invalid_argument`        *Subject* or *release* is NULL.
+   :c:data:`np_invalid_operation`       The subject is virtual. *release*
+will not be called.
+   :c:data:`np_operation_would_block`   The send queue towards a peer of the
+subject is full. *release* will not be called.
+   ===================================  =======================================
+
+
+.. c:function:: enum np_return np_send_many(np_context* ac, np_subject subject,
+const struct np_iovec* messages, size_t count)
+
+   Sends several messages on a given subject. Compared to calling
+   :c:func:`np_send` for each message, the subject and its attributes are only
+   looked up once and the messages are handed over to the job queue in batches.
+
+   :param ac:       a neuropil application context.
+   :param subject:  the subject to send on.
+   :param messages: an array of *count* buffers (pointer and length) to be sent.
+   :param count:    the number of messages.
+   :return:         :c:data:`np_ok` on success.
+
+   ===================================  =======================================
+   Status                               Meaning
+   ===================================  =======================================
+   :c:data:`np_invalid_argument`        *Subject* or *messages* is NULL.
+   :c:data:`np_invalid_operation`       The subject is virtual or the job queue
+rejected a batch, remaining messages have not been sent.
+   :c:data:`np_operation_would_block`   The send queue towards a peer of the
+subject is full, no message has been sent.
+   ===================================  =======================================
 
 
 .. c:function:: enum np_return np_add_receive_cb(np_context* ac, np_subject
@@ -623,6 +740,35 @@ supported by the implementation for the given subject is exceeded.
    ===============================  ===========================================
 
 
+.. c:function:: enum np_return np_add_receive_view_cb(np_context* ac,
+np_subject subject, np_receive_view_callback callback)
+
+   Like :c:func:`np_add_receive_cb`, but the callback receives a
+   :c:type:`np_message_view` whose data and attributes point into the memory
+   of the received message instead of being copied. The view is only valid
+   until the callback returns.
+
+   :param ac:        a neuropil application context.
+   :param subject:   the subject to receive on.
+   :param callback:  a pointer to a function of type
+:c:type:`np_receive_view_callback`. :return: :c:data:`np_ok` on success.
+
+.. c:function:: enum np_return np_set_mx_discard_cb(np_context* ac, np_subject
+subject, np_discard_callback callback)
+
+   Sets a callback which is invoked for every message that is dropped from the
+   message cache of a subject, either because the cache overflowed or because
+   the message expired before a peer became available. Outbound messages carry
+   their data, inbound messages are still encrypted and only report uuid,
+   sender and subject. Pass :c:data:`NULL` to remove the callback. The subject
+   has to be set up by :c:func:`np_set_mx_properties` or a callback before.
+
+   :param ac:        a neuropil application context.
+   :param subject:   the subject of the message cache.
+   :param callback:  a pointer to a function of type
+:c:type:`np_discard_callback`. :return: :c:data:`np_ok` on success,
+:c:data:`np_invalid_operation` if the subject has not been set up.
+
 .. c:function:: bool np_receive_callback(struct np_message *message)
 
    Receive callback function type to be implemented by neuropil applications. A
@@ -23,6 +23,9 @@ void _np_attributes_destroy(np_state_t *context);
 NP_API_PROTEC
 np_attributes_t *_np_get_attributes_cache(np_state_t           *context,
                                           enum np_msg_attr_type cache);
+// changes whenever one of the attribute caches is modified
+NP_API_INTERN
+uint32_t _np_attributes_generation(np_state_t *context);
 NP_API_INTERN
 void _np_policy_set_key(np_bloom_t *bloom, char key[255]);
 NP_API_INTERN
@@ -22,8 +22,36 @@ bool _np_out_callback_wrapper(np_state_t *context, const np_util_event_t event);
 NP_API_INTERN
 bool _np_out_default(np_state_t *context, np_util_event_t event);
 
+// removes the hops which must not receive the message part: its source, this
+// node, hops without a connection and all hops if the part has been sent
+// before. A resend of an own message part is not filtered as sent before.
+NP_API_INTERN
+void _np_axon_filter_hops(np_state_t   *context,
+                          np_message_t *msg,
+                          np_dhkey_t    msg_from,
+                          np_dhkey_t    msg_to,
+                          bool          is_resend,
+                          np_sll_t(np_dhkey_t, hops));
+// the hops of a re-delivery: the target of the original send if it is a
+// neighbour, the first hop of the original send otherwise. If neither is
+// connected anymore the message is routed like a new one.
+NP_API_INTERN
+void _np_axon_redelivery_hops(np_state_t   *context,
+                              np_message_t *msg,
+                              np_dhkey_t    target,
+                              np_sll_t(np_dhkey_t, hops));
+// re-sends an encrypted and chunked message which has not been acknowledged
+NP_API_INTERN
+bool _np_out_redeliver(np_state_t *context, np_util_event_t event);
+
 NP_API_INTERN
 bool _np_out_forward(np_state_t *context, np_util_event_t event);
+// relays a message part for another node right after its transport decryption.
+// Returns false if the message has to take the regular way through the alias.
+NP_API_INTERN
+bool _np_out_forward_cut_through(np_state_t         *context,
+                                 np_event_runtime_t *current_run,
+                                 np_message_t       *forward_msg);
 
 // sends a handshake message to the target node, assumes physical neighbourhood
 NP_API_INTERN
@@ -76,6 +104,18 @@ bool _np_out_authorization_reply(np_state_t     *context,
 NP_API_INTERN
 bool _np_out_accounting_request(np_state_t *context, np_util_event_t msg_event);
 
+// bundling of control messages (piggy, update, pheromone) per next hop
+NP_API_INTERN
+bool _np_bundles_init(np_state_t *context);
+NP_API_INTERN
+void _np_bundles_destroy(np_state_t *context);
+// creates the bundle entry of msg, to and from are left out if they match the
+// hop and this node, see _np_control_bundle_entry_read
+NP_API_INTERN
+np_tree_t *_np_control_bundle_entry_create(np_state_t   *context,
+                                           np_message_t *msg,
+                                           np_dhkey_t    hop);
+
 #ifdef __cplusplus
 }
 #endif
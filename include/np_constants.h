@@ -31,6 +31,8 @@ extern "C" {
 #define ref_route_inroute            "ref_route_inroute"
 #define ref_route_inleafset          "ref_route_inleafset"
 #define ref_msgproperty_msgcache     "ref_msgproperty_msgcache"
+#define ref_msgproperty_redelivery   "ref_msgproperty_redelivery"
+#define ref_control_bundle           "ref_control_bundle"
 #define ref_key_parent               "ref_key_parent"
 #define ref_message_msg_property     "ref_message_msg_property"
 #define ref_ack_obj                  "ref_ack_obj"
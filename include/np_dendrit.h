@@ -18,6 +18,30 @@ extern "C" {
 NP_API_INTERN
 bool _np_in_handshake(np_state_t *context, np_util_event_t msg_event);
 
+// acknowledgements are collected per target node and sent in batches, see
+// NP_ACK_COALESCE_WINDOW_SEC
+NP_API_INTERN
+bool _np_acks_init(np_state_t *context);
+NP_API_INTERN
+void _np_acks_destroy(np_state_t *context);
+
+// encodes the uuids of acknowledged messages into an ack body. The hold times
+// tell the sender how long each ack was held back, pass NULL if it was not.
+NP_API_INTERN
+void _np_ack_encode(np_tree_t *body,
+                    char (*uuids)[NP_UUID_BYTES],
+                    const double *holds,
+                    uint16_t      count);
+// number of acknowledged uuids of an ack body, single or batched
+NP_API_INTERN
+uint32_t _np_ack_count(np_tree_t *body);
+// reads the uuid and hold time at index, returns false if there is none
+NP_API_INTERN
+bool _np_ack_get(np_tree_t *body,
+                 uint32_t   index,
+                 char       uuid[NP_UUID_BYTES],
+                 double    *hold);
+
 NP_API_INTERN
 bool _check_and_send_destination_ack(np_state_t     *context,
                                      np_util_event_t msg_event);
@@ -47,6 +71,16 @@ bool _np_in_available_receiver(np_state_t *context, np_util_event_t msg_event);
 
 NP_API_INTERN
 bool _np_in_pheromone(np_state_t *context, np_util_event_t msg_event);
+// unpacks the control messages of a bundle and dispatches them one by one
+NP_API_INTERN
+bool _np_in_control_bundle(np_state_t *context, np_util_event_t msg_event);
+// restores a message of a bundle entry, to and from default to the fields of
+// the bundle. Returns false if the entry is malformed.
+NP_API_INTERN
+bool _np_control_bundle_entry_read(np_tree_t    *entry,
+                                   np_treeval_t  bundle_to,
+                                   np_treeval_t  bundle_from,
+                                   np_message_t *msg_in);
 
 NP_API_INTERN
 bool _np_in_authenticate(np_state_t *context, np_util_event_t msg_event);
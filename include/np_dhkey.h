@@ -85,6 +85,19 @@ void _np_dhkey_distance(np_dhkey_t             *diff,
                         const np_dhkey_t *const k1,
                         const np_dhkey_t *const k2);
 
+/* key_closest: target, keys, valid, count, min_dif
+ * returns the position of the key in #keys# with the smallest distance to
+ * #target# or #count# if there is none. If #valid# is given, only keys with a
+ * non zero entry are considered. Of equally distant keys the last one wins.
+ * The distance of the closest key is assigned to #min_dif# if not NULL.
+ */
+NP_API_INTERN
+uint32_t _np_dhkey_closest(const np_dhkey_t *const target,
+                           const np_dhkey_t       *keys,
+                           const uint8_t          *valid,
+                           uint32_t                count,
+                           np_dhkey_t             *min_dif);
+
 NP_API_INTERN
 void _np_dhkey_hamming_distance(uint8_t                *diff,
                                 const np_dhkey_t *const x,
@@ -136,6 +149,13 @@ NP_API_INTERN
 void _np_str_dhkey(const char *key_string, np_dhkey_t *k);
 NP_API_INTERN
 np_dhkey_t _np_dhkey_generate_hash(const unsigned char *data, size_t data_size);
+/**
+ * expands a binary uuid to a dhkey without hashing it again. The uuid is
+ * already random, the upper four words are derived from the lower four so
+ * that bloom filters can use all words of the key.
+ */
+NP_API_INTERN
+np_dhkey_t _np_dhkey_from_uuid(const np_uuid_t *uuid);
 #ifdef __cplusplus
 }
 #endif
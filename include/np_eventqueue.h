@@ -7,12 +7,21 @@
 
 #include <stdbool.h>
 
+#include "util/np_event.h"
+
 #include "np_types.h"
 
 #ifdef __cplusplus
 extern "C" {
 #endif
 
+// the events chained to the event that is executed by a runtime
+#define np_event_runtime_max_size 1000
+struct np_event_runtime_s {
+  np_util_event_t  __chained_events[np_event_runtime_max_size];
+  volatile uint8_t __chained_events_size;
+};
+
 NP_API_INTERN
 void __np_event_runtime_add_event(np_state_t         *context,
                                   np_event_runtime_t *runtime,
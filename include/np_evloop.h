@@ -44,6 +44,25 @@ NP_EVENT_EVLOOP_PROTOTYPE(out)
 NP_EVENT_EVLOOP_PROTOTYPE(http)
 NP_EVENT_EVLOOP_PROTOTYPE(file)
 
+/**
+ * ingress shards: additional in loops, each with its own thread, receiving on
+ * their own SO_REUSEPORT socket of a listening network. Shard 0 is the in loop
+ * itself, the functions below map it to the in loop functions.
+ */
+NP_API_INTERN
+uint8_t _np_event_in_shard_count(np_state_t *context);
+NP_API_INTERN
+struct ev_loop *_np_event_get_loop_in_shard(np_state_t *context,
+                                            uint8_t     shard);
+NP_API_INTERN
+void _np_event_suspend_loop_in_shard(np_state_t *context, uint8_t shard);
+NP_API_INTERN
+void _np_event_resume_loop_in_shard(np_state_t *context, uint8_t shard);
+NP_API_INTERN
+void _np_event_reconfigure_loop_in_shard(np_state_t *context, uint8_t shard);
+NP_API_INTERN
+void _np_event_in_shard_run(np_state_t *context, np_thread_t *thread);
+
 NP_API_INTERN
 bool _np_event_init(np_state_t *context);
 
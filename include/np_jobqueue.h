@@ -73,6 +73,13 @@ void np_jobqueue_submit_event_callbacks(np_state_t     *context,
                                         np_util_event_t event,
                                         np_sll_t(np_evt_callback_t, callbacks),
                                         const char *ident);
+// runs callback once with event, user_data is referenced by the job
+NP_API_INTERN
+bool np_jobqueue_submit_event_callback(np_state_t       *context,
+                                       double            delay,
+                                       np_util_event_t   event,
+                                       np_evt_callback_t callback,
+                                       const char       *ident);
 NP_API_INTERN
 void np_jobqueue_submit_event_periodic(np_state_t       *context,
                                        size_t            priority,
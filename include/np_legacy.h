@@ -46,7 +46,7 @@ extern "C" {
 #define NP_CTX_MODULES                                                         \
   route, memory, threads, events, statistics, keycache, http, sysinfo, log,    \
       jobqueue, shutdown, bootstrap, time, msgproperties, pheromones,          \
-      attributes, search, files, network
+      attributes, search, files, network, acks, bundles
 
 /**
 \toggle_keepwhitespaces
@@ -108,8 +108,8 @@ struct np_state_s {
   np_key_t *my_identity;
   char      realm_id[256];
 
-  np_tree_t  *msg_part_cache;
-  np_bloom_t *msg_part_filter;
+  np_msgpart_cache_t *msg_part_cache;
+  np_bloom_t         *msg_part_filter;
 
   TSP(np_bloom_t *, msg_forward_filter);
 
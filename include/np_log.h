@@ -5,10 +5,13 @@
 #ifndef _NP_LOG_INNER_H_
 #define _NP_LOG_INNER_H_
 
+#include <stdarg.h>
+
 #include "stdio.h"
 
 #include "neuropil_log.h"
 
+#include "np_settings.h"
 #include "np_types.h"
 
 /*
@@ -32,6 +35,33 @@
 
 typedef enum np_log_e log_type;
 
+// a log line as written by the producing thread: the format string (which has
+// to be a literal) is not evaluated, all arguments are copied into args
+struct np_log_record {
+  uint64_t      tv_sec;
+  uint32_t      tv_nsec;
+  uint32_t      level;
+  const char   *format;
+  uint16_t      args_length;
+  uint8_t       specs;    // number of conversions packed into args
+  bool          complete; // false if args ran out of space
+  unsigned char args[NP_LOG_RECORD_ARGS_BYTES];
+};
+
+NP_API_INTERN
+void __np_log_pack(struct np_log_record *record, const char *msg, va_list ap);
+
+NP_API_INTERN
+size_t __np_log_unpack(const struct np_log_record *record,
+                       char                       *buffer,
+                       size_t                      buffer_size);
+
+NP_API_INTERN
+size_t __np_log_format_record(np_state_t                 *context,
+                              const struct np_log_record *record,
+                              unsigned long               thread_id,
+                              char                       *line);
+
 NP_API_EXPORT
 bool _np_log_init(np_state_t *context, const char *filename, uint32_t level);
 
@@ -58,9 +88,27 @@ void np_log_message(np_state_t   *context,
     // TODO: add context? __attribute__((__format__ (__printf__, 5,6) ))
     ;
 
+// same as np_log_message, but msg has to be a string literal: only the
+// pointer to the format string is stored together with the packed arguments
+// and the line is formatted later by the log writer
+NP_API_EXPORT
+void _np_log_message_static(np_state_t   *context,
+                            enum np_log_e level,
+                            const char   *srcFile,
+                            const char   *funcName,
+                            uint16_t      lineno,
+                            const char   *msg,
+                            ...);
+
 #ifndef log_msg
 #define log_msg(level, msg, ...)                                               \
-  np_log_message(context, level, __FILE__, FUNC, __LINE__, msg, ##__VA_ARGS__)
+  _np_log_message_static(context,                                              \
+                         level,                                                \
+                         __FILE__,                                             \
+                         FUNC,                                                 \
+                         __LINE__,                                             \
+                         "" msg,                                               \
+                         ##__VA_ARGS__)
 #endif
 
 #ifndef log_info
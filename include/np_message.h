@@ -24,7 +24,8 @@ enum np_message_submit_type {
 };
 
 struct np_message_s {
-  char *uuid;
+  char     *uuid;
+  np_uuid_t uuid_key; // binary form of uuid, used for all lookups
 
   np_tree_t *header;
   np_tree_t *instructions;
@@ -41,13 +42,27 @@ struct np_message_s {
   // np_msgproperty_conf_ptr msg_property;
   double send_at;
   double redelivery_at;
+  // first hop of the last transmission, its pacing is fed by the ack
+  np_dhkey_t hop_dhkey;
 
   void             *bin_body;
   void             *bin_footer;
   np_messagepart_t *bin_static;
 
+  // the serialized subject copied from the outbound template, it is not
+  // serialized again for each chunk
+  uint8_t       header_prefix_size;
+  unsigned char header_prefix[MSG_HEADER_PREFIX_SIZE];
+
   enum np_message_submit_type submit_type;
   np_aaatoken_t              *decryption_token;
+
+  // user payload borrowed by the body (np_send_zerocopy), handed back to the
+  // caller when the message is released
+  np_release_callback  release_cb;
+  const unsigned char *release_data;
+  size_t               release_length;
+  void                *release_arg;
 } NP_API_INTERN;
 
 _NP_GENERATE_MEMORY_PROTOTYPES(np_message_t)
@@ -155,28 +170,36 @@ static const char *_NP_MSG_HEADER_TO      = "_np.to";
 static const char *_NP_MSG_HEADER_FROM    = "_np.from";
 
 // msg instructions constants
-static const char *_NP_MSG_INST_SEND_COUNTER  = "_np.sendnr";
-static const char *_NP_MSG_INST_PARTS         = "_np.parts";
-static const char *_NP_MSG_INST_ACK           = "_np.ack";
-static const char *_NP_MSG_INST_ACK_TO        = "_np.ack_to";
-static const char *_NP_MSG_INST_SEQ           = "_np.seq";
-static const char *_NP_MSG_INST_UUID          = "_np.uuid";
-static const char *_NP_MSG_INST_RESPONSE_UUID = "_np.response_uuid";
-static const char *_NP_MSG_INST_TTL           = "_np.ttl";
-static const char *_NP_MSG_INST_TSTAMP        = "_np.tstamp";
+static const char *_NP_MSG_INST_SEND_COUNTER   = "_np.sendnr";
+static const char *_NP_MSG_INST_PARTS          = "_np.parts";
+static const char *_NP_MSG_INST_ACK            = "_np.ack";
+static const char *_NP_MSG_INST_ACK_TO         = "_np.ack_to";
+static const char *_NP_MSG_INST_SEQ            = "_np.seq";
+static const char *_NP_MSG_INST_UUID           = "_np.uuid";
+static const char *_NP_MSG_INST_RESPONSE_UUID  = "_np.response_uuid";
+static const char *_NP_MSG_INST_RESPONSE_UUIDS = "_np.response_uuids";
+static const char *_NP_MSG_INST_RESPONSE_HOLDS = "_np.response_holds";
+static const char *_NP_MSG_INST_TTL            = "_np.ttl";
+static const char *_NP_MSG_INST_TSTAMP         = "_np.tstamp";
 
 // msg extension constants
 static const char *_NP_MSG_EXTENSIONS_SESSION = "_np.session";
 
 // msg handshake constants
-static const char *NP_HS_PAYLOAD   = "_np.payload";
-static const char *NP_HS_SIGNATURE = "_np.signature";
-static const char *NP_HS_PRIO      = "_np.hs.priority";
+static const char *NP_HS_PAYLOAD      = "_np.payload";
+static const char *NP_HS_SIGNATURE    = "_np.signature";
+static const char *NP_HS_PRIO         = "_np.hs.priority";
+static const char *NP_HS_CAPABILITIES = "_np.hs.capabilities";
 
 // body constants
 static const char *NP_MSG_BODY_TEXT = "_np.text";
 static const char *NP_MSG_BODY_XML  = "_np.xml";
 
+// control bundle constants, keys of a single bundled message
+static const char *NP_MSG_BUNDLE_HEADER       = "_np.b.h";
+static const char *NP_MSG_BUNDLE_INSTRUCTIONS = "_np.b.i";
+static const char *NP_MSG_BUNDLE_BODY         = "_np.b.b";
+
 // msg footer constants
 static const char *NP_MSG_FOOTER_GARBAGE = "_np.garbage";
 
@@ -6,6 +6,7 @@
 #ifndef _NP_MESSAGEPART_H_
 #define _NP_MESSAGEPART_H_
 
+#include "np_dhkey.h"
 #include "np_memory.h"
 #include "np_threads.h"
 #include "np_types.h"
@@ -52,6 +53,37 @@ bool _np_messagepart_encrypt(np_state_t              *context,
 NP_API_INTERN
 void _np_messagepart_trace_info(char *desc, np_messagepart_t *msg_in);
 
+/**
+ * reassembly cache for chunked messages. In-flight messages are spread over
+ * NP_MSG_PART_CACHE_SHARDS independently locked shards. Each entry keeps a
+ * slot array indexed by chunk number and a bitmap of received parts, which
+ * makes duplicate detection and the completion check O(1). Expiry of partial
+ * messages is driven by a timer wheel.
+ */
+NP_API_INTERN
+np_msgpart_cache_t *_np_messagepart_cache_create(np_state_t *context);
+NP_API_INTERN
+void _np_messagepart_cache_destroy(np_state_t         *context,
+                                   np_msgpart_cache_t *cache);
+// adds the (single) part of msg_to_add. returns the reassembled message once
+// the last missing part arrived, the returned message still carries the
+// ref_msgpartcache reference.
+NP_API_INTERN
+np_message_t *_np_messagepart_cache_add(np_state_t         *context,
+                                        np_msgpart_cache_t *cache,
+                                        np_dhkey_t          msg_key,
+                                        np_message_t       *msg_to_add,
+                                        uint16_t            expected_chunks,
+                                        uint16_t           *received_chunks);
+// releases all partial messages which expired up to "now"
+NP_API_INTERN
+void _np_messagepart_cache_expire(np_state_t         *context,
+                                  np_msgpart_cache_t *cache,
+                                  double              now);
+NP_API_INTERN
+uint32_t _np_messagepart_cache_size(np_state_t         *context,
+                                    np_msgpart_cache_t *cache);
+
 NP_API_PROTEC
 char *np_messagepart_printcache(np_state_t *context, bool asOneLine);
 #ifdef __cplusplus
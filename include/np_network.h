@@ -53,6 +53,11 @@ enum socket_type {
   MASK_OPTION    = 0xF00,
 } NP_ENUM;
 
+typedef enum np_network_send_class_e {
+  np_network_send_control = 0,
+  np_network_send_data,
+} np_network_send_class_e;
+
 typedef enum np_network_type_e {
   np_network_type_none   = 0x00,
   np_network_type_server = 0x01,
@@ -77,13 +82,57 @@ struct np_network_s {
 
   double last_send_date;
   double last_received_date;
-  np_sll_t(void_ptr, out_events);
+
+  /**
+   * encrypted chunks waiting for the socket. Control chunks are served before
+   * any data chunk, data chunks are kept per subject ("flow") and served
+   * deficit round robin, so a bulk subject cannot delay the other subjects
+   * towards the same peer. Both classes are bounded. Guarded by the
+   * access_lock.
+   */
+  struct np_network_send_queue_s {
+    void *retry; // chunk the socket could not take, sent next
+    np_sll_t(void_ptr, control);
+    np_tree_t *flows;           // subject dhkey -> flow
+    np_sll_t(void_ptr, active); // flows with pending chunks, round robin order
+    np_tree_t *send_classes;    // subject dhkey -> np_network_send_class_e
+    uint32_t   data_size;
+    np_sll_t(void_ptr, deferred); // chunks rejected by a full queue
+    bool deferred_pending;        // a retry of the deferred chunks is queued
+  } out_queue;
 
   uint32_t seqend;
 
   char ip[CHAR_LENGTH_IP];
   char port[CHAR_LENGTH_PORT];
 
+  /**
+   * congestion control state of the peer behind this network. An AIMD window
+   * (in chunks) is fed by the ack path and turned into a pacing rate, the out
+   * loop then spends tokens from a bucket refilled at that rate. Guarded by
+   * the access_lock.
+   */
+  struct np_network_pacing_s {
+    double cwnd;
+    double ssthresh;
+    double srtt;
+    double rate;
+    double tokens;
+    double refilled_at;
+    double decreased_at;
+  } pacing;
+  ev_timer pacing_timer;
+
+  /**
+   * ingress shards of a listening network. shard_watchers holds one
+   * SO_REUSEPORT socket for each additional shard, the kernel hashes the
+   * flows of the peers onto these sockets. Networks of accepted tcp
+   * connections stay on the shard of the socket that accepted them.
+   */
+  uint8_t shard;
+  uint8_t shard_count;
+  ev_io  *shard_watchers;
+
   np_mutex_t access_lock;
   TSP(bool, can_be_enabled);
 
@@ -138,10 +187,56 @@ bool _np_network_init(np_network_t    *network,
                       int              prepared_socket_fd,
                       enum socket_type passive_socket_type);
 
+// sends one chunk, returns false with *would_block set if the socket could
+// not take the chunk right now
 NP_API_INTERN
 bool _np_network_send_data(np_state_t   *context,
                            np_network_t *network,
-                           void         *data_to_send);
+                           void         *data_to_send,
+                           bool         *would_block);
+// the following functions have to be called with the access_lock of the
+// network held. _np_network_send_class caches the class of a subject in the
+// network. _np_network_enqueue returns np_operation_would_block if the queue
+// of the class is full, the chunk then still belongs to the caller
+NP_API_INTERN
+np_network_send_class_e _np_network_send_class(np_network_t *network,
+                                               np_dhkey_t    subject);
+NP_API_INTERN
+enum np_return _np_network_enqueue(np_network_t           *network,
+                                   void                   *chunk,
+                                   np_network_send_class_e send_class,
+                                   np_dhkey_t              subject);
+NP_API_INTERN
+void *_np_network_dequeue(np_network_t *network);
+NP_API_INTERN
+uint32_t _np_network_queue_size(np_network_t *network);
+// keeps an encrypted chunk that _np_network_enqueue rejected and takes it
+// over. Deferred chunks are moved into the queue by a retry job, chunks of
+// messages expired at expires_at or after NP_NETWORK_SEND_QUEUE_RETRY_MAX
+// attempts are dropped
+NP_API_INTERN
+void _np_network_defer(np_network_t           *network,
+                       void                   *chunk,
+                       np_network_send_class_e send_class,
+                       np_dhkey_t              subject,
+                       double                  expires_at);
+// gives each deferred chunk one attempt, returns true if chunks remain
+NP_API_INTERN
+bool _np_network_retry_deferred(np_network_t *network);
+// true if the data queue of a peer that subject is sent to reached the high
+// watermark and has not yet drained below the low watermark
+NP_API_INTERN
+bool _np_network_is_congested(np_state_t *context, np_dhkey_t subject);
+// feeds the round trip time of an acknowledged message (or a timeout, if
+// lost is true) into the congestion window of the network
+NP_API_INTERN
+void _np_network_pacing_update(np_network_t *network, double rtt, bool lost);
+// grows the congestion window for a chunk that was queued without expecting
+// an acknowledgement, as if it had been acknowledged. Otherwise fire and
+// forget traffic would stay at the initial window. A full socket still halves
+// the window. Has to be called with the access_lock of the network held.
+NP_API_INTERN
+void _np_network_pacing_unacked(np_network_t *network);
 /**
  ** _np_network_append_msg_to_out_queue:
  ** Sends a message to host
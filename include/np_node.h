@@ -33,6 +33,16 @@ static const char *np_node_status_str[] = {
     "Connected",
 };
 
+// optional wire formats a node is able to read, announced in the handshake
+// token. Peers without the flag receive the old message format.
+enum np_node_capability {
+  np_node_capability_none           = 0x00,
+  np_node_capability_ack_batch      = 0x01,
+  np_node_capability_control_bundle = 0x02,
+};
+#define NP_NODE_CAPABILITIES                                                   \
+  (np_node_capability_ack_batch | np_node_capability_control_bundle)
+
 struct np_node_s {
   char            *host_key;
   enum socket_type protocol;
@@ -43,6 +53,7 @@ struct np_node_s {
   enum np_node_status _handshake_status;
   double              handshake_send_at;
   uint32_t            handshake_priority;
+  uint32_t            capabilities;
 
   enum np_node_status _joined_status;
   double              join_send_at;
@@ -133,6 +144,15 @@ uint8_t _np_node_check_address_validity(np_node_t *np_node);
 NP_API_INTERN
 int _np_node_cmp(np_node_t *a, np_node_t *b);
 
+/** _np_node_has_capability
+ ** checks the capabilities the node announced in its handshake, false for
+ ** unknown nodes
+ **/
+NP_API_INTERN
+bool _np_node_has_capability(np_state_t             *context,
+                             np_dhkey_t              node_dhkey,
+                             enum np_node_capability capability);
+
 #ifdef __cplusplus
 }
 #endif
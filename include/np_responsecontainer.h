@@ -17,6 +17,7 @@ extern "C" {
 
 struct np_responsecontainer_s {
   char       uuid[NP_UUID_BYTES];
+  np_uuid_t  uuid_key;   // binary form of uuid, key of the response handler
   np_dhkey_t dest_dhkey; // the destination key / next/final hop of the message
   np_dhkey_t msg_dhkey;  // the message (OUT) dhkey for this response handler
 
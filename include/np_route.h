@@ -55,6 +55,19 @@ NP_API_INTERN
 sll_return(np_key_ptr)
     _np_route_lookup(np_state_t *context, np_dhkey_t key, uint8_t count);
 
+/** _np_route_lookup_batch:
+ ** resolves the next hop of each of the #count# targets in one pass over a
+ ** contiguous copy of leafset and routing table. next_hops[i] is set to the
+ ** same key _np_route_lookup(targets[i], 1) would return or NULL. Found keys
+ ** are referenced with "_np_route_lookup_batch". Returns the number of found
+ ** next hops.
+ **/
+NP_API_INTERN
+uint32_t _np_route_lookup_batch(np_state_t       *context,
+                                const np_dhkey_t *targets,
+                                uint32_t          count,
+                                np_key_t        **next_hops);
+
 /** _np_route_neighbors:
  ** returns an list of neighbor nodes with priority to closer nodes.
  **
@@ -30,8 +30,9 @@ extern "C" {
  *  - CONSOLE_LOG
  *      prints the log in stdout
  *  - NP_BENCHMARKING
- *      if defined enables the performance point macros and sets the size of the
- * asd calucations array
+ *      if defined enables the performance point macros. Durations are recorded
+ *      into lock free per thread histograms, which is cheap enough to keep the
+ *      performance points enabled in release builds as well
  *  - NP_STATISTICS
  *      enables all of the following NP_STATISTICS* switches
  *  - NP_STATISTICS_COUNTER
@@ -49,13 +50,13 @@ extern "C" {
 #define NP_MEMORY_CHECK_MAGIC_NO
 #define NP_MEMORY_CHECK_MEMORY_REFFING 1
 // #define NP_THREADS_CHECK_THREADING 1
-#define NP_BENCHMARKING 1024
 // #define CONSOLE_BACKUP_LOG
 // #define CONSOLE_LOG 1
 #endif // DEBUG
 // #define CATCH_SEGFAULT
 
 #define NP_STATISTICS
+#define NP_BENCHMARKING
 
 #ifdef NP_STATISTICS
 #define DEBUG_CALLBACKS 1
@@ -100,6 +101,23 @@ extern "C" {
 #define NP_STATISTICS_PROMETHEUS_DATA_GATHERING_INTERVAL (NP_PI / 10)
 #endif
 
+/**
+ * upper bounds (in seconds) of the buckets of the per subject / per peer
+ * latency histograms, the +Inf bucket is always added
+ */
+#ifndef NP_STATISTICS_LATENCY_BUCKETS
+#define NP_STATISTICS_LATENCY_BUCKETS                                          \
+  {0.001, 0.0025, 0.005, 0.01, 0.025, 0.05, 0.1, 0.25, 0.5, 1, 2.5, 5, 10}
+#endif
+
+/**
+ * number of subjects and of peers the statistics module tracks metrics for,
+ * has to be a power of two. Further subjects / peers are not exported.
+ */
+#ifndef NP_STATISTICS_METRICS_SLOTS
+#define NP_STATISTICS_METRICS_SLOTS 1024
+#endif
+
 #ifndef NP_LOG_FLUSH_INTERVAL
 #define NP_LOG_FLUSH_INTERVAL (NP_PI / 100)
 #endif
@@ -125,6 +143,14 @@ extern "C" {
 #ifndef MSGPROPERTY_DEFAULT_MIN_TTL_SEC
 #define MSGPROPERTY_DEFAULT_MIN_TTL_SEC (NP_PI_INT) // 3 seconds
 #endif
+// initial and maximum number of unacknowledged messages per subject which are
+// scheduled for redelivery
+#ifndef MSGPROPERTY_REDELIVERY_SCHEDULE_SIZE
+#define MSGPROPERTY_REDELIVERY_SCHEDULE_SIZE (32)
+#endif
+#ifndef MSGPROPERTY_REDELIVERY_SCHEDULE_MAX
+#define MSGPROPERTY_REDELIVERY_SCHEDULE_MAX (INT16_MAX)
+#endif
 
 /*
  *	if the sysinfo subsystem in enabled and the node is a client
@@ -172,6 +198,8 @@ extern "C" {
 #define MSG_CHUNK_SIZE_1024 (1024)
 #define MSG_ENCRYPTION_BYTES_40                                                \
   (crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES)
+// the serialized subject of a message, prepared once per outbound subject
+#define MSG_HEADER_PREFIX_SIZE (64)
 
 #ifndef MISC_LOG_FLUSH_INTERVAL_SEC
 #define MISC_LOG_FLUSH_INTERVAL_SEC (NP_PI / 30)
@@ -182,6 +210,23 @@ extern "C" {
 #ifndef MISC_LOG_FLUSH_AFTER_X_ITEMS
 #define MISC_LOG_FLUSH_AFTER_X_ITEMS (20)
 #endif
+// log records are written into per-thread rings and formatted by the file
+// event loop, see np_log.c
+#ifndef NP_LOG_RING_ENABLE
+#define NP_LOG_RING_ENABLE (1)
+#endif
+#ifndef NP_LOG_RING_RECORDS
+#define NP_LOG_RING_RECORDS (512) // per thread, has to be a power of two
+#endif
+#ifndef NP_LOG_RECORD_ARGS_BYTES
+#define NP_LOG_RECORD_ARGS_BYTES (224)
+#endif
+#ifndef NP_LOG_WRITEV_BATCH
+#define NP_LOG_WRITEV_BATCH (64)
+#endif
+#ifndef NP_LOG_LINE_MAX
+#define NP_LOG_LINE_MAX (1024)
+#endif
 #ifndef MISC_REJOIN_BOOTSTRAP_INTERVAL_SEC
 #define MISC_REJOIN_BOOTSTRAP_INTERVAL_SEC (NP_PI)
 #endif
@@ -220,6 +265,17 @@ extern "C" {
 #ifndef MISC_READ_HTTP_SEC
 #define MISC_READ_HTTP_SEC (NP_PI / 10)
 #endif
+#ifndef NP_HTTP_RECV_BUFFER_SIZE
+#define NP_HTTP_RECV_BUFFER_SIZE 16384
+#endif
+// a client with more pending (pipelined) responses is not read from
+#ifndef NP_HTTP_MAX_PENDING_RESPONSES
+#define NP_HTTP_MAX_PENDING_RESPONSES 64
+#endif
+// a client without a complete request or a written response is closed
+#ifndef NP_HTTP_TIMEOUT_SEC
+#define NP_HTTP_TIMEOUT_SEC (NP_PI * 2)
+#endif
 #ifndef MISC_SEND_PINGS_SEC
 #define MISC_SEND_PINGS_SEC (NP_PI * 10)
 #endif
@@ -288,6 +344,89 @@ extern "C" {
 #ifndef NP_NETWORK_DEFAULT_MAX_MSGS_PER_SEC
 #define NP_NETWORK_DEFAULT_MAX_MSGS_PER_SEC (0)
 #endif
+
+// acknowledgements to the same node are collected for this time span and sent
+// as one ack message, set to 0.0 to send every ack on its own
+#ifndef NP_ACK_COALESCE_WINDOW_SEC
+#define NP_ACK_COALESCE_WINDOW_SEC (NP_PI / 500)
+#endif
+// a batch of acknowledgements is sent right away once it is full
+#ifndef NP_ACK_BATCH_MAX_SIZE
+#define NP_ACK_BATCH_MAX_SIZE (16)
+#endif
+
+// message parts for other nodes are relayed right after the transport
+// decryption, without passing the jobqueue and the alias state machine
+#ifndef NP_FORWARD_CUT_THROUGH
+#define NP_FORWARD_CUT_THROUGH (true)
+#endif
+
+// piggy, update and pheromone messages for the same next hop are collected
+// for this time span and sent as one chunk, set to 0.0 to send every control
+// message on its own. Pings are never held back, they measure the latency.
+#ifndef NP_CONTROL_BUNDLE_WINDOW_SEC
+#define NP_CONTROL_BUNDLE_WINDOW_SEC (NP_PI / 500)
+#endif
+#ifndef NP_CONTROL_BUNDLE_MAX_ENTRIES
+#define NP_CONTROL_BUNDLE_MAX_ENTRIES (8)
+#endif
+// payload bytes of a chunk left for the bundled messages, the remainder is
+// needed for the header and instructions of the bundle itself
+#ifndef NP_CONTROL_BUNDLE_MAX_BYTES
+#define NP_CONTROL_BUNDLE_MAX_BYTES                                            \
+  (MSG_CHUNK_SIZE_1024 - MSG_ENCRYPTION_BYTES_40 - 320)
+#endif
+
+// per peer send pacing, window sizes are counted in chunks
+#ifndef NP_NETWORK_PACING_INITIAL_CWND
+#define NP_NETWORK_PACING_INITIAL_CWND (16.0)
+#endif
+#ifndef NP_NETWORK_PACING_MIN_CWND
+#define NP_NETWORK_PACING_MIN_CWND (2.0)
+#endif
+#ifndef NP_NETWORK_PACING_MAX_CWND
+#define NP_NETWORK_PACING_MAX_CWND (1024.0)
+#endif
+#ifndef NP_NETWORK_PACING_INITIAL_RTT
+#define NP_NETWORK_PACING_INITIAL_RTT (NP_PI / 100)
+#endif
+#ifndef NP_NETWORK_PACING_GAIN
+#define NP_NETWORK_PACING_GAIN (1.25)
+#endif
+#ifndef NP_NETWORK_PACING_MIN_DELAY_SEC
+#define NP_NETWORK_PACING_MIN_DELAY_SEC (0.001)
+#endif
+
+// per peer send queue, sizes are counted in chunks. Control chunks are always
+// sent first, data chunks are shared round robin between the subjects with a
+// quantum of NP_NETWORK_SEND_QUEUE_QUANTUM chunks per round. Once the data
+// chunks queued for a peer reach the high watermark, np_send returns
+// np_operation_would_block for the subjects queued towards this peer until
+// the queue has drained below the low watermark. Chunks that do not fit into a
+// full queue are kept encrypted and retried every
+// NP_NETWORK_SEND_QUEUE_RETRY_SEC, they are dropped once their message expired
+// or after NP_NETWORK_SEND_QUEUE_RETRY_MAX attempts
+#ifndef NP_NETWORK_SEND_QUEUE_MAX_CONTROL
+#define NP_NETWORK_SEND_QUEUE_MAX_CONTROL (256)
+#endif
+#ifndef NP_NETWORK_SEND_QUEUE_MAX_DATA
+#define NP_NETWORK_SEND_QUEUE_MAX_DATA (1024)
+#endif
+#ifndef NP_NETWORK_SEND_QUEUE_QUANTUM
+#define NP_NETWORK_SEND_QUEUE_QUANTUM (4)
+#endif
+#ifndef NP_NETWORK_SEND_QUEUE_HIGH_WATERMARK
+#define NP_NETWORK_SEND_QUEUE_HIGH_WATERMARK (768)
+#endif
+#ifndef NP_NETWORK_SEND_QUEUE_LOW_WATERMARK
+#define NP_NETWORK_SEND_QUEUE_LOW_WATERMARK (384)
+#endif
+#ifndef NP_NETWORK_SEND_QUEUE_RETRY_SEC
+#define NP_NETWORK_SEND_QUEUE_RETRY_SEC (0.005)
+#endif
+#ifndef NP_NETWORK_SEND_QUEUE_RETRY_MAX
+#define NP_NETWORK_SEND_QUEUE_RETRY_MAX (64)
+#endif
 // indirect #define NP_NETWORK_MAX_BYTES_PER_SCAN
 // (NP_NETWORK_MAX_MSGS_PER_SCAN*1024)
 #ifndef NETWORK_RECEIVING_TIMEOUT_SEC
@@ -311,6 +450,25 @@ extern "C" {
 #define NP_EVENT_IO_CHECK_PERIOD_SEC (NP_PI / 100)
 #endif
 
+// event loops that got a thread of the pool (see np_settings.n_threads) block
+// in the io backend until io or an async wakeup arrives. If disabled,
+// triggered loops wait up to NP_EVENT_IO_CHECK_PERIOD_SEC between batches.
+// Loops without a thread are polled by the jobqueue every MISC_READ_EVENTS_SEC
+// in both cases. The http loop (if enabled) and the additional ingress shards
+// run in threads of their own, in addition to the pool
+#ifndef NP_EVENT_LOOP_EVENT_DRIVEN
+#define NP_EVENT_LOOP_EVENT_DRIVEN (true)
+#endif
+
+// number of ingress shards (loop, thread and SO_REUSEPORT socket) used to
+// receive data on a listening port, see np_settings.ingress_shards
+#ifndef NP_EVENT_IN_SHARDS
+#define NP_EVENT_IN_SHARDS (1)
+#endif
+#ifndef NP_EVENT_IN_MAX_SHARDS
+#define NP_EVENT_IN_MAX_SHARDS (16)
+#endif
+
 /*
     lower value => success avg more on realtime
     higher value => more msgs need to be failed to regard this link as bad
@@ -341,6 +499,15 @@ extern "C" {
 #ifndef NP_MSG_PART_FILTER_SIZE_INTERVAL
 #define NP_MSG_PART_FILTER_SIZE_INTERVAL 8192
 #endif
+#ifndef NP_MSG_PART_CACHE_SHARDS
+#define NP_MSG_PART_CACHE_SHARDS 16
+#endif
+#ifndef NP_MSG_PART_CACHE_WHEEL_SLOTS
+#define NP_MSG_PART_CACHE_WHEEL_SLOTS 64
+#endif
+#ifndef NP_MSG_PART_CACHE_WHEEL_TICK_SEC
+#define NP_MSG_PART_CACHE_WHEEL_TICK_SEC (0.250)
+#endif
 #ifndef NP_MSG_FORWARD_FILTER_SIZE
 #define NP_MSG_FORWARD_FILTER_SIZE 8192
 #endif
@@ -40,23 +40,16 @@ enum np_prometheus_exposed_metrics {
   np_prometheus_exposed_metrics_network_out_per_sec,
   np_prometheus_exposed_metrics_pheromones_inhale,
   np_prometheus_exposed_metrics_pheromones_exhale,
+  np_prometheus_exposed_metrics_control_saved_chunks,
+  np_prometheus_exposed_metrics_control_saved_chunks_per_sec,
+  np_prometheus_exposed_metrics_event_loop_wakeups,
+  np_prometheus_exposed_metrics_event_loop_wakeups_per_sec,
   np_prometheus_exposed_metrics_END
 };
 
 char *np_statistics_prometheus_export(np_context *ac);
 
 #ifdef NP_BENCHMARKING
-struct np_statistics_performance_point_s {
-  char      *name;
-  double     durations[NP_BENCHMARKING];
-  uint16_t   durations_idx;
-  uint32_t   hit_count;
-  uint32_t   durations_count;
-  np_mutex_t access;
-};
-
-typedef struct np_statistics_performance_point_s
-    np_statistics_performance_point_t;
 GENERATE_ENUM_STR(np_statistics_performance_point,
                   memory_new,
                   memory_ref,
@@ -93,8 +86,75 @@ GENERATE_ENUM_STR(np_statistics_performance_point,
                   jobqueue_manager_distribute_job,
                   message_decrypt)
 
+/**
+ * performance points record their durations (in nsec) into histograms with
+ * log-linear buckets (HDR style): durations below NP_PERFORMANCE_SUB_BUCKETS
+ * nsec are counted exactly, every following power of two is split into
+ * NP_PERFORMANCE_SUB_BUCKETS linear buckets, which bounds the relative error
+ * to 1/NP_PERFORMANCE_SUB_BUCKETS. Durations of 2^NP_PERFORMANCE_MAX_BITS nsec
+ * and more end up in the last bucket.
+ *
+ * Each thread owns a shard with one histogram per performance point. Only the
+ * owning thread writes into its shard, without locks or atomic read-modify-
+ * write operations, readers merge all shards of the statistics module.
+ * Buckets count with 64 bits like hit_count and sum, a frequently hit point
+ * would wrap a 32 bit bucket within hours.
+ */
+#define NP_PERFORMANCE_SUB_BUCKET_BITS 4
+#define NP_PERFORMANCE_SUB_BUCKETS     (1 << NP_PERFORMANCE_SUB_BUCKET_BITS)
+#define NP_PERFORMANCE_MAX_BITS        36
+#define NP_PERFORMANCE_BUCKETS                                                 \
+  ((NP_PERFORMANCE_MAX_BITS - NP_PERFORMANCE_SUB_BUCKET_BITS + 1) *            \
+   NP_PERFORMANCE_SUB_BUCKETS)
+
+struct np_statistics_performance_shard_s {
+  unsigned long thread_id;
+  uint64_t      hit_count[np_statistics_performance_point_END];
+  uint64_t      sum[np_statistics_performance_point_END];
+  uint64_t      max[np_statistics_performance_point_END];
+  uint64_t buckets[np_statistics_performance_point_END][NP_PERFORMANCE_BUCKETS];
+
+  struct np_statistics_performance_shard_s *next;
+};
+typedef struct np_statistics_performance_shard_s
+    np_statistics_performance_shard_t;
+
+// merged view of a performance point over all threads, durations in seconds
+struct np_statistics_performance_point_s {
+  const char *name;
+  uint64_t    hit_count;
+  uint64_t    durations_count;
+  double      min;
+  double      avg;
+  double      max;
+  double      p50;
+  double      p99;
+};
+typedef struct np_statistics_performance_point_s
+    np_statistics_performance_point_t;
 #endif
 
+/**
+ * per subject and per peer metrics live in fixed size tables with
+ * NP_STATISTICS_METRICS_SLOTS slots and linear probing. The message path finds
+ * known metrics without taking a lock. Slots are claimed and released under a
+ * lock, a released slot keeps its metrics (hidden from the exposition) and
+ * hands them to the next key, so their memory stays valid for late writers.
+ */
+enum np_statistics_metrics_slot_state {
+  np_statistics_metrics_slot_empty = 0,
+  np_statistics_metrics_slot_claimed,
+  np_statistics_metrics_slot_ready,
+  np_statistics_metrics_slot_released,
+};
+
+struct np_statistics_metrics_slot_s {
+  np_dhkey_t key;
+  void      *metrics; // valid once the slot is ready
+  uint8_t    state;
+};
+typedef struct np_statistics_metrics_slot_s np_statistics_metrics_slot_t;
+
 np_module_struct(statistics) {
   np_state_t             *context;
   np_simple_cache_table_t __cache;
@@ -102,15 +162,25 @@ np_module_struct(statistics) {
   prometheus_context *_prometheus_context;
   prometheus_metric  *_prometheus_metrics[np_prometheus_exposed_metrics_END];
   double              startup_time;
-  np_tree_t          *_per_subject_metrics;
-  np_tree_t          *_per_dhkey_metrics;
+
+  np_statistics_metrics_slot_t *_per_subject_metrics;
+  np_statistics_metrics_slot_t *_per_dhkey_metrics;
+  np_spinlock_t                 _metrics_lock;
+
+  // the exposition is rendered into this buffer by every scrape. It is used as
+  // the http body until it has been sent, a pipelined scrape which finds it
+  // busy is rendered into a buffer of its own.
+  char  *_prometheus_buffer;
+  size_t _prometheus_buffer_size;
+  bool   _prometheus_buffer_busy;
 
 #ifdef DEBUG_CALLBACKS
   np_sll_t(void_ptr, __np_debug_statistics);
 #endif
 #ifdef NP_BENCHMARKING
-  np_statistics_performance_point_t
-      performance_points[np_statistics_performance_point_END];
+  pthread_key_t                      __performance_key;
+  np_spinlock_t                      __performance_lock;
+  np_statistics_performance_shard_t *__performance_shards;
 #endif
 };
 
@@ -156,14 +226,67 @@ void __np_statistics_set_success_avg(np_state_t *context,
                                      np_dhkey_t  id,
                                      float       value);
 NP_API_INTERN
+void __np_statistics_set_send_window(np_state_t *context,
+                                     np_dhkey_t  id,
+                                     float       value);
+NP_API_INTERN
+void __np_statistics_set_pacing_rate(np_state_t *context,
+                                     np_dhkey_t  id,
+                                     float       value);
+NP_API_INTERN
+void __np_statistics_set_msgcache_size(np_state_t *context,
+                                       np_dhkey_t  subject,
+                                       uint16_t    size);
+NP_API_INTERN
+void __np_increment_msgcache_dropped_counter(np_state_t *context,
+                                             np_dhkey_t  subject);
+NP_API_INTERN
+void __np_statistics_set_send_queue_size(np_state_t *context,
+                                         np_dhkey_t  id,
+                                         uint32_t    size);
+NP_API_INTERN
+void __np_statistics_observe_end_to_end(np_state_t *context,
+                                        np_dhkey_t  subject,
+                                        double      seconds);
+NP_API_INTERN
+void __np_statistics_observe_reassembly(np_state_t *context,
+                                        np_dhkey_t  subject,
+                                        double      seconds);
+NP_API_INTERN
+void __np_statistics_release_dhkey_metrics(np_state_t *context,
+                                           np_dhkey_t  id);
+NP_API_INTERN
+void __np_statistics_observe_send_to_ack(np_state_t *context,
+                                         np_dhkey_t  id,
+                                         double      seconds);
+NP_API_INTERN
 void __np_statistics_increment_pheromones_inhale(np_state_t *context);
 NP_API_INTERN
 void __np_statistics_increment_pheromones_exhale(np_state_t *context);
+NP_API_INTERN
+void __np_statistics_add_control_saved_chunks(np_state_t *context,
+                                              uint32_t    add);
+NP_API_INTERN
+void __np_statistics_increment_event_loop_wakeups(np_state_t *context);
 
 #define _np_set_latency(id, value)                                             \
   __np_statistics_set_latency(context, id, value)
 #define _np_set_success_avg(id, value)                                         \
   __np_statistics_set_success_avg(context, id, value)
+#define _np_set_send_window(id, value)                                         \
+  __np_statistics_set_send_window(context, id, value)
+#define _np_set_pacing_rate(id, value)                                         \
+  __np_statistics_set_pacing_rate(context, id, value)
+#define _np_set_send_queue_size(id, value)                                     \
+  __np_statistics_set_send_queue_size(context, id, value)
+#define _np_statistics_observe_end_to_end(subject, seconds)                    \
+  __np_statistics_observe_end_to_end(context, subject, seconds)
+#define _np_statistics_observe_reassembly(subject, seconds)                    \
+  __np_statistics_observe_reassembly(context, subject, seconds)
+#define _np_statistics_observe_send_to_ack(id, seconds)                        \
+  __np_statistics_observe_send_to_ack(context, id, seconds)
+#define _np_statistics_release_dhkey_metrics(id)                               \
+  __np_statistics_release_dhkey_metrics(context, id)
 #define _np_increment_forwarding_counter(subject)                              \
   __np_increment_forwarding_counter(context, subject)
 #define _np_increment_received_msgs_counter(subject)                           \
@@ -178,9 +301,20 @@ void __np_statistics_increment_pheromones_exhale(np_state_t *context);
   __np_statistics_increment_pheromones_inhale(context)
 #define _np_statistics_increment_pheromones_exhale()                           \
   __np_statistics_increment_pheromones_exhale(context)
+#define _np_statistics_add_control_saved_chunks(add)                           \
+  __np_statistics_add_control_saved_chunks(context, add)
+#define _np_statistics_increment_event_loop_wakeups()                          \
+  __np_statistics_increment_event_loop_wakeups(context)
 #else
 #define _np_set_latency(id, value)
 #define _np_set_success_avg(id, value)
+#define _np_set_send_window(id, value)
+#define _np_set_pacing_rate(id, value)
+#define _np_set_send_queue_size(id, value)
+#define _np_statistics_observe_end_to_end(subject, seconds)
+#define _np_statistics_observe_reassembly(subject, seconds)
+#define _np_statistics_observe_send_to_ack(id, seconds)
+#define _np_statistics_release_dhkey_metrics(id)
 #define _np_increment_forwarding_counter(subject)
 #define _np_increment_received_msgs_counter(subject)
 #define _np_increment_send_msgs_counter(subject)
@@ -188,6 +322,8 @@ void __np_statistics_increment_pheromones_exhale(np_state_t *context);
 #define _np_statistics_add_received_bytes(add)
 #define _np_statistics_increment_pheromones_inhale()
 #define _np_statistics_increment_pheromones_exhale()
+#define _np_statistics_add_control_saved_chunks(add)
+#define _np_statistics_increment_event_loop_wakeups()
 #endif // DEBUG
 
 #ifdef NP_BENCHMARKING
@@ -214,67 +350,73 @@ void __np_statistics_increment_pheromones_exhale(np_state_t *context);
     min_v = 0, max_v = 0.0, avg_v = 0.0, stddev_v = 0.0;                       \
   }
 
-#define NP_PERFORMANCE_POINT_DESTROY()                                         \
-  for (int i = 0; i < np_statistics_performance_point_END; i++) {              \
-    _np_threads_mutex_destroy(                                                 \
-        context,                                                               \
-        &np_module(statistics)->performance_points[i].access);                 \
-  }
+NP_API_INTERN
+np_statistics_performance_shard_t *
+_np_statistics_performance_shard_new(np_state_t *context);
+NP_API_INTERN
+void _np_statistics_performance_get(
+    np_state_t                            *context,
+    enum np_statistics_performance_point_e point,
+    np_statistics_performance_point_t     *result);
+
+static inline uint64_t _np_statistics_performance_now() {
+  struct timespec ts;
+  clock_gettime(CLOCK_MONOTONIC, &ts);
+  return (uint64_t)ts.tv_sec * 1000000000 + ts.tv_nsec;
+}
+
+static inline uint16_t _np_statistics_performance_bucket(uint64_t nsec) {
+  if (nsec < NP_PERFORMANCE_SUB_BUCKETS) return nsec;
+
+  uint8_t msb = 63 - __builtin_clzll(nsec);
+  if (msb >= NP_PERFORMANCE_MAX_BITS) return NP_PERFORMANCE_BUCKETS - 1;
+
+  uint8_t shift = msb - NP_PERFORMANCE_SUB_BUCKET_BITS;
+  return (shift + 1) * NP_PERFORMANCE_SUB_BUCKETS +
+         ((nsec >> shift) & (NP_PERFORMANCE_SUB_BUCKETS - 1));
+}
+
+static inline np_statistics_performance_shard_t *
+_np_statistics_performance_shard(np_state_t *context) {
+  np_statistics_performance_shard_t *shard =
+      pthread_getspecific(np_module(statistics)->__performance_key);
+  if (shard == NULL) shard = _np_statistics_performance_shard_new(context);
+  return shard;
+}
+
+// the shard has a single writer, readers only need to see whole values
+static inline void
+_np_statistics_performance_record(np_statistics_performance_shard_t     *shard,
+                                  enum np_statistics_performance_point_e point,
+                                  uint64_t                               nsec) {
+  uint64_t *bucket =
+      &shard->buckets[point][_np_statistics_performance_bucket(nsec)];
+  __atomic_store_n(bucket, *bucket + 1, __ATOMIC_RELAXED);
+  __atomic_store_n(&shard->sum[point],
+                   shard->sum[point] + nsec,
+                   __ATOMIC_RELAXED);
+  if (nsec > shard->max[point])
+    __atomic_store_n(&shard->max[point], nsec, __ATOMIC_RELAXED);
+}
 
 #define NP_PERFORMANCE_POINT_START(NAME)                                       \
-  double                             t1_##NAME;                                \
-  np_statistics_performance_point_t *container_##NAME;                         \
+  uint64_t                           t1_##NAME    = 0;                         \
+  np_statistics_performance_shard_t *shard_##NAME = NULL;                      \
   if (np_module_initiated(statistics)) {                                       \
-    container_##NAME =                                                         \
-        &np_module(statistics)                                                 \
-             ->performance_points[np_statistics_performance_point_##NAME];     \
-    {                                                                          \
-      _LOCK_ACCESS(&container_##NAME->access) {                                \
-        ASSERT(container_##NAME->hit_count < UINT32_MAX,                       \
-               "max hitcount of %s reached",                                   \
-               container_##NAME->name);                                        \
-        container_##NAME->hit_count++;                                         \
-      }                                                                        \
-      t1_##NAME = np_time_now(); /*(double)clock()/CLOCKS_PER_SEC;*/           \
-    }                                                                          \
+    shard_##NAME = _np_statistics_performance_shard(context);                  \
+    __atomic_store_n(                                                          \
+        &shard_##NAME->hit_count[np_statistics_performance_point_##NAME],      \
+        shard_##NAME->hit_count[np_statistics_performance_point_##NAME] + 1,   \
+        __ATOMIC_RELAXED);                                                     \
+    t1_##NAME = _np_statistics_performance_now();                              \
   }
 
 #define NP_PERFORMANCE_POINT_END(NAME)                                         \
-  if (np_module_initiated(statistics)) {                                       \
-    double t2_##NAME = np_time_now(); /*(double)clock()/CLOCKS_PER_SEC;*/      \
-    {                                                                          \
-      _LOCK_ACCESS(&container_##NAME->access) {                                \
-        container_##NAME->durations[container_##NAME->durations_idx] =         \
-            t2_##NAME - t1_##NAME;                                             \
-        container_##NAME->durations_idx =                                      \
-            (container_##NAME->durations_idx + 1) % NP_BENCHMARKING;           \
-        container_##NAME->durations_count++;                                   \
-      }                                                                        \
-    }                                                                          \
-  }
-
-#define __NP_PERFORMANCE_GET_POINTS_STR_CONTAINER(STR, container)              \
-  _LOCK_ACCESS(&container.access) {                                            \
-    CALC_STATISTICS(container.durations /*array*/,                             \
-                    /*no accessor*/, /*max_size*/                              \
-                    (container.durations_count > NP_BENCHMARKING               \
-                         ? NP_BENCHMARKING                                     \
-                         : container.durations_idx),                           \
-                    min_v,                                                     \
-                    max_v,                                                     \
-                    avg_v,                                                     \
-                    stddev_v);                                                 \
-    STR = np_str_concatAndFree(                                                \
-        STR,                                                                   \
-        "%100s --> %8.6f / %8.6f / %8.6f / %8.6f / %10" PRIu32 " / %10" PRIu32 \
-        "\n",                                                                  \
-        container.name,                                                        \
-        min_v,                                                                 \
-        avg_v,                                                                 \
-        max_v,                                                                 \
-        stddev_v,                                                              \
-        container.hit_count,                                                   \
-        container.durations_count);                                            \
+  if (shard_##NAME != NULL) {                                                  \
+    _np_statistics_performance_record(shard_##NAME,                            \
+                                      np_statistics_performance_point_##NAME,  \
+                                      _np_statistics_performance_now() -       \
+                                          t1_##NAME);                          \
   }
 
 #define NP_PERFORMANCE_GET_POINTS_STR(STR)                                     \
@@ -282,26 +424,36 @@ void __np_statistics_increment_pheromones_exhale(np_state_t *context);
   {                                                                            \
     STR = np_str_concatAndFree(                                                \
         STR,                                                                   \
-        "%-10s %89s --> %8s / %8s / %8s / %8s / %10s / %10s \n",               \
+        "%-10s %89s --> %8s / %8s / %8s / %8s / %8s / %10s / %10s \n",         \
         "(constant)",                                                          \
         "name",                                                                \
         "min",                                                                 \
         "avg",                                                                 \
+        "p50",                                                                 \
+        "p99",                                                                 \
         "max",                                                                 \
-        "stddev",                                                              \
         "hits",                                                                \
         "completed");                                                          \
     for (int i = 0; i < np_statistics_performance_point_END; i++) {            \
-      np_statistics_performance_point_t container =                            \
-          np_module(statistics)->performance_points[i];                        \
-      __NP_PERFORMANCE_GET_POINTS_STR_CONTAINER(STR, container);               \
+      np_statistics_performance_point_t point;                                 \
+      _np_statistics_performance_get(context, i, &point);                      \
+      STR = np_str_concatAndFree(STR,                                          \
+                                 "%100s --> %8.6f / %8.6f / %8.6f / %8.6f / "  \
+                                 "%8.6f / %10" PRIu64 " / %10" PRIu64 "\n",    \
+                                 point.name,                                   \
+                                 point.min,                                    \
+                                 point.avg,                                    \
+                                 point.p50,                                    \
+                                 point.p99,                                    \
+                                 point.max,                                    \
+                                 point.hit_count,                              \
+                                 point.durations_count);                       \
     }                                                                          \
     char *stats = __np_statistics_debug_print(context);                        \
     STR         = np_str_concatAndFree(STR, stats);                            \
     free(stats);                                                               \
   }
 #else
-#define NP_PERFORMANCE_POINT_DESTROY()
 #define NP_PERFORMANCE_POINT_START(name)
 #define NP_PERFORMANCE_POINT_END(name)
 #define CALC_STATISTICS(array,                                                 \
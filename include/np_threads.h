@@ -219,6 +219,12 @@ np_thread_t *__np_createThread(NP_UNUSED np_state_t *context,
                                bool                  auto_run,
                                enum np_thread_type_e type);
 
+// starts an additional thread for an event loop which is set up after the
+// workers (e.g. http), a loop function is only started once
+NP_API_INTERN
+np_thread_t *_np_threads_start_eventloop(np_state_t           *context,
+                                         np_threads_worker_run fn);
+
 NP_API_INTERN
 np_thread_t *_np_threads_get_self(NP_UNUSED np_state_t *context);
 NP_API_INTERN
@@ -45,6 +45,8 @@ typedef np_key_t          *np_key_ptr;
 typedef struct np_message_s np_message_t;
 typedef np_message_t       *np_message_ptr;
 
+typedef struct np_msgpart_cache_s np_msgpart_cache_t;
+
 typedef struct np_msgproperty_conf_s np_msgproperty_conf_t;
 typedef np_msgproperty_conf_t       *np_msgproperty_conf_ptr;
 
@@ -77,6 +79,13 @@ typedef np_thread_t       *np_thread_ptr;
 typedef struct np_crypto_s         np_crypto_t;
 typedef struct np_crypto_session_s np_crypto_session_t;
 
+// binary form of a uuid, the text form (NP_UUID_BYTES) is only used for
+// logging and the wire format
+#define NP_UUID_BIN_BYTES 16
+typedef struct np_uuid_s {
+  unsigned char b[NP_UUID_BIN_BYTES];
+} np_uuid_t;
+
 /*
  *  user callback functions
  */
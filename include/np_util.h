@@ -1805,10 +1805,23 @@ extern "C" {
       #e33, #e34, #e35, #e36, #e37, #e38, #e39, #e40, #e41, #e42, #e43, #e44,  \
       #e45, #e46, #e47, #e48, #e49, __GENERATE_ENUM_STR_END(NAME)
 
-// create a sha156 uuid string, take the current date into account
+// create a uuid string (8-4-4-4-12 hex digits). str is not used anymore and
+// kept for compatibility, num is mixed into the uuid
 NP_API_EXPORT
 char *np_uuid_create(const char *str, const uint16_t num, char **buffer);
 
+// create a binary uuid: a SipHash of a per thread counter, keyed with a random
+// per thread key
+NP_API_INTERN
+void _np_uuid_create_bin(np_uuid_t *uuid, uint16_t num);
+// hex encode a binary uuid, only needed for logging and the wire format
+NP_API_INTERN
+void _np_uuid_to_str(const np_uuid_t *uuid, char uuid_str[NP_UUID_BYTES]);
+// parse the text form of a uuid. strings which are not in the 8-4-4-4-12 hex
+// format are hashed, so that every string maps to a stable binary uuid
+NP_API_INTERN
+void _np_uuid_from_str(const char *uuid_str, np_uuid_t *uuid);
+
 NP_API_INTERN
 void _np_sll_remove_doublettes(np_sll_t(np_key_ptr, list_of_keys));
 
@@ -64,6 +64,29 @@ void np_serializer_read_map(np_state_t              *context,
                             np_deserialize_buffer_t *buffer,
                             np_tree_t               *tree);
 
+/**
+ * @brief serialization of a map with a static part that is serialized once
+ *
+ * np_serializer_write_elements writes the key/value pairs of #tree# without
+ * the enclosing map. np_serializer_write_map_prefixed writes #tree# like
+ * np_serializer_write_map, but copies the elements with one of the
+ * #prefix_keys# from #prefix# instead of serializing them again. The caller
+ * has to make sure that their values did not change since #prefix# was
+ * written.
+ */
+NP_API_INTERN
+void np_serializer_write_elements(np_state_t            *context,
+                                  np_serialize_buffer_t *buffer,
+                                  const np_tree_t       *tree);
+NP_API_INTERN
+void np_serializer_write_map_prefixed(np_state_t            *context,
+                                      np_serialize_buffer_t *buffer,
+                                      const np_tree_t       *tree,
+                                      const char *const     *prefix_keys,
+                                      uint8_t                prefix_count,
+                                      const void            *prefix,
+                                      size_t                 prefix_size);
+
 /**
  * @brief (de-) serialization of a datablock (attributes) into a document
  *
@@ -161,6 +161,13 @@ structure
 */
 NP_API_EXPORT
 void np_tree_insert_str(np_tree_t *tree, const char *key, np_treeval_t val);
+// inserts data without copying it, the caller has to keep it alive as long
+// as the tree uses it
+NP_API_EXPORT
+void np_tree_insert_str_ref(np_tree_t  *tree,
+                            const char *key,
+                            void       *data,
+                            uint32_t    size);
 NP_API_EXPORT
 void np_tree_insert_int(np_tree_t *tree, int16_t ikey, np_treeval_t val);
 NP_API_EXPORT
@@ -81,7 +81,8 @@ enum np_treeval_type_t {
   np_treeval_type_special_char_ptr,
   np_treeval_type_cwt,
   np_treeval_type_cose_signed,
-  np_treeval_type_cose_encrypted
+  np_treeval_type_cose_encrypted,
+  np_treeval_type_bin_ref // borrowed binary, serialized like bin
 };
 
 /* The Jval -- a type that can hold any type */
@@ -136,6 +137,8 @@ np_treeval_t np_treeval_new_f(float f);
 np_treeval_t np_treeval_new_d(double d);
 np_treeval_t np_treeval_new_v(void *v);
 np_treeval_t np_treeval_new_bin(void *data, uint32_t size);
+// the data is not owned and has to outlive the tree, copies turn into bin
+np_treeval_t np_treeval_new_bin_ref(void *data, uint32_t size);
 np_treeval_t np_treeval_new_s(char *s);
 np_treeval_t np_treeval_new_ss(uint8_t idx);
 np_treeval_t np_treeval_new_c(char c);
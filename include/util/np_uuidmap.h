@@ -0,0 +1,84 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#ifndef NP_UUIDMAP_H_
+#define NP_UUIDMAP_H_
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "sodium.h"
+
+#include "util/np_treeval.h"
+
+#include "np_types.h"
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+/**
+ * Implementation of a hash table keyed by binary uuids (np_uuid_t). The table
+ * uses open addressing with linear probing, its capacity is always a power of
+ * two. The slot of a key is derived from a siphash24 of the uuid, seeded with
+ * random data per table. Each slot holds a copy of the key and a np_treeval_t,
+ * the user is responsible to clean up values which point to memory.
+ *
+ * Removed keys leave a tombstone behind, which makes it safe to delete the
+ * current element while iterating over the table. Insertion may resize the
+ * table and must not be mixed with an iteration. The table is not protected
+ * from concurrent access.
+ */
+
+enum np_uuidmap_slot_state {
+  np_uuidmap_slot_empty = 0,
+  np_uuidmap_slot_used,
+  np_uuidmap_slot_deleted,
+};
+
+struct np_uuidmap_entry_s {
+  np_uuid_t    key;
+  np_treeval_t val;
+  uint8_t      state;
+};
+typedef struct np_uuidmap_entry_s np_uuidmap_entry_t;
+
+struct np_uuidmap_s {
+  uint32_t      size;     // number of keys in the table
+  uint32_t      capacity; // number of slots, a power of two
+  uint32_t      deleted;  // number of tombstones
+  unsigned char _seed[crypto_shorthash_KEYBYTES];
+
+  np_uuidmap_entry_t *_entries;
+};
+typedef struct np_uuidmap_s np_uuidmap_t;
+
+NP_API_INTERN
+np_uuidmap_t *np_uuidmap_create(uint32_t initial_capacity);
+NP_API_INTERN
+void np_uuidmap_free(np_uuidmap_t *map);
+
+// returns false if the key is already present, the value is not changed then
+NP_API_INTERN
+bool np_uuidmap_insert(np_uuidmap_t    *map,
+                       const np_uuid_t *key,
+                       np_treeval_t     val);
+NP_API_INTERN
+np_treeval_t *np_uuidmap_find(const np_uuidmap_t *map, const np_uuid_t *key);
+NP_API_INTERN
+bool np_uuidmap_del(np_uuidmap_t *map, const np_uuid_t *key);
+
+// returns the next used entry starting at *pos and advances *pos, NULL when the
+// end of the table has been reached. Start an iteration with *pos = 0.
+NP_API_INTERN
+np_uuidmap_entry_t *np_uuidmap_next(np_uuidmap_t *map, uint32_t *pos);
+// removes the entry returned by np_uuidmap_next
+NP_API_INTERN
+void np_uuidmap_del_entry(np_uuidmap_t *map, np_uuidmap_entry_t *entry);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* NP_UUIDMAP_H_ */
@@ -24,6 +24,7 @@
 #include "util/np_tree.h"
 
 #include "np_aaatoken.h"
+#include "np_axon.h"
 #include "np_eventqueue.h"
 #include "np_key.h"
 #include "np_keycache.h"
@@ -58,8 +59,9 @@ np_message_t *_np_alias_check_msgpart_cache(np_state_t   *context,
   char msg_uuid[NP_UUID_BYTES + 1] = {0};
   strncpy(msg_uuid, _uuid->val.value.s, NP_UUID_BYTES);
 
-  np_dhkey_t uuid_dhkey =
-      _np_dhkey_generate_hash(_uuid->val.value.s, NP_UUID_BYTES - 1);
+  np_uuid_t uuid_key;
+  _np_uuid_from_str(_uuid->val.value.s, &uuid_key);
+  np_dhkey_t uuid_dhkey = _np_dhkey_from_uuid(&uuid_key);
 
   np_dhkey_t check_dhkey = {0};
   _np_dhkey_add(&check_dhkey, &uuid_dhkey, &_from->val.value.dhkey);
@@ -80,92 +82,42 @@ np_message_t *_np_alias_check_msgpart_cache(np_state_t   *context,
           ->val.value.a2_ui[0];
   if (!is_expired && !_seen_before) {
     if (expected_msg_chunks > 1) {
-      _LOCK_MODULE(np_message_part_cache_t) {
-        // If there exists multiple chunks, check if we already have one in
-        // cache
-        np_tree_elem_t *tmp =
-            np_tree_find_dhkey(context->msg_part_cache, check_dhkey);
-        if (NULL != tmp) {
-          // there exists a msg(part) in our msgcache for this msg uuid
-          // lets add our msgpart to this msg
-          np_message_t *msg_in_cache            = tmp->val.value.v;
-          uint32_t      current_count_of_chunks = 0;
-
-          _LOCK_ACCESS(&msg_to_check->msg_chunks_lock) {
-            np_messagepart_ptr to_add = to_add =
-                pll_first(msg_to_check->msg_chunks)
-                    ->val; // get the messagepart we received
-
-            log_debug_msg(LOG_MESSAGE | LOG_DEBUG,
-                          "message (%s) %p / %p / %p",
-                          msg_uuid,
-                          msg_in_cache,
-                          msg_in_cache->msg_chunks,
-                          to_add);
-
-            _LOCK_ACCESS(&msg_in_cache->msg_chunks_lock) {
-              // try to add the new received messagepart to the msg in cache
-              if (pll_insert(np_messagepart_ptr,
-                             msg_in_cache->msg_chunks,
-                             to_add,
-                             false,
-                             _np_messagepart_cmp)) {
-                // new entry is added (was not present)
-                pll_head(np_messagepart_ptr, msg_to_check->msg_chunks);
-              }
-
-              // now we check if all chunks are complete for this msg
-              current_count_of_chunks = pll_size(msg_in_cache->msg_chunks);
-            }
-          }
-
-          if (current_count_of_chunks != expected_msg_chunks) {
-            log_debug(LOG_MESSAGE,
-                      "message %s (%s) not complete yet (%" PRIu32
-                      " of %" PRIu16 "), waiting for missing parts",
-                      subject,
-                      msg_uuid,
-                      current_count_of_chunks,
-                      expected_msg_chunks);
-            // nothing to return as we still wait for chunks
-          } else {
-
-            log_debug(LOG_MESSAGE,
-                      "message %s (%s) is complete now  (%" PRIu32
-                      " of %" PRIu16 ")",
-                      subject,
-                      msg_uuid,
-                      current_count_of_chunks,
-                      expected_msg_chunks);
-
-            ret = msg_in_cache;
-            // removing the message from the cache system
-            ref_replace_reason(np_message_t,
-                               msg_in_cache,
-                               ref_msgpartcache,
-                               FUNC);
-            // msg_uuid =
-            // np_treeval_to_str(np_tree_find_str(msg_in_cache->instructions,
-            // _NP_MSG_INST_UUID)->val, NULL);
-            np_tree_del_dhkey(context->msg_part_cache, check_dhkey);
-
-            context->msg_part_filter->op.add_cb(context->msg_part_filter,
-                                                uuid_dhkey);
-          }
-        } else {
-          // there exists no msg(part) in our msgcache for this msg uuid
-          // TODO: limit msg_part_cache size
-
-          // there is no chunk for this msg in cache,
-          // so we insert this message into out cache
-          // as a structure to accumulate further chunks into
-          np_ref_obj(np_message_t,
-                     msg_to_check,
-                     ref_msgpartcache); // we need to unref this after we finish
-                                        // the handeling of this msg
-          np_tree_insert_dhkey(context->msg_part_cache,
-                               check_dhkey,
-                               np_treeval_new_v(msg_to_check));
+      // If there exists multiple chunks, add our msgpart to the reassembly
+      // cache. the cache returns the complete message once all parts arrived
+      uint16_t current_count_of_chunks = 0;
+      np_message_t *msg_in_cache =
+          _np_messagepart_cache_add(context,
+                                    context->msg_part_cache,
+                                    check_dhkey,
+                                    msg_to_check,
+                                    expected_msg_chunks,
+                                    &current_count_of_chunks);
+
+      if (NULL == msg_in_cache) {
+        log_debug(LOG_MESSAGE,
+                  "message %s (%s) not complete yet (%" PRIu16 " of %" PRIu16
+                  "), waiting for missing parts",
+                  subject,
+                  msg_uuid,
+                  current_count_of_chunks,
+                  expected_msg_chunks);
+        // nothing to return as we still wait for chunks
+      } else {
+        log_debug(LOG_MESSAGE,
+                  "message %s (%s) is complete now  (%" PRIu16 " of %" PRIu16
+                  ")",
+                  subject,
+                  msg_uuid,
+                  current_count_of_chunks,
+                  expected_msg_chunks);
+
+        ret = msg_in_cache;
+        // the message has been removed from the cache system
+        ref_replace_reason(np_message_t, msg_in_cache, ref_msgpartcache, FUNC);
+
+        _LOCK_MODULE(np_message_part_cache_t) {
+          context->msg_part_filter->op.add_cb(context->msg_part_filter,
+                                              uuid_dhkey);
         }
       }
     } else {
@@ -198,35 +150,11 @@ np_message_t *_np_alias_check_msgpart_cache(np_state_t   *context,
 
 void _np_alias_cleanup_msgpart_cache(np_state_t               *context,
                                      NP_UNUSED np_util_event_t event) {
-  np_sll_t(np_dhkey_t, to_del);
-  sll_init(np_dhkey_t, to_del);
+  // left-over message parts are released by the timer wheel of the cache
+  _np_messagepart_cache_expire(context, context->msg_part_cache, np_time_now());
+
   _LOCK_MODULE(np_message_part_cache_t) {
-    if (context->msg_part_cache->size > 0) {
-      log_debug_msg(
-          LOG_MISC,
-          "MSG_PART_TABLE checking (left-over) message parts (size: %d)",
-          context->msg_part_cache->size);
-      np_tree_elem_t *tmp = NULL;
-      RB_FOREACH (tmp, np_tree_s, context->msg_part_cache) {
-        np_message_t *msg = tmp->val.value.v;
-        if (true == _np_message_is_expired(msg)) {
-          log_debug_msg(
-              LOG_MISC,
-              "MSG_PART_TABLE removing (left-over) message part for uuid: %s",
-              msg->uuid);
-          np_unref_obj(np_message_t, msg, ref_msgpartcache);
-          sll_append(np_dhkey_t, to_del, tmp->key.value.dhkey);
-        }
-      }
-    }
     _np_decaying_bloom_decay(context->msg_part_filter);
-    sll_iterator(np_dhkey_t) iter = sll_first(to_del);
-    while (NULL != iter) {
-      np_tree_del_dhkey(context->msg_part_cache, iter->val);
-      sll_next(iter);
-    }
-
-    sll_free(np_dhkey_t, to_del);
   }
 
   uint16_t _peer_nodes =
@@ -635,6 +563,11 @@ void __np_alias_decrypt(
                   msg_in->uuid);
 
     _np_message_trace_info("MSG_IN_TRANSPORT", msg_in);
+    if (_np_out_forward_cut_through(context, event.current_run, msg_in)) {
+      np_unref_obj(np_message_t, msg_in, FUNC);
+      return;
+    }
+
     np_util_event_t in_message_evt = {
         .type         = (evt_external | evt_message), //|evt_multimatch),
         .user_data    = msg_in,
@@ -916,6 +849,10 @@ bool __is_dht_message(np_util_statemachine_t *statemachine,
       np_generate_subject((np_subject *)&leave_dhkey,
                           _NP_MSG_LEAVE_REQUEST,
                           strnlen(_NP_MSG_LEAVE_REQUEST, 256));
+      np_dhkey_t bundle_dhkey = {0};
+      np_generate_subject((np_subject *)&bundle_dhkey,
+                          _NP_MSG_CONTROL_BUNDLE,
+                          strnlen(_NP_MSG_CONTROL_BUNDLE, 256));
 
       // if (ret) {
       ret &=
@@ -923,7 +860,8 @@ bool __is_dht_message(np_util_statemachine_t *statemachine,
            _np_dhkey_equal(&msg_subject_elem->val.value.dhkey, &ping_dhkey) ||
            _np_dhkey_equal(&msg_subject_elem->val.value.dhkey, &piggy_dhkey) ||
            _np_dhkey_equal(&msg_subject_elem->val.value.dhkey, &update_dhkey) ||
-           _np_dhkey_equal(&msg_subject_elem->val.value.dhkey, &leave_dhkey));
+           _np_dhkey_equal(&msg_subject_elem->val.value.dhkey, &leave_dhkey) ||
+           _np_dhkey_equal(&msg_subject_elem->val.value.dhkey, &bundle_dhkey));
       // }
       NP_PERFORMANCE_POINT_END(is_dht_message);
     }
@@ -1219,8 +1157,7 @@ void __np_handle_np_forward(np_util_statemachine_t *statemachine,
 
   np_dhkey_t ack_dhkey = {0};
   np_generate_subject(&ack_dhkey, _NP_MSG_ACK, strnlen(_NP_MSG_ACK, 256));
-  np_dhkey_t forward_dhkey = {0};
-  np_generate_subject(&forward_dhkey, _FORWARD, strnlen(_FORWARD, 256));
+  np_dhkey_t forward_dhkey = _np_msgproperty_forward_dhkey();
 
   // np_dhkey_t subj_in_dhkey     = _np_msgproperty_tweaked_dhkey(INBOUND,
   // subj_dhkey);
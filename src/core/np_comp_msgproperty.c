@@ -21,6 +21,7 @@
 #include "core/np_comp_intent.h"
 #include "util/np_bloom.h"
 #include "util/np_event.h"
+#include "util/np_serialization.h"
 #include "util/np_statemachine.h"
 #include "util/np_tree.h"
 #include "util/np_treeval.h"
@@ -49,13 +50,26 @@ NP_SLL_GENERATE_IMPLEMENTATION(np_msgproperty_run_ptr);
 
 static np_dhkey_t __local_tx_dhkey = {0};
 static np_dhkey_t __local_rx_dhkey = {0};
+static np_dhkey_t __forward_dhkey  = {0};
 
 struct np_redelivery_data_s {
   np_dhkey_t    target;
   double        redelivery_at;
-  np_message_t *message;
+  np_message_t *message; // NULL once the message has been acknowledged, the
+                         // entry is released when it reaches the schedule head
 };
-typedef struct np_redelivery_data_s np_redelivery_data_t;
+
+bool np_redelivery_data_ptr_compare(np_redelivery_data_ptr i,
+                                    np_redelivery_data_ptr j) {
+  return (i->redelivery_at < j->redelivery_at);
+}
+
+size_t
+np_redelivery_data_ptr_binheap_get_priority(np_redelivery_data_ptr element) {
+  return (size_t)element->redelivery_at;
+}
+
+NP_BINHEAP_GENERATE_IMPLEMENTATION(np_redelivery_data_ptr);
 
 np_dhkey_t _np_msgproperty_tweaked_dhkey(np_msg_mode_type mode_type,
                                          np_dhkey_t       subject) {
@@ -76,6 +90,8 @@ np_dhkey_t _np_msgproperty_dhkey(np_msg_mode_type mode_type,
   return _dhkey;
 }
 
+np_dhkey_t _np_msgproperty_forward_dhkey() { return __forward_dhkey; }
+
 void __np_msgproperty_threshold_increase(
     const np_msgproperty_conf_t *const self_conf, np_msgproperty_run_t *self) {
   if (self->msg_threshold < self_conf->max_threshold) {
@@ -99,6 +115,14 @@ void __np_msgproperty_threshold_decrease(
   }
 }
 
+static void __np_msgproperty_template_free(np_msgproperty_template_t *self) {
+  if (self == NULL) return;
+
+  np_tree_free(self->header);
+  np_tree_free(self->instructions);
+  free(self);
+}
+
 void _np_msgproperty_conf_t_new(np_state_t       *context,
                                 NP_UNUSED uint8_t type,
                                 NP_UNUSED size_t  size,
@@ -136,6 +160,9 @@ void _np_msgproperty_conf_t_new(np_state_t       *context,
   memset(&prop->subject_dhkey_in, 0, NP_FINGERPRINT_BYTES);
   memset(&prop->subject_dhkey_out, 0, NP_FINGERPRINT_BYTES);
   // memset(&prop->subject_dhkey_wire, 0, NP_FINGERPRINT_BYTES);
+
+  prop->conf_generation = 0;
+  TSP_INITD(prop->out_template, NULL);
 }
 
 void _np_msgproperty_run_t_new(np_state_t       *context,
@@ -152,13 +179,21 @@ void _np_msgproperty_run_t_new(np_state_t       *context,
 
   prop->msg_threshold = 0;
 
-  prop->response_handler = np_tree_create(); // only used for msghandler NP_ACK
-  prop->redelivery_messages =
-      np_tree_create(); // only used for msghandler "is_internal=false"
+  // only used for msghandler NP_ACK
+  prop->response_handler = np_uuidmap_create(0);
+  // only used for msghandler "is_internal=false"
+  prop->redelivery_messages = np_uuidmap_create(0);
+  pheap_init(np_redelivery_data_ptr,
+             prop->redelivery_schedule,
+             MSGPROPERTY_REDELIVERY_SCHEDULE_SIZE);
 
-  sll_init(np_message_ptr, prop->msg_cache);
+  prop->msg_cache.slots    = NULL;
+  prop->msg_cache.capacity = 0;
+  prop->msg_cache.first    = 0;
+  prop->msg_cache.count    = 0;
+  prop->discard_cb         = NULL;
 
-  prop->unique_uuids = np_tree_create();
+  prop->unique_uuids = np_uuidmap_create(0);
 
   np_init_datablock(prop->attributes, sizeof(prop->attributes));
 
@@ -189,6 +224,11 @@ void _np_msgproperty_conf_t_del(NP_UNUSED np_state_t *context,
     free(prop->rep_subject);
     prop->rep_subject = NULL;
   }
+  TSP_SCOPE(prop->out_template) {
+    __np_msgproperty_template_free(prop->out_template);
+    prop->out_template = NULL;
+  }
+  TSP_DESTROY(prop->out_template);
 }
 
 void _np_msgproperty_run_t_del(NP_UNUSED np_state_t *context,
@@ -204,13 +244,27 @@ void _np_msgproperty_run_t_del(NP_UNUSED np_state_t *context,
 
   assert(prop != NULL);
 
-  np_tree_free(prop->unique_uuids);
-  np_tree_free(prop->response_handler);    //
-  np_tree_free(prop->redelivery_messages); //
+  np_uuidmap_free(prop->unique_uuids);
+  np_uuidmap_free(prop->response_handler);
+  np_uuidmap_free(prop->redelivery_messages);
+  while (!pheap_is_empty(np_redelivery_data_ptr, prop->redelivery_schedule)) {
+    np_redelivery_data_t *redeliver =
+        pheap_head(np_redelivery_data_ptr, prop->redelivery_schedule);
+    if (redeliver->message != NULL)
+      np_unref_obj(np_message_t,
+                   redeliver->message,
+                   ref_msgproperty_redelivery);
+    free(redeliver);
+  }
+  pheap_free(np_redelivery_data_ptr, prop->redelivery_schedule);
 
-  if (prop->msg_cache != NULL) {
-    sll_free(np_message_ptr, prop->msg_cache);
+  for (uint16_t i = 0; i < prop->msg_cache.count; i++) {
+    np_message_t *msg =
+        prop->msg_cache
+            .slots[(prop->msg_cache.first + i) % prop->msg_cache.capacity];
+    np_unref_obj(np_message_t, msg, ref_msgproperty_msgcache);
   }
+  free(prop->msg_cache.slots);
 
   if (prop->user_callbacks != NULL) {
     sll_free(np_usercallback_ptr, prop->user_callbacks);
@@ -225,6 +279,9 @@ void _np_msgproperty_run_t_del(NP_UNUSED np_state_t *context,
 bool _np_msgproperty_init(np_state_t *context) {
   __local_tx_dhkey = _np_dhkey_generate_hash("local_tx", 8);
   __local_rx_dhkey = _np_dhkey_generate_hash("local_rx", 8);
+  np_generate_subject((np_subject *)&__forward_dhkey,
+                      _FORWARD,
+                      strnlen(_FORWARD, 256));
 
   // NEUROPIL_INTERN_MESSAGES
   np_sll_t(np_msgproperty_conf_ptr, msgproperties);
@@ -374,6 +431,139 @@ np_msgproperty_run_t *_np_msgproperty_run_get(np_state_t      *context,
   return ret;
 }
 
+bool _np_msgproperty_is_threshold_breached(np_state_t      *context,
+                                           np_msg_mode_type mode_type,
+                                           np_dhkey_t       subject) {
+  np_msgproperty_conf_t *property_conf =
+      _np_msgproperty_conf_get(context, mode_type, subject);
+  np_msgproperty_run_t *property_run =
+      _np_msgproperty_run_get(context, mode_type, subject);
+
+  return (property_conf != NULL && property_run != NULL &&
+          __np_msgproperty_threshold_breached(property_conf, property_run));
+}
+
+// returns an up to date outbound template, the caller has to hold the lock of
+// out_template
+static np_msgproperty_template_t *
+__np_msgproperty_template_get(np_state_t            *context,
+                              np_msgproperty_conf_t *self) {
+  uint32_t conf_generation =
+      __atomic_load_n(&self->conf_generation, __ATOMIC_ACQUIRE);
+  uint32_t attr_generation = _np_attributes_generation(context);
+
+  np_msgproperty_template_t *ret = self->out_template;
+  if (ret != NULL && ret->conf_generation == conf_generation &&
+      ret->attr_generation == attr_generation)
+    return ret;
+
+  if (ret == NULL) {
+    ret = malloc(sizeof(np_msgproperty_template_t));
+    CHECK_MALLOC(ret);
+    ret->header        = np_tree_create();
+    ret->instructions  = np_tree_create();
+    self->out_template = ret;
+  } else {
+    np_tree_clear(ret->header);
+    np_tree_clear(ret->instructions);
+  }
+  ret->conf_generation = conf_generation;
+  ret->attr_generation = attr_generation;
+
+  log_debug_msg(LOG_MSGPROPERTY,
+                "rebuilding outbound template of msgproperty %s",
+                self->msg_subject);
+
+  np_tree_insert_str(ret->header,
+                     _NP_MSG_HEADER_SUBJECT,
+                     np_treeval_new_dhkey(self->subject_dhkey));
+
+  // the subject is the same for each message, it is serialized once
+  ret->header_prefix_size = 0;
+  if (np_tree_get_byte_size(ret->header) <= MSG_HEADER_PREFIX_SIZE) {
+    np_serialize_buffer_t prefix_serializer = {
+        ._tree          = ret->header,
+        ._target_buffer = ret->header_prefix,
+        ._buffer_size   = MSG_HEADER_PREFIX_SIZE,
+        ._bytes_written = 0,
+        ._error         = 0};
+    np_serializer_write_elements(context, &prefix_serializer, ret->header);
+    if (prefix_serializer._error == 0)
+      ret->header_prefix_size = prefix_serializer._bytes_written;
+  }
+
+  np_tree_insert_str(ret->instructions,
+                     _NP_MSG_INST_TTL,
+                     np_treeval_new_d(self->msg_ttl));
+  np_tree_insert_str(ret->instructions,
+                     _NP_MSG_INST_ACK,
+                     np_treeval_new_ush(self->ack_mode));
+  // chunking placeholder, patched during serialization
+  np_tree_insert_str(ret->instructions,
+                     _NP_MSG_INST_PARTS,
+                     np_treeval_new_iarray(1, 1));
+  np_tree_insert_str(ret->instructions,
+                     _NP_MSG_INST_SEND_COUNTER,
+                     np_treeval_new_ush(0));
+  np_tree_insert_str(ret->instructions, _NP_MSG_INST_SEQ, np_treeval_new_ul(0));
+
+  ret->attributes_size = 0;
+  if (np_data_ok ==
+      np_init_datablock(ret->attributes, sizeof(ret->attributes))) {
+    np_merge_data(
+        ret->attributes,
+        (np_datablock_t *)_np_get_attributes_cache(context, NP_ATTR_USER_MSG));
+    np_merge_data(ret->attributes,
+                  (np_datablock_t *)_np_get_attributes_cache(
+                      context,
+                      NP_ATTR_IDENTITY_AND_USER_MSG));
+    np_merge_data(ret->attributes,
+                  (np_datablock_t *)_np_get_attributes_cache(
+                      context,
+                      NP_ATTR_INTENT_AND_USER_MSG));
+    if (np_data_ok != np_get_data_size(ret->attributes, &ret->attributes_size))
+      ret->attributes_size = 0;
+  }
+  return ret;
+}
+
+void _np_msgproperty_template_apply(np_state_t            *context,
+                                    np_msgproperty_conf_t *self,
+                                    np_message_t          *msg) {
+  TSP_SCOPE(self->out_template) {
+    np_msgproperty_template_t *out_template =
+        __np_msgproperty_template_get(context, self);
+    np_tree_copy(out_template->header, msg->header);
+    np_tree_copy(out_template->instructions, msg->instructions);
+
+    msg->header_prefix_size = out_template->header_prefix_size;
+    memcpy(msg->header_prefix,
+           out_template->header_prefix,
+           out_template->header_prefix_size);
+  }
+}
+
+size_t _np_msgproperty_template_attributes(np_state_t            *context,
+                                           np_msgproperty_conf_t *self,
+                                           np_tree_t             *body) {
+  size_t ret = 0;
+  TSP_SCOPE(self->out_template) {
+    np_msgproperty_template_t *out_template =
+        __np_msgproperty_template_get(context, self);
+    ret = out_template->attributes_size;
+    if (ret > 0) {
+      np_tree_insert_str(body,
+                         NP_SERIALISATION_ATTRIBUTES,
+                         np_treeval_new_bin(out_template->attributes, ret));
+    }
+  }
+  return ret;
+}
+
+void _np_msgproperty_template_invalidate(np_msgproperty_conf_t *self) {
+  __atomic_add_fetch(&self->conf_generation, 1, __ATOMIC_RELEASE);
+}
+
 /**
  ** returns the msgproperty struct #func# for the given #mode_type# and
  *#subject#, and creates it if it is not yet present
@@ -470,26 +660,30 @@ void np_msgproperty_register(np_msgproperty_conf_t *msg_property) {
   }
 }
 
+// each chunk of a message is checked on its own, the chunk numbers are mixed
+// into the (random) uuid
+static void __np_msgproperty_uniquety_key(const np_message_t *msg,
+                                          np_uuid_t          *key) {
+  uint32_t chunks[2] = {msg->no_of_chunks, msg->no_of_chunk};
+
+  *key = msg->uuid_key;
+  for (uint8_t i = 0; i < sizeof(chunks); i++)
+    key->b[NP_UUID_BIN_BYTES - sizeof(chunks) + i] ^=
+        ((unsigned char *)chunks)[i];
+}
+
 bool _np_msgproperty_check_msg_uniquety(np_msgproperty_conf_t *self_conf,
                                         np_msgproperty_run_t  *self_run,
                                         np_message_t          *msg_to_check) {
   bool ret = true;
   if (self_conf->unique_uuids_check) {
-    char _to_check[50] = {0};
-    sprintf(_to_check,
-            "%s:%05" PRIu32 ":%05" PRIu32,
-            msg_to_check->uuid,
-            msg_to_check->no_of_chunks,
-            msg_to_check->no_of_chunk);
-
-    if (np_tree_find_str(self_run->unique_uuids, _to_check) == NULL) {
-      np_tree_insert_str(
-          self_run->unique_uuids,
-          _to_check,
-          np_treeval_new_d(_np_message_get_expiery(msg_to_check)));
-    } else {
-      ret = false;
-    }
+    np_uuid_t _to_check;
+    __np_msgproperty_uniquety_key(msg_to_check, &_to_check);
+
+    ret = np_uuidmap_insert(
+        self_run->unique_uuids,
+        &_to_check,
+        np_treeval_new_d(_np_message_get_expiery(msg_to_check)));
   }
   return ret;
 }
@@ -526,7 +720,9 @@ np_treeval_new_d(_np_message_get_expiery(msg_to_check)));
 void _np_msgproperty_remove_msg_from_uniquety_list(
     np_msgproperty_run_t *self, np_message_t *msg_to_remove) {
   // if (self->unique_uuids_check) {
-  np_tree_del_str(self->unique_uuids, msg_to_remove->uuid);
+  np_uuid_t _to_remove;
+  __np_msgproperty_uniquety_key(msg_to_remove, &_to_remove);
+  np_uuidmap_del(self->unique_uuids, &_to_remove);
   // }
 }
 
@@ -536,53 +732,26 @@ void _np_msgproperty_job_msg_uniquety(np_msgproperty_conf_t *self_conf,
   // TODO: iter over msgproeprties and remove expired msg uuid from unique_uuids
   double now;
   if (self_conf->unique_uuids_check) {
-    sll_init_full(char_ptr, to_remove);
-
-    np_tree_elem_t *iter_tree = NULL;
-    now                       = np_time_now();
-    RB_FOREACH (iter_tree, np_tree_s, self_run->unique_uuids) {
-      if (iter_tree->val.value.d < now) {
-        sll_append(char_ptr, to_remove, iter_tree->key.value.s);
+    uint32_t removed = 0;
+    uint32_t pos     = 0;
+
+    np_uuidmap_entry_t *iter_map = NULL;
+    now                          = np_time_now();
+    while ((iter_map = np_uuidmap_next(self_run->unique_uuids, &pos))) {
+      if (iter_map->val.value.d < now) {
+        np_uuidmap_del_entry(self_run->unique_uuids, iter_map);
+        removed++;
       }
     }
 
-    sll_iterator(char_ptr) iter_to_rm = sll_first(to_remove);
-    if (iter_to_rm != NULL) {
+    if (removed > 0) {
       log_debug_msg(LOG_DEBUG | LOG_MSGPROPERTY,
-                    "UNIQUITY removing %" PRIu32 " from %" PRIu16
-                    " items from unique_uuids for %s",
-                    sll_size(to_remove),
+                    "UNIQUITY removed %" PRIu32 " items, %" PRIu32
+                    " items left in unique_uuids for %s",
+                    removed,
                     self_run->unique_uuids->size,
                     self_conf->msg_subject);
-      while (iter_to_rm != NULL) {
-        np_tree_del_str(self_run->unique_uuids, iter_to_rm->val);
-        sll_next(iter_to_rm);
-      }
     }
-    // sll_clear(char_ptr, to_remove);
-
-    // iter_tree = NULL;
-    // RB_FOREACH(iter_tree, np_tree_s, self->unique_uuids_out)
-    // {
-    //     if (iter_tree->val.value.d < now) {
-    //         sll_append(char_ptr, to_remove, iter_tree->key.value.s);
-    //     }
-    // }
-
-    // iter_to_rm = sll_first(to_remove);
-    // if(iter_to_rm != NULL) {
-    //     log_debug_msg(LOG_DEBUG | LOG_MSGPROPERTY ,"UNIQUITY removing
-    //     %"PRIu32" from %"PRIu16" items from unique_uuids for %s",
-    //                                                 sll_size(to_remove),
-    //                                                 self->unique_uuids_out->size,
-    //                                                 self->msg_subject);
-    //     while (iter_to_rm != NULL)
-    //     {
-    //         np_tree_del_str(self->unique_uuids_out, iter_to_rm->val);
-    //         sll_next(iter_to_rm);
-    //     }
-    // }
-    sll_free(char_ptr, to_remove);
   }
 }
 
@@ -597,17 +766,17 @@ void _np_msgproperty_cleanup_response_handler(np_msgproperty_run_t *self,
   np_ctx_memory(self);
 
   // remove expired msg uuid from response uuids
-  double now = np_time_now();
-  sll_init_full(char_ptr, to_remove);
+  double   now     = np_time_now();
+  uint32_t removed = 0;
+  uint32_t pos     = 0;
 
-  np_tree_elem_t         *iter_tree = NULL;
-  np_responsecontainer_t *current   = NULL;
-  now                               = np_time_now();
+  np_uuidmap_entry_t     *iter_map = NULL;
+  np_responsecontainer_t *current  = NULL;
 
-  RB_FOREACH (iter_tree, np_tree_s, self->response_handler) {
+  while ((iter_map = np_uuidmap_next(self->response_handler, &pos))) {
     bool handle_event = false;
 
-    current = (np_responsecontainer_t *)iter_tree->val.value.v;
+    current = (np_responsecontainer_t *)iter_map->val.value.v;
     // TODO: find correct dhkey from responsecontainer and use it as
     // target_dhkey
     np_util_event_t response_event = {.user_data = current};
@@ -673,23 +842,122 @@ void _np_msgproperty_cleanup_response_handler(np_msgproperty_run_t *self,
       np_unref_obj(np_responsecontainer_t,
                    current,
                    "_np_message_add_response_handler");
-      sll_append(char_ptr, to_remove, iter_tree->key.value.s);
+      np_uuidmap_del_entry(self->response_handler, iter_map);
+      removed++;
     }
   }
 
-  sll_iterator(char_ptr) iter_to_rm = sll_first(to_remove);
-  if (iter_to_rm != NULL) {
+  if (removed > 0) {
     log_debug_msg(LOG_DEBUG | LOG_MSGPROPERTY,
-                  "RESPONSE removing %" PRIu32 " from %" PRIu16
-                  " items from response_handler",
-                  sll_size(to_remove),
+                  "RESPONSE removed %" PRIu32 " items, %" PRIu32
+                  " items left in response_handler",
+                  removed,
                   self->response_handler->size);
-    while (iter_to_rm != NULL) {
-      np_tree_del_str(self->response_handler, iter_to_rm->val);
-      sll_next(iter_to_rm);
+  }
+}
+
+static np_message_t *__np_msgcache_peek(struct np_msgcache_s *cache,
+                                        bool                  newest) {
+  if (cache->count == 0) return NULL;
+
+  if (newest)
+    return cache->slots[(cache->first + cache->count - 1) % cache->capacity];
+  else return cache->slots[cache->first];
+}
+
+static np_message_t *__np_msgcache_pop(struct np_msgcache_s *cache,
+                                       bool                  newest) {
+  np_message_t *ret = __np_msgcache_peek(cache, newest);
+  if (ret == NULL) return NULL;
+
+  if (!newest) cache->first = (cache->first + 1) % cache->capacity;
+  cache->count--;
+  return ret;
+}
+
+np_message_t *
+_np_msgproperty_msgcache_next(np_msgproperty_conf_t *property_conf,
+                              np_msgproperty_run_t  *property_run,
+                              bool                   take) {
+  bool newest = FLAG_CMP(property_conf->cache_policy, LIFO);
+  if (!newest && !FLAG_CMP(property_conf->cache_policy, FIFO)) return NULL;
+
+  if (take) return __np_msgcache_pop(&property_run->msg_cache, newest);
+  else return __np_msgcache_peek(&property_run->msg_cache, newest);
+}
+
+static void __np_msgcache_push(struct np_msgcache_s *cache, np_message_t *msg) {
+  assert(cache->count < cache->capacity);
+
+  cache->slots[(cache->first + cache->count) % cache->capacity] = msg;
+  cache->count++;
+}
+
+// counts the dropped message and hands it to the user discard hook, the
+// reference of the msg_cache has to be released by the caller
+static void __np_msgproperty_discard(np_state_t            *context,
+                                     np_msgproperty_conf_t *property_conf,
+                                     np_msgproperty_run_t  *property_run,
+                                     np_message_t          *msg) {
+  __np_increment_msgcache_dropped_counter(context,
+                                          property_conf->subject_dhkey);
+
+  if (property_run->discard_cb == NULL) return;
+
+  struct np_message_view view = {.uuid        = msg->uuid,
+                                 .received_at = np_time_now()};
+  memcpy(&view.subject, &property_conf->subject_dhkey, NP_FINGERPRINT_BYTES);
+
+  np_dhkey_t *sender = _np_message_get_sender(msg);
+  if (sender != NULL) memcpy(&view.from, sender, NP_FINGERPRINT_BYTES);
+
+  // only outbound messages are still unencrypted
+  if (msg->body != NULL) {
+    np_tree_elem_t *userdata =
+        np_tree_find_str(msg->body, NP_SERIALISATION_USERDATA);
+    if (userdata != NULL) {
+      view.data        = userdata->val.value.bin;
+      view.data_length = userdata->val.size;
+    }
+    np_tree_elem_t *msg_attributes =
+        np_tree_find_str(msg->body, NP_SERIALISATION_ATTRIBUTES);
+    if (msg_attributes != NULL) {
+      view.attributes        = msg_attributes->val.value.bin;
+      view.attributes_length = msg_attributes->val.size;
     }
   }
-  sll_free(char_ptr, to_remove);
+  property_run->discard_cb(context, &view);
+}
+
+// adapts the capacity of the msg_cache to the configured cache_size, surplus
+// messages are dropped starting with the oldest one
+static void __np_msgcache_resize(np_state_t            *context,
+                                 np_msgproperty_conf_t *property_conf,
+                                 np_msgproperty_run_t  *property_run) {
+  struct np_msgcache_s *cache    = &property_run->msg_cache;
+  uint16_t              capacity = property_conf->cache_size;
+
+  if (cache->capacity == capacity) return;
+
+  while (cache->count > capacity) {
+    np_message_t *old_msg = __np_msgcache_pop(cache, false);
+    __np_msgproperty_discard(context, property_conf, property_run, old_msg);
+    np_unref_obj(np_message_t, old_msg, ref_msgproperty_msgcache);
+  }
+
+  np_message_t **slots = NULL;
+  if (capacity > 0) {
+    slots = calloc(capacity, sizeof(np_message_t *));
+    CHECK_MALLOC(slots);
+  }
+  for (uint16_t i = 0; i < cache->count; i++) {
+    slots[i] = cache->slots[(cache->first + i) % cache->capacity];
+  }
+  free(cache->slots);
+
+  cache->slots    = slots;
+  cache->capacity = capacity;
+  cache->first    = 0;
 }
 
 void _np_msgproperty_check_msgcache(np_util_statemachine_t *statemachine,
@@ -703,52 +971,40 @@ void _np_msgproperty_check_msgcache(np_util_statemachine_t *statemachine,
   NP_CAST(my_property_key->entity_array[1], np_msgproperty_run_t, property_run);
   // NP_CAST(event.user_data, np_message_t, message);
 
+  struct np_msgcache_s *cache = &property_run->msg_cache;
+
   // check if we are (one of the) sending node(s) of this kind of message
   // should not return NULL
-  log_debug_msg(
-      LOG_ROUTING,
-      "this node is one sender of messages, checking msgcache (%p / %u) ...",
-      property_run->msg_cache,
-      sll_size(property_run->msg_cache));
-
-  // get message from cache (maybe only for one way mep ?!)
-  uint16_t msg_available = 0;
-  msg_available          = sll_size(property_run->msg_cache);
-
-  while (0 < msg_available && msg_available <= property_conf->cache_size) {
-    np_message_t *msg_out = NULL;
-    // if messages are available in cache, send them !
-    if (FLAG_CMP(property_conf->cache_policy, FIFO))
-      msg_out = sll_head(np_message_ptr, property_run->msg_cache);
-    else if (FLAG_CMP(property_conf->cache_policy, LIFO))
-      msg_out = sll_tail(np_message_ptr, property_run->msg_cache);
-    else break;
-
-    // check for more messages in cache after head/tail command
-    // msg_available = sll_size(send_prop->msg_cache_out);
-    msg_available--;
-
-    if (NULL != msg_out) {
-      np_dhkey_t target_dhkey = {0};
-      log_debug(
-          LOG_MSGPROPERTY,
-          "message in sender cache found and initialize resend for msg %s",
-          msg_out->uuid);
-
-      np_util_event_t send_event = {
-          .type         = (evt_internal | evt_userspace | evt_message),
-          .user_data    = msg_out,
-          .target_dhkey = target_dhkey};
-      _np_event_runtime_add_event(context,
-                                  event.current_run,
-                                  property_conf->subject_dhkey_out,
-                                  send_event);
+  log_debug_msg(LOG_ROUTING,
+                "this node is one sender of messages, checking msgcache "
+                "(%" PRIu16 " / %" PRIu16 ") ...",
+                cache->count,
+                cache->capacity);
+
+  // a receiver is available, drain the complete cache in policy order
+  np_message_t *msg_out = NULL;
+  while (NULL != (msg_out = _np_msgproperty_msgcache_next(property_conf,
+                                                          property_run,
+                                                          true))) {
+    np_dhkey_t target_dhkey = {0};
+    log_debug(LOG_MSGPROPERTY,
+              "message in sender cache found and initialize resend for msg %s",
+              msg_out->uuid);
+
+    np_util_event_t send_event = {
+        .type         = (evt_internal | evt_userspace | evt_message),
+        .user_data    = msg_out,
+        .target_dhkey = target_dhkey};
+    _np_event_runtime_add_event(context,
+                                event.current_run,
+                                property_conf->subject_dhkey_out,
+                                send_event);
 
-      np_unref_obj(np_message_t, msg_out, ref_msgproperty_msgcache);
-    } else {
-      break;
-    }
+    np_unref_obj(np_message_t, msg_out, ref_msgproperty_msgcache);
   }
+  __np_statistics_set_msgcache_size(context,
+                                    property_conf->subject_dhkey,
+                                    cache->count);
 }
 
 void _np_msgproperty_check_msgcache_for(np_util_statemachine_t *statemachine,
@@ -766,66 +1022,44 @@ void _np_msgproperty_check_msgcache_for(np_util_statemachine_t *statemachine,
   NP_CAST(my_property_key->entity_array[1], np_msgproperty_run_t, property_run);
   // NP_CAST(event.user_data, np_message_t, message);
 
-  log_debug_msg(
-      LOG_MSGPROPERTY | LOG_ROUTING,
-      "this node is the receiver of messages, checking msgcache (%p / %u) ...",
-      property_run->msg_cache,
-      sll_size(property_run->msg_cache));
-  // get message from cache (maybe only for one way mep ?!)
-  uint16_t msg_available = 0;
-
-  msg_available = sll_size(property_run->msg_cache);
-
-  while (0 < msg_available && msg_available <= property_conf->cache_size) {
-    // grab a message
-    np_message_t *msg = NULL;
-    sll_iterator(np_message_ptr) peek;
-    // if messages are available in cache, try to decode them !
-    if (FLAG_CMP(property_conf->cache_policy, FIFO)) {
-      peek = sll_first(property_run->msg_cache);
-      if (peek != NULL && peek->val != NULL &&
-          _np_dhkey_cmp(_np_message_get_sender(peek->val),
-                        &event.target_dhkey) == 0) {
-        msg = sll_head(np_message_ptr, property_run->msg_cache);
-      }
-    } else if (FLAG_CMP(property_conf->cache_policy, LIFO)) {
-      peek = sll_last(property_run->msg_cache);
-      if (peek != NULL && peek->val != NULL &&
-          _np_dhkey_cmp(_np_message_get_sender(peek->val),
-                        &event.target_dhkey) == 0) {
-        msg = sll_tail(np_message_ptr, property_run->msg_cache);
-      }
-    }
-    // recalc number of available messages
-    // msg_available = sll_size(recv_prop->msg_cache_in);
-    msg_available--;
-
-    // handle selected message
-    if (NULL != msg) {
-      log_debug(LOG_MSGPROPERTY,
-                "message in receiver cache found and initialize redelivery for "
-                "msg %s",
-                msg->uuid);
-      np_dhkey_t in_handler =
-          property_conf
-              ->subject_dhkey_in; // (INBOUND, property_conf->msg_subject);
-      np_util_event_t msg_in_event = {.type = (evt_external | evt_message),
-                                      .target_dhkey = in_handler,
-                                      .user_data    = msg};
-      _np_event_runtime_add_event(context,
-                                  current_run,
-                                  in_handler,
-                                  msg_in_event);
+  struct np_msgcache_s *cache = &property_run->msg_cache;
 
-      np_unref_obj(np_message_t, msg, ref_msgproperty_msgcache);
+  log_debug_msg(LOG_MSGPROPERTY | LOG_ROUTING,
+                "this node is the receiver of messages, checking msgcache "
+                "(%" PRIu16 " / %" PRIu16 ") ...",
+                cache->count,
+                cache->capacity);
 
-    } else {
+  np_message_t *peek = NULL;
+  while (NULL != (peek = _np_msgproperty_msgcache_next(property_conf,
+                                                       property_run,
+                                                       false))) {
+    // grab a message, if it can be decoded with the new token
+    if (_np_dhkey_cmp(_np_message_get_sender(peek), &event.target_dhkey) != 0)
       break;
-    }
+
+    np_message_t *msg =
+        _np_msgproperty_msgcache_next(property_conf, property_run, true);
+    log_debug(LOG_MSGPROPERTY,
+              "message in receiver cache found and initialize redelivery for "
+              "msg %s",
+              msg->uuid);
+    np_dhkey_t in_handler =
+        property_conf
+            ->subject_dhkey_in; // (INBOUND, property_conf->msg_subject);
+    np_util_event_t msg_in_event = {.type = (evt_external | evt_message),
+                                    .target_dhkey = in_handler,
+                                    .user_data    = msg};
+    _np_event_runtime_add_event(context, current_run, in_handler, msg_in_event);
+
+    np_unref_obj(np_message_t, msg, ref_msgproperty_msgcache);
 
     // do not continue processing message if max treshold is reached
     if (property_run->msg_threshold > property_conf->max_threshold) break;
   }
+  __np_statistics_set_msgcache_size(context,
+                                    property_conf->subject_dhkey,
+                                    cache->count);
 }
 
 void _np_msgproperty_cleanup_cache(np_util_statemachine_t         *statemachine,
@@ -838,28 +1072,36 @@ void _np_msgproperty_cleanup_cache(np_util_statemachine_t         *statemachine,
           property_conf);
   NP_CAST(my_property_key->entity_array[1], np_msgproperty_run_t, property_run);
 
+  struct np_msgcache_s *cache = &property_run->msg_cache;
+
   log_debug(LOG_MSGPROPERTY,
-            "checking for outdated messages in msgcache (%s: %p / %u) ...",
+            "checking for outdated messages in msgcache (%s: %" PRIu16
+            " / %" PRIu16 ") ...",
             property_conf->msg_subject,
-            property_run->msg_cache,
-            sll_size(property_run->msg_cache));
+            cache->count,
+            cache->capacity);
 
-  sll_iterator(np_message_ptr) iter_prop_msg_cache =
-      sll_first(property_run->msg_cache);
-  while (iter_prop_msg_cache != NULL) {
-    sll_iterator(np_message_ptr) old_iter = iter_prop_msg_cache;
-    sll_next(iter_prop_msg_cache); // we need to iterate before we delete the
-                                   // old iter
-
-    np_message_t *old_msg = old_iter->val;
+  // compact the ring in place, the order of the remaining messages is kept
+  uint16_t kept = 0;
+  for (uint16_t i = 0; i < cache->count; i++) {
+    np_message_t *old_msg = cache->slots[(cache->first + i) % cache->capacity];
     ASSERT(old_msg != NULL, "cannot have an empty element");
+
     if (_np_message_is_expired(old_msg)) {
       // log_msg(LOG_WARNING,"purging expired message (subj: %s, uuid: %s) from
       // receiver cache ...", msg_prop->msg_subject, old_msg->uuid);
-      sll_delete(np_message_ptr, property_run->msg_cache, old_iter);
+      __np_msgproperty_discard(context, property_conf, property_run, old_msg);
       np_unref_obj(np_message_t, old_msg, ref_msgproperty_msgcache);
+    } else {
+      cache->slots[(cache->first + kept) % cache->capacity] = old_msg;
+      kept++;
     }
   }
+  cache->count = kept;
+
+  __np_statistics_set_msgcache_size(context,
+                                    property_conf->subject_dhkey,
+                                    cache->count);
   log_debug_msg(LOG_MSGPROPERTY,
                 "cleanup receiver cache for subject %s done",
                 property_conf->msg_subject);
@@ -875,44 +1117,136 @@ void __np_property_add_msg_to_cache(np_util_statemachine_t *statemachine,
           property_conf);
   NP_CAST(my_property_key->entity_array[1], np_msgproperty_run_t, property_run);
   NP_CAST(event.user_data, np_message_t, message);
+
+  struct np_msgcache_s *cache = &property_run->msg_cache;
+  __np_msgcache_resize(context, property_conf, property_run);
+
   // cache already full ?
-  if (property_conf->cache_size <= sll_size(property_run->msg_cache)) {
+  if (cache->count == cache->capacity) {
     log_debug_msg(LOG_MSGPROPERTY | LOG_DEBUG,
                   "msg cache full, checking overflow policy ...");
 
-    if (FLAG_CMP(property_conf->cache_policy, OVERFLOW_PURGE)) {
-      log_debug_msg(LOG_MSGPROPERTY | LOG_DEBUG,
-                    "OVERFLOW_PURGE: discarding message in msgcache for %s",
-                    property_conf->msg_subject);
-      np_message_t *old_msg = NULL;
-
-      if (FLAG_CMP(property_conf->cache_policy, FIFO))
-        old_msg = sll_head(np_message_ptr, property_run->msg_cache);
-      else if (FLAG_CMP(property_conf->cache_policy, LIFO))
-        old_msg = sll_tail(np_message_ptr, property_run->msg_cache);
-
-      if (old_msg != NULL) {
-        // TODO: add callback hook to allow user space handling of discarded
-        // message
-        np_unref_obj(np_message_t, old_msg, ref_msgproperty_msgcache);
-      }
-    }
-
-    if (FLAG_CMP(property_conf->cache_policy, OVERFLOW_REJECT)) {
+    if (FLAG_CMP(property_conf->cache_policy, OVERFLOW_REJECT) ||
+        cache->capacity == 0) {
       log_debug_msg(LOG_MSGPROPERTY | LOG_DEBUG,
                     "rejecting new message because cache is full");
+      __np_msgproperty_discard(context, property_conf, property_run, message);
+      return;
     }
+
+    // OVERFLOW_PURGE: the oldest message makes room, regardless of the order
+    // in which the cache is delivered
+    log_debug_msg(LOG_MSGPROPERTY | LOG_DEBUG,
+                  "OVERFLOW_PURGE: discarding message in msgcache for %s",
+                  property_conf->msg_subject);
+    np_message_t *old_msg = __np_msgcache_pop(cache, false);
+    __np_msgproperty_discard(context, property_conf, property_run, old_msg);
+    np_unref_obj(np_message_t, old_msg, ref_msgproperty_msgcache);
   }
 
   np_ref_obj(np_message_t, message, ref_msgproperty_msgcache);
+  __np_msgcache_push(cache, message);
 
   log_debug(LOG_MSGPROPERTY | LOG_ROUTING,
-            "added message (%s) to msgcache (%p / %d) ...",
+            "added message (%s) to msgcache (%" PRIu16 " / %" PRIu16 ") ...",
             message->uuid,
-            property_run->msg_cache,
-            sll_size(property_run->msg_cache));
+            cache->count,
+            cache->capacity);
+  __np_statistics_set_msgcache_size(context,
+                                    property_conf->subject_dhkey,
+                                    cache->count);
+}
 
-  sll_prepend(np_message_ptr, property_run->msg_cache, message);
+bool _np_msgproperty_redelivery_add(np_state_t           *context,
+                                    np_msgproperty_run_t *self,
+                                    np_message_t         *msg,
+                                    np_dhkey_t            target,
+                                    double                redelivery_at) {
+  if (np_uuidmap_find(self->redelivery_messages, &msg->uuid_key) != NULL)
+    return false;
+
+  np_pheap_t(np_redelivery_data_ptr, schedule) = self->redelivery_schedule;
+  if (schedule->count == schedule->size) {
+    if (schedule->size >= MSGPROPERTY_REDELIVERY_SCHEDULE_MAX) {
+      log_msg(LOG_WARNING,
+              "redelivery schedule full, message %s will not be redelivered",
+              msg->uuid);
+      return false;
+    }
+    // grow the schedule, acknowledged entries are released on the way
+    np_pheap_t(np_redelivery_data_ptr, larger) = NULL;
+    pheap_init(np_redelivery_data_ptr,
+               larger,
+               MIN(2 * schedule->size, MSGPROPERTY_REDELIVERY_SCHEDULE_MAX));
+    while (!pheap_is_empty(np_redelivery_data_ptr, schedule)) {
+      np_redelivery_data_t *current =
+          pheap_head(np_redelivery_data_ptr, schedule);
+      if (current->message == NULL) free(current);
+      else pheap_insert(np_redelivery_data_ptr, larger, current);
+    }
+    pheap_free(np_redelivery_data_ptr, schedule);
+    self->redelivery_schedule = schedule = larger;
+  }
+
+  np_redelivery_data_t *redeliver = malloc(sizeof(np_redelivery_data_t));
+  CHECK_MALLOC(redeliver);
+  _np_dhkey_assign(&redeliver->target, &target);
+  redeliver->message       = msg;
+  redeliver->redelivery_at = redelivery_at;
+
+  np_ref_obj(np_message_t, msg, ref_msgproperty_redelivery);
+  np_uuidmap_insert(self->redelivery_messages,
+                    &msg->uuid_key,
+                    np_treeval_new_v(redeliver));
+  pheap_insert(np_redelivery_data_ptr, schedule, redeliver);
+  return true;
+}
+
+bool _np_msgproperty_redelivery_remove(np_state_t           *context,
+                                       np_msgproperty_run_t *self,
+                                       const np_uuid_t      *msg_uuid,
+                                       np_dhkey_t           *hop) {
+  np_treeval_t *elem = np_uuidmap_find(self->redelivery_messages, msg_uuid);
+  if (elem == NULL) return false;
+
+  // the entry stays in the schedule until it is due, this avoids a linear
+  // search in the heap
+  np_redelivery_data_t *redeliver = elem->value.v;
+  if (hop != NULL) _np_dhkey_assign(hop, &redeliver->message->hop_dhkey);
+  np_uuidmap_del(self->redelivery_messages, msg_uuid);
+  np_unref_obj(np_message_t, redeliver->message, ref_msgproperty_redelivery);
+  redeliver->message = NULL;
+  return true;
+}
+
+np_message_t *
+_np_msgproperty_redelivery_next(np_state_t           *context,
+                                np_msgproperty_run_t *self,
+                                double                now,
+                                double                resend_interval,
+                                np_dhkey_t           *target) {
+  np_pheap_t(np_redelivery_data_ptr, schedule) = self->redelivery_schedule;
+
+  while (!pheap_is_empty(np_redelivery_data_ptr, schedule)) {
+    np_redelivery_data_t *current =
+        pheap_first(np_redelivery_data_ptr, schedule);
+    if (current->redelivery_at >= now) break;
+
+    current = pheap_head(np_redelivery_data_ptr, schedule);
+    if (current->message == NULL) {
+      free(current);
+      continue;
+    }
+    // O(log n) reschedule of the same entry
+    current->redelivery_at += resend_interval;
+    if (current->redelivery_at < now)
+      current->redelivery_at = now + resend_interval;
+    pheap_insert(np_redelivery_data_ptr, schedule, current);
+
+    if (target != NULL) _np_dhkey_assign(target, &current->target);
+    return current->message;
+  }
+  return NULL;
 }
 
 void __np_msgproperty_redeliver_messages(np_util_statemachine_t *statemachine,
@@ -925,49 +1259,29 @@ void __np_msgproperty_redeliver_messages(np_util_statemachine_t *statemachine,
           property_conf);
   NP_CAST(my_property_key->entity_array[1], np_msgproperty_run_t, property_run);
 
-  // remove expired msg uuid from response uuids
   double now             = np_time_now();
   double resend_interval = property_conf->msg_ttl / (property_conf->retry + 1);
 
-  np_tree_elem_t       *iter_tree = NULL;
-  np_redelivery_data_t *current   = NULL;
-
-  RB_FOREACH (iter_tree, np_tree_s, property_run->redelivery_messages) {
-    current = (np_redelivery_data_t *)iter_tree->val.value.v;
-
-    if (current->redelivery_at < now) { // send message redelivery attempt
-      current->redelivery_at = current->redelivery_at + resend_interval;
-
-      np_message_t *redeliver_copy = NULL;
-      np_new_obj(np_message_t, redeliver_copy, FUNC);
-      np_message_clone(redeliver_copy, current->message);
-
-      np_util_event_t message_event = {.type = (evt_message | evt_internal),
-                                       .user_data    = redeliver_copy,
-                                       .target_dhkey = current->target};
-      _np_event_runtime_add_event(context,
-                                  event.current_run,
-                                  property_conf->subject_dhkey_out,
-                                  message_event);
-      /*
-      char buf[100];
-      snprintf(buf,100,"urn:np:message:redelivery:%s",redeliver_copy->uuid);
-      if(!np_jobqueue_submit_event(context, 0, property_conf->subject_dhkey_out,
-      message_event, buf)){ log_error("Jobqueue rejected new job for message
-      redelivery of msg %s. No resend will be initiated.", redeliver_copy->uuid
-          );
-      }else{
-          log_info(LOG_ROUTING, "re-delivery of message %s / %s inititated",
-      iter_tree->key.value.s, property_conf->msg_subject);
-      }
-      */
-      log_info(LOG_ROUTING,
-               "re-delivery of message %s / %s inititated",
-               iter_tree->key.value.s,
-               property_conf->msg_subject);
-
-      np_unref_obj(np_message_t, redeliver_copy, FUNC);
-    }
+  np_dhkey_t    target = {0};
+  np_message_t *redeliver_msg;
+  while (NULL != (redeliver_msg =
+                      _np_msgproperty_redelivery_next(context,
+                                                      property_run,
+                                                      now,
+                                                      resend_interval,
+                                                      &target))) {
+    // the message is already encrypted and chunked, send it again on the way
+    // of the original send without passing the outbound callbacks
+    np_util_event_t message_event = {.type = (evt_message | evt_internal),
+                                     .user_data    = redeliver_msg,
+                                     .target_dhkey = target,
+                                     .current_run  = event.current_run};
+    _np_out_redeliver(context, message_event);
+
+    log_info(LOG_ROUTING,
+             "re-delivery of message %s / %s inititated",
+             redeliver_msg->uuid,
+             property_conf->msg_subject);
   }
 }
 
@@ -1107,6 +1421,10 @@ void __load_internal_callback(char            *msg_subject,
     if (mode == INBOUND)
       sll_append(np_evt_callback_t, callback_list, _np_in_pheromone);
   }
+  if (0 == strncmp(msg_subject, _NP_MSG_CONTROL_BUNDLE, msg_subject_len)) {
+    if (mode == INBOUND)
+      sll_append(np_evt_callback_t, callback_list, _np_in_control_bundle);
+  }
 }
 
 void _np_msgproperty_create_token_ledger(np_util_statemachine_t *statemachine,
@@ -1520,6 +1838,8 @@ void np_msgproperty_from_user(np_state_t              *context,
 
   // mep type conversion
   dest->mep_type = ANY_TO_ANY;
+
+  _np_msgproperty_template_invalidate(dest);
 }
 
 // NP_UTIL_STATEMACHINE_TRANSITION(states, UNUSED, IN_USE_MSGPROPERTY,
@@ -1594,6 +1914,7 @@ void __np_set_property(np_util_statemachine_t *statemachine,
   my_property_key->type |= np_key_type_subject;
 
   my_property_key->entity_array[0] = property;
+  _np_msgproperty_template_invalidate(property);
   log_debug_msg(LOG_MSGPROPERTY,
                 "sto  :msgproperty %s: %p added to list: %p / %p",
                 property->msg_subject,
@@ -1626,8 +1947,22 @@ void __np_property_update(np_util_statemachine_t *statemachine,
           np_msgproperty_conf_t,
           old_property);
   NP_CAST(event.user_data, np_msgproperty_conf_t, new_property);
-  // buggy, but for now ...
-  *old_property = *new_property;
+  if (old_property != new_property) {
+    // buggy, but for now ... the outbound template and its lock stay with the
+    // old property
+    np_msgproperty_template_t *out_template = NULL;
+    np_spinlock_t              out_template_lock;
+    TSP_SCOPE(old_property->out_template) {
+      out_template               = old_property->out_template;
+      old_property->out_template = NULL;
+    }
+    out_template_lock               = old_property->out_template_lock;
+    *old_property                   = *new_property;
+    old_property->out_template      = NULL;
+    old_property->out_template_lock = out_template_lock;
+    __np_msgproperty_template_free(out_template);
+  }
+  _np_msgproperty_template_invalidate(old_property);
 }
 
 void __np_msgproperty_send_available_messages(
@@ -2008,7 +2343,16 @@ void __np_property_handle_in_msg(np_util_statemachine_t *statemachine,
 
   __np_msgproperty_threshold_decrease(property_conf, property_run);
 
-  if (ret) _np_increment_received_msgs_counter(property_conf->subject_dhkey);
+  if (ret) {
+    _np_increment_received_msgs_counter(property_conf->subject_dhkey);
+
+    np_tree_elem_t *msg_tstamp =
+        np_tree_find_str(msg_in->instructions, _NP_MSG_INST_TSTAMP);
+    if (msg_tstamp != NULL)
+      _np_statistics_observe_end_to_end(
+          property_conf->subject_dhkey,
+          np_time_now() - msg_tstamp->val.value.d);
+  }
 
   log_debug(LOG_MESSAGE,
             "in: (subject: %s / msg: %s) handling complete",
@@ -2195,21 +2539,16 @@ void __np_property_redelivery_set(np_util_statemachine_t *statemachine,
 
   double resend_interval = property_conf->msg_ttl / (property_conf->retry + 1);
 
-  if (np_tree_find_str(property_run->redelivery_messages, message->uuid) ==
-      NULL) {
+  if (_np_msgproperty_redelivery_add(context,
+                                     property_run,
+                                     message,
+                                     event.target_dhkey,
+                                     message->send_at + resend_interval)) {
     log_msg(LOG_INFO,
             "storing message %s / %s for possible re-delivery",
             message->uuid,
             property_conf->msg_subject);
     __np_msgproperty_threshold_increase(property_conf, property_run);
-    np_redelivery_data_t *redeliver = malloc(sizeof(np_redelivery_data_t));
-    _np_dhkey_assign(&redeliver->target, &event.target_dhkey);
-    redeliver->message       = message;
-    redeliver->redelivery_at = message->send_at + resend_interval;
-    np_tree_insert_str(property_run->redelivery_messages,
-                       message->uuid,
-                       np_treeval_new_v(redeliver));
-    np_ref_obj(np_message_t, message, FUNC);
   }
 }
 
@@ -2227,27 +2566,37 @@ void __np_response_handler_set(np_util_statemachine_t *statemachine,
 
   if (property_conf->is_internal) { // registration of response handler for
                                     // message type NP_ACK
-    if (np_tree_find_str(property_run->response_handler,
-                         responsehandler->uuid) == NULL)
-      np_tree_insert_str(property_run->response_handler,
-                         responsehandler->uuid,
-                         np_treeval_new_v(responsehandler));
+    np_uuidmap_insert(property_run->response_handler,
+                      &responsehandler->uuid_key,
+                      np_treeval_new_v(responsehandler));
   } else { // a responsehandler reporting a timeout or an acknowledgement
-    CHECK_STR_FIELD_BOOL(property_run->redelivery_messages,
-                         responsehandler->uuid,
-                         msg_tree_elem,
-                         "NO UUID FOUND") {
+    np_dhkey_t hop = {0};
+    if (_np_msgproperty_redelivery_remove(context,
+                                          property_run,
+                                          &responsehandler->uuid_key,
+                                          &hop)) {
       log_msg(LOG_INFO,
               "message %s / %s acknowledged or timed out",
               responsehandler->uuid,
               property_conf->msg_subject);
-      np_redelivery_data_t *redeliver = msg_tree_elem->val.value.v;
-      np_unref_obj(np_message_t,
-                   redeliver->message,
-                   "__np_property_redelivery_set");
-      np_tree_del_str(property_run->redelivery_messages, responsehandler->uuid);
-      free(redeliver);
       __np_msgproperty_threshold_decrease(property_conf, property_run);
+
+      // the first hop adjusts its send window to the acks of the messages
+      if (!_np_dhkey_equal(&hop, &dhkey_zero) &&
+          _np_keycache_exists(context, hop, NULL)) {
+        np_util_event_t hop_event = event;
+        hop_event.target_dhkey    = hop;
+        hop_event.cleanup = __np_msgproperty_event_cleanup_response_handler;
+        np_ref_obj(np_responsecontainer_t,
+                   responsehandler,
+                   "_np_msgproperty_cleanup_response_handler");
+        _np_event_runtime_add_event(context,
+                                    event.current_run,
+                                    hop,
+                                    hop_event);
+      }
+    } else {
+      log_error("NO UUID FOUND");
     }
     // np_unref_obj(np_responsecontainer_t, responsehandler, ref_obj_usage);
   }
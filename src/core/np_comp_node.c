@@ -12,6 +12,8 @@
 
 #include <inttypes.h>
 
+#include "neuropil_data.h"
+
 #include "util/np_event.h"
 #include "util/np_statemachine.h"
 
@@ -19,6 +21,7 @@
 #include "np_axon.h"
 #include "np_eventqueue.h"
 #include "np_evloop.h"
+#include "np_jobqueue.h"
 #include "np_key.h"
 #include "np_keycache.h"
 #include "np_legacy.h"
@@ -27,6 +30,7 @@
 #include "np_network.h"
 #include "np_responsecontainer.h"
 #include "np_route.h"
+#include "np_statistics.h"
 
 // IN_SETUP -> IN_USE transition condition / action #1
 bool __is_node_handshake_token(np_util_statemachine_t *statemachine,
@@ -396,6 +400,17 @@ void __np_node_set(np_util_statemachine_t *statemachine,
     }
     np_ref_obj(np_node_t, node_key->entity_array[2], "__np_node_set");
 
+    if (node_token->type == np_aaatoken_type_handshake) {
+      // older nodes do not announce their capabilities
+      struct np_data_conf cfg;
+      np_data_value       capabilities = {.unsigned_integer = 0};
+      char                key[255]     = {0};
+      strncpy(key, NP_HS_CAPABILITIES, 254);
+      np_get_data(node_token->attributes, key, &cfg, &capabilities);
+      ((np_node_t *)node_key->entity_array[2])->capabilities =
+          capabilities.unsigned_integer;
+    }
+
     // handle handshake token after wildcard join
     char *tmp_connection_str = np_get_connection_string_from(node_key, false);
     np_dhkey_t wildcard_dhkey =
@@ -502,6 +517,13 @@ void __np_node_update(np_util_statemachine_t *statemachine,
              node->latency,
              node->latency_win[node->latency_win_index]);
   }
+  _np_set_success_avg(node_key->dhkey, node->success_avg);
+  _np_set_latency(node_key->dhkey, node->latency);
+  // the queue may also grow while no acks arrive
+  np_network_t *network = _np_key_get_network(node_key);
+  if (network != NULL)
+    _np_set_send_queue_size(node_key->dhkey, _np_network_queue_size(network));
+
   if (node->is_in_routing_table || node->is_in_leafset)
     log_info(LOG_EXPERIMENT,
              "connection to node %.15s:%.6s success rate now: %1.2f latency "
@@ -1041,6 +1063,8 @@ void __np_node_destroy(np_util_statemachine_t         *statemachine,
   __np_key_to_trinity(node_key, &trinity);
 
   _np_network_disable(trinity.network);
+  // the metric slots of the peer are reused by the next peer
+  _np_statistics_release_dhkey_metrics(node_key->dhkey);
 
   if (node_key->entity_array[3] != NULL)
     np_unref_obj(np_network_t,
@@ -1340,16 +1364,26 @@ void __np_node_send_direct(np_util_statemachine_t *statemachine,
            packet,
            hs_messagepart->part);
 
+  enum np_return is_queued = np_ok;
+  np_dhkey_t     no_flow   = {0};
   _LOCK_ACCESS(&trinity.network->access_lock) {
     // ret =_np_network_send_data(context, trinity.network, packet);
 
-    sll_append(void_ptr, trinity.network->out_events, (void *)packet);
+    is_queued = _np_network_enqueue(trinity.network,
+                                    (void *)packet,
+                                    np_network_send_control,
+                                    no_flow);
 
     log_trace_msg(LOG_TRACE,
-                  "start: void __np_node_send_direct(...) { %d",
-                  sll_size(trinity.network->out_events));
+                  "start: void __np_node_send_direct(...) { %" PRIu32,
+                  _np_network_queue_size(trinity.network));
+  }
+  if (is_queued != np_ok) {
+    log_info(LOG_MESSAGE,
+             "Dropping msg %s due to full send queue",
+             hs_messagepart->uuid);
+    np_unref_obj(BLOB_1024, packet, ref_obj_creation);
   }
-  // np_unref_obj(BLOB_1024, packet, ref_obj_creation);
 
   _np_network_start(trinity.network, false);
   _np_event_invoke_out(context);
@@ -1414,7 +1448,9 @@ void __np_node_send_encrypted(np_util_statemachine_t *statemachine,
   unsigned char *enc_msg; //[MSG_CHUNK_SIZE_1024]={0};
   np_new_obj(BLOB_1024, enc_msg, ref_obj_creation);
 
-  int encryption = -1;
+  int    encryption = -1;
+  double expires_at = 0.0;
+  bool   acked      = false;
   _LOCK_ACCESS(&part->work_lock) {
     // replace with our onw local sequence number for next hop
     np_tree_replace_str(part->instructions,
@@ -1425,6 +1461,17 @@ void __np_node_send_encrypted(np_util_statemachine_t *statemachine,
         np_tree_find_str(part->instructions, _NP_MSG_INST_SEND_COUNTER);
     jrb_send_counter->val.value.ush++;
 
+    // the parts share the instructions of their message
+    np_tree_elem_t *tstamp =
+        np_tree_find_str(part->instructions, _NP_MSG_INST_TSTAMP);
+    np_tree_elem_t *ttl =
+        np_tree_find_str(part->instructions, _NP_MSG_INST_TTL);
+    if (tstamp != NULL && ttl != NULL)
+      expires_at = tstamp->val.value.d + ttl->val.value.d;
+    np_tree_elem_t *ack =
+        np_tree_find_str(part->instructions, _NP_MSG_INST_ACK);
+    acked = ack != NULL && ack->val.value.ush != ACK_NONE;
+
     _np_messagepart_trace_info("MSGPART_OUT_ENCRYPTED", part);
 
     // add protection from replay attacks ...
@@ -1455,7 +1502,7 @@ void __np_node_send_encrypted(np_util_statemachine_t *statemachine,
             trinity.node->port);
   } else {
     /* send data */
-    if (NULL != trinity.network->out_events) {
+    if (trinity.network->initialized) {
       /*
       #ifdef DEBUG
                   char tmp_hex[MSG_CHUNK_SIZE_1024*2+1] = { 0 };
@@ -1478,12 +1525,37 @@ void __np_node_send_encrypted(np_util_statemachine_t *statemachine,
                 trinity.network->ip,
                 trinity.network->port,
                 _np_key_as_str(node_key));
+      np_dhkey_t      subject = {0};
+      np_tree_elem_t *subject_elem =
+          np_tree_find_str(part->header, _NP_MSG_HEADER_SUBJECT);
+      if (subject_elem != NULL) subject = subject_elem->val.value.dhkey;
+
+      enum np_return is_queued = np_ok;
       _LOCK_ACCESS(&trinity.network->access_lock) {
         // ret = _np_network_send_data(context, trinity.network, enc_msg);
 
-        sll_append(void_ptr, trinity.network->out_events, (void *)enc_msg);
+        // internal messages are sent ahead of user data, user data is shared
+        // fairly between the subjects
+        np_network_send_class_e send_class = np_network_send_control;
+        if (subject_elem != NULL)
+          send_class = _np_network_send_class(trinity.network, subject);
+
+        is_queued = _np_network_enqueue(trinity.network,
+                                        (void *)enc_msg,
+                                        send_class,
+                                        subject);
+        // the subject is reported as blocked to np_send, the encrypted chunk
+        // is kept (with its sequence number and send counter) until the queue
+        // had some time to drain
+        if (is_queued == np_ok && !acked)
+          _np_network_pacing_unacked(trinity.network);
+        else if (is_queued != np_ok)
+          _np_network_defer(trinity.network,
+                            (void *)enc_msg,
+                            send_class,
+                            subject,
+                            expires_at);
       }
-      // np_unref_obj(BLOB_1024, packet, ref_obj_creation);
 
       _np_network_start(trinity.network, false);
       _np_event_invoke_out(context);
@@ -1664,35 +1736,63 @@ void __np_node_handle_response(np_util_statemachine_t *statemachine,
   log_trace_msg(LOG_TRACE, "start: bool __np_node_handle_response(...) {");
 
   NP_CAST(statemachine->_user_data, np_key_t, node_key);
+  NP_CAST(event.user_data, np_responsecontainer_t, response);
   np_node_t *node = _np_key_get_node(node_key);
 
-  node->success_win_index++;
-  if (node->success_win_index == NP_NODE_SUCCESS_WINDOW)
-    node->success_win_index = 0;
+  struct __np_node_trinity trinity = {0};
+  __np_key_to_trinity(node_key, &trinity);
 
-  node->latency_win_index++;
-  if (node->latency_win_index == NP_NODE_SUCCESS_WINDOW)
-    node->latency_win_index = 0;
+  // acks of user messages only feed the send window of this first hop, the
+  // success and latency of the node are measured with pings to the node
+  bool is_ping = _np_dhkey_equal(&response->dest_dhkey, &node_key->dhkey);
 
-  NP_CAST(event.user_data, np_responsecontainer_t, response);
+  if (is_ping) {
+    node->success_win_index++;
+    if (node->success_win_index == NP_NODE_SUCCESS_WINDOW)
+      node->success_win_index = 0;
+
+    node->latency_win_index++;
+    if (node->latency_win_index == NP_NODE_SUCCESS_WINDOW)
+      node->latency_win_index = 0;
+  }
 
   if (FLAG_CMP(event.type, evt_timeout)) {
-    node->success_win[node->success_win_index % NP_NODE_SUCCESS_WINDOW] = 0;
-    node->latency_win[node->latency_win_index % NP_NODE_SUCCESS_WINDOW] =
-        (response->expires_at - response->send_at);
+    if (is_ping) {
+      node->success_win[node->success_win_index % NP_NODE_SUCCESS_WINDOW] = 0;
+      node->latency_win[node->latency_win_index % NP_NODE_SUCCESS_WINDOW] =
+          (response->expires_at - response->send_at);
+    }
+    if (trinity.network != NULL)
+      _np_network_pacing_update(trinity.network, 0.0, true);
   } else if (FLAG_CMP(event.type, evt_response)) {
-    node->last_success = np_time_now();
-    node->success_win[node->success_win_index % NP_NODE_SUCCESS_WINDOW] = 1;
-    if (node->latency == -1) {
-      for (uint8_t i = 0; i < NP_NODE_SUCCESS_WINDOW; i++) {
-        node->latency_win[i] = (response->received_at - response->send_at);
+    if (trinity.network != NULL)
+      _np_network_pacing_update(trinity.network,
+                                response->received_at - response->send_at,
+                                false);
+    _np_statistics_observe_send_to_ack(node_key->dhkey,
+                                       response->received_at -
+                                           response->send_at);
+    if (is_ping) {
+      node->last_success = np_time_now();
+      node->success_win[node->success_win_index % NP_NODE_SUCCESS_WINDOW] = 1;
+      if (node->latency == -1) {
+        for (uint8_t i = 0; i < NP_NODE_SUCCESS_WINDOW; i++) {
+          node->latency_win[i] = (response->received_at - response->send_at);
+        }
+      } else {
+        node->latency_win[node->latency_win_index % NP_NODE_SUCCESS_WINDOW] =
+            (response->received_at - response->send_at);
       }
-    } else {
-      node->latency_win[node->latency_win_index % NP_NODE_SUCCESS_WINDOW] =
-          (response->received_at - response->send_at);
     }
   } else {
     log_msg(LOG_INFO,
             "unknown responsehandler called, not doing any action ...");
   }
+
+  if (trinity.network != NULL) {
+    _np_set_send_window(node_key->dhkey, trinity.network->pacing.cwnd);
+    _np_set_pacing_rate(node_key->dhkey, trinity.network->pacing.rate);
+    _np_set_send_queue_size(node_key->dhkey,
+                            _np_network_queue_size(trinity.network));
+  }
 }
@@ -28,7 +28,9 @@
 
 #include "np_aaatoken.h"
 #include "np_attributes.h"
+#include "np_axon.h"
 #include "np_data.h"
+#include "np_dendrit.h"
 #include "np_dhkey.h"
 #include "np_eventqueue.h"
 #include "np_evloop.h"
@@ -57,8 +59,8 @@ static const char *error_strings[] = {
     "could not init network",
     "argument is invalid",
     "operation is currently invalid",
-    "insufficient memory",
-    "startup error. See log for more details"};
+    "startup error. See log for more details",
+    "operation would block, retry later"};
 const char *np_error_str(enum np_return e) {
   if (e > 0) return error_strings[e];
   else return NULL;
@@ -97,6 +99,7 @@ enum np_return np_regenerate_subject(NP_UNUSED np_context *ac,
                                                   _NP_MSG_PIGGY_REQUEST,
                                                   _NP_MSG_UPDATE_REQUEST,
                                                   _NP_MSG_PHEROMONE_UPDATE,
+                                                  _NP_MSG_CONTROL_BUNDLE,
                                                   _NP_MSG_AVAILABLE_RECEIVER,
                                                   _NP_MSG_AVAILABLE_SENDER,
                                                   _NP_MSG_AUTHENTICATION_REQUEST,
@@ -106,9 +109,9 @@ enum np_return np_regenerate_subject(NP_UNUSED np_context *ac,
                                                   _NP_MSG_ACCOUNTING_REQUEST,
                                                   "_NP.SYSINFO.DATA"};
   static bool       bin_subjects_are_generated = false;
-  static np_subject known_bin_subjects[16];
+  static np_subject known_bin_subjects[17];
   if (!bin_subjects_are_generated) {
-    for (int i = 0; i < 16; i++) {
+    for (int i = 0; i < 17; i++) {
       np_generate_subject(&known_bin_subjects[i],
                           known_subjects[i],
                           strnlen(known_subjects[i], 256));
@@ -116,7 +119,7 @@ enum np_return np_regenerate_subject(NP_UNUSED np_context *ac,
     bin_subjects_are_generated = true;
   }
 
-  for (int i = 0; i < 16; i++) {
+  for (int i = 0; i < 17; i++) {
     if (memcmp(subject, &known_bin_subjects[i], NP_FINGERPRINT_BYTES) == 0) {
       strncpy(subject_buffer, known_subjects[i], buffer_length);
       is_known = true;
@@ -156,6 +159,7 @@ struct np_settings *np_default_settings(struct np_settings *settings) {
   ret->jobqueue_size    = JOBQUEUE_MAX_SIZE;
   ret->log_write_fn     = NULL;
   ret->max_msgs_per_sec = 0;
+  ret->ingress_shards   = NP_EVENT_IN_SHARDS;
 
 #ifdef DEBUG
   ret->log_level |= LOG_DEBUG
@@ -252,7 +256,7 @@ np_context *np_new_context(struct np_settings *settings_in) {
     context->enable_realm_server = false;
 
     // initialize message part handling cache
-    context->msg_part_cache               = np_tree_create();
+    context->msg_part_cache = _np_messagepart_cache_create(context);
     struct np_bloom_optable_s decaying_op = {
         .add_cb   = _np_decaying_bloom_add,
         .check_cb = _np_decaying_bloom_check,
@@ -370,6 +374,14 @@ enum np_return _np_listen_safe(np_context *ac,
         log_msg(LOG_ERROR,
                 "neuropil_init: could not enable general networking");
         ret = np_startup;
+      } else if (!_np_acks_init(context)) {
+        log_msg(LOG_ERROR,
+                "neuropil_init: could not enable acknowledgement batching");
+        ret = np_startup;
+      } else if (!_np_bundles_init(context)) {
+        log_msg(LOG_ERROR,
+                "neuropil_init: could not enable control message bundling");
+        ret = np_startup;
       } else if (!_np_statistics_enable(context)) {
         log_msg(LOG_ERROR, "neuropil_init: could not enable statistics");
         ret = np_startup;
@@ -698,11 +710,13 @@ enum np_return np_send(np_context          *ac,
   return ret;
 }
 
-enum np_return np_send_to(np_context          *ac,
-                          np_subject           subject_id,
-                          const unsigned char *message,
-                          size_t               length,
-                          np_id(*target)) {
+enum np_return __np_send(np_context          *ac,
+                         np_subject           subject_id,
+                         const unsigned char *message,
+                         size_t               length,
+                         np_id(*target),
+                         np_release_callback release,
+                         void               *release_arg) {
   enum np_return ret = np_ok;
   np_ctx_cast(ac);
 
@@ -710,6 +724,10 @@ enum np_return np_send_to(np_context          *ac,
       0}; // _np_msgproperty_dhkey(OUTBOUND, subject_id);
   memcpy(&subject_dhkey, subject_id, NP_FINGERPRINT_BYTES);
 
+  // push back on the application while the send queue of a peer is filled up
+  if (_np_network_is_congested(context, subject_dhkey))
+    return np_operation_would_block;
+
   // make sure that an outbound msgproperty exists, function call is here for
   // the side effect
   np_msgproperty_conf_t *prop =
@@ -720,29 +738,19 @@ enum np_return np_send_to(np_context          *ac,
   np_msgproperty_register(prop);
 
   np_tree_t *body = np_tree_create();
-  np_tree_insert_str(body,
-                     NP_SERIALISATION_USERDATA,
-                     np_treeval_new_bin((void *)message, length));
-
-  np_attributes_t tmp_msg_attr;
-  if (np_ok == np_init_datablock(tmp_msg_attr, sizeof(tmp_msg_attr))) {
-    np_merge_data(tmp_msg_attr,
-                  _np_get_attributes_cache(context, NP_ATTR_USER_MSG));
-    np_merge_data(
-        tmp_msg_attr,
-        _np_get_attributes_cache(context, NP_ATTR_IDENTITY_AND_USER_MSG));
-    np_merge_data(
-        tmp_msg_attr,
-        _np_get_attributes_cache(context, NP_ATTR_INTENT_AND_USER_MSG));
-    size_t attributes_size;
-    if (np_ok == np_get_data_size(tmp_msg_attr, &attributes_size) &&
-        attributes_size > 0) {
-      np_tree_insert_str(body,
-                         NP_SERIALISATION_ATTRIBUTES,
-                         np_treeval_new_bin(tmp_msg_attr, attributes_size));
-    }
+  if (release == NULL) {
+    np_tree_insert_str(body,
+                       NP_SERIALISATION_USERDATA,
+                       np_treeval_new_bin((void *)message, length));
+  } else {
+    np_tree_insert_str_ref(body,
+                           NP_SERIALISATION_USERDATA,
+                           (void *)message,
+                           length);
   }
 
+  _np_msgproperty_template_attributes(context, prop, body);
+
   np_dhkey_t target_dhkey = {0}; // will be used as a selector -> check whether
                                  // the opposite peer contains this hash value
   if (target != NULL) {
@@ -757,6 +765,12 @@ enum np_return np_send_to(np_context          *ac,
                      context->my_node_key->dhkey,
                      subject_dhkey,
                      body);
+  if (release != NULL) {
+    msg_out->release_cb     = release;
+    msg_out->release_data   = message;
+    msg_out->release_length = length;
+    msg_out->release_arg    = release_arg;
+  }
 
   log_info(LOG_MESSAGE | LOG_EXPERIMENT | LOG_ROUTING,
            "user sending message (size: %" PRIu16 " msg: %s)",
@@ -784,6 +798,128 @@ enum np_return np_send_to(np_context          *ac,
   return ret;
 }
 
+enum np_return np_send_to(np_context          *ac,
+                          np_subject           subject_id,
+                          const unsigned char *message,
+                          size_t               length,
+                          np_id(*target)) {
+  return __np_send(ac, subject_id, message, length, target, NULL, NULL);
+}
+
+enum np_return np_send_zerocopy(np_context          *ac,
+                                np_subject           subject_id,
+                                const unsigned char *message,
+                                size_t               length,
+                                np_release_callback  release,
+                                void                *release_arg) {
+  if (subject_id == NULL || release == NULL) return np_invalid_argument;
+
+  return __np_send(ac, subject_id, message, length, NULL, release, release_arg);
+}
+
+// a batch of outbound messages travelling as a single job, the container is
+// a memory managed blob
+struct __np_send_batch {
+  np_dhkey_t    out_dhkey;
+  uint16_t      count;
+  np_message_t *messages[];
+};
+#define NP_SEND_MANY_BATCH                                                     \
+  ((MSG_CHUNK_SIZE_1024 - sizeof(struct __np_send_batch)) /                    \
+   sizeof(np_message_t *))
+
+bool __np_send_many_cb(np_state_t *context, np_util_event_t event) {
+  struct __np_send_batch *batch = event.user_data;
+
+  for (uint16_t i = 0; i < batch->count; i++) {
+    np_util_event_t send_event = {.type      = (evt_internal | evt_message),
+                                  .user_data = batch->messages[i]};
+    _np_event_runtime_start_with_event(context, batch->out_dhkey, send_event);
+    np_unref_obj(np_message_t, batch->messages[i], "np_send_many");
+  }
+  batch->count = 0;
+  return true;
+}
+
+enum np_return np_send_many(np_context            *ac,
+                            np_subject             subject_id,
+                            const struct np_iovec *messages,
+                            size_t                 count) {
+  np_ctx_cast(ac);
+
+  if (subject_id == NULL || (messages == NULL && count > 0))
+    return np_invalid_argument;
+
+  np_dhkey_t subject_dhkey = {0};
+  memcpy(&subject_dhkey, subject_id, NP_FINGERPRINT_BYTES);
+
+  if (_np_network_is_congested(context, subject_dhkey))
+    return np_operation_would_block;
+
+  // property and registration are the same for all messages
+  np_msgproperty_conf_t *prop =
+      _np_msgproperty_get_or_create(ac, OUTBOUND, subject_dhkey);
+  if (prop->audience_type == NP_MX_AUD_VIRTUAL) return np_invalid_operation;
+
+  np_msgproperty_register(prop);
+
+  np_dhkey_t out_dhkey = _np_msgproperty_tweaked_dhkey(OUTBOUND, subject_dhkey);
+
+  enum np_return ret = np_ok;
+  size_t         i   = 0;
+  while (i < count) {
+    struct __np_send_batch *batch = NULL;
+    np_new_obj(BLOB_1024, batch);
+    batch->out_dhkey = out_dhkey;
+    batch->count     = 0;
+
+    for (; i < count && batch->count < NP_SEND_MANY_BATCH; i++) {
+      np_tree_t *body = np_tree_create();
+      np_tree_insert_str(
+          body,
+          NP_SERIALISATION_USERDATA,
+          np_treeval_new_bin((void *)messages[i].data, messages[i].length));
+      _np_msgproperty_template_attributes(context, prop, body);
+
+      np_message_t *msg_out = NULL;
+      np_new_obj(np_message_t, msg_out, "np_send_many");
+      _np_message_create(msg_out,
+                         subject_dhkey,
+                         context->my_node_key->dhkey,
+                         subject_dhkey,
+                         body);
+      _np_message_trace_info("MSG_USER_SEND", msg_out);
+
+      batch->messages[batch->count++] = msg_out;
+    }
+
+    log_info(LOG_MESSAGE | LOG_EXPERIMENT | LOG_ROUTING,
+             "user sending batch of %" PRIu16 " messages",
+             batch->count);
+
+    np_util_event_t batch_event = {.type      = (evt_internal | evt_message),
+                                   .user_data = batch};
+    if (!np_jobqueue_submit_event_callback(context,
+                                           0.0,
+                                           batch_event,
+                                           __np_send_many_cb,
+                                           "event: userspace message batch")) {
+      log_msg(LOG_WARNING,
+              "rejecting sending of %" PRIu16
+              " messages, please check jobqueue settings!",
+              batch->count);
+      for (uint16_t j = 0; j < batch->count; j++)
+        np_unref_obj(np_message_t, batch->messages[j], "np_send_many");
+      batch->count = 0;
+      ret          = np_invalid_operation;
+    }
+    np_unref_obj(BLOB_1024, batch, ref_obj_creation);
+
+    if (ret != np_ok) break;
+  }
+  return ret;
+}
+
 bool __np_receive_callback_converter(np_context               *ac,
                                      const np_message_t *const msg,
                                      np_tree_t                *body,
@@ -840,6 +976,87 @@ bool __np_receive_callback_converter(np_context               *ac,
   return ret;
 }
 
+bool __np_receive_view_converter(np_context               *ac,
+                                 const np_message_t *const msg,
+                                 np_tree_t                *body,
+                                 void                     *localdata) {
+  np_ctx_cast(ac);
+  np_receive_view_callback callback = localdata;
+  np_tree_elem_t *userdata = np_tree_find_str(body, NP_SERIALISATION_USERDATA);
+
+  if (userdata == NULL) {
+    log_info(LOG_MESSAGE | LOG_ROUTING,
+             "(msg: %s) contains no userdata",
+             msg->uuid);
+    return true;
+  }
+
+  // nothing is copied, all pointers refer to the reassembled message
+  struct np_message_view view = {.uuid        = msg->uuid,
+                                 .received_at = np_time_now(),
+                                 .data        = userdata->val.value.bin,
+                                 .data_length = userdata->val.size};
+  memcpy(&view.subject, _np_message_get_subject(msg), NP_FINGERPRINT_BYTES);
+
+  ASSERT(msg->decryption_token != NULL,
+         "The decryption token should never be empty in this stage");
+  np_dhkey_t _t;
+  np_str_id(&_t, msg->decryption_token->issuer);
+  memcpy(&view.from, &_t, NP_FINGERPRINT_BYTES);
+
+  np_tree_elem_t *msg_attributes =
+      np_tree_find_str(body, NP_SERIALISATION_ATTRIBUTES);
+  if (msg_attributes != NULL) {
+    view.attributes        = msg_attributes->val.value.bin;
+    view.attributes_length = msg_attributes->val.size;
+  }
+
+  log_debug(LOG_MESSAGE | LOG_VERBOSE,
+            "(msg: %s) Calling user view function.",
+            msg->uuid);
+  callback(context, &view);
+  log_info(LOG_MESSAGE | LOG_EXPERIMENT, "(msg: %s) send to user", msg->uuid);
+  return true;
+}
+
+enum np_return np_add_receive_view_cb(np_context              *ac,
+                                      np_subject               subject_id,
+                                      np_receive_view_callback callback) {
+  if (subject_id == NULL || callback == NULL) return np_invalid_argument;
+
+  np_dhkey_t subject_dhkey = {0};
+  memcpy(&subject_dhkey, subject_id, NP_FINGERPRINT_BYTES);
+
+  np_add_receive_listener(ac,
+                          __np_receive_view_converter,
+                          callback,
+                          subject_dhkey);
+  return np_ok;
+}
+
+enum np_return np_set_mx_discard_cb(np_context         *ac,
+                                    np_subject          subject_id,
+                                    np_discard_callback callback) {
+  np_ctx_cast(ac);
+  if (subject_id == NULL) return np_invalid_argument;
+
+  np_dhkey_t subject_dhkey = {0};
+  memcpy(&subject_dhkey, subject_id, NP_FINGERPRINT_BYTES);
+
+  // both directions keep a msg_cache, the subject has to be configured by
+  // np_set_mx_properties or a callback beforehand
+  np_msgproperty_run_t *in_run =
+      _np_msgproperty_run_get(context, INBOUND, subject_dhkey);
+  np_msgproperty_run_t *out_run =
+      _np_msgproperty_run_get(context, OUTBOUND, subject_dhkey);
+  if (in_run == NULL && out_run == NULL) return np_invalid_operation;
+
+  if (in_run != NULL) in_run->discard_cb = callback;
+  if (out_run != NULL) out_run->discard_cb = callback;
+
+  return np_ok;
+}
+
 enum np_return np_add_receive_cb(np_context         *ac,
                                  np_subject          subject_id,
                                  np_receive_callback callback) {
@@ -1158,6 +1375,7 @@ void np_destroy(np_context *ac, bool gracefully) {
 
   _np_jobqueue_destroy(context);
   _np_time_destroy(context);
+  _np_messagepart_cache_destroy(context, context->msg_part_cache);
 
   // sodium_destroy() /* not available */
   _np_route_destroy(context);
@@ -1166,12 +1384,13 @@ void np_destroy(np_context *ac, bool gracefully) {
   _np_msgproperty_destroy(context);
   _np_statistics_destroy(context);
   _np_network_module_destroy(context);
+  _np_acks_destroy(context);
+  _np_bundles_destroy(context);
   _np_threads_destroy(context);
   _np_log_destroy(context);
   _np_event_destroy(context);
   _np_memory_destroy(context);
 
-  np_tree_free(context->msg_part_cache);
   TSP_DESTROY(context->status);
   free(context);
 #ifdef CONSOLE_BACKUP_LOG
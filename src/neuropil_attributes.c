@@ -25,6 +25,8 @@
 np_module_struct(attributes) {
   np_state_t     *context;
   np_attributes_t attribute_cache[NP_ATTR_MAX];
+  // bumped on every change of the attribute_cache
+  uint32_t generation;
 };
 
 void _np_attributes_destroy(np_state_t *context) {
@@ -61,10 +63,14 @@ enum np_data_return np_set_ident_attr_bin(np_context           *ac,
     ret = np_set_data(ident->attributes, conf, (np_data_value){.bin = bin});
   }
 
-  if (inheritance != NP_ATTR_NONE)
+  if (inheritance != NP_ATTR_NONE) {
     ret = np_set_data(np_module(attributes)->attribute_cache[inheritance],
                       conf,
                       (np_data_value){.bin = bin});
+    __atomic_add_fetch(&np_module(attributes)->generation,
+                       1,
+                       __ATOMIC_RELEASE);
+  }
 
   return ret;
 }
@@ -100,10 +106,14 @@ enum np_data_return np_set_mxp_attr_bin(np_context           *ac,
     }
   }
 
-  if (inheritance != NP_ATTR_NONE)
+  if (inheritance != NP_ATTR_NONE) {
     ret = np_set_data(np_module(attributes)->attribute_cache[inheritance],
                       conf,
                       (np_data_value){.bin = bin});
+    __atomic_add_fetch(&np_module(attributes)->generation,
+                       1,
+                       __ATOMIC_RELEASE);
+  }
 
   return ret;
 }
@@ -147,6 +157,10 @@ np_attributes_t *_np_get_attributes_cache(np_state_t           *context,
   return &np_module(attributes)->attribute_cache[cache];
 }
 
+uint32_t _np_attributes_generation(np_state_t *context) {
+  return __atomic_load_n(&np_module(attributes)->generation, __ATOMIC_ACQUIRE);
+}
+
 enum np_data_return np_set_mxp_attr_policy_bin(np_context    *ac,
                                                np_subject     subject,
                                                char           key[255],
@@ -105,41 +105,6 @@ bool _np_out_callback_wrapper(np_state_t           *context,
                 message->uuid,
                 my_property_conf->msg_subject);
 
-  if (FLAG_CMP(my_property_conf->ack_mode, ACK_DESTINATION)) {
-    // TODO: create a copy in case of re-delivery for un-acked messages
-    np_message_t *redeliver_copy = NULL;
-    np_new_obj(np_message_t, redeliver_copy, FUNC);
-
-    np_message_clone(redeliver_copy, message);
-    _np_message_add_response_handler(redeliver_copy, event, false);
-
-    np_util_event_t redeliver_event = {
-        .type         = (evt_redeliver | evt_internal | evt_message),
-        .target_dhkey = event.target_dhkey,
-        .user_data    = redeliver_copy};
-    //_np_event_runtime_add_event(context, event.current_run, prop_out_dhkey,
-    // redeliver_event);
-    // POSSIBLE ASYNC POINT
-    char buf[100];
-    snprintf(buf,
-             100,
-             "urn:np:message:redelivery_conf:%s",
-             redeliver_copy->uuid);
-    if (!np_jobqueue_submit_event(context,
-                                  0,
-                                  prop_out_dhkey,
-                                  redeliver_event,
-                                  buf)) {
-      log_error(
-          "Jobqueue rejected new job for message redelivery configuration of "
-          "msg %s. No resend will be initiated.",
-          redeliver_copy->uuid);
-    }
-    //
-
-    np_unref_obj(np_message_t, redeliver_copy, FUNC);
-  }
-
   np_dhkey_t _computed_to            = {0};
   sll_iterator(np_aaatoken_ptr) iter = tmp_token_list->first;
   while (NULL != iter) {
@@ -169,6 +134,30 @@ bool _np_out_callback_wrapper(np_state_t           *context,
   // encrypt the relevant message part itself
   _np_message_encrypt_payload(message, tmp_token_list);
 
+  if (FLAG_CMP(my_property_conf->ack_mode, ACK_DESTINATION)) {
+    // keep the encrypted message for re-delivery of un-acked messages, its
+    // chunks are serialized once and re-used for every re-delivery
+    _np_message_add_response_handler(message, event, false);
+
+    np_util_event_t redeliver_event = {
+        .type         = (evt_redeliver | evt_internal | evt_message),
+        .target_dhkey = event.target_dhkey,
+        .user_data    = message};
+    // POSSIBLE ASYNC POINT
+    char buf[100];
+    snprintf(buf, 100, "urn:np:message:redelivery_conf:%s", message->uuid);
+    if (!np_jobqueue_submit_event(context,
+                                  0,
+                                  prop_out_dhkey,
+                                  redeliver_event,
+                                  buf)) {
+      log_error(
+          "Jobqueue rejected new job for message redelivery configuration of "
+          "msg %s. No resend will be initiated.",
+          message->uuid);
+    }
+  }
+
   np_aaatoken_unref_list(tmp_token_list, "_np_intent_get_all_receiver");
   ret = true;
 
@@ -177,47 +166,29 @@ bool _np_out_callback_wrapper(np_state_t           *context,
   return ret;
 }
 
-void __np_axon_chunk_and_send(np_state_t         *context,
-                              np_event_runtime_t *current_run,
-                              np_message_t       *msg,
-                              np_dhkey_t          msg_from,
-                              np_dhkey_t          msg_to,
-                              np_sll_t(np_dhkey_t, tmp)) {
-  // 2: chunk the message if required
-  // TODO: send two separate messages?
-  if (msg->is_single_part == false) {
-    _np_message_calculate_chunking(msg);
-    _np_message_serialize_chunked(context, msg);
-  }
-
-  // 3: send over to msg splitter
-  char            buf[65]  = {0};
+void _np_axon_filter_hops(np_state_t   *context,
+                          np_message_t *msg,
+                          np_dhkey_t    msg_from,
+                          np_dhkey_t    msg_to,
+                          bool          is_resend,
+                          np_sll_t(np_dhkey_t, hops)) {
   uint16_t        chunk_id = -1;
-  uint16_t        chunks   = -1;
   np_tree_elem_t *_tmp;
   if (msg->instructions != NULL &&
       NULL !=
           (_tmp = np_tree_find_str(msg->instructions, _NP_MSG_INST_PARTS))) {
     chunk_id = _tmp->val.value.a2_ui[1];
-    chunks   = _tmp->val.value.a2_ui[0];
   }
 
-  log_info(LOG_ROUTING,
-           "sending    message (%s %" PRIu16 "/%" PRIu16
-           ") target: %s to next %" PRIu32 " hops",
-           msg->uuid,
-           chunk_id,
-           chunks,
-           np_id_str(buf, &msg_to),
-           sll_size(tmp));
-
   np_dhkey_t _cache_msg_id = {0};
   _np_dhkey_add(&_cache_msg_id, &_cache_msg_id, &msg_to);
-  np_dhkey_t _uuid = _np_dhkey_generate_hash(msg->uuid, NP_UUID_BYTES);
+  np_dhkey_t _uuid = _np_dhkey_from_uuid(&msg->uuid_key);
   _np_dhkey_add(&_cache_msg_id, &_cache_msg_id, &_uuid);
   np_dhkey_t _chunk_id = _np_dhkey_generate_hash(&chunk_id, sizeof(chunk_id));
   _np_dhkey_add(&_cache_msg_id, &_cache_msg_id, &_chunk_id);
 
+  // a resend of our own message part has been added to the filter by its
+  // first send, it has to pass nevertheless
   bool _send_before = false;
   TSP_SCOPE(context->msg_forward_filter) {
     _send_before =
@@ -229,33 +200,14 @@ void __np_axon_chunk_and_send(np_state_t         *context,
                                              _cache_msg_id);
     }
   }
+  if (is_resend) _send_before = false;
 
-  sll_iterator(np_dhkey_t) key_iter = sll_first(tmp);
+  sll_iterator(np_dhkey_t) key_iter = sll_first(hops);
   while (key_iter != NULL) {
-    if (!_send_before && !_np_dhkey_equal(&key_iter->val, &msg_from) &&
-        !_np_dhkey_equal(&key_iter->val, &context->my_node_key->dhkey) &&
-        _np_keycache_exists(context, key_iter->val, NULL)) {
-      log_info(LOG_ROUTING,
-               "sending    message (%s) to hop %s",
-               msg->uuid,
-               np_id_str(buf, &key_iter->val));
-      np_util_event_t send_event = {.type      = (evt_internal | evt_message),
-                                    .user_data = msg,
-                                    .target_dhkey = msg_to};
-      _np_event_runtime_add_event(context,
-                                  current_run,
-                                  key_iter->val,
-                                  send_event);
-      /* POSSIBLE ASYNC POINT
-      char buf[100];
-      snprintf(buf, 100, "urn:np:message:splitter:%s", msg->uuid);
-      if(!np_jobqueue_submit_event(context, 0, key_iter->val, send_event, buf)){
-          log_error("Jobqueue rejected new job for messagepart delivery of msg
-      %s", msg->uuid
-          );
-      }
-      */
-    } else {
+    sll_iterator(np_dhkey_t) next = key_iter->flink;
+    if (_send_before || _np_dhkey_equal(&key_iter->val, &msg_from) ||
+        _np_dhkey_equal(&key_iter->val, &context->my_node_key->dhkey) ||
+        !_np_keycache_exists(context, key_iter->val, NULL)) {
       char buf[65] = {0};
       log_info(LOG_ROUTING,
                "do not send message (%s) to hop %s as: %s %s %s %s ",
@@ -271,47 +223,104 @@ void __np_axon_chunk_and_send(np_state_t         *context,
                _np_keycache_exists(context, key_iter->val, NULL)
                    ? ""
                    : " target is not connected to me;");
+      sll_delete(np_dhkey_t, hops, key_iter);
     }
-    sll_next(key_iter);
+    key_iter = next;
   }
 }
 
-bool _np_out_forward(np_state_t *context, np_util_event_t event) {
-  log_trace_msg(LOG_TRACE, "start: bool _np_out_forward(...){");
+void __np_axon_chunk_and_send(np_state_t         *context,
+                              np_event_runtime_t *current_run,
+                              np_message_t       *msg,
+                              np_dhkey_t          msg_from,
+                              np_dhkey_t          msg_to,
+                              bool                is_resend,
+                              np_sll_t(np_dhkey_t, tmp)) {
+  // 2: chunk the message if required, re-delivered messages still carry
+  // their serialized chunks
+  // TODO: send two separate messages?
+  bool is_serialized = false;
+  _LOCK_ACCESS(&msg->msg_chunks_lock) {
+    is_serialized = pll_size(msg->msg_chunks) > 0;
+  }
+  if (msg->is_single_part == false && !is_serialized) {
+    _np_message_calculate_chunking(msg);
+    _np_message_serialize_chunked(context, msg);
+  }
 
-  NP_CAST(event.user_data, np_message_t, forward_msg);
+  // 3: send over to msg splitter
+  char            buf[65]  = {0};
+  uint16_t        chunk_id = -1;
+  uint16_t        chunks   = -1;
+  np_tree_elem_t *_tmp;
+  if (msg->instructions != NULL &&
+      NULL !=
+          (_tmp = np_tree_find_str(msg->instructions, _NP_MSG_INST_PARTS))) {
+    chunk_id = _tmp->val.value.a2_ui[1];
+    chunks   = _tmp->val.value.a2_ui[0];
+  }
 
-  CHECK_STR_FIELD(forward_msg->header, _NP_MSG_HEADER_FROM, msg_from);
-  CHECK_STR_FIELD(forward_msg->header, _NP_MSG_HEADER_TO, msg_to);
-  CHECK_STR_FIELD(forward_msg->header, _NP_MSG_HEADER_SUBJECT, msg_subj);
+  log_info(LOG_ROUTING,
+           "sending    message (%s %" PRIu16 "/%" PRIu16
+           ") target: %s to next %" PRIu32 " hops",
+           msg->uuid,
+           chunk_id,
+           chunks,
+           np_id_str(buf, &msg_to),
+           sll_size(tmp));
 
-  if (!_np_route_my_key_has_connection(context)) {
-    log_msg(
-        LOG_INFO,
-        "--- request for forward message (%s) out, but no connections left ...",
-        forward_msg->uuid);
-    return false;
+  _np_axon_filter_hops(context, msg, msg_from, msg_to, is_resend, tmp);
+
+  bool is_first_hop                 = true;
+  sll_iterator(np_dhkey_t) key_iter = sll_first(tmp);
+  while (key_iter != NULL) {
+    log_info(LOG_ROUTING,
+             "sending    message (%s) to hop %s",
+             msg->uuid,
+             np_id_str(buf, &key_iter->val));
+    if (is_first_hop) {
+      _np_dhkey_assign(&msg->hop_dhkey, &key_iter->val);
+      is_first_hop = false;
+    }
+    np_util_event_t send_event = {.type         = (evt_internal | evt_message),
+                                  .user_data    = msg,
+                                  .target_dhkey = msg_to};
+    _np_event_runtime_add_event(context,
+                                current_run,
+                                key_iter->val,
+                                send_event);
+    /* POSSIBLE ASYNC POINT
+    char buf[100];
+    snprintf(buf, 100, "urn:np:message:splitter:%s", msg->uuid);
+    if(!np_jobqueue_submit_event(context, 0, key_iter->val, send_event, buf)){
+        log_error("Jobqueue rejected new job for messagepart delivery of msg
+    %s", msg->uuid
+        );
+    }
+    */
+    sll_next(key_iter);
   }
+}
 
-  float target_age          = 1.0;
-  np_sll_t(np_dhkey_t, tmp) = NULL;
-  sll_init(np_dhkey_t, tmp);
-  char *tmp_source = "_np_pheromone_snuffle_receiver";
+// collects the next hops of a forwarded message: existing pheromone trails of
+// the subject first, the routing table as a fallback
+static void __np_axon_forward_hops(np_state_t   *context,
+                                   np_message_t *forward_msg,
+                                   np_dhkey_t    msg_subj,
+                                   np_dhkey_t    msg_to,
+                                   np_sll_t(np_dhkey_t, tmp)) {
+  float target_age = 1.0;
   // np_dhkey_t recv_dhkey = _np_msgproperty_tweaked_dhkey(INBOUND,
   // msg_subj.value.dhkey);
   uint8_t i = 0;
   while (sll_size(tmp) == 0 && i < 8) {
-    _np_pheromone_snuffle_receiver(context,
-                                   tmp,
-                                   msg_subj.value.dhkey,
-                                   &target_age);
+    _np_pheromone_snuffle_receiver(context, tmp, msg_subj, &target_age);
     i++;
     target_age -= 0.1;
   };
 
   if (sll_size(tmp) == 0) {
     // find next hop based on fingerprint of the message
-    tmp_source = "_np_route_lookup";
     log_debug_msg(LOG_ROUTING,
                   "(msg: %s) pheromone lookup failed, looking up routing table",
                   forward_msg->uuid);
@@ -319,7 +328,7 @@ bool _np_out_forward(np_state_t *context, np_util_event_t event) {
     np_sll_t(np_key_ptr, route_tmp) = NULL;
     i                               = 1;
     do {
-      route_tmp = _np_route_lookup(context, msg_to.value.dhkey, i);
+      route_tmp = _np_route_lookup(context, msg_to, i);
       i++;
     } while (sll_size(route_tmp) == 0 && i < 5);
 
@@ -331,6 +340,91 @@ bool _np_out_forward(np_state_t *context, np_util_event_t event) {
     np_key_unref_list(route_tmp, "_np_route_lookup");
     sll_free(np_key_ptr, route_tmp);
   }
+}
+
+bool _np_out_forward_cut_through(np_state_t         *context,
+                                 np_event_runtime_t *current_run,
+                                 np_message_t       *forward_msg) {
+  if (!NP_FORWARD_CUT_THROUGH) return false;
+
+  np_tree_elem_t *msg_from =
+      np_tree_find_str(forward_msg->header, _NP_MSG_HEADER_FROM);
+  np_tree_elem_t *msg_to =
+      np_tree_find_str(forward_msg->header, _NP_MSG_HEADER_TO);
+  np_tree_elem_t *msg_subj =
+      np_tree_find_str(forward_msg->header, _NP_MSG_HEADER_SUBJECT);
+  if (msg_from == NULL || msg_to == NULL || msg_subj == NULL) return false;
+
+  // messages for this node, internal messages (acks, pheromones, discovery)
+  // and subjects with a local receiver take the regular way
+  if (_np_dhkey_equal(&msg_to->val.value.dhkey, &context->my_node_key->dhkey))
+    return false;
+  // expired messages are dropped and a busy forward property throttles the
+  // relaying, both is done by the regular way
+  if (_np_message_is_expired(forward_msg)) return false;
+
+  if (_np_msgproperty_is_threshold_breached(context,
+                                            OUTBOUND,
+                                            _np_msgproperty_forward_dhkey()))
+    return false;
+
+  if (NULL !=
+      _np_msgproperty_conf_get(context, INBOUND, msg_subj->val.value.dhkey))
+    return false;
+  if (!_np_route_my_key_has_connection(context)) return false;
+
+  np_sll_t(np_dhkey_t, tmp) = NULL;
+  sll_init(np_dhkey_t, tmp);
+  __np_axon_forward_hops(context,
+                         forward_msg,
+                         msg_subj->val.value.dhkey,
+                         msg_to->val.value.dhkey,
+                         tmp);
+
+  bool ret = (sll_size(tmp) > 0);
+  if (ret) {
+    log_debug_msg(LOG_ROUTING,
+                  "(msg: %s) relaying part %" PRIu16 " without local handling",
+                  forward_msg->uuid,
+                  forward_msg->no_of_chunk);
+    __np_axon_chunk_and_send(context,
+                             current_run,
+                             forward_msg,
+                             msg_from->val.value.dhkey,
+                             msg_to->val.value.dhkey,
+                             false,
+                             tmp);
+    _np_increment_forwarding_counter(msg_subj->val.value.dhkey);
+  }
+  sll_free(np_dhkey_t, tmp);
+
+  return ret;
+}
+
+bool _np_out_forward(np_state_t *context, np_util_event_t event) {
+  log_trace_msg(LOG_TRACE, "start: bool _np_out_forward(...){");
+
+  NP_CAST(event.user_data, np_message_t, forward_msg);
+
+  CHECK_STR_FIELD(forward_msg->header, _NP_MSG_HEADER_FROM, msg_from);
+  CHECK_STR_FIELD(forward_msg->header, _NP_MSG_HEADER_TO, msg_to);
+  CHECK_STR_FIELD(forward_msg->header, _NP_MSG_HEADER_SUBJECT, msg_subj);
+
+  if (!_np_route_my_key_has_connection(context)) {
+    log_msg(
+        LOG_INFO,
+        "--- request for forward message (%s) out, but no connections left ...",
+        forward_msg->uuid);
+    return false;
+  }
+
+  np_sll_t(np_dhkey_t, tmp) = NULL;
+  sll_init(np_dhkey_t, tmp);
+  __np_axon_forward_hops(context,
+                         forward_msg,
+                         msg_subj.value.dhkey,
+                         msg_to.value.dhkey,
+                         tmp);
 
   if (sll_size(tmp) == 0) {
     log_info(
@@ -346,6 +440,7 @@ bool _np_out_forward(np_state_t *context, np_util_event_t event) {
                            forward_msg,
                            msg_from.value.dhkey,
                            msg_to.value.dhkey,
+                           false,
                            tmp);
 
   // 4 cleanup
@@ -356,6 +451,21 @@ __np_cleanup__ : {}
   return true;
 }
 
+// collects the next hops of a message from the pheromone trails of its subject
+static void __np_axon_default_hops(np_state_t *context,
+                                   np_dhkey_t  msg_subj,
+                                   np_sll_t(np_dhkey_t, tmp)) {
+  float target_probability = 1.0;
+  // np_dhkey_t recv_dhkey = _np_msgproperty_dhkey(INBOUND,
+  // msg_subj.value.dhkey);
+  uint8_t i = 0;
+  while (sll_size(tmp) == 0 && i < 8) {
+    _np_pheromone_snuffle_receiver(context, tmp, msg_subj, &target_probability);
+    i++;
+    target_probability -= 0.1;
+  };
+}
+
 bool _np_out_default(np_state_t *context, np_util_event_t event) {
   log_trace_msg(LOG_TRACE, "start: bool _np_out_default(...){");
 
@@ -373,21 +483,9 @@ bool _np_out_default(np_state_t *context, np_util_event_t event) {
     return false;
   }
 
-  float target_probability  = 1.0;
   np_sll_t(np_dhkey_t, tmp) = NULL;
   sll_init(np_dhkey_t, tmp);
-
-  // np_dhkey_t recv_dhkey = _np_msgproperty_dhkey(INBOUND,
-  // msg_subj.value.dhkey);
-  uint8_t i = 0;
-  while (sll_size(tmp) == 0 && i < 8) {
-    _np_pheromone_snuffle_receiver(context,
-                                   tmp,
-                                   msg_subj.value.dhkey,
-                                   &target_probability);
-    i++;
-    target_probability -= 0.1;
-  };
+  __np_axon_default_hops(context, msg_subj.value.dhkey, tmp);
 
   if (sll_size(tmp) == 0) {
     log_info(
@@ -403,6 +501,7 @@ bool _np_out_default(np_state_t *context, np_util_event_t event) {
                            default_msg,
                            msg_from.value.dhkey,
                            msg_to.value.dhkey,
+                           false,
                            tmp);
 
   // 4 cleanup
@@ -415,6 +514,61 @@ __np_cleanup__ : {}
   return true;
 }
 
+void _np_axon_redelivery_hops(np_state_t   *context,
+                              np_message_t *msg,
+                              np_dhkey_t    target,
+                              np_sll_t(np_dhkey_t, hops)) {
+  np_dhkey_t candidates[2] = {target, msg->hop_dhkey};
+  np_dhkey_t zero          = {0};
+  for (uint8_t i = 0; i < 2 && sll_size(hops) == 0; i++) {
+    if (_np_dhkey_equal(&candidates[i], &zero)) continue;
+
+    np_key_t *key = _np_keycache_find(context, candidates[i]);
+    if (key == NULL) continue;
+    if (_np_key_get_node(key) != NULL)
+      sll_append(np_dhkey_t, hops, candidates[i]);
+    np_unref_obj(np_key_t, key, "_np_keycache_find");
+  }
+
+  if (sll_size(hops) == 0)
+    __np_axon_default_hops(context, *_np_message_get_subject(msg), hops);
+}
+
+bool _np_out_redeliver(np_state_t *context, np_util_event_t event) {
+  log_trace_msg(LOG_TRACE, "start: bool _np_out_redeliver(...){");
+
+  NP_CAST(event.user_data, np_message_t, redeliver_msg);
+  bool ret = false;
+
+  CHECK_STR_FIELD(redeliver_msg->header, _NP_MSG_HEADER_FROM, msg_from);
+  CHECK_STR_FIELD(redeliver_msg->header, _NP_MSG_HEADER_TO, msg_to);
+
+  np_sll_t(np_dhkey_t, tmp) = NULL;
+  sll_init(np_dhkey_t, tmp);
+  _np_axon_redelivery_hops(context, redeliver_msg, event.target_dhkey, tmp);
+
+  ret = (sll_size(tmp) > 0);
+  if (ret) {
+    __np_axon_chunk_and_send(context,
+                             event.current_run,
+                             redeliver_msg,
+                             msg_from.value.dhkey,
+                             msg_to.value.dhkey,
+                             true,
+                             tmp);
+  } else {
+    log_info(LOG_ROUTING,
+             "--- request for re-delivery of message (%s), but no routing "
+             "found ...",
+             redeliver_msg->uuid);
+  }
+  sll_free(np_dhkey_t, tmp);
+
+__np_cleanup__ : {}
+
+  return ret;
+}
+
 bool _np_out_available_messages(np_state_t *context, np_util_event_t event) {
   log_trace_msg(LOG_TRACE, "start: bool _np_out_available_messages(...){");
 
@@ -505,6 +659,7 @@ bool _np_out_available_messages(np_state_t *context, np_util_event_t event) {
                            available_msg,
                            msg_from.value.dhkey,
                            msg_to.value.dhkey,
+                           false,
                            tmp);
 
   sll_free(np_dhkey_t, tmp);
@@ -514,6 +669,279 @@ __np_cleanup__ : {}
   return true;
 }
 
+np_module_struct(bundles) {
+  np_state_t *context;
+  // control messages waiting to be sent, one bundle per next hop
+  TSP(np_tree_t *, pending);
+  // a one shot flush is scheduled, guarded by the pending lock
+  bool flush_scheduled;
+};
+
+typedef struct __np_control_bundle_s {
+  np_dhkey_t    hop;
+  double        first_at;
+  uint16_t      count;
+  size_t        size;
+  np_tree_t    *entries;
+  // the first message is sent on its own if nothing else joins the bundle
+  np_message_t *first;
+  np_dhkey_t    first_target;
+} __np_control_bundle_t;
+
+// hands the (serialized) parts of msg over to the next hop
+static void __np_axon_send_parts(np_state_t         *context,
+                                 np_event_runtime_t *current_run,
+                                 np_message_t       *msg,
+                                 np_dhkey_t          hop,
+                                 np_dhkey_t          target) {
+  _LOCK_ACCESS(&msg->msg_chunks_lock) {
+    pll_iterator(np_messagepart_ptr) iter = pll_first(msg->msg_chunks);
+    while (NULL != iter) {
+      char buf[65] = {0};
+      log_debug_msg(LOG_ROUTING,
+                    "submitting message (%s) to next hop %s",
+                    msg->uuid,
+                    np_id_str(buf, &hop));
+      memcpy(iter->val->uuid, msg->uuid, NP_UUID_BYTES);
+      np_util_event_t send_event = {.type      = (evt_internal | evt_message),
+                                    .user_data = iter->val,
+                                    .target_dhkey = target};
+      _np_event_runtime_add_event(context, current_run, hop, send_event);
+      pll_next(iter);
+    }
+  }
+}
+
+static void __np_axon_bundle_send(np_state_t            *context,
+                                  np_event_runtime_t    *current_run,
+                                  __np_control_bundle_t *bundle) {
+  if (bundle->count == 1) {
+    _np_message_serialize_chunked(context, bundle->first);
+    __np_axon_send_parts(context,
+                         current_run,
+                         bundle->first,
+                         bundle->hop,
+                         bundle->first_target);
+  } else {
+    np_dhkey_t bundle_subject = {0};
+    np_generate_subject(&bundle_subject,
+                        _NP_MSG_CONTROL_BUNDLE,
+                        strnlen(_NP_MSG_CONTROL_BUNDLE, 256));
+
+    np_message_t *bundle_msg = NULL;
+    np_new_obj(np_message_t, bundle_msg, FUNC);
+    _np_message_create(bundle_msg,
+                       bundle->hop,
+                       context->my_node_key->dhkey,
+                       bundle_subject,
+                       bundle->entries);
+    bundle->entries = NULL; // the message owns the entries now
+
+    log_debug_msg(LOG_ROUTING,
+                  "sending bundle (%s) of %" PRIu16 " control messages",
+                  bundle_msg->uuid,
+                  bundle->count);
+
+    _np_message_calculate_chunking(bundle_msg);
+    _np_message_serialize_chunked(context, bundle_msg);
+    __np_axon_send_parts(context,
+                         current_run,
+                         bundle_msg,
+                         bundle->hop,
+                         bundle->hop);
+    _np_statistics_add_control_saved_chunks(bundle->count - 1);
+
+    np_unref_obj(np_message_t, bundle_msg, FUNC);
+  }
+
+  np_unref_obj(np_message_t, bundle->first, ref_control_bundle);
+  if (bundle->entries != NULL) np_tree_free(bundle->entries);
+  free(bundle);
+}
+
+np_tree_t *_np_control_bundle_entry_create(np_state_t   *context,
+                                           np_message_t *msg,
+                                           np_dhkey_t    hop) {
+  // to and from are restored by the receiver when they match the bundle
+  np_tree_t *header = np_tree_clone(msg->header);
+  CHECK_STR_FIELD_BOOL(header, _NP_MSG_HEADER_TO, msg_to, "NO TO IN MESSAGE") {
+    if (_np_dhkey_equal(&msg_to->val.value.dhkey, &hop))
+      np_tree_del_str(header, _NP_MSG_HEADER_TO);
+  }
+  CHECK_STR_FIELD_BOOL(header,
+                       _NP_MSG_HEADER_FROM,
+                       msg_from,
+                       "NO FROM IN MESSAGE") {
+    if (_np_dhkey_equal(&msg_from->val.value.dhkey,
+                        &context->my_node_key->dhkey))
+      np_tree_del_str(header, _NP_MSG_HEADER_FROM);
+  }
+  np_tree_t *entry = np_tree_create();
+  np_tree_insert_str(entry, NP_MSG_BUNDLE_HEADER, np_treeval_new_tree(header));
+  np_tree_insert_str(entry,
+                     NP_MSG_BUNDLE_INSTRUCTIONS,
+                     np_treeval_new_tree(msg->instructions));
+  np_tree_insert_str(entry, NP_MSG_BUNDLE_BODY, np_treeval_new_tree(msg->body));
+  np_tree_free(header);
+
+  return entry;
+}
+
+bool __np_axon_bundle_flush_pending(np_state_t *context, np_util_event_t event);
+
+// has to be called with the pending lock held
+static void __np_axon_bundle_schedule_flush(np_state_t *context, double delay) {
+  if (np_module(bundles)->flush_scheduled) return;
+
+  np_module(bundles)->flush_scheduled =
+      np_jobqueue_submit_event_callback(context,
+                                        delay,
+                                        (np_util_event_t){0},
+                                        __np_axon_bundle_flush_pending,
+                                        "__np_axon_bundle_flush_pending");
+  if (!np_module(bundles)->flush_scheduled)
+    log_warn(LOG_ROUTING, "could not schedule the flush of control bundles");
+}
+
+// adds a single chunk control message to the bundle of the next hop, the
+// chunking of the message has to be calculated before. Returns false if the
+// message has to be sent on its own.
+static bool __np_axon_bundle_add(np_state_t         *context,
+                                 np_event_runtime_t *current_run,
+                                 np_message_t       *msg,
+                                 np_dhkey_t          hop,
+                                 np_dhkey_t          target) {
+  if (NP_CONTROL_BUNDLE_WINDOW_SEC <= 0.0 || !np_module_initiated(bundles))
+    return false;
+  if (msg->no_of_chunks != 1) return false;
+  // older nodes cannot unpack a bundle
+  if (!_np_node_has_capability(context,
+                               hop,
+                               np_node_capability_control_bundle))
+    return false;
+
+  np_tree_t *entry      = _np_control_bundle_entry_create(context, msg, hop);
+  size_t     entry_size = np_tree_get_byte_size(entry);
+  if (entry_size > NP_CONTROL_BUNDLE_MAX_BYTES) {
+    np_tree_free(entry);
+    return false;
+  }
+
+  __np_control_bundle_t *full_bundle = NULL;
+  TSP_SCOPE(np_module(bundles)->pending) {
+    __np_control_bundle_t *bundle = NULL;
+    np_tree_elem_t        *elem =
+        np_tree_find_dhkey(np_module(bundles)->pending, hop);
+    if (elem != NULL) {
+      bundle = elem->val.value.v;
+      if (bundle->size + entry_size > NP_CONTROL_BUNDLE_MAX_BYTES) {
+        np_tree_del_dhkey(np_module(bundles)->pending, hop);
+        full_bundle = bundle;
+        bundle      = NULL;
+      }
+    }
+    if (bundle == NULL) {
+      bundle = calloc(1, sizeof(__np_control_bundle_t));
+      CHECK_MALLOC(bundle);
+      bundle->hop          = hop;
+      bundle->first_at     = np_time_now();
+      bundle->entries      = np_tree_create();
+      bundle->first_target = target;
+      np_ref_obj(np_message_t, msg, ref_control_bundle);
+      bundle->first = msg;
+      np_tree_insert_dhkey(np_module(bundles)->pending,
+                           hop,
+                           np_treeval_new_v(bundle));
+      __np_axon_bundle_schedule_flush(context, NP_CONTROL_BUNDLE_WINDOW_SEC);
+    }
+    np_tree_insert_int(bundle->entries,
+                       bundle->count,
+                       np_treeval_new_tree(entry));
+    bundle->count++;
+    bundle->size += entry_size;
+
+    if (full_bundle == NULL &&
+        bundle->count == NP_CONTROL_BUNDLE_MAX_ENTRIES) {
+      np_tree_del_dhkey(np_module(bundles)->pending, hop);
+      full_bundle = bundle;
+    }
+  }
+  np_tree_free(entry);
+  log_debug_msg(LOG_ROUTING, "queued control message %s", msg->uuid);
+
+  if (full_bundle != NULL)
+    __np_axon_bundle_send(context, current_run, full_bundle);
+
+  return true;
+}
+
+bool __np_axon_bundle_flush_pending(np_state_t               *context,
+                                    NP_UNUSED np_util_event_t event) {
+  np_sll_t(void_ptr, ready) = NULL;
+  sll_init(void_ptr, ready);
+
+  double now = np_time_now();
+  TSP_SCOPE(np_module(bundles)->pending) {
+    np_module(bundles)->flush_scheduled = false;
+
+    double          next_due = 0.0;
+    np_tree_elem_t *iter     = NULL;
+    RB_FOREACH (iter, np_tree_s, np_module(bundles)->pending) {
+      __np_control_bundle_t *bundle = iter->val.value.v;
+      double due = bundle->first_at + NP_CONTROL_BUNDLE_WINDOW_SEC;
+      if (due <= now) {
+        sll_append(void_ptr, ready, bundle);
+      } else if (next_due == 0.0 || due < next_due) {
+        next_due = due;
+      }
+    }
+    sll_iterator(void_ptr) ready_iter = sll_first(ready);
+    while (ready_iter != NULL) {
+      __np_control_bundle_t *bundle = ready_iter->val;
+      np_tree_del_dhkey(np_module(bundles)->pending, bundle->hop);
+      sll_next(ready_iter);
+    }
+    // the timer only runs while bundles are pending
+    if (next_due > 0.0)
+      __np_axon_bundle_schedule_flush(context, next_due - now);
+  }
+
+  __np_control_bundle_t *bundle = NULL;
+  while (NULL != (bundle = sll_head(void_ptr, ready))) {
+    __np_axon_bundle_send(context, NULL, bundle);
+  }
+  sll_free(void_ptr, ready);
+
+  return true;
+}
+
+bool _np_bundles_init(np_state_t *context) {
+  if (!np_module_initiated(bundles)) {
+    np_module_malloc(bundles);
+    TSP_INITD(_module->pending, np_tree_create());
+    _module->flush_scheduled = false;
+  }
+  return true;
+}
+
+void _np_bundles_destroy(np_state_t *context) {
+  if (np_module_initiated(bundles)) {
+    np_module_var(bundles);
+
+    np_tree_elem_t *iter = NULL;
+    RB_FOREACH (iter, np_tree_s, _module->pending) {
+      __np_control_bundle_t *bundle = iter->val.value.v;
+      np_unref_obj(np_message_t, bundle->first, ref_control_bundle);
+      np_tree_free(bundle->entries);
+      free(bundle);
+    }
+    np_tree_free(_module->pending);
+    TSP_DESTROY(_module->pending);
+
+    np_module_free(bundles);
+  }
+}
+
 bool _np_out_pheromone(np_state_t *context, np_util_event_t msg_event) {
   log_trace_msg(LOG_TRACE, "start: bool _np_out_pheromone(...) {");
 
@@ -528,15 +956,18 @@ bool _np_out_pheromone(np_state_t *context, np_util_event_t msg_event) {
   CHECK_STR_FIELD(pheromone_msg_out->header, _NP_MSG_HEADER_FROM, msg_from);
 
   // 1: find next hop based on fingerprint of the token
-  np_sll_t(np_key_ptr, tmp) = NULL;
-  tmp = _np_route_lookup(context, msg_event.target_dhkey, 1);
-  char *source_sll_of_keys = "_np_route_lookup";
-
-  if (sll_size(tmp) <
-      1) { // nothing found, send leafset to exchange some data at least
+  np_sll_t(np_key_ptr, tmp)    = NULL;
+  np_key_t *next_hop           = NULL;
+  char     *source_sll_of_keys = "_np_route_lookup_batch";
+
+  if (1 == _np_route_lookup_batch(context,
+                                  &msg_event.target_dhkey,
+                                  1,
+                                  &next_hop)) {
+    sll_init(np_key_ptr, tmp);
+    sll_append(np_key_ptr, tmp, next_hop);
+  } else { // nothing found, send leafset to exchange some data at least
     // prevents small clusters from not exchanging all data
-    np_key_unref_list(tmp, source_sll_of_keys); // only for completion
-    sll_free(np_key_ptr, tmp);
     tmp = _np_route_neighbors(context);
     // tmp = _np_route_row_lookup(context, msg_event.target_dhkey);
     source_sll_of_keys = "_np_route_neighbors";
@@ -562,29 +993,22 @@ bool _np_out_pheromone(np_state_t *context, np_util_event_t msg_event) {
     //__np_axon_chunk_and_send(context, event.current_run, available_msg,
     // msg_from.value.dhkey, msg_to.value.dhkey, tmp);
 
-    // 2: chunk the message if required
+    // 2: chunk the message if required, small ones join the bundle of the hop
     // TODO: send two separate messages?
     _np_message_calculate_chunking(pheromone_msg_out);
-    _np_message_serialize_chunked(context, pheromone_msg_out);
-
-    // 3: send over the message parts
-    _LOCK_ACCESS(&pheromone_msg_out->msg_chunks_lock) {
-      pll_iterator(np_messagepart_ptr) part_iter =
-          pll_first(pheromone_msg_out->msg_chunks);
-      while (NULL != part_iter) {
-        memcpy(part_iter->val->uuid, pheromone_msg_out->uuid, NP_UUID_BYTES);
-        log_debug_msg(LOG_ROUTING,
-                      "submitting pheromone request to next hop %s",
-                      _np_key_as_str(target));
-        np_util_event_t send_event = {.type      = (evt_internal | evt_message),
-                                      .user_data = part_iter->val,
-                                      .target_dhkey = msg_event.target_dhkey};
-        _np_event_runtime_add_event(context,
-                                    msg_event.current_run,
-                                    target->dhkey,
-                                    send_event);
-        pll_next(part_iter);
-      }
+    if (!__np_axon_bundle_add(context,
+                              msg_event.current_run,
+                              pheromone_msg_out,
+                              target->dhkey,
+                              msg_event.target_dhkey)) {
+      _np_message_serialize_chunked(context, pheromone_msg_out);
+
+      // 3: send over the message parts
+      __np_axon_send_parts(context,
+                           msg_event.current_run,
+                           pheromone_msg_out,
+                           target->dhkey,
+                           msg_event.target_dhkey);
     }
 
     if (_np_dhkey_equal(&target_iter->val->dhkey,
@@ -742,28 +1166,19 @@ bool _np_out_ping(np_state_t *context, const np_util_event_t event) {
                 "_np_out_ping for message uuid %s",
                 ping_msg->uuid);
 
-  // 2: chunk the message if required
+  _np_message_add_response_handler(ping_msg, event, true);
+
+  // 2: chunk the message if required. Pings do not join the bundle of the
+  // hop, the time in the bundle would be added to the measured latency
   _np_message_calculate_chunking(ping_msg);
   _np_message_serialize_chunked(context, ping_msg);
 
-  _np_message_add_response_handler(ping_msg, event, true);
-
   // 3: send over the message parts
-  _LOCK_ACCESS(&ping_msg->msg_chunks_lock) {
-    pll_iterator(np_messagepart_ptr) iter = pll_first(ping_msg->msg_chunks);
-    while (NULL != iter) {
-      memcpy(iter->val->uuid, ping_msg->uuid, NP_UUID_BYTES);
-      np_util_event_t ping_event = {.type      = (evt_internal | evt_message),
-                                    .user_data = iter->val,
-                                    .target_dhkey = event.target_dhkey};
-      _np_event_runtime_add_event(context,
-                                  event.current_run,
-                                  ping_event.target_dhkey,
-                                  ping_event);
-
-      pll_next(iter);
-    }
-  }
+  __np_axon_send_parts(context,
+                       event.current_run,
+                       ping_msg,
+                       event.target_dhkey,
+                       event.target_dhkey);
 
   return true;
 }
@@ -773,36 +1188,21 @@ bool _np_out_piggy(np_state_t *context, const np_util_event_t event) {
 
   NP_CAST(event.user_data, np_message_t, piggy_msg);
 
-  // 2: chunk the message if required
+  // 2: chunk the message if required, small ones join the bundle of the hop
   _np_message_calculate_chunking(piggy_msg);
-  _np_message_serialize_chunked(context, piggy_msg);
-
-  // 3: send over the message parts
+  if (!__np_axon_bundle_add(context,
+                            event.current_run,
+                            piggy_msg,
+                            event.target_dhkey,
+                            event.target_dhkey)) {
+    _np_message_serialize_chunked(context, piggy_msg);
 
-  _LOCK_ACCESS(&piggy_msg->msg_chunks_lock) {
-    pll_iterator(np_messagepart_ptr) iter = pll_first(piggy_msg->msg_chunks);
-    while (NULL != iter) {
-#ifdef DEBUG
-      np_key_t *target_key = _np_keycache_find(context, event.target_dhkey);
-      if (target_key != NULL) {
-        log_debug_msg(LOG_ROUTING,
-                      "submitting piggy to target key %s / %p",
-                      _np_key_as_str(target_key),
-                      target_key);
-        np_unref_obj(np_key_t, target_key, "_np_keycache_find");
-      }
-#endif // DEBUG
-      memcpy(iter->val->uuid, piggy_msg->uuid, NP_UUID_BYTES);
-      np_util_event_t piggy_event = {.type      = (evt_internal | evt_message),
-                                     .user_data = iter->val,
-                                     .target_dhkey = event.target_dhkey};
-      _np_event_runtime_add_event(context,
-                                  event.current_run,
-                                  event.target_dhkey,
-                                  piggy_event);
-
-      pll_next(iter);
-    }
+    // 3: send over the message parts
+    __np_axon_send_parts(context,
+                         event.current_run,
+                         piggy_msg,
+                         event.target_dhkey,
+                         event.target_dhkey);
   }
 
   return true;
@@ -849,29 +1249,22 @@ bool _np_out_update(np_state_t *context, const np_util_event_t event) {
                       np_treeval_new_dhkey(target->dhkey));
   _np_message_trace_info("MSG_OUT_UPDATE", update_msg);
 
-  // 4: chunk the message if required
+  // 4: chunk the message if required, small ones join the bundle of the hop
   // TODO: send two separate messages?
   _np_message_calculate_chunking(update_msg);
-  _np_message_serialize_chunked(context, update_msg);
-
-  // 5: send over the message parts
-  _LOCK_ACCESS(&update_msg->msg_chunks_lock) {
-    pll_iterator(np_messagepart_ptr) iter = pll_first(update_msg->msg_chunks);
-    while (NULL != iter) {
-      log_debug_msg(LOG_ROUTING,
-                    "submitting update request to target key %s / %p",
-                    _np_key_as_str(target),
-                    target);
-      memcpy(iter->val->uuid, update_msg->uuid, NP_UUID_BYTES);
-      np_util_event_t update_event = {.type      = (evt_internal | evt_message),
-                                      .user_data = iter->val,
-                                      .target_dhkey = event.target_dhkey};
-      _np_event_runtime_add_event(context,
-                                  event.current_run,
-                                  target->dhkey,
-                                  update_event);
-      pll_next(iter);
-    }
+  if (!__np_axon_bundle_add(context,
+                            event.current_run,
+                            update_msg,
+                            target->dhkey,
+                            event.target_dhkey)) {
+    _np_message_serialize_chunked(context, update_msg);
+
+    // 5: send over the message parts
+    __np_axon_send_parts(context,
+                         event.current_run,
+                         update_msg,
+                         target->dhkey,
+                         event.target_dhkey);
   }
 
   // 5 cleanup
@@ -35,6 +35,7 @@
 #include "util/np_serialization.h"
 #include "util/np_tree.h"
 #include "util/np_treeval.h"
+#include "util/np_uuidmap.h"
 
 #include "np_aaatoken.h"
 #include "np_axon.h"
@@ -61,6 +62,241 @@
 #include "np_types.h"
 #include "np_util.h"
 
+np_module_struct(acks) {
+  np_state_t *context;
+  // acknowledgements waiting to be sent, one batch per target node
+  TSP(np_tree_t *, pending);
+  // a one shot flush is scheduled, guarded by the pending lock
+  bool flush_scheduled;
+};
+
+typedef struct __np_ack_batch_s {
+  np_dhkey_t target;
+  double     first_at;
+  uint16_t   count;
+  char       uuids[NP_ACK_BATCH_MAX_SIZE][NP_UUID_BYTES];
+  double     queued_at[NP_ACK_BATCH_MAX_SIZE];
+} __np_ack_batch_t;
+
+void _np_ack_encode(np_tree_t *body,
+                    char (*uuids)[NP_UUID_BYTES],
+                    const double *holds,
+                    uint16_t      count) {
+  assert(count > 0);
+
+  if (count == 1) {
+    np_tree_insert_str(body,
+                       _NP_MSG_INST_RESPONSE_UUID,
+                       np_treeval_new_s(uuids[0]));
+  } else {
+    np_tree_insert_str(body,
+                       _NP_MSG_INST_RESPONSE_UUIDS,
+                       np_treeval_new_bin(uuids, count * NP_UUID_BYTES));
+  }
+
+  if (holds != NULL) {
+    // microseconds in network byte order, one per uuid
+    uint32_t hold_us[count];
+    for (uint16_t i = 0; i < count; i++) {
+      double hold = holds[i] > 0.0 ? holds[i] * 1000000.0 : 0.0;
+      hold_us[i]  = htonl(hold < UINT32_MAX ? (uint32_t)hold : UINT32_MAX);
+    }
+    np_tree_insert_str(body,
+                       _NP_MSG_INST_RESPONSE_HOLDS,
+                       np_treeval_new_bin(hold_us, count * sizeof(uint32_t)));
+  }
+}
+
+static np_tree_elem_t *__np_ack_batch_elem(np_tree_t *body) {
+  np_tree_elem_t *ack_uuids =
+      np_tree_find_str(body, _NP_MSG_INST_RESPONSE_UUIDS);
+  if (ack_uuids != NULL && ack_uuids->val.type != np_treeval_type_bin &&
+      ack_uuids->val.type != np_treeval_type_bin_ref)
+    ack_uuids = NULL;
+  return ack_uuids;
+}
+
+uint32_t _np_ack_count(np_tree_t *body) {
+  np_tree_elem_t *ack_uuid =
+      np_tree_find_str(body, _NP_MSG_INST_RESPONSE_UUID);
+  np_tree_elem_t *ack_uuids = __np_ack_batch_elem(body);
+
+  if (ack_uuids != NULL) return ack_uuids->val.size / NP_UUID_BYTES;
+  if (ack_uuid != NULL && ack_uuid->val.type == np_treeval_type_char_ptr)
+    return 1;
+  return 0;
+}
+
+bool _np_ack_get(np_tree_t *body,
+                 uint32_t   index,
+                 char       uuid[NP_UUID_BYTES],
+                 double    *hold) {
+  uint32_t count = _np_ack_count(body);
+  if (index >= count) return false;
+
+  np_tree_elem_t *ack_uuids = __np_ack_batch_elem(body);
+  if (ack_uuids != NULL) {
+    // a batch of fixed size uuid strings, see _np_ack_encode
+    memcpy(uuid,
+           ack_uuids->val.value.bin + (index * NP_UUID_BYTES),
+           NP_UUID_BYTES);
+  } else {
+    np_tree_elem_t *ack_uuid =
+        np_tree_find_str(body, _NP_MSG_INST_RESPONSE_UUID);
+    strncpy(uuid, ack_uuid->val.value.s, NP_UUID_BYTES);
+  }
+  uuid[NP_UUID_BYTES - 1] = '\0';
+
+  // older nodes and acks which were not held back have no hold times
+  *hold                 = 0.0;
+  np_tree_elem_t *holds = np_tree_find_str(body, _NP_MSG_INST_RESPONSE_HOLDS);
+  if (holds != NULL &&
+      (holds->val.type == np_treeval_type_bin ||
+       holds->val.type == np_treeval_type_bin_ref) &&
+      holds->val.size == count * sizeof(uint32_t)) {
+    uint32_t hold_us;
+    memcpy(&hold_us,
+           holds->val.value.bin + (index * sizeof(uint32_t)),
+           sizeof(uint32_t));
+    *hold = ntohl(hold_us) / 1000000.0;
+  }
+  return true;
+}
+
+// creates one ack message for all uuids and hands it over to the outbound ack
+// property. Without hold times the acks are sent in the single uuid format.
+static void __np_ack_send(np_state_t         *context,
+                          np_event_runtime_t *current_run,
+                          np_dhkey_t          target_dhkey,
+                          char (*uuids)[NP_UUID_BYTES],
+                          const double *holds,
+                          uint16_t      count) {
+  np_dhkey_t ack_subject = {0};
+  np_generate_subject(&ack_subject, _NP_MSG_ACK, strnlen(_NP_MSG_ACK, 256));
+  np_dhkey_t ack_out_dhkey =
+      _np_msgproperty_tweaked_dhkey(OUTBOUND, ack_subject);
+
+  np_tree_t *msg_body = np_tree_create();
+  _np_ack_encode(msg_body, uuids, holds, count);
+
+  np_message_t *msg_out = NULL;
+  np_new_obj(np_message_t, msg_out, FUNC);
+  _np_message_create(msg_out,
+                     target_dhkey,
+                     context->my_node_key->dhkey,
+                     ack_subject,
+                     msg_body);
+
+  log_info(LOG_ROUTING,
+           "ack of %" PRIu16 " message(s) (first: %s) with %s",
+           count,
+           uuids[0],
+           msg_out->uuid);
+
+  np_util_event_t ack_event = {.type         = evt_message | evt_internal,
+                               .target_dhkey = ack_out_dhkey,
+                               .user_data    = msg_out};
+  _np_event_runtime_add_event(context, current_run, ack_out_dhkey, ack_event);
+  np_unref_obj(np_message_t, msg_out, FUNC);
+}
+
+static void __np_ack_batch_send(np_state_t         *context,
+                                np_event_runtime_t *current_run,
+                                __np_ack_batch_t   *batch) {
+  // the time the acks were held back must not count as round trip time
+  double now = np_time_now();
+  double holds[NP_ACK_BATCH_MAX_SIZE];
+  for (uint16_t i = 0; i < batch->count; i++)
+    holds[i] = now - batch->queued_at[i];
+
+  __np_ack_send(context,
+                current_run,
+                batch->target,
+                batch->uuids,
+                holds,
+                batch->count);
+}
+
+bool __np_ack_flush_pending(np_state_t *context, np_util_event_t event);
+
+// has to be called with the pending lock held
+static void __np_ack_schedule_flush(np_state_t *context, double delay) {
+  if (np_module(acks)->flush_scheduled) return;
+
+  np_module(acks)->flush_scheduled =
+      np_jobqueue_submit_event_callback(context,
+                                        delay,
+                                        (np_util_event_t){0},
+                                        __np_ack_flush_pending,
+                                        "__np_ack_flush_pending");
+  if (!np_module(acks)->flush_scheduled)
+    log_warn(LOG_ROUTING, "could not schedule the flush of pending acks");
+}
+
+bool __np_ack_flush_pending(np_state_t               *context,
+                            NP_UNUSED np_util_event_t event) {
+  np_sll_t(void_ptr, ready) = NULL;
+  sll_init(void_ptr, ready);
+
+  double now = np_time_now();
+  TSP_SCOPE(np_module(acks)->pending) {
+    np_module(acks)->flush_scheduled = false;
+
+    double          next_due = 0.0;
+    np_tree_elem_t *iter     = NULL;
+    RB_FOREACH (iter, np_tree_s, np_module(acks)->pending) {
+      __np_ack_batch_t *batch = iter->val.value.v;
+      double            due   = batch->first_at + NP_ACK_COALESCE_WINDOW_SEC;
+      if (due <= now) {
+        sll_append(void_ptr, ready, batch);
+      } else if (next_due == 0.0 || due < next_due) {
+        next_due = due;
+      }
+    }
+    sll_iterator(void_ptr) ready_iter = sll_first(ready);
+    while (ready_iter != NULL) {
+      __np_ack_batch_t *batch = ready_iter->val;
+      np_tree_del_dhkey(np_module(acks)->pending, batch->target);
+      sll_next(ready_iter);
+    }
+    // the timer only runs while acknowledgements are pending
+    if (next_due > 0.0) __np_ack_schedule_flush(context, next_due - now);
+  }
+
+  __np_ack_batch_t *batch = NULL;
+  while (NULL != (batch = sll_head(void_ptr, ready))) {
+    __np_ack_batch_send(context, NULL, batch);
+    free(batch);
+  }
+  sll_free(void_ptr, ready);
+
+  return true;
+}
+
+bool _np_acks_init(np_state_t *context) {
+  if (!np_module_initiated(acks)) {
+    np_module_malloc(acks);
+    TSP_INITD(_module->pending, np_tree_create());
+    _module->flush_scheduled = false;
+  }
+  return true;
+}
+
+void _np_acks_destroy(np_state_t *context) {
+  if (np_module_initiated(acks)) {
+    np_module_var(acks);
+
+    np_tree_elem_t *iter = NULL;
+    RB_FOREACH (iter, np_tree_s, _module->pending) {
+      free(iter->val.value.v);
+    }
+    np_tree_free(_module->pending);
+    TSP_DESTROY(_module->pending);
+
+    np_module_free(acks);
+  }
+}
+
 bool _check_and_send_destination_ack(np_state_t     *context,
                                      np_util_event_t msg_event) {
   NP_CAST(msg_event.user_data, np_message_t, msg);
@@ -71,41 +307,60 @@ bool _check_and_send_destination_ack(np_state_t     *context,
                        "NOT AN ACK MSG") {
     // TODO: check intent token for ack indicator if user space message
     if (FLAG_CMP(msg_ack->val.value.ush, ACK_DESTINATION)) {
-      np_dhkey_t ack_subject = {0};
-      np_generate_subject(&ack_subject, _NP_MSG_ACK, strnlen(_NP_MSG_ACK, 256));
-
-      np_dhkey_t ack_out_dhkey =
-          _np_msgproperty_tweaked_dhkey(OUTBOUND, ack_subject);
       np_dhkey_t target_dhkey =
           np_tree_find_str(msg->header, _NP_MSG_HEADER_FROM)
               ->val.value.dhkey; // where the message came from
 
-      np_tree_t *msg_body = np_tree_create();
-      np_tree_insert_str(msg_body,
-                         _NP_MSG_INST_RESPONSE_UUID,
-                         np_treeval_new_s(msg->uuid));
-
-      np_message_t *msg_out = NULL;
-      np_new_obj(np_message_t, msg_out, FUNC);
-      _np_message_create(msg_out,
-                         target_dhkey,
-                         context->my_node_key->dhkey,
-                         ack_subject,
-                         msg_body);
-
-      log_info(LOG_ROUTING,
-               "ack of message %s with %s",
-               msg->uuid,
-               msg_out->uuid);
-
-      np_util_event_t ack_event = {.type         = evt_message | evt_internal,
-                                   .target_dhkey = ack_out_dhkey,
-                                   .user_data    = msg_out};
-      _np_event_runtime_add_event(context,
-                                  msg_event.current_run,
-                                  ack_out_dhkey,
-                                  ack_event);
-      np_unref_obj(np_message_t, msg_out, FUNC);
+      // nodes which cannot read batches receive each ack right away
+      if (NP_ACK_COALESCE_WINDOW_SEC <= 0.0 || !np_module_initiated(acks) ||
+          !_np_node_has_capability(context,
+                                   target_dhkey,
+                                   np_node_capability_ack_batch)) {
+        char uuid[1][NP_UUID_BYTES] = {{0}};
+        strncpy(uuid[0], msg->uuid, NP_UUID_BYTES - 1);
+        __np_ack_send(context,
+                      msg_event.current_run,
+                      target_dhkey,
+                      uuid,
+                      NULL,
+                      1);
+        return true;
+      }
+
+      // collect the uuid, the batch is sent by the flush timer or as soon as
+      // it is full
+      __np_ack_batch_t *full_batch = NULL;
+      TSP_SCOPE(np_module(acks)->pending) {
+        __np_ack_batch_t *batch = NULL;
+        np_tree_elem_t   *entry =
+            np_tree_find_dhkey(np_module(acks)->pending, target_dhkey);
+        if (entry == NULL) {
+          batch = calloc(1, sizeof(__np_ack_batch_t));
+          CHECK_MALLOC(batch);
+          batch->target   = target_dhkey;
+          batch->first_at = np_time_now();
+          np_tree_insert_dhkey(np_module(acks)->pending,
+                               target_dhkey,
+                               np_treeval_new_v(batch));
+          __np_ack_schedule_flush(context, NP_ACK_COALESCE_WINDOW_SEC);
+        } else {
+          batch = entry->val.value.v;
+        }
+        strncpy(batch->uuids[batch->count], msg->uuid, NP_UUID_BYTES - 1);
+        batch->queued_at[batch->count] = np_time_now();
+        batch->count++;
+
+        if (batch->count == NP_ACK_BATCH_MAX_SIZE) {
+          np_tree_del_dhkey(np_module(acks)->pending, target_dhkey);
+          full_batch = batch;
+        }
+      }
+      log_debug_msg(LOG_ROUTING, "queued ack of message %s", msg->uuid);
+
+      if (full_batch != NULL) {
+        __np_ack_batch_send(context, msg_event.current_run, full_batch);
+        free(full_batch);
+      }
     }
   }
   return true;
@@ -492,38 +747,60 @@ __np_cleanup__:
   return true;
 }
 
-bool _np_in_ack(np_state_t *context, np_util_event_t msg_event) {
-  log_trace_msg(LOG_TRACE, "start: bool __np_in_ack(...){");
-
-  NP_CAST(msg_event.user_data, np_message_t, msg);
-
-  CHECK_STR_FIELD(msg->body, _NP_MSG_INST_RESPONSE_UUID, ack_uuid);
-
-  np_dhkey_t ack_in_dhkey = _np_msgproperty_dhkey(INBOUND, _NP_MSG_ACK);
-  np_key_t  *ack_key      = _np_keycache_find(context, ack_in_dhkey);
-  NP_CAST(ack_key->entity_array[1], np_msgproperty_run_t, property);
+static void __np_in_ack_uuid(np_state_t           *context,
+                             np_msgproperty_run_t *property,
+                             np_message_t         *msg,
+                             const char           *ack_uuid,
+                             double                hold) {
+  np_uuid_t ack_key;
+  _np_uuid_from_str(ack_uuid, &ack_key);
 
-  np_tree_elem_t *response_entry =
-      np_tree_find_str(property->response_handler, ack_uuid.value.s);
+  np_treeval_t *response_entry =
+      np_uuidmap_find(property->response_handler, &ack_key);
   if (response_entry !=
       NULL) { // just an acknowledgement of own messages send out earlier
-    NP_CAST(response_entry->val.value.v, np_responsecontainer_t, response);
+    NP_CAST(response_entry->value.v, np_responsecontainer_t, response);
     log_debug_msg(LOG_ROUTING | LOG_MESSAGE,
                   "msg (%s) is acknowledgment of uuid=%s",
                   msg->uuid,
-                  np_treeval_to_str(ack_uuid, NULL));
-    response->received_at = np_time_now();
+                  ack_uuid);
+    // remove the time the ack was held back by the receiver, but keep the
+    // receive time after the send time
+    double received_at = np_time_now() - hold;
+    response->received_at =
+        received_at > response->send_at ? received_at : np_time_now();
   } else {
     log_debug_msg(
         LOG_ROUTING | LOG_MESSAGE,
         "msg (%s) is acknowledgment of uuid=%s but we do not know of this msg",
         msg->uuid,
-        np_treeval_to_str(ack_uuid, NULL));
+        ack_uuid);
   }
+}
 
-  np_unref_obj(np_key_t, ack_key, "_np_keycache_find");
+bool _np_in_ack(np_state_t *context, np_util_event_t msg_event) {
+  log_trace_msg(LOG_TRACE, "start: bool __np_in_ack(...){");
 
-__np_cleanup__ : {}
+  NP_CAST(msg_event.user_data, np_message_t, msg);
+
+  uint32_t count = _np_ack_count(msg->body);
+  if (count == 0) {
+    log_msg(LOG_WARNING, "ack message %s without uuids", msg->uuid);
+    return true;
+  }
+
+  np_dhkey_t ack_in_dhkey = _np_msgproperty_dhkey(INBOUND, _NP_MSG_ACK);
+  np_key_t  *ack_key      = _np_keycache_find(context, ack_in_dhkey);
+  NP_CAST(ack_key->entity_array[1], np_msgproperty_run_t, property);
+
+  char   uuid[NP_UUID_BYTES];
+  double hold = 0.0;
+  for (uint32_t i = 0; i < count; i++) {
+    if (_np_ack_get(msg->body, i, uuid, &hold))
+      __np_in_ack_uuid(context, property, msg, uuid, hold);
+  }
+
+  np_unref_obj(np_key_t, ack_key, "_np_keycache_find");
 
   return true;
 }
@@ -812,6 +1089,147 @@ __np_cleanup__ : {}
   return true;
 }
 
+bool _np_control_bundle_entry_read(np_tree_t    *entry,
+                                   np_treeval_t  bundle_to,
+                                   np_treeval_t  bundle_from,
+                                   np_message_t *msg_in) {
+  np_tree_elem_t *header = np_tree_find_str(entry, NP_MSG_BUNDLE_HEADER);
+  np_tree_elem_t *instructions =
+      np_tree_find_str(entry, NP_MSG_BUNDLE_INSTRUCTIONS);
+  np_tree_elem_t *body = np_tree_find_str(entry, NP_MSG_BUNDLE_BODY);
+  if (header == NULL || header->val.type != np_treeval_type_jrb_tree ||
+      instructions == NULL ||
+      instructions->val.type != np_treeval_type_jrb_tree || body == NULL ||
+      body->val.type != np_treeval_type_jrb_tree)
+    return false;
+
+  np_tree_copy(header->val.value.tree, msg_in->header);
+  np_tree_copy(instructions->val.value.tree, msg_in->instructions);
+  np_tree_copy(body->val.value.tree, msg_in->body);
+  // restore the fields which are shared with the bundle
+  if (NULL == np_tree_find_str(msg_in->header, _NP_MSG_HEADER_TO))
+    np_tree_insert_str(msg_in->header, _NP_MSG_HEADER_TO, bundle_to);
+  if (NULL == np_tree_find_str(msg_in->header, _NP_MSG_HEADER_FROM))
+    np_tree_insert_str(msg_in->header, _NP_MSG_HEADER_FROM, bundle_from);
+
+  np_tree_elem_t *msg_uuid =
+      np_tree_find_str(msg_in->instructions, _NP_MSG_INST_UUID);
+  if (msg_uuid == NULL || msg_uuid->val.type != np_treeval_type_char_ptr ||
+      NULL == np_tree_find_str(msg_in->header, _NP_MSG_HEADER_SUBJECT))
+    return false;
+
+  char *old    = msg_in->uuid;
+  msg_in->uuid = strdup(np_treeval_to_str(msg_uuid->val, NULL));
+  free(old);
+  _np_uuid_from_str(msg_in->uuid, &msg_in->uuid_key);
+
+  return true;
+}
+
+bool _np_in_control_bundle(np_state_t *context, np_util_event_t msg_event) {
+  log_trace_msg(LOG_TRACE, "start: bool _np_in_control_bundle(...) {");
+
+  NP_CAST(msg_event.user_data, np_message_t, bundle_msg);
+
+  CHECK_STR_FIELD(bundle_msg->header, _NP_MSG_HEADER_TO, msg_to);
+  CHECK_STR_FIELD(bundle_msg->header, _NP_MSG_HEADER_FROM, msg_from);
+
+  // the bundle has been handed over by the alias key of the last hop
+  np_key_ro_t alias_key = {0};
+  if (!_np_keycache_exists(context, msg_event.target_dhkey, &alias_key) ||
+      !FLAG_CMP(alias_key.type, np_key_type_alias)) {
+    log_warn(LOG_ROUTING,
+             "dropping bundle (%s), last hop is unknown",
+             bundle_msg->uuid);
+    return false;
+  }
+  np_dhkey_t last_hop = alias_key.parent_dhkey;
+
+  // pheromones are only accepted from our direct neighbours
+  bool      is_neighbour = false;
+  np_key_t *node_key     = _np_keycache_find(context, last_hop);
+  if (node_key != NULL) {
+    np_node_t *node = _np_key_get_node(node_key);
+    is_neighbour =
+        (node != NULL) && (node->is_in_leafset || node->is_in_routing_table);
+    np_unref_obj(np_key_t, node_key, "_np_keycache_find");
+  }
+
+  np_dhkey_t ping_dhkey = {0};
+  np_generate_subject(&ping_dhkey,
+                      _NP_MSG_PING_REQUEST,
+                      strnlen(_NP_MSG_PING_REQUEST, 256));
+  np_dhkey_t piggy_dhkey = {0};
+  np_generate_subject(&piggy_dhkey,
+                      _NP_MSG_PIGGY_REQUEST,
+                      strnlen(_NP_MSG_PIGGY_REQUEST, 256));
+  np_dhkey_t update_dhkey = {0};
+  np_generate_subject(&update_dhkey,
+                      _NP_MSG_UPDATE_REQUEST,
+                      strnlen(_NP_MSG_UPDATE_REQUEST, 256));
+  np_dhkey_t pheromone_dhkey = {0};
+  np_generate_subject(&pheromone_dhkey,
+                      _NP_MSG_PHEROMONE_UPDATE,
+                      strnlen(_NP_MSG_PHEROMONE_UPDATE, 256));
+
+  np_tree_elem_t *iter = NULL;
+  RB_FOREACH (iter, np_tree_s, bundle_msg->body) {
+    if (iter->val.type != np_treeval_type_jrb_tree) continue;
+
+    np_message_t *msg_in = NULL;
+    np_new_obj(np_message_t, msg_in, FUNC);
+
+    bool is_valid = _np_control_bundle_entry_read(iter->val.value.tree,
+                                                  msg_to,
+                                                  msg_from,
+                                                  msg_in);
+
+    np_tree_elem_t *msg_subject =
+        np_tree_find_str(msg_in->header, _NP_MSG_HEADER_SUBJECT);
+    np_tree_elem_t *msg_in_to =
+        np_tree_find_str(msg_in->header, _NP_MSG_HEADER_TO);
+
+    np_util_event_t in_event = msg_event;
+    in_event.user_data       = msg_in;
+
+    if (is_valid) {
+      np_dhkey_t subject_dhkey = msg_subject->val.value.dhkey;
+      if (_np_dhkey_equal(&subject_dhkey, &pheromone_dhkey)) {
+        is_valid              = is_neighbour;
+        in_event.target_dhkey = last_hop;
+      } else {
+        // same rules as for a dht message which arrived on its own
+        is_valid = (_np_dhkey_equal(&subject_dhkey, &ping_dhkey) ||
+                    _np_dhkey_equal(&subject_dhkey, &piggy_dhkey) ||
+                    _np_dhkey_equal(&subject_dhkey, &update_dhkey)) &&
+                   _np_dhkey_equal(&msg_in_to->val.value.dhkey,
+                                   &context->my_node_key->dhkey);
+      }
+    }
+
+    if (is_valid) {
+      log_debug_msg(LOG_ROUTING,
+                    "handling   message (%s) of bundle (%s)",
+                    msg_in->uuid,
+                    bundle_msg->uuid);
+      _np_event_runtime_add_event(
+          context,
+          msg_event.current_run,
+          _np_msgproperty_tweaked_dhkey(INBOUND, msg_subject->val.value.dhkey),
+          in_event);
+    } else {
+      log_warn(LOG_ROUTING,
+               "dropping invalid entry of bundle (%s)",
+               bundle_msg->uuid);
+    }
+    np_unref_obj(np_message_t, msg_in, FUNC);
+  }
+
+__np_cleanup__ : {}
+
+  return true;
+}
+
 bool _np_in_handshake(np_state_t *context, np_util_event_t msg_event) {
   log_trace_msg(LOG_TRACE,
                 "start: bool _np_msgin_handshake(np_message_t* msg) {");
@@ -14,6 +14,10 @@
 #include <string.h>
 #include <unistd.h>
 
+#if defined(__AVX2__)
+#include <immintrin.h>
+#endif
+
 #include "sodium.h"
 
 #include "neuropil_log.h"
@@ -33,6 +37,54 @@ static np_dhkey_t __dhkey_min;
 static np_dhkey_t __dhkey_half;
 static np_dhkey_t __dhkey_max;
 
+/**
+ * a dhkey fits into a single 256 bit register. If the library is compiled for
+ * AVX2 (e.g. -mavx2 -mbmi) the functions below use these kernels, otherwise a
+ * portable implementation working on 64 bit words where possible. Limbs are
+ * compared in order t[0] ... t[7], add / sub work per limb without carry.
+ */
+#if defined(__AVX2__)
+#define NP_DHKEY_AVX2
+
+static inline __m256i __np_dhkey_load(const np_dhkey_t *const k) {
+  return _mm256_loadu_si256((const __m256i *)k);
+}
+
+static inline void __np_dhkey_store(np_dhkey_t *k, __m256i v) {
+  _mm256_storeu_si256((__m256i *)k, v);
+}
+
+// returns > 0 if a>b, < 0 if a<b, and 0 if a==b (limb t[0] decides first)
+static inline int8_t __np_dhkey_cmp_avx2(__m256i a, __m256i b) {
+  uint32_t neq = ~(uint32_t)_mm256_movemask_ps(
+                     _mm256_castsi256_ps(_mm256_cmpeq_epi32(a, b))) &
+                 0xff;
+  if (neq == 0) return 0;
+
+  // unsigned compare: flip the sign bits and use the signed compare
+  __m256i  sign = _mm256_set1_epi32(INT32_MIN);
+  uint32_t gt   = (uint32_t)_mm256_movemask_ps(_mm256_castsi256_ps(
+      _mm256_cmpgt_epi32(_mm256_xor_si256(a, sign),
+                         _mm256_xor_si256(b, sign))));
+  return ((gt >> __builtin_ctz(neq)) & 1) ? 1 : -1;
+}
+
+static inline __m256i __np_dhkey_distance_avx2(__m256i a, __m256i b) {
+  __m256i d = (__np_dhkey_cmp_avx2(a, b) > 0) ? _mm256_sub_epi32(a, b)
+                                              : _mm256_sub_epi32(b, a);
+  // max - d per limb is the complement of d
+  if (__np_dhkey_cmp_avx2(_mm256_set1_epi32(INT32_MIN), d) < 0)
+    d = _mm256_xor_si256(d, _mm256_set1_epi32(-1));
+  return d;
+}
+#endif
+
+// the dhkey as four 64 bit words in memory order
+static inline void __np_dhkey_words(const np_dhkey_t *const k,
+                                    uint64_t                w[4]) {
+  memcpy(w, k, sizeof(np_dhkey_t));
+}
+
 NP_SLL_GENERATE_IMPLEMENTATION(np_dhkey_t)
 
 np_dhkey_t _np_dhkey_generate_hash(const unsigned char *data,
@@ -59,6 +111,18 @@ np_dhkey_t _np_dhkey_generate_hash(const unsigned char *data,
   return kResult;
 }
 
+np_dhkey_t _np_dhkey_from_uuid(const np_uuid_t *uuid) {
+  np_dhkey_t kResult = {0};
+  memcpy(&kResult.t[0], uuid->b, NP_UUID_BIN_BYTES);
+
+  for (uint8_t k = 0; k < 4; k++) {
+    uint32_t mixed = kResult.t[k] ^ (kResult.t[(k + 1) & 3] >> 16 |
+                                     kResult.t[(k + 1) & 3] << 16);
+    kResult.t[k + 4] = mixed * 0x9e3779b1;
+  }
+  return kResult;
+}
+
 np_dhkey_t np_dhkey_create_from_hash(const char *strOrig) {
   log_trace_msg(
       LOG_TRACE,
@@ -142,25 +206,41 @@ void _np_dhkey_assign(np_dhkey_t *k1, const np_dhkey_t *const k2) {
 }
 
 bool _np_dhkey_equal(const np_dhkey_t *const k1, const np_dhkey_t *const k2) {
-  for (uint8_t i = 0; i < 8; i++)
-    if (k1->t[i] != k2->t[i]) return false;
-  return true;
+#ifdef NP_DHKEY_AVX2
+  __m256i x = _mm256_xor_si256(__np_dhkey_load(k1), __np_dhkey_load(k2));
+  return _mm256_testz_si256(x, x);
+#else
+  uint64_t w1[4], w2[4];
+  __np_dhkey_words(k1, w1);
+  __np_dhkey_words(k2, w2);
+  return ((w1[0] ^ w2[0]) | (w1[1] ^ w2[1]) | (w1[2] ^ w2[2]) |
+          (w1[3] ^ w2[3])) == 0;
+#endif
 }
 
 int8_t _np_dhkey_cmp(const np_dhkey_t *const k1, const np_dhkey_t *const k2) {
   if (k1 == NULL) return -1;
   if (k2 == NULL) return 1;
 
+#ifdef NP_DHKEY_AVX2
+  return __np_dhkey_cmp_avx2(__np_dhkey_load(k1), __np_dhkey_load(k2));
+#else
   for (uint8_t i = 0; i < 8; i++) {
     if (k1->t[i] > k2->t[i]) return (1);
     else if (k1->t[i] < k2->t[i]) return (-1);
   }
   return (0);
+#endif
 }
 
 void _np_dhkey_add(np_dhkey_t             *result,
                    const np_dhkey_t *const op1,
                    const np_dhkey_t *const op2) {
+#ifdef NP_DHKEY_AVX2
+  __m256i a = __np_dhkey_load(op1), b = __np_dhkey_load(op2);
+  __np_dhkey_store(result, _mm256_add_epi32(a, b));
+  return;
+#endif
   // we dont care about unsigned integer overflow, since we are adding hashes
   // as we are using uint32_t we always stay in valid data
   // for (uint8_t i = 0; i < 8; i++)
@@ -179,14 +259,24 @@ void _np_dhkey_add(np_dhkey_t             *result,
 void _np_dhkey_sub(np_dhkey_t             *result,
                    const np_dhkey_t *const op1,
                    const np_dhkey_t *const op2) {
+#ifdef NP_DHKEY_AVX2
+  __m256i a = __np_dhkey_load(op1), b = __np_dhkey_load(op2);
+  __np_dhkey_store(result, _mm256_sub_epi32(a, b));
+#else
   for (uint8_t i = 0; i < 8; i++) {
     result->t[i] = op1->t[i] - op2->t[i];
   }
+#endif
 }
 
 void _np_dhkey_and(np_dhkey_t             *result,
                    const np_dhkey_t *const op1,
                    const np_dhkey_t *const op2) {
+#ifdef NP_DHKEY_AVX2
+  __m256i a = __np_dhkey_load(op1), b = __np_dhkey_load(op2);
+  __np_dhkey_store(result, _mm256_and_si256(a, b));
+  return;
+#endif
   // for (uint8_t i = 0; i < 8; i++)
   // {
   result->t[0] = op1->t[0] & op2->t[0];
@@ -203,6 +293,11 @@ void _np_dhkey_and(np_dhkey_t             *result,
 void _np_dhkey_or(np_dhkey_t             *result,
                   const np_dhkey_t *const op1,
                   const np_dhkey_t *const op2) {
+#ifdef NP_DHKEY_AVX2
+  __m256i a = __np_dhkey_load(op1), b = __np_dhkey_load(op2);
+  __np_dhkey_store(result, _mm256_or_si256(a, b));
+  return;
+#endif
   // for (uint8_t i = 0; i < 8; i++)
   // {
   result->t[0] = op1->t[0] | op2->t[0];
@@ -219,6 +314,11 @@ void _np_dhkey_or(np_dhkey_t             *result,
 void _np_dhkey_xor(np_dhkey_t             *result,
                    const np_dhkey_t *const op1,
                    const np_dhkey_t *const op2) {
+#ifdef NP_DHKEY_AVX2
+  __m256i a = __np_dhkey_load(op1), b = __np_dhkey_load(op2);
+  __np_dhkey_store(result, _mm256_xor_si256(a, b));
+  return;
+#endif
   // for (uint8_t i = 0; i < 8; i++)
   // {
   result->t[0] = op1->t[0] ^ op2->t[0];
@@ -269,10 +369,15 @@ np_dhkey_t np_dhkey_max(NP_UNUSED np_state_t *context) {
   return __dhkey_max;
 };
 
-// TODO: the distance of two hash keys could be implemented much better
 void _np_dhkey_distance(np_dhkey_t             *diff,
                         const np_dhkey_t *const k1,
                         const np_dhkey_t *const k2) {
+#ifdef NP_DHKEY_AVX2
+  __np_dhkey_store(
+      diff,
+      __np_dhkey_distance_avx2(__np_dhkey_load(k1), __np_dhkey_load(k2)));
+  return;
+#endif
   int cmp = _np_dhkey_cmp(k1, k2);
   // calculate absolute distance
   if (cmp > 0) {
@@ -285,42 +390,82 @@ void _np_dhkey_distance(np_dhkey_t             *diff,
     _np_dhkey_sub(diff, &__dhkey_max, diff);
 }
 
+uint32_t _np_dhkey_closest(const np_dhkey_t *const target,
+                           const np_dhkey_t       *keys,
+                           const uint8_t          *valid,
+                           uint32_t                count,
+                           np_dhkey_t             *min_dif) {
+  uint32_t ret = count;
+#ifdef NP_DHKEY_AVX2
+  // target and the shortest distance stay in registers for the whole scan
+  __m256i t   = __np_dhkey_load(target);
+  __m256i min = _mm256_setzero_si256();
+  for (uint32_t i = 0; i < count; i++) {
+    if (valid != NULL && valid[i] == 0) continue;
+    __m256i dif = __np_dhkey_distance_avx2(t, __np_dhkey_load(&keys[i]));
+    if (ret == count || __np_dhkey_cmp_avx2(dif, min) <= 0) {
+      min = dif;
+      ret = i;
+    }
+  }
+  if (ret < count && min_dif != NULL) __np_dhkey_store(min_dif, min);
+#else
+  np_dhkey_t dif, min = {0};
+  for (uint32_t i = 0; i < count; i++) {
+    if (valid != NULL && valid[i] == 0) continue;
+    _np_dhkey_distance(&dif, target, &keys[i]);
+    if (ret == count || _np_dhkey_cmp(&dif, &min) <= 0) {
+      _np_dhkey_assign(&min, &dif);
+      ret = i;
+    }
+  }
+  if (ret < count && min_dif != NULL) _np_dhkey_assign(min_dif, &min);
+#endif
+  return ret;
+}
+
 void _np_dhkey_hamming_distance(uint8_t                *diff,
                                 const np_dhkey_t *const x,
                                 const np_dhkey_t *const y) {
-  *diff = 0;
-  // for (uint8_t k = 0; k < 8; ++k)
-  // {
-  uint32_t val = 0;
-  val          = x->t[0] ^ y->t[0];
-  *diff += __builtin_popcount(val);
-  val = x->t[1] ^ y->t[1];
-  *diff += __builtin_popcount(val);
-  val = x->t[2] ^ y->t[2];
-  *diff += __builtin_popcount(val);
-  val = x->t[3] ^ y->t[3];
-  *diff += __builtin_popcount(val);
-  val = x->t[4] ^ y->t[4];
-  *diff += __builtin_popcount(val);
-  val = x->t[5] ^ y->t[5];
-  *diff += __builtin_popcount(val);
-  val = x->t[6] ^ y->t[6];
-  *diff += __builtin_popcount(val);
-  val = x->t[7] ^ y->t[7];
-  *diff += __builtin_popcount(val);
-
-  // Count the number of bits set
-  // while (val != 0)
-  // {
-  //     (*diff)++;
-  //     val &= val - 1;
-  // }
-  // }
+#ifdef NP_DHKEY_AVX2
+  __m256i v = _mm256_xor_si256(__np_dhkey_load(x), __np_dhkey_load(y));
+  *diff     = __builtin_popcountll(_mm256_extract_epi64(v, 0)) +
+          __builtin_popcountll(_mm256_extract_epi64(v, 1)) +
+          __builtin_popcountll(_mm256_extract_epi64(v, 2)) +
+          __builtin_popcountll(_mm256_extract_epi64(v, 3));
+#else
+  uint64_t wx[4], wy[4];
+  __np_dhkey_words(x, wx);
+  __np_dhkey_words(y, wy);
+  *diff = __builtin_popcountll(wx[0] ^ wy[0]) +
+          __builtin_popcountll(wx[1] ^ wy[1]) +
+          __builtin_popcountll(wx[2] ^ wy[2]) +
+          __builtin_popcountll(wx[3] ^ wy[3]);
+#endif
 }
 
 void _np_dhkey_hamming_distance_each(np_dhkey_t             *diff,
                                      const np_dhkey_t *const x,
                                      const np_dhkey_t *const y) {
+#ifdef NP_DHKEY_AVX2
+  // popcount of each byte by a half byte lookup, then summed up per limb
+  const __m256i lut = _mm256_setr_epi8(0, 1, 1, 2, 1, 2, 2, 3,
+                                      1, 2, 2, 3, 2, 3, 3, 4,
+                                      0, 1, 1, 2, 1, 2, 2, 3,
+                                      1, 2, 2, 3, 2, 3, 3, 4);
+  const __m256i low = _mm256_set1_epi8(0x0f);
+
+  __m256i v  = _mm256_xor_si256(__np_dhkey_load(x), __np_dhkey_load(y));
+  __m256i lo = _mm256_and_si256(v, low);
+  __m256i hi = _mm256_and_si256(_mm256_srli_epi16(v, 4), low);
+  __m256i cnt = _mm256_add_epi8(_mm256_shuffle_epi8(lut, lo),
+                                _mm256_shuffle_epi8(lut, hi));
+  // bytes -> 16 bit -> 32 bit sums
+  __m256i sum = _mm256_maddubs_epi16(cnt, _mm256_set1_epi8(1));
+  sum         = _mm256_madd_epi16(sum, _mm256_set1_epi16(1));
+  __np_dhkey_store(diff, sum);
+  return;
+#endif
   // uint16_t pp_diff = 0;
 
   // for (uint8_t k = 0; k < 8; ++k) // loops are nice, but slower than direct
@@ -410,21 +555,35 @@ uint16_t _np_dhkey_index(const np_dhkey_t *a, const np_dhkey_t *b) {
 
   // use uint8_t instead of unsigned char as uint8_t is guaranteed to be 8 bits
   // long
-  uint8_t *_pos_a = (uint8_t *)a;
-  uint8_t *_pos_b = (uint8_t *)b;
-
-  uint8_t ret = 0;
-  for (uint8_t k = 0; k < sizeof(np_dhkey_t); k++) {
-    // check heach half byte for a diff
-    if ((*_pos_a & 0xf0) != (*_pos_b & 0xf0)) break;
-    ret++;
-    if ((*_pos_a & 0x0f) != (*_pos_b & 0x0f)) break;
-    ret++;
-    // move pointers one byte
-    _pos_a += 1;
-    _pos_b += 1;
+  const uint8_t *_pos_a = (const uint8_t *)a;
+  const uint8_t *_pos_b = (const uint8_t *)b;
+
+  // find the first differing byte, the high half byte is compared first
+  uint16_t byte = sizeof(np_dhkey_t);
+#ifdef NP_DHKEY_AVX2
+  __m256i  x  = _mm256_xor_si256(__np_dhkey_load(a), __np_dhkey_load(b));
+  uint32_t nz = ~(uint32_t)_mm256_movemask_epi8(
+      _mm256_cmpeq_epi8(x, _mm256_setzero_si256()));
+  if (nz != 0) byte = __builtin_ctz(nz);
+#else
+  uint64_t wa[4], wb[4];
+  __np_dhkey_words(a, wa);
+  __np_dhkey_words(b, wb);
+  for (uint8_t w = 0; w < 4; w++) {
+    uint64_t x = wa[w] ^ wb[w];
+    if (x == 0) continue;
+#if defined(__BYTE_ORDER__) && __BYTE_ORDER__ == __ORDER_BIG_ENDIAN__
+    byte = w * 8 + __builtin_clzll(x) / 8;
+#else
+    byte = w * 8 + __builtin_ctzll(x) / 8;
+#endif
+    break;
   }
-  return ret;
+#endif
+  if (byte == sizeof(np_dhkey_t)) return 2 * sizeof(np_dhkey_t);
+
+  uint8_t diff = _pos_a[byte] ^ _pos_b[byte];
+  return 2 * byte + ((diff & 0xf0) == 0 ? 1 : 0);
 }
 /*
     Returns a specific position from the dhkey
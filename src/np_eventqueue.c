@@ -45,11 +45,6 @@
 
 const char _np_ref_event_runtime[] = "_np_event_runtime";
 
-#define np_event_runtime_max_size 1000
-struct np_event_runtime_s {
-  np_util_event_t  __chained_events[np_event_runtime_max_size];
-  volatile uint8_t __chained_events_size;
-};
 /**
  * @brief Adds an event to a given event chain to be executed after the current
  * key lock is released.
@@ -91,6 +91,7 @@
   void _l_acquire_##LOOPNAME(EV_P) {                                           \
     np_state_t *context = ev_userdata(EV_A);                                   \
     _np_threads_lock_module(context, np_event_##LOOPNAME##_t_lock, FUNC);      \
+    _np_statistics_increment_event_loop_wakeups();                             \
   }                                                                            \
   void _l_release_##LOOPNAME(EV_P) {                                           \
     np_state_t *context = ev_userdata(EV_A);                                   \
@@ -104,9 +105,11 @@
     while (ev_pending_count(EV_A)) {                                           \
       ev_invoke_pending(np_module(events)->__loop_##LOOPNAME);                 \
     }                                                                          \
-    _np_threads_module_condition_timedwait(context,                            \
-                                           np_event_##LOOPNAME##_t_lock,       \
-                                           NP_EVENT_IO_CHECK_PERIOD_SEC);      \
+    if (!NP_EVENT_LOOP_EVENT_DRIVEN) {                                         \
+      _np_threads_module_condition_timedwait(context,                          \
+                                             np_event_##LOOPNAME##_t_lock,     \
+                                             NP_EVENT_IO_CHECK_PERIOD_SEC);    \
+    }                                                                          \
     if (np_get_status(context) >= np_shutdown) {                               \
       ev_break(EV_A_ EVBREAK_ALL);                                             \
     }                                                                          \
@@ -155,15 +158,26 @@
     return (np_module(events)->__loop_##LOOPNAME);                             \
   }                                                                            \
   void _np_event_invoke_##LOOPNAME(np_state_t *context) {                      \
-    if (0 == _np_threads_trylock_module(context,                               \
-                                        np_event_##LOOPNAME##_t_lock,          \
-                                        "ev_out")) {                           \
+    if (NP_EVENT_LOOP_EVENT_DRIVEN) {                                          \
+      /* wakes up the loop blocking in the io backend */                       \
+      ev_async_send(np_module(events)->__loop_##LOOPNAME,                      \
+                    &np_module(events)->__async_##LOOPNAME);                   \
+    } else if (0 == _np_threads_trylock_module(context,                        \
+                                               np_event_##LOOPNAME##_t_lock,   \
+                                               "ev_out")) {                    \
       _np_threads_module_condition_signal(context,                             \
                                           np_event_##LOOPNAME##_t_lock);       \
       _np_threads_unlock_module(context, np_event_##LOOPNAME##_t_lock);        \
     }                                                                          \
   }
 
+// an additional in loop with its own thread, shard 0 is the in loop itself
+struct __np_event_in_shard_s {
+  struct ev_loop *loop;
+  ev_async        async;
+  np_mutex_t      lock;
+};
+
 np_module_struct(events) {
   np_state_t *context;
 
@@ -171,6 +185,10 @@ np_module_struct(events) {
   __NP_EVENT_EVLOOP_STRUCTS(out);
   __NP_EVENT_EVLOOP_STRUCTS(http);
   __NP_EVENT_EVLOOP_STRUCTS(file);
+
+  uint8_t                       __in_shard_count;
+  struct __np_event_in_shard_s *__in_shards; // index 0 is unused
+  TSP(uint8_t, __in_shards_started);
 };
 
 __NP_EVENT_LOOP_FNs(in);
@@ -182,6 +200,120 @@ void async_cb(EV_P_ NP_UNUSED ev_async *w,
               NP_UNUSED int revents) { /* just used for the side effects */
 }
 
+static struct __np_event_in_shard_s *
+__np_event_in_shard_of(np_state_t *context, struct ev_loop *loop) {
+  for (uint8_t i = 1; i < np_module(events)->__in_shard_count; i++) {
+    if (np_module(events)->__in_shards[i].loop == loop)
+      return &np_module(events)->__in_shards[i];
+  }
+  return NULL;
+}
+
+static void __l_acquire_in_shard(EV_P) {
+  np_state_t                   *context = ev_userdata(EV_A);
+  struct __np_event_in_shard_s *shard   = __np_event_in_shard_of(context, EV_A);
+  _np_threads_mutex_lock(context, &shard->lock, FUNC);
+  _np_statistics_increment_event_loop_wakeups();
+}
+
+static void __l_release_in_shard(EV_P) {
+  np_state_t                   *context = ev_userdata(EV_A);
+  struct __np_event_in_shard_s *shard   = __np_event_in_shard_of(context, EV_A);
+  _np_threads_mutex_unlock(context, &shard->lock);
+  if (np_get_status(context) >= np_shutdown) {
+    ev_break(EV_A_ EVBREAK_ALL);
+  }
+}
+
+uint8_t _np_event_in_shard_count(np_state_t *context) {
+  if (!np_module_initiated(events)) return 1;
+  return np_module(events)->__in_shard_count;
+}
+
+struct ev_loop *_np_event_get_loop_in_shard(np_state_t *context,
+                                            uint8_t     shard) {
+  if (shard == 0) return _np_event_get_loop_in(context);
+  return np_module(events)->__in_shards[shard].loop;
+}
+
+void _np_event_suspend_loop_in_shard(np_state_t *context, uint8_t shard) {
+  if (shard == 0) {
+    _np_event_suspend_loop_in(context);
+  } else {
+    _np_threads_mutex_lock(context,
+                           &np_module(events)->__in_shards[shard].lock,
+                           FUNC);
+  }
+}
+
+void _np_event_resume_loop_in_shard(np_state_t *context, uint8_t shard) {
+  if (shard == 0) {
+    _np_event_resume_loop_in(context);
+  } else {
+    _np_threads_mutex_unlock(context,
+                             &np_module(events)->__in_shards[shard].lock);
+  }
+}
+
+void _np_event_reconfigure_loop_in_shard(np_state_t *context, uint8_t shard) {
+  if (shard == 0) {
+    _np_event_reconfigure_loop_in(context);
+  } else {
+    ev_async_send(np_module(events)->__in_shards[shard].loop,
+                  &np_module(events)->__in_shards[shard].async);
+  }
+}
+
+void _np_event_in_shard_run(np_state_t *context, np_thread_t *thread) {
+  // every shard thread picks the next shard which is not running yet
+  uint8_t shard = 0;
+  TSP_SCOPE(np_module(events)->__in_shards_started) {
+    shard = ++np_module(events)->__in_shards_started;
+  }
+  if (shard >= np_module(events)->__in_shard_count) return;
+
+  struct __np_event_in_shard_s *in_shard =
+      &np_module(events)->__in_shards[shard];
+  _LOCK_ACCESS(&in_shard->lock) { ev_run(in_shard->loop, 0); }
+  log_info(LOG_THREADS,
+           "thread %" PRIsizet " (ingress shard %" PRIu8 ") stopping ...",
+           thread->id,
+           shard);
+}
+
+static void __np_event_in_shards_init(np_state_t *context) {
+  np_module_var(events);
+
+  uint8_t shards = context->settings->ingress_shards;
+#ifndef SO_REUSEPORT
+  // without SO_REUSEPORT there is only a single socket to read from
+  shards = 1;
+#endif
+  if (shards < 1) shards = 1;
+  if (shards > NP_EVENT_IN_MAX_SHARDS) shards = NP_EVENT_IN_MAX_SHARDS;
+
+  _module->__in_shard_count = shards;
+  _module->__in_shards = calloc(shards, sizeof(struct __np_event_in_shard_s));
+  CHECK_MALLOC(_module->__in_shards);
+  TSP_INITD(_module->__in_shards_started, 0);
+
+  for (uint8_t i = 1; i < shards; i++) {
+    struct __np_event_in_shard_s *shard = &_module->__in_shards[i];
+
+    shard->loop = ev_loop_new(EVFLAG_AUTO | EVFLAG_FORKCHECK);
+    if (shard->loop == NULL) {
+      ABORT("ERROR: cannot init ingress shard event loop");
+    }
+    _np_threads_mutex_init(context, &shard->lock, "ingress shard lock");
+    ev_async_init(&shard->async, async_cb);
+    ev_async_start(shard->loop, &shard->async);
+    ev_set_userdata(shard->loop, context);
+    ev_set_loop_release_cb(shard->loop,
+                           __l_release_in_shard,
+                           __l_acquire_in_shard);
+  }
+}
+
 bool _np_event_init(np_state_t *context) {
   bool ret = false;
   if (!np_module_initiated(events)) {
@@ -190,6 +322,7 @@ bool _np_event_init(np_state_t *context) {
     __NP_EVENT_EVLOOP_INIT(out);
     __NP_EVENT_EVLOOP_INIT(http);
     __NP_EVENT_EVLOOP_INIT(file);
+    __np_event_in_shards_init(context);
     ret = true;
   }
   return ret;
@@ -202,6 +335,12 @@ void _np_event_destroy(np_state_t *context) {
     __NP_EVENT_EVLOOP_DEINIT(out);
     __NP_EVENT_EVLOOP_DEINIT(http);
     __NP_EVENT_EVLOOP_DEINIT(file);
+    for (uint8_t i = 1; i < _module->__in_shard_count; i++) {
+      ev_loop_destroy(_module->__in_shards[i].loop);
+      _np_threads_mutex_destroy(context, &_module->__in_shards[i].lock);
+    }
+    free(_module->__in_shards);
+    TSP_DESTROY(_module->__in_shards_started);
     np_module_free(events);
   }
 }
@@ -265,6 +265,46 @@ void np_jobqueue_submit_event_periodic(np_state_t       *context,
   }
 }
 
+bool np_jobqueue_submit_event_callback(np_state_t       *context,
+                                       double            delay,
+                                       np_util_event_t   event,
+                                       np_evt_callback_t callback,
+                                       const char       *ident) {
+  log_debug_msg(LOG_JOBS | LOG_DEBUG, "np_jobqueue_submit_event_callback");
+
+  np_sll_t(np_evt_callback_t, callbacks);
+  sll_init(np_evt_callback_t, callbacks);
+  sll_append(np_evt_callback_t, callbacks, callback);
+
+  if (event.user_data != NULL) {
+    np_ref_obj(np_unknown_t, event.user_data, "np_jobqueue_submit_event");
+  }
+
+  np_job_t new_job               = {0};
+  new_job.evt                    = event;
+  new_job.priority               = JOBQUEUE_PRIORITY_MOD_SUBMIT_ROUTE;
+  new_job.exec_not_before_tstamp = np_time_now() + delay;
+  new_job.type                   = 2;
+  new_job.is_periodic            = false;
+  new_job.interval               = 0;
+  new_job.processorFuncs         = callbacks;
+  new_job.__del_processorFuncs   = true;
+
+#ifdef DEBUG_CALLBACKS
+  ASSERT(ident != NULL && strlen(ident) > 0 && strlen(ident) < 255,
+         "You need to define a valid identificator for this job");
+  memcpy(new_job.ident, ident, strnlen(ident, 254));
+  log_debug(LOG_JOBS, "Created Job %s", new_job.ident);
+#endif
+
+  if (!_np_jobqueue_insert(context, new_job, delay == 0)) {
+    log_info(LOG_JOBS, "Dropping job as jobqueue is rejecting it");
+    _np_job_free(context, &new_job);
+    return false;
+  }
+  return true;
+}
+
 bool np_jobqueue_submit_event(np_state_t     *context,
                               double          delay,
                               np_dhkey_t      next,
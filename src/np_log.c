@@ -13,6 +13,7 @@
 #include <stdlib.h>
 #include <string.h>
 #include <sys/time.h>
+#include <sys/uio.h>
 #include <time.h>
 #include <unistd.h>
 
@@ -58,11 +59,30 @@ typedef struct log_str_t {
   int         log_code;
 } log_str_t;
 
+// single producer (the owning thread) / single consumer (the log writer)
+// ring. head is only written by the producer, tail only by the consumer.
+struct np_log_ring {
+  uint64_t      head;
+  uint64_t      tail;
+  uint64_t      dropped;
+  uint64_t      dropped_reported;
+  unsigned long thread_id;
+  bool          exited; // set when the owning thread ends
+
+  struct np_log_ring  *next;
+  struct np_log_record records[NP_LOG_RING_RECORDS];
+};
+
 np_module_struct(log) {
   np_state_t   *context;
   np_log_t     *__logger;
   np_spinlock_t __log_lock;
   bool          __init;
+
+  pthread_key_t       __ring_key;
+  struct np_log_ring *__rings;
+  np_spinlock_t       __writer_lock;
+  char (*__lines)[NP_LOG_LINE_MAX];
 };
 
 void _np_log_to_str(char         *buffer,
@@ -319,6 +339,100 @@ void _np_log_rotate(np_state_t *context, bool force) {
   }
 }
 
+bool __np_log_accept(np_state_t *context, enum np_log_e level) {
+  // include msg if log level is included into selected levels
+  // and if the msg has a category and is included into selected categories
+  // or if no category is provided for msg or the log level contains the
+  // LOG_GLOBAL flag
+  return ((level & LOG_LEVEL_MASK & np_module(log)->__logger->level) >
+               LOG_NONE &&
+           ((level & LOG_VERBOSE) <=
+            (LOG_VERBOSE & np_module(log)->__logger->level)) &&
+           ((level & LOG_MODUL_MASK & np_module(log)->__logger->level) >
+                LOG_NONE ||
+            (np_module(log)->__logger->level & LOG_MODUL_MASK & LOG_GLOBAL) ==
+                LOG_GLOBAL ||
+            (level & LOG_MODUL_MASK) == LOG_NONE)) ||
+         FLAG_CMP(level, LOG_ERROR) || FLAG_CMP(level, LOG_WARNING);
+}
+
+void __np_log_message_entry(np_state_t   *context,
+                            enum np_log_e level,
+                            const char   *msg,
+                            va_list       ap) {
+  np_log_entry_ptr new_log_entry = malloc(sizeof(struct np_log_entry));
+  _np_log_to_str(new_log_entry->level, 20, level & LOG_LEVEL_MASK);
+  new_log_entry->timestamp = _np_time_force_now_nsec();
+
+  new_log_entry->string_length = vasprintf(&new_log_entry->string, msg, ap);
+  assert(new_log_entry->string_length > 0);
+
+#ifndef CONSOLE_LOG
+  if (context->settings->log_write_fn == NULL) {
+#endif
+    struct timeval tval;
+    struct tm      local_time;
+    gettimeofday(&tval, (struct timezone *)0);
+    int32_t millis = tval.tv_usec;
+    localtime_r(&tval.tv_sec, &local_time);
+
+    char prefix[500] = {0};
+    strftime(prefix, 80, "%Y-%m-%d %H:%M:%S", &local_time);
+
+    int new_log_entry_length = strlen(prefix);
+    sprintf(prefix + new_log_entry_length,
+            ".%06d "  /*millisec*/
+            "%-15lu " /*thread id*/
+            //"%15.15s:%-5hd %-25.25s " /* file desc*/
+            "%8s " /*Level*/,
+            millis,                        // millisec
+            (unsigned long)pthread_self(), // thread id
+            // srcFile, lineno, funcName, // file desc
+            new_log_entry->level);
+
+    _np_log_to_str(prefix + strlen(prefix),
+                   500 - strlen(prefix),
+                   level & LOG_MODUL_MASK);
+
+    char *buf;
+    new_log_entry->string_length =
+        asprintf(&buf, "%s %s\n", prefix, new_log_entry->string);
+    free(new_log_entry->string);
+    new_log_entry->string = buf;
+#ifndef CONSOLE_LOG
+  }
+#endif
+
+#if defined(CONSOLE_LOG) && CONSOLE_LOG == 1
+  fprintf(stdout, new_log_entry->string);
+#else
+  size_t log_size = 0;
+  np_spinlock_lock(&np_module(log)->__log_lock);
+  {
+    sll_append(np_log_entry_ptr,
+               np_module(log)->__logger->logentries_l,
+               new_log_entry);
+    log_size = sll_size(np_module(log)->__logger->logentries_l);
+  }
+  np_spinlock_unlock(&np_module(log)->__log_lock);
+
+  // instant writeout
+  if ((level & LOG_ERROR) == LOG_ERROR) {
+    _np_log_fflush(context, true);
+  }
+#ifdef DEBUG
+  else {
+    _np_log_fflush(context, true);
+  }
+#else  // DEBUG
+  else if (log_size > MISC_LOG_FLUSH_AFTER_X_ITEMS) {
+    _np_event_invoke_file(context);
+  }
+#endif // DEBUG
+
+#endif // CONSOLE_LOG
+}
+
 void np_log_message(np_state_t   *context,
                     enum np_log_e level,
                     const char   *srcFile,
@@ -336,78 +450,374 @@ void np_log_message(np_state_t   *context,
 #endif
     return;
   }
-  // include msg if log level is included into selected levels
-  // and if the msg has a category and is included into selected categories
-  // or if no category is provided for msg or the log level contains the
-  // LOG_GLOBAL flag
-  if (((level & LOG_LEVEL_MASK & np_module(log)->__logger->level) > LOG_NONE &&
-       ((level & LOG_VERBOSE) <=
-        (LOG_VERBOSE & np_module(log)->__logger->level)) &&
-       ((level & LOG_MODUL_MASK & np_module(log)->__logger->level) > LOG_NONE ||
-        (np_module(log)->__logger->level & LOG_MODUL_MASK & LOG_GLOBAL) ==
-            LOG_GLOBAL ||
-        (level & LOG_MODUL_MASK) == LOG_NONE)) ||
-      FLAG_CMP(level, LOG_ERROR) || FLAG_CMP(level, LOG_WARNING)) {
-    np_log_entry_ptr new_log_entry = malloc(sizeof(struct np_log_entry));
-    _np_log_to_str(new_log_entry->level, 20, level & LOG_LEVEL_MASK);
-    new_log_entry->timestamp = _np_time_force_now_nsec();
 
+  if (__np_log_accept(context, level)) {
     va_list ap;
     va_start(ap, msg);
-    new_log_entry->string_length = vasprintf(&new_log_entry->string, msg, ap);
+    __np_log_message_entry(context, level, msg, ap);
     va_end(ap);
-    assert(new_log_entry->string_length > 0);
+  }
+}
 
-#ifndef CONSOLE_LOG
-    if (context->settings->log_write_fn == NULL) {
-#endif
-      struct timeval tval;
-      struct tm      local_time;
-      gettimeofday(&tval, (struct timezone *)0);
-      int32_t millis = tval.tv_usec;
-      localtime_r(&tval.tv_sec, &local_time);
-
-      char prefix[500] = {0};
-      strftime(prefix, 80, "%Y-%m-%d %H:%M:%S", &local_time);
-
-      int new_log_entry_length = strlen(prefix);
-      sprintf(prefix + new_log_entry_length,
-              ".%06d "  /*millisec*/
-              "%-15lu " /*thread id*/
-              //"%15.15s:%-5hd %-25.25s " /* file desc*/
-              "%8s " /*Level*/,
-              millis,                        // millisec
-              (unsigned long)pthread_self(), // thread id
-              // srcFile, lineno, funcName, // file desc
-              new_log_entry->level);
-
-      _np_log_to_str(prefix + strlen(prefix),
-                     500 - strlen(prefix),
-                     level & LOG_MODUL_MASK);
-
-      char *buf;
-      new_log_entry->string_length =
-          asprintf(&buf, "%s %s\n", prefix, new_log_entry->string);
-      free(new_log_entry->string);
-      new_log_entry->string = buf;
-#ifndef CONSOLE_LOG
+/**
+ * binary log records
+ *
+ * printf style arguments are packed according to the conversions of the
+ * format string. Strings are copied, everything else is stored with the size
+ * of its (promoted) type. Formatting happens when the writer drains the
+ * rings, using the same format string again.
+ */
+enum __np_log_length {
+  __len_none = 0,
+  __len_hh,
+  __len_h,
+  __len_l,
+  __len_ll,
+  __len_j,
+  __len_z,
+  __len_t,
+  __len_L,
+};
+
+struct __np_log_spec {
+  const char          *start; // the '%'
+  const char          *end;   // the conversion character
+  enum __np_log_length length;
+  bool                 width_star;
+  bool                 precision_star;
+  int                  precision; // -1 if not given
+};
+
+// parses a conversion specification, returns false on an unknown conversion
+bool __np_log_parse_spec(const char *start, struct __np_log_spec *spec) {
+  const char *p        = start + 1;
+  spec->start          = start;
+  spec->length         = __len_none;
+  spec->width_star     = false;
+  spec->precision_star = false;
+  spec->precision      = -1;
+
+  while (*p == '-' || *p == '+' || *p == ' ' || *p == '#' || *p == '0') p++;
+
+  if (*p == '*') {
+    spec->width_star = true;
+    p++;
+  } else
+    while (*p >= '0' && *p <= '9') p++;
+
+  if (*p == '.') {
+    p++;
+    spec->precision = 0;
+    if (*p == '*') {
+      spec->precision_star = true;
+      p++;
+    } else
+      while (*p >= '0' && *p <= '9')
+        spec->precision = spec->precision * 10 + (*p++ - '0');
+  }
+
+  switch (*p) {
+  case 'h':
+    spec->length = (*(p + 1) == 'h') ? __len_hh : __len_h;
+    p += (spec->length == __len_hh) ? 2 : 1;
+    break;
+  case 'l':
+    spec->length = (*(p + 1) == 'l') ? __len_ll : __len_l;
+    p += (spec->length == __len_ll) ? 2 : 1;
+    break;
+  case 'j':
+    spec->length = __len_j;
+    p++;
+    break;
+  case 'z':
+    spec->length = __len_z;
+    p++;
+    break;
+  case 't':
+    spec->length = __len_t;
+    p++;
+    break;
+  case 'L':
+    spec->length = __len_L;
+    p++;
+    break;
+  }
+  spec->end = p;
+
+  return (NULL != strchr("diouxXcfFeEgGaAspn%", *p) && *p != '\0');
+}
+
+#define __NP_LOG_PACK(TYPE, VALUE)                                             \
+  {                                                                            \
+    TYPE _value = (VALUE);                                                     \
+    if (pos + sizeof(TYPE) > NP_LOG_RECORD_ARGS_BYTES) goto __incomplete;      \
+    memcpy(record->args + pos, &_value, sizeof(TYPE));                         \
+    pos += sizeof(TYPE);                                                       \
+  }
+
+void __np_log_pack(struct np_log_record *record, const char *msg, va_list ap) {
+  uint16_t             pos = 0;
+  struct __np_log_spec spec;
+
+  record->specs    = 0;
+  record->complete = true;
+
+  for (const char *p = msg; *p != '\0'; p++) {
+    if (*p != '%') continue;
+    if (!__np_log_parse_spec(p, &spec)) goto __incomplete;
+    p = spec.end;
+    if (*p == '%') continue;
+
+    // stars are consumed in the same order as printf does
+    int precision = spec.precision;
+    if (spec.width_star) __NP_LOG_PACK(int, va_arg(ap, int));
+    if (spec.precision_star) {
+      precision = va_arg(ap, int);
+      __NP_LOG_PACK(int, precision);
     }
-#endif
 
-#if defined(CONSOLE_LOG) && CONSOLE_LOG == 1
-    fprintf(stdout, new_log_entry->string);
-#else
-    size_t log_size = 0;
-    np_spinlock_lock(&np_module(log)->__log_lock);
-    {
-      sll_append(np_log_entry_ptr,
-                 np_module(log)->__logger->logentries_l,
-                 new_log_entry);
-      log_size = sll_size(np_module(log)->__logger->logentries_l);
+    switch (*p) {
+    case 'd':
+    case 'i':
+    case 'c':
+      if (spec.length == __len_l) __NP_LOG_PACK(long, va_arg(ap, long))
+      else if (spec.length == __len_ll || spec.length == __len_j)
+        __NP_LOG_PACK(long long, va_arg(ap, long long))
+      else if (spec.length == __len_z)
+        __NP_LOG_PACK(ssize_t, va_arg(ap, ssize_t))
+      else if (spec.length == __len_t)
+        __NP_LOG_PACK(ptrdiff_t, va_arg(ap, ptrdiff_t))
+      else __NP_LOG_PACK(int, va_arg(ap, int))
+      break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (spec.length == __len_l)
+        __NP_LOG_PACK(unsigned long, va_arg(ap, unsigned long))
+      else if (spec.length == __len_ll || spec.length == __len_j)
+        __NP_LOG_PACK(unsigned long long, va_arg(ap, unsigned long long))
+      else if (spec.length == __len_z)
+        __NP_LOG_PACK(size_t, va_arg(ap, size_t))
+      else if (spec.length == __len_t)
+        __NP_LOG_PACK(ptrdiff_t, va_arg(ap, ptrdiff_t))
+      else __NP_LOG_PACK(unsigned int, va_arg(ap, unsigned int))
+      break;
+    case 'p':
+      __NP_LOG_PACK(void *, va_arg(ap, void *))
+      break;
+    case 'n':
+      (void)va_arg(ap, void *);
+      break;
+    case 's': {
+      const char *str = va_arg(ap, const char *);
+      if (str == NULL) str = "(null)";
+      size_t len = (precision >= 0) ? strnlen(str, precision) : strlen(str);
+      if (pos + len + 1 > NP_LOG_RECORD_ARGS_BYTES) {
+        // store as much of the string as possible
+        if (pos + 1 >= NP_LOG_RECORD_ARGS_BYTES) goto __incomplete;
+        len              = NP_LOG_RECORD_ARGS_BYTES - pos - 1;
+        record->complete = false;
+      }
+      memcpy(record->args + pos, str, len);
+      record->args[pos + len] = '\0';
+      pos += len + 1;
+      if (!record->complete) {
+        record->specs++;
+        record->args_length = pos;
+        return;
+      }
+    } break;
+    default: // floating point conversions
+      if (spec.length == __len_L)
+        __NP_LOG_PACK(long double, va_arg(ap, long double))
+      else __NP_LOG_PACK(double, va_arg(ap, double))
+      break;
+    }
+    record->specs++;
+  }
+  record->args_length = pos;
+  return;
+
+__incomplete:
+  record->complete    = false;
+  record->args_length = pos;
+}
+
+#define __NP_LOG_UNPACK(TYPE, TARGET)                                          \
+  {                                                                            \
+    memcpy(&TARGET, record->args + pos, sizeof(TYPE));                         \
+    pos += sizeof(TYPE);                                                       \
+  }
+
+#define __NP_LOG_FORMAT(TYPE)                                                  \
+  {                                                                            \
+    TYPE _value;                                                               \
+    __NP_LOG_UNPACK(TYPE, _value);                                             \
+    if (spec.width_star && spec.precision_star)                                \
+      n = snprintf(out, left, spec_str, width, precision, _value);             \
+    else if (spec.width_star)                                                  \
+      n = snprintf(out, left, spec_str, width, _value);                        \
+    else if (spec.precision_star)                                              \
+      n = snprintf(out, left, spec_str, precision, _value);                    \
+    else n = snprintf(out, left, spec_str, _value);                            \
+  }
+
+// formats the message part of a record, returns the length of the message
+size_t __np_log_unpack(const struct np_log_record *record,
+                       char                       *buffer,
+                       size_t                      buffer_size) {
+  struct __np_log_spec spec;
+  uint16_t             pos   = 0;
+  uint8_t              specs = 0;
+  char                *out   = buffer;
+  size_t               left  = buffer_size;
+
+  for (const char *p = record->format; *p != '\0' && left > 1; p++) {
+    if (*p != '%') {
+      *out++ = *p;
+      left--;
+      continue;
     }
+    if (specs == record->specs && !record->complete) break;
+    if (!__np_log_parse_spec(p, &spec)) break;
+
+    p = spec.end;
+    if (*p == '%') {
+      *out++ = '%';
+      left--;
+      continue;
+    }
+
+    char   spec_str[32] = {0};
+    size_t spec_length  = spec.end - spec.start + 1;
+    if (spec_length >= sizeof(spec_str)) break;
+    memcpy(spec_str, spec.start, spec_length);
+
+    int width = 0, precision = 0, n = 0;
+    if (spec.width_star) __NP_LOG_UNPACK(int, width);
+    if (spec.precision_star) __NP_LOG_UNPACK(int, precision);
+
+    switch (*p) {
+    case 'd':
+    case 'i':
+    case 'c':
+      if (spec.length == __len_l) __NP_LOG_FORMAT(long)
+      else if (spec.length == __len_ll || spec.length == __len_j)
+        __NP_LOG_FORMAT(long long)
+      else if (spec.length == __len_z) __NP_LOG_FORMAT(ssize_t)
+      else if (spec.length == __len_t) __NP_LOG_FORMAT(ptrdiff_t)
+      else __NP_LOG_FORMAT(int)
+      break;
+    case 'o':
+    case 'u':
+    case 'x':
+    case 'X':
+      if (spec.length == __len_l) __NP_LOG_FORMAT(unsigned long)
+      else if (spec.length == __len_ll || spec.length == __len_j)
+        __NP_LOG_FORMAT(unsigned long long)
+      else if (spec.length == __len_z) __NP_LOG_FORMAT(size_t)
+      else if (spec.length == __len_t) __NP_LOG_FORMAT(ptrdiff_t)
+      else __NP_LOG_FORMAT(unsigned int)
+      break;
+    case 'p':
+      __NP_LOG_FORMAT(void *)
+      break;
+    case 'n':
+      break;
+    case 's': {
+      const char *str = (const char *)record->args + pos;
+      pos += strnlen(str, NP_LOG_RECORD_ARGS_BYTES - pos) + 1;
+      if (spec.width_star && spec.precision_star)
+        n = snprintf(out, left, spec_str, width, precision, str);
+      else if (spec.width_star) n = snprintf(out, left, spec_str, width, str);
+      else if (spec.precision_star)
+        n = snprintf(out, left, spec_str, precision, str);
+      else n = snprintf(out, left, spec_str, str);
+    } break;
+    default:
+      if (spec.length == __len_L) __NP_LOG_FORMAT(long double)
+      else __NP_LOG_FORMAT(double)
+      break;
+    }
+    specs++;
+
+    if (n < 0) break;
+    if ((size_t)n >= left) n = left - 1;
+    out  += n;
+    left -= n;
+  }
+
+  if (!record->complete && left > 4) {
+    memcpy(out, " ...", 4);
+    out  += 4;
+    left -= 4;
+  }
+  *out = '\0';
+  return out - buffer;
+}
+
+struct np_log_ring *__np_log_get_ring(np_state_t *context) {
+  struct np_log_ring *ring =
+      pthread_getspecific(np_module(log)->__ring_key);
+  if (ring == NULL) {
+    ring = calloc(1, sizeof(struct np_log_ring));
+    CHECK_MALLOC(ring);
+    ring->thread_id = (unsigned long)pthread_self();
+
+    np_spinlock_lock(&np_module(log)->__log_lock);
+    ring->next              = np_module(log)->__rings;
+    np_module(log)->__rings = ring;
     np_spinlock_unlock(&np_module(log)->__log_lock);
 
-    // instant writeout
+    pthread_setspecific(np_module(log)->__ring_key, ring);
+  }
+  return ring;
+}
+
+void _np_log_message_static(np_state_t   *context,
+                            enum np_log_e level,
+                            const char   *srcFile,
+                            const char   *funcName,
+                            uint16_t      lineno,
+                            const char   *msg,
+                            ...) {
+  if (!np_module_initiated(log) || np_module(log)->__logger == NULL) {
+#ifdef CONSOLE_BACKUP_LOG
+    va_list ap;
+    va_start(ap, msg);
+    vfprintf(stderr, msg, ap);
+    fprintf(stderr, "\n");
+    va_end(ap);
+#endif
+    return;
+  }
+
+  if (!__np_log_accept(context, level)) return;
+
+  va_list ap;
+  va_start(ap, msg);
+
+#if NP_LOG_RING_ENABLE && !defined(CONSOLE_LOG)
+  struct np_log_ring *ring = __np_log_get_ring(context);
+  uint64_t            tail = __atomic_load_n(&ring->tail, __ATOMIC_ACQUIRE);
+
+  if (ring->head - tail < NP_LOG_RING_RECORDS) {
+    struct np_log_record *record =
+        &ring->records[ring->head & (NP_LOG_RING_RECORDS - 1)];
+
+    struct timespec ts;
+    timespec_get(&ts, TIME_UTC);
+    record->tv_sec  = ts.tv_sec;
+    record->tv_nsec = ts.tv_nsec;
+    record->level   = level;
+    record->format  = msg;
+    __np_log_pack(record, msg, ap);
+    va_end(ap);
+
+    uint64_t fill = ring->head + 1 - tail;
+    __atomic_store_n(&ring->head, ring->head + 1, __ATOMIC_RELEASE);
+
     if ((level & LOG_ERROR) == LOG_ERROR) {
       _np_log_fflush(context, true);
     }
@@ -416,14 +826,250 @@ void np_log_message(np_state_t   *context,
       _np_log_fflush(context, true);
     }
 #else  // DEBUG
-    else if (log_size > MISC_LOG_FLUSH_AFTER_X_ITEMS) {
+    else if (fill == MISC_LOG_FLUSH_AFTER_X_ITEMS) {
       _np_event_invoke_file(context);
     }
 #endif // DEBUG
+    return;
+  }
 
-#endif // CONSOLE_LOG
+  if (!FLAG_CMP(level, LOG_ERROR) && !FLAG_CMP(level, LOG_WARNING)) {
+    // ring is full, the writer will report the number of lost records
+    __atomic_store_n(&ring->dropped, ring->dropped + 1, __ATOMIC_RELEASE);
+    va_end(ap);
+    _np_event_invoke_file(context);
+    return;
+  }
+  // errors and warnings are never dropped
+#endif
+
+  __np_log_message_entry(context, level, msg, ap);
+  va_end(ap);
+}
+
+size_t __np_log_format_record(np_state_t                 *context,
+                              const struct np_log_record *record,
+                              unsigned long               thread_id,
+                              char                       *line) {
+  char level_str[20] = {0};
+  _np_log_to_str(level_str, 20, record->level & LOG_LEVEL_MASK);
+
+  size_t length = 0;
+  if (context->settings->log_write_fn == NULL) {
+    struct tm local_time;
+    time_t    tv_sec = record->tv_sec;
+    localtime_r(&tv_sec, &local_time);
+
+    length = strftime(line, 80, "%Y-%m-%d %H:%M:%S", &local_time);
+    length += snprintf(line + length,
+                       NP_LOG_LINE_MAX - length,
+                       ".%06d "  /*millisec*/
+                       "%-15lu " /*thread id*/
+                       "%8s " /*Level*/,
+                       (int32_t)(record->tv_nsec / 1000),
+                       thread_id,
+                       level_str);
+    _np_log_to_str(line + length,
+                   NP_LOG_LINE_MAX - length,
+                   record->level & LOG_MODUL_MASK);
+    length += strnlen(line + length, NP_LOG_LINE_MAX - length);
+    line[length++] = ' ';
+  }
+  length +=
+      __np_log_unpack(record, line + length, NP_LOG_LINE_MAX - length - 1);
+  if (context->settings->log_write_fn == NULL) line[length++] = '\n';
+  line[length] = '\0';
+
+  return length;
+}
+
+void __np_log_writev(np_state_t *context, struct iovec *iov, int iovcnt) {
+  while (iovcnt > 0) {
+    ssize_t written = writev(np_module(log)->__logger->fp, iov, iovcnt);
+    if (written < 0) {
+      if (errno == EINTR) continue;
+      break;
+    }
+    // advance over partially written vectors
+    while (iovcnt > 0 && (size_t)written >= iov->iov_len) {
+      written -= iov->iov_len;
+      iov++;
+      iovcnt--;
+    }
+    if (iovcnt > 0) {
+      iov->iov_base = (char *)iov->iov_base + written;
+      iov->iov_len -= written;
+    }
   }
 }
+
+void __np_log_write(np_state_t *context, np_log_entry_ptr entry);
+
+// called by pthread when a thread with a ring ends, the ring itself is
+// released by the writer once it has been drained
+void __np_log_ring_exit(void *data) {
+  struct np_log_ring *ring = data;
+  __atomic_store_n(&ring->exited, true, __ATOMIC_RELEASE);
+}
+
+// unlinks and frees the drained rings of exited threads, the caller has to
+// hold the writer lock
+void __np_log_reap_rings(np_state_t *context) {
+  struct np_log_ring *reaped = NULL;
+
+  np_spinlock_lock(&np_module(log)->__log_lock);
+  struct np_log_ring **link = &np_module(log)->__rings;
+  while (*link != NULL) {
+    struct np_log_ring *ring = *link;
+    if (__atomic_load_n(&ring->exited, __ATOMIC_ACQUIRE) &&
+        __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE) == ring->tail &&
+        __atomic_load_n(&ring->dropped, __ATOMIC_ACQUIRE) ==
+            ring->dropped_reported) {
+      *link      = ring->next;
+      ring->next = reaped;
+      reaped     = ring;
+    } else {
+      link = &ring->next;
+    }
+  }
+  np_spinlock_unlock(&np_module(log)->__log_lock);
+
+  while (reaped != NULL) {
+    struct np_log_ring *next = reaped->next;
+    free(reaped);
+    reaped = next;
+  }
+}
+
+np_log_entry_ptr
+__np_log_entry_new(const char *line, size_t length, double ts, uint32_t level) {
+  np_log_entry_ptr entry = malloc(sizeof(struct np_log_entry));
+  CHECK_MALLOC(entry);
+  entry->string = strndup(line, length);
+  CHECK_MALLOC(entry->string);
+  entry->string_length = length;
+  entry->timestamp     = ts;
+  _np_log_to_str(entry->level, 20, level & LOG_LEVEL_MASK);
+  return entry;
+}
+
+// drains all thread rings in timestamp order and writes the formatted lines
+// with one writev call per batch. lines for a log_write_fn are copied out and
+// handed to the callback after the writer lock has been released
+void __np_log_drain_rings(np_state_t *context, bool force) {
+  if (force)
+    np_spinlock_lock(&np_module(log)->__writer_lock);
+  else if (!np_spinlock_trylock(&np_module(log)->__writer_lock))
+    return;
+
+  struct iovec iov[NP_LOG_WRITEV_BATCH];
+  uint32_t     batches  = 0;
+  bool         done     = false;
+  bool         callback = context->settings->log_write_fn != NULL;
+
+  np_sll_t(np_log_entry_ptr, entries);
+  sll_init(np_log_entry_ptr, entries);
+
+  while (!done && batches <= MISC_LOG_FLUSH_MAX_ITEMS / NP_LOG_WRITEV_BATCH) {
+    int    count = 0;
+    size_t bytes = 0;
+
+    while (count < NP_LOG_WRITEV_BATCH) {
+      // pick the oldest pending record of all rings
+      struct np_log_ring   *oldest_ring   = NULL;
+      struct np_log_record *oldest_record = NULL;
+
+      np_spinlock_lock(&np_module(log)->__log_lock);
+      struct np_log_ring *ring = np_module(log)->__rings;
+      np_spinlock_unlock(&np_module(log)->__log_lock);
+
+      for (; ring != NULL; ring = ring->next) {
+        uint64_t dropped = __atomic_load_n(&ring->dropped, __ATOMIC_ACQUIRE);
+        if (dropped != ring->dropped_reported &&
+            count < NP_LOG_WRITEV_BATCH) {
+          int n = snprintf(np_module(log)->__lines[count],
+                           NP_LOG_LINE_MAX,
+                           "%" PRIu64 " log records of thread %lu dropped\n",
+                           dropped - ring->dropped_reported,
+                           ring->thread_id);
+          ring->dropped_reported = dropped;
+          if (callback) {
+            sll_append(np_log_entry_ptr,
+                       entries,
+                       __np_log_entry_new(np_module(log)->__lines[count],
+                                          n,
+                                          _np_time_force_now_nsec(),
+                                          LOG_WARNING));
+            count++;
+            continue;
+          }
+          iov[count].iov_base    = np_module(log)->__lines[count];
+          iov[count].iov_len     = n;
+          bytes += n;
+          count++;
+        }
+
+        uint64_t head = __atomic_load_n(&ring->head, __ATOMIC_ACQUIRE);
+        if (head == ring->tail) continue;
+
+        struct np_log_record *record =
+            &ring->records[ring->tail & (NP_LOG_RING_RECORDS - 1)];
+        if (oldest_record == NULL ||
+            record->tv_sec < oldest_record->tv_sec ||
+            (record->tv_sec == oldest_record->tv_sec &&
+             record->tv_nsec < oldest_record->tv_nsec)) {
+          oldest_ring   = ring;
+          oldest_record = record;
+        }
+      }
+      if (oldest_record == NULL || count >= NP_LOG_WRITEV_BATCH) {
+        done = (oldest_record == NULL);
+        break;
+      }
+
+      char  *line   = np_module(log)->__lines[count];
+      size_t length = __np_log_format_record(context,
+                                             oldest_record,
+                                             oldest_ring->thread_id,
+                                             line);
+      __atomic_store_n(&oldest_ring->tail,
+                       oldest_ring->tail + 1,
+                       __ATOMIC_RELEASE);
+
+      if (callback) {
+        sll_append(np_log_entry_ptr,
+                   entries,
+                   __np_log_entry_new(line,
+                                      length,
+                                      oldest_record->tv_sec +
+                                          oldest_record->tv_nsec / 1000000000.,
+                                      oldest_record->level));
+        count++;
+        continue;
+      }
+      iov[count].iov_base = line;
+      iov[count].iov_len  = length;
+      bytes += length;
+      count++;
+    }
+
+    if (!callback && count > 0 && np_module(log)->__logger->fp > 0) {
+      __np_log_writev(context, iov, count);
+      np_spinlock_lock(&np_module(log)->__log_lock);
+      np_module(log)->__logger->log_size += bytes;
+      np_spinlock_unlock(&np_module(log)->__log_lock);
+    }
+    batches++;
+  }
+  __np_log_reap_rings(context);
+  np_spinlock_unlock(&np_module(log)->__writer_lock);
+
+  np_log_entry_ptr entry;
+  while (NULL != (entry = sll_head(np_log_entry_ptr, entries)))
+    __np_log_write(context, entry);
+  sll_free(np_log_entry_ptr, entries);
+}
+
 void __np_log_write(np_state_t *context, np_log_entry_ptr entry) {
   uint32_t bytes_witten = 0;
   bool     retry        = false;
@@ -470,6 +1116,8 @@ void _np_log_fflush(np_state_t *context, bool force) {
        0 = log till no entries are available anymore
        1 = discontinue the flush
   */
+  __np_log_drain_rings(context, force);
+
   int      flush_status = -1;
   uint32_t i            = 0;
   do {
@@ -517,6 +1165,11 @@ bool _np_log_init(np_state_t *context, const char *filename, uint32_t level) {
   if (!np_module_initiated(log)) {
     np_module_malloc(log);
     TSP_INIT(np_module(log)->__log);
+    np_spinlock_init(&_module->__writer_lock, PTHREAD_PROCESS_PRIVATE);
+    pthread_key_create(&_module->__ring_key, __np_log_ring_exit);
+    _module->__rings = NULL;
+    _module->__lines = calloc(NP_LOG_WRITEV_BATCH, NP_LOG_LINE_MAX);
+    CHECK_MALLOC(_module->__lines);
 
     np_log_t *__logger = (np_log_t *)calloc(1, sizeof(np_log_t));
     CHECK_MALLOC(__logger);
@@ -573,6 +1226,16 @@ void _np_log_destroy(np_state_t *context) {
     sll_free(np_log_entry_ptr, _module->__logger->logentries_l);
     free(_module->__logger);
 
+    struct np_log_ring *ring = _module->__rings;
+    while (ring != NULL) {
+      struct np_log_ring *next = ring->next;
+      free(ring);
+      ring = next;
+    }
+    pthread_key_delete(_module->__ring_key);
+    np_spinlock_destroy(&_module->__writer_lock);
+    free(_module->__lines);
+
     np_module_free(log);
   }
 }
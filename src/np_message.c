@@ -67,7 +67,10 @@ void _np_message_t_new(np_state_t       *context,
   snprintf(mutex_str, 63, "%s", "urn:np:message:msg_chunks");
   _np_threads_mutex_init(context, &msg_tmp->msg_chunks_lock, mutex_str);
 
-  msg_tmp->uuid = np_uuid_create("msg", 0, NULL);
+  msg_tmp->uuid = malloc(NP_UUID_BYTES);
+  CHECK_MALLOC(msg_tmp->uuid);
+  _np_uuid_create_bin(&msg_tmp->uuid_key, 0);
+  _np_uuid_to_str(&msg_tmp->uuid_key, msg_tmp->uuid);
 
   log_debug_msg(LOG_MESSAGE | LOG_DEBUG,
                 "creating uuid %s for new msg",
@@ -78,16 +81,23 @@ void _np_message_t_new(np_state_t       *context,
   msg_tmp->body           = np_tree_create();
   msg_tmp->footer         = np_tree_create();
   msg_tmp->send_at        = 0;
+  msg_tmp->hop_dhkey      = dhkey_zero;
   msg_tmp->no_of_chunks   = 1;
   msg_tmp->is_single_part = false;
 
   pll_init(np_messagepart_ptr, msg_tmp->msg_chunks);
-  msg_tmp->bin_body   = NULL;
-  msg_tmp->bin_footer = NULL;
-  msg_tmp->bin_static = NULL;
+  msg_tmp->bin_body           = NULL;
+  msg_tmp->bin_footer         = NULL;
+  msg_tmp->bin_static         = NULL;
+  msg_tmp->header_prefix_size = 0;
 
   msg_tmp->submit_type      = np_message_submit_type_ROUTE;
   msg_tmp->decryption_token = NULL;
+
+  msg_tmp->release_cb     = NULL;
+  msg_tmp->release_data   = NULL;
+  msg_tmp->release_length = 0;
+  msg_tmp->release_arg    = NULL;
 }
 
 /*
@@ -126,6 +136,16 @@ void _np_message_t_del(np_state_t       *context,
   np_tree_free(msg->body);
   np_tree_free(msg->footer);
 
+  // all chunks have been sent (or dropped), the body does not reference the
+  // user payload anymore
+  if (msg->release_cb != NULL) {
+    msg->release_cb(context,
+                    msg->release_data,
+                    msg->release_length,
+                    msg->release_arg);
+    msg->release_cb = NULL;
+  }
+
   _LOCK_ACCESS(&msg->msg_chunks_lock) {
     if (msg->msg_chunks != NULL) {
       pll_iterator(np_messagepart_ptr) iter = pll_first(msg->msg_chunks);
@@ -385,7 +405,17 @@ bool _np_message_serialize_chunked(np_state_t *context, np_message_t *msg) {
                                                  ._buffer_size   = header_size,
                                                  ._bytes_written = 0,
                                                  ._error         = 0};
-      np_serializer_write_map(context, &header_serializer, msg->header);
+      if (msg->header_prefix_size > 0) {
+        np_serializer_write_map_prefixed(context,
+                                         &header_serializer,
+                                         msg->header,
+                                         &_NP_MSG_HEADER_SUBJECT,
+                                         1,
+                                         msg->header_prefix,
+                                         msg->header_prefix_size);
+      } else {
+        np_serializer_write_map(context, &header_serializer, msg->header);
+      }
     }
 
     // log_debug_msg(LOG_SERIALIZATION | LOG_DEBUG, "copying the header (size
@@ -642,6 +672,7 @@ bool _np_message_deserialize_header_and_instructions(np_message_t *msg,
           char *old = msg->uuid;
           msg->uuid = strdup(np_treeval_to_str(msg_uuid, NULL));
           free(old);
+          _np_uuid_from_str(msg->uuid, &msg->uuid_key);
 
           log_debug(LOG_MESSAGE,
                     "(msg:%s) received message part: %d / %d",
@@ -810,60 +841,52 @@ void _np_message_create(np_message_t *msg,
   // np_message_t* new_msg;
   // log_debug_msg(LOG_MESSAGE | LOG_DEBUG, "message ptr: %p %s", msg, subject);
 
-  // in the future: header
-  np_tree_insert_str(msg->header,
-                     _NP_MSG_HEADER_SUBJECT,
-                     np_treeval_new_dhkey(subject));
-  np_tree_insert_str(msg->header, _NP_MSG_HEADER_TO, np_treeval_new_dhkey(to));
-  np_tree_insert_str(msg->header,
-                     _NP_MSG_HEADER_FROM,
-                     np_treeval_new_dhkey(from));
-  // insert a uuid if not yet present
-  np_tree_insert_str(msg->instructions,
-                     _NP_MSG_INST_UUID,
-                     np_treeval_new_s(msg->uuid));
-
   // derived message data from the msgproperty
   np_msgproperty_conf_t *out_prop =
       _np_msgproperty_conf_get(context, OUTBOUND, subject);
 
-  // insert timestamp and time-to-live
   double now = np_time_now();
-  np_tree_insert_str(msg->instructions,
-                     _NP_MSG_INST_TSTAMP,
-                     np_treeval_new_d(now));
-  if (out_prop != NULL)
-    np_tree_insert_str(msg->instructions,
-                       _NP_MSG_INST_TTL,
-                       np_treeval_new_d(out_prop->msg_ttl));
-  else
+  if (out_prop != NULL) {
+    // subject, ttl, ack mode and the counters are prepared by the template
+    _np_msgproperty_template_apply(context, out_prop, msg);
+  } else {
+    np_tree_insert_str(msg->header,
+                       _NP_MSG_HEADER_SUBJECT,
+                       np_treeval_new_dhkey(subject));
     np_tree_insert_str(msg->instructions,
                        _NP_MSG_INST_TTL,
                        np_treeval_new_d(5.0));
-  msg->redelivery_at = msg->send_at = now;
-
-  // insert msg acknowledgement indicator
-  if (out_prop != NULL)
-    np_tree_insert_str(msg->instructions,
-                       _NP_MSG_INST_ACK,
-                       np_treeval_new_ush(out_prop->ack_mode));
-  else
+    // insert msg acknowledgement indicator
     np_tree_insert_str(msg->instructions,
                        _NP_MSG_INST_ACK,
                        np_treeval_new_ush(ACK_NONE));
+    // insert message chunking placeholder
+    np_tree_insert_str(msg->instructions,
+                       _NP_MSG_INST_PARTS,
+                       np_treeval_new_iarray(1, 1));
+    // set re-send count to zero if not yet present
+    np_tree_insert_str(msg->instructions,
+                       _NP_MSG_INST_SEND_COUNTER,
+                       np_treeval_new_ush(0));
+    // placeholder for incrementing sequence counter
+    np_tree_insert_str(msg->instructions,
+                       _NP_MSG_INST_SEQ,
+                       np_treeval_new_ul(0));
+  }
 
-  // insert message chunking placeholder
+  // per message values: receiver, sender, uuid and timestamp
+  np_tree_insert_str(msg->header, _NP_MSG_HEADER_TO, np_treeval_new_dhkey(to));
+  np_tree_insert_str(msg->header,
+                     _NP_MSG_HEADER_FROM,
+                     np_treeval_new_dhkey(from));
+  // insert a uuid if not yet present
   np_tree_insert_str(msg->instructions,
-                     _NP_MSG_INST_PARTS,
-                     np_treeval_new_iarray(1, 1));
-
-  // in the future: instructions
-  // set re-send count to zero if not yet present
+                     _NP_MSG_INST_UUID,
+                     np_treeval_new_s(msg->uuid));
   np_tree_insert_str(msg->instructions,
-                     _NP_MSG_INST_SEND_COUNTER,
-                     np_treeval_new_ush(0));
-  // placeholder for incrementing sequence counter
-  np_tree_insert_str(msg->instructions, _NP_MSG_INST_SEQ, np_treeval_new_ul(0));
+                     _NP_MSG_INST_TSTAMP,
+                     np_treeval_new_d(now));
+  msg->redelivery_at = msg->send_at = now;
 
   if (the_data != NULL) {
     _np_message_setbody(msg, the_data);
@@ -897,6 +920,7 @@ bool np_message_clone(np_message_t *copy_of_message, np_message_t *message) {
   copy_of_message->is_single_part = message->is_single_part;
   copy_of_message->no_of_chunks   = message->no_of_chunks;
   memcpy(copy_of_message->uuid, message->uuid, NP_UUID_BYTES);
+  copy_of_message->uuid_key = message->uuid_key;
 
   np_tree_free(copy_of_message->header);
   copy_of_message->header = np_tree_clone(message->header);
@@ -1082,7 +1106,8 @@ bool _np_message_decrypt_payload(np_message_t *msg, np_aaatoken_t *tmp_token) {
                   "decryption of message sym_key (%s) failed",
                   msg->uuid);
         } else {
-          np_tree_t *encrypted_body = np_tree_create();
+          np_tree_t *encrypted_body     = np_tree_create();
+          encrypted_body->attr.in_place = true;
           if (_np_messagepart_decrypt(context,
                                       msg->body,
                                       nonce,
@@ -1094,6 +1119,16 @@ bool _np_message_decrypt_payload(np_message_t *msg, np_aaatoken_t *tmp_token) {
                     "decryption of message (%s) payloads body failed",
                     msg->uuid);
           } else {
+            // the decrypted body borrows its values from the buffer of the
+            // encrypted part, which now belongs to the message
+            if (msg->body->attr.in_place == false) {
+              np_tree_elem_t *enc_part =
+                  np_tree_find_str(msg->body, NP_ENCRYPTED);
+              free(msg->bin_body);
+              msg->bin_body           = enc_part->val.value.bin;
+              enc_part->val.value.bin = NULL;
+            }
+
             np_tree_t *old = msg->body;
             msg->body      = encrypted_body;
             np_tree_free(old);
@@ -1141,6 +1176,7 @@ void _np_message_add_response_handler(
 
   // TODO: more efficient, please ...
   memcpy(rh->uuid, self->uuid, NP_UUID_BYTES);
+  rh->uuid_key = self->uuid_key;
   if (use_destination_from_header_to_field) {
     rh->dest_dhkey =
         np_tree_find_str(self->header, _NP_MSG_HEADER_TO)->val.value.dhkey;
@@ -1222,7 +1258,7 @@ void _np_message_trace_info(char *desc, np_message_t *msg_in) {
   info_str = np_str_concatAndFree(info_str, ": %s", msg_in->uuid);
 #endif
 
-  log_info(LOG_MESSAGE, info_str);
+  log_info(LOG_MESSAGE, "%s", info_str);
   free(info_str);
 }
 
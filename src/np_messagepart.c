@@ -22,6 +22,7 @@
 #include "np_log.h"
 #include "np_memory.h"
 #include "np_message.h"
+#include "np_statistics.h"
 #include "np_types.h"
 #include "np_util.h"
 
@@ -65,9 +66,13 @@ bool _np_messagepart_decrypt(np_state_t              *context,
     log_msg(LOG_ERROR, "couldn't find encrypted msg part");
     return (false);
   }
-  size_t        decrypted_size = enc_msg_part->val.size - crypto_box_MACBYTES;
-  unsigned char dec_part[decrypted_size];
-  int16_t       ret = crypto_secretbox_open_easy(dec_part,
+  size_t decrypted_size = enc_msg_part->val.size - crypto_box_MACBYTES;
+  // an in_place target tree borrows its values from the decrypted buffer,
+  // therefore decrypt into the memory of the encrypted part itself
+  unsigned char  dec_buffer[target->attr.in_place ? 1 : decrypted_size];
+  unsigned char *dec_part =
+      target->attr.in_place ? enc_msg_part->val.value.bin : dec_buffer;
+  int16_t ret = crypto_secretbox_open_easy(dec_part,
                                            enc_msg_part->val.value.bin,
                                            enc_msg_part->val.size,
                                            enc_nonce,
@@ -179,6 +184,276 @@ void _np_messagepart_t_new(np_state_t       *context,
   _np_threads_mutex_init(context, &part->work_lock, "urn:np:msgpart:worklock");
 }
 
+struct np_msgpart_entry_s {
+  np_dhkey_t          key;
+  np_message_t       *msg;
+  uint16_t            expected;
+  uint16_t            received;
+  double              expires_at;
+  double              first_received_at;
+  uint64_t           *received_bits;
+  np_messagepart_ptr *slots;
+};
+
+struct np_msgpart_shard_s {
+  np_mutex_t lock;
+  np_tree_t *entries;
+};
+
+struct np_msgpart_cache_s {
+  struct np_msgpart_shard_s shards[NP_MSG_PART_CACHE_SHARDS];
+
+  np_mutex_t wheel_lock;
+  uint64_t   wheel_tick;
+  np_sll_t(np_dhkey_t, wheel[NP_MSG_PART_CACHE_WHEEL_SLOTS]);
+};
+
+static inline struct np_msgpart_shard_s *
+__np_messagepart_cache_shard(np_msgpart_cache_t *cache, np_dhkey_t msg_key) {
+  return &cache->shards[msg_key.t[0] % NP_MSG_PART_CACHE_SHARDS];
+}
+
+static inline uint64_t __np_messagepart_cache_tick(double time) {
+  return (uint64_t)(time / NP_MSG_PART_CACHE_WHEEL_TICK_SEC);
+}
+
+static void __np_messagepart_cache_schedule(np_state_t         *context,
+                                            np_msgpart_cache_t *cache,
+                                            np_dhkey_t          msg_key,
+                                            double              expires_at) {
+  uint64_t tick = __np_messagepart_cache_tick(expires_at);
+  _LOCK_ACCESS(&cache->wheel_lock) {
+    // never schedule into a bucket which has already been processed
+    if (tick <= cache->wheel_tick) tick = cache->wheel_tick + 1;
+    sll_append(np_dhkey_t,
+               cache->wheel[tick % NP_MSG_PART_CACHE_WHEEL_SLOTS],
+               msg_key);
+  }
+}
+
+static void __np_messagepart_entry_free(np_state_t                *context,
+                                        struct np_msgpart_entry_s *entry,
+                                        bool                       release) {
+  if (release) {
+    for (uint16_t i = 0; i < entry->expected; i++) {
+      if (entry->slots[i] != NULL)
+        np_unref_obj(np_messagepart_t,
+                     entry->slots[i],
+                     ref_message_messagepart);
+    }
+    np_unref_obj(np_message_t, entry->msg, ref_msgpartcache);
+  }
+  free(entry->received_bits);
+  free(entry->slots);
+  free(entry);
+}
+
+np_msgpart_cache_t *_np_messagepart_cache_create(np_state_t *context) {
+  np_msgpart_cache_t *cache = calloc(1, sizeof(np_msgpart_cache_t));
+  CHECK_MALLOC(cache);
+
+  for (uint16_t i = 0; i < NP_MSG_PART_CACHE_SHARDS; i++) {
+    _np_threads_mutex_init(context,
+                           &cache->shards[i].lock,
+                           "urn:np:msgpart:cache:shard");
+    cache->shards[i].entries = np_tree_create();
+  }
+  _np_threads_mutex_init(context,
+                         &cache->wheel_lock,
+                         "urn:np:msgpart:cache:wheel");
+  for (uint16_t i = 0; i < NP_MSG_PART_CACHE_WHEEL_SLOTS; i++) {
+    sll_init(np_dhkey_t, cache->wheel[i]);
+  }
+  cache->wheel_tick = __np_messagepart_cache_tick(np_time_now());
+
+  return cache;
+}
+
+void _np_messagepart_cache_destroy(np_state_t         *context,
+                                   np_msgpart_cache_t *cache) {
+  if (cache == NULL) return;
+
+  for (uint16_t i = 0; i < NP_MSG_PART_CACHE_SHARDS; i++) {
+    struct np_msgpart_shard_s *shard = &cache->shards[i];
+    _LOCK_ACCESS(&shard->lock) {
+      np_tree_elem_t *tmp = NULL;
+      RB_FOREACH (tmp, np_tree_s, shard->entries) {
+        __np_messagepart_entry_free(context, tmp->val.value.v, true);
+      }
+      np_tree_free(shard->entries);
+    }
+    _np_threads_mutex_destroy(context, &shard->lock);
+  }
+  for (uint16_t i = 0; i < NP_MSG_PART_CACHE_WHEEL_SLOTS; i++) {
+    sll_free(np_dhkey_t, cache->wheel[i]);
+  }
+  _np_threads_mutex_destroy(context, &cache->wheel_lock);
+  free(cache);
+}
+
+np_message_t *_np_messagepart_cache_add(np_state_t         *context,
+                                        np_msgpart_cache_t *cache,
+                                        np_dhkey_t          msg_key,
+                                        np_message_t       *msg_to_add,
+                                        uint16_t            expected_chunks,
+                                        uint16_t           *received_chunks) {
+  np_message_t *ret = NULL;
+
+  np_messagepart_ptr to_add = NULL;
+  _LOCK_ACCESS(&msg_to_add->msg_chunks_lock) {
+    if (pll_size(msg_to_add->msg_chunks) > 0)
+      to_add = pll_first(msg_to_add->msg_chunks)->val;
+  }
+  if (to_add == NULL || to_add->part == 0 || to_add->part > expected_chunks) {
+    log_debug_msg(LOG_MESSAGE | LOG_DEBUG,
+                  "message (%s) contains no valid part (%" PRIu16 ")",
+                  msg_to_add->uuid,
+                  expected_chunks);
+    return NULL;
+  }
+
+  uint16_t                   idx     = to_add->part - 1;
+  bool                       is_new  = false;
+  struct np_msgpart_entry_s *entry   = NULL;
+  struct np_msgpart_shard_s *shard   = __np_messagepart_cache_shard(cache, msg_key);
+  double                     expires = _np_message_get_expiery(msg_to_add);
+
+  _LOCK_ACCESS(&shard->lock) {
+    np_tree_elem_t *tmp = np_tree_find_dhkey(shard->entries, msg_key);
+    if (NULL == tmp) {
+      // there is no chunk for this msg in cache, so we use this message as
+      // the structure to accumulate further chunks into
+      entry = calloc(1, sizeof(struct np_msgpart_entry_s));
+      CHECK_MALLOC(entry);
+      entry->key               = msg_key;
+      entry->msg               = msg_to_add;
+      entry->expected          = expected_chunks;
+      entry->expires_at        = expires;
+      entry->first_received_at = np_time_now();
+      entry->received_bits =
+          calloc((expected_chunks + 63) / 64, sizeof(uint64_t));
+      entry->slots = calloc(expected_chunks, sizeof(np_messagepart_ptr));
+      CHECK_MALLOC(entry->received_bits);
+      CHECK_MALLOC(entry->slots);
+
+      // we need to unref this after we finish the handling of this msg
+      np_ref_obj(np_message_t, msg_to_add, ref_msgpartcache);
+      np_tree_insert_dhkey(shard->entries,
+                           msg_key,
+                           np_treeval_new_v(entry));
+      is_new = true;
+    } else {
+      entry = tmp->val.value.v;
+    }
+
+    if (entry->expected == expected_chunks &&
+        0 == (entry->received_bits[idx / 64] & (1ULL << (idx % 64)))) {
+      // move the received messagepart (and its reference) into the slot
+      _LOCK_ACCESS(&msg_to_add->msg_chunks_lock) {
+        pll_head(np_messagepart_ptr, msg_to_add->msg_chunks);
+      }
+      entry->slots[idx] = to_add;
+      entry->received_bits[idx / 64] |= (1ULL << (idx % 64));
+      entry->received++;
+    }
+    *received_chunks = entry->received;
+
+    if (entry->received == entry->expected) {
+      // all chunks are present, the slot array is ordered already. Inserting
+      // from the last to the first part keeps each pll_insert at the head.
+      ret = entry->msg;
+      _LOCK_ACCESS(&ret->msg_chunks_lock) {
+        for (uint16_t i = entry->expected; i > 0; i--) {
+          pll_insert(np_messagepart_ptr,
+                     ret->msg_chunks,
+                     entry->slots[i - 1],
+                     false,
+                     _np_messagepart_cmp);
+        }
+      }
+      np_dhkey_t *subject = _np_message_get_subject(ret);
+      if (subject != NULL)
+        _np_statistics_observe_reassembly(
+            *subject,
+            np_time_now() - entry->first_received_at);
+
+      np_tree_del_dhkey(shard->entries, msg_key);
+      __np_messagepart_entry_free(context, entry, false);
+      is_new = false;
+    }
+  }
+
+  if (is_new)
+    __np_messagepart_cache_schedule(context, cache, msg_key, expires);
+
+  return ret;
+}
+
+void _np_messagepart_cache_expire(np_state_t         *context,
+                                  np_msgpart_cache_t *cache,
+                                  double              now) {
+  uint64_t now_tick = __np_messagepart_cache_tick(now);
+
+  np_sll_t(np_dhkey_t, due);
+  sll_init(np_dhkey_t, due);
+
+  _LOCK_ACCESS(&cache->wheel_lock) {
+    // a full rotation visits every bucket, no need to iterate further
+    if (now_tick > cache->wheel_tick + NP_MSG_PART_CACHE_WHEEL_SLOTS)
+      cache->wheel_tick = now_tick - NP_MSG_PART_CACHE_WHEEL_SLOTS;
+
+    while (cache->wheel_tick < now_tick) {
+      cache->wheel_tick++;
+      uint16_t bucket = cache->wheel_tick % NP_MSG_PART_CACHE_WHEEL_SLOTS;
+      while (!sll_empty(cache->wheel[bucket])) {
+        sll_append(np_dhkey_t, due, sll_head(np_dhkey_t, cache->wheel[bucket]));
+      }
+    }
+  }
+
+  sll_iterator(np_dhkey_t) iter = sll_first(due);
+  while (NULL != iter) {
+    struct np_msgpart_shard_s *shard =
+        __np_messagepart_cache_shard(cache, iter->val);
+    double reschedule_at = 0.0;
+
+    _LOCK_ACCESS(&shard->lock) {
+      // completed messages have already been removed from their shard
+      np_tree_elem_t *tmp = np_tree_find_dhkey(shard->entries, iter->val);
+      if (NULL != tmp) {
+        struct np_msgpart_entry_s *entry = tmp->val.value.v;
+        if (entry->expires_at <= now) {
+          log_debug_msg(
+              LOG_MISC,
+              "MSG_PART_TABLE removing (left-over) message part for uuid: %s",
+              entry->msg->uuid);
+          np_tree_del_dhkey(shard->entries, iter->val);
+          __np_messagepart_entry_free(context, entry, true);
+        } else {
+          // the ttl exceeds one rotation of the wheel
+          reschedule_at = entry->expires_at;
+        }
+      }
+    }
+    if (reschedule_at > 0.0)
+      __np_messagepart_cache_schedule(context, cache, iter->val, reschedule_at);
+
+    sll_next(iter);
+  }
+  sll_free(np_dhkey_t, due);
+}
+
+uint32_t _np_messagepart_cache_size(np_state_t         *context,
+                                    np_msgpart_cache_t *cache) {
+  uint32_t ret = 0;
+  for (uint16_t i = 0; i < NP_MSG_PART_CACHE_SHARDS; i++) {
+    _LOCK_ACCESS(&cache->shards[i].lock) {
+      ret += cache->shards[i].entries->size;
+    }
+  }
+  return ret;
+}
+
 char *np_messagepart_printcache(np_state_t *context, bool asOneLine) {
   char *ret      = NULL;
   char *new_line = "\n";
@@ -186,31 +461,36 @@ char *np_messagepart_printcache(np_state_t *context, bool asOneLine) {
     new_line = "    ";
   }
 
-  ret = np_str_concatAndFree(ret,
-                             "--- Messagepart cache (%" PRIu16 ") ---%s",
-                             context->msg_part_cache->size,
-                             new_line);
-  _LOCK_MODULE(np_message_part_cache_t) {
-    np_tree_elem_t *tmp = NULL;
-
-    RB_FOREACH (tmp, np_tree_s, context->msg_part_cache) {
-
-      np_message_t *msg = tmp->val.value.v;
-      char          tmp_msg_subject[65];
-      // TODO: tmp_msg_subject (this is an ugly cast from dhkey* to char*)
-      sodium_bin2hex(tmp_msg_subject,
-                     65,
-                     _np_message_get_subject(msg),
-                     NP_FINGERPRINT_BYTES);
-
-      ret = np_str_concatAndFree(ret,
-                                 "%s   received %2" PRIu32 " of %2" PRIu16
-                                 " expected parts. msg subject: %s%s",
-                                 msg->uuid,
-                                 pll_size(msg->msg_chunks),
-                                 msg->no_of_chunks,
-                                 tmp_msg_subject,
-                                 new_line);
+  ret = np_str_concatAndFree(
+      ret,
+      "--- Messagepart cache (%" PRIu32 ") ---%s",
+      _np_messagepart_cache_size(context, context->msg_part_cache),
+      new_line);
+
+  for (uint16_t i = 0; i < NP_MSG_PART_CACHE_SHARDS; i++) {
+    struct np_msgpart_shard_s *shard = &context->msg_part_cache->shards[i];
+    _LOCK_ACCESS(&shard->lock) {
+      np_tree_elem_t *tmp = NULL;
+
+      RB_FOREACH (tmp, np_tree_s, shard->entries) {
+
+        struct np_msgpart_entry_s *entry = tmp->val.value.v;
+        char                       tmp_msg_subject[65];
+        // TODO: tmp_msg_subject (this is an ugly cast from dhkey* to char*)
+        sodium_bin2hex(tmp_msg_subject,
+                       65,
+                       _np_message_get_subject(entry->msg),
+                       NP_FINGERPRINT_BYTES);
+
+        ret = np_str_concatAndFree(ret,
+                                   "%s   received %2" PRIu16 " of %2" PRIu16
+                                   " expected parts. msg subject: %s%s",
+                                   entry->msg->uuid,
+                                   entry->received,
+                                   entry->expected,
+                                   tmp_msg_subject,
+                                   new_line);
+      }
     }
   }
   ret = np_str_concatAndFree(ret, "--- Messagepart cache end ---%s", new_line);
@@ -263,6 +543,6 @@ void _np_messagepart_trace_info(char *desc, np_messagepart_t *msg_in) {
                                   msg_in->part);
 #endif
 
-  log_debug(LOG_MESSAGE, info_str);
+  log_debug(LOG_MESSAGE, "%s", info_str);
   free(info_str);
 }
@@ -34,6 +34,7 @@
 
 #include "neuropil_log.h"
 
+#include "core/np_comp_msgproperty.h"
 #include "core/np_comp_node.h"
 #include "util/np_event.h"
 
@@ -76,11 +77,15 @@ np_module_struct(network) {
   np_state_t *context;
   TSP(size_t, __msgs_per_sec_in);
   TSP(size_t, __msgs_per_sec_out);
+  // subject dhkey -> number of peers whose data queue is congested
+  TSP(np_tree_t *, __blocked_subjects);
   /**
    * @brief Runtime constant how many messages per second this node can handle,
    * set to 0 to disable.
    */
   size_t max_msgs_per_sec;
+  // time of the last reset of the per second counters
+  double __capacity_reset_at;
 };
 
 bool __np_network_module_periodic_capacity_reset(
@@ -92,7 +97,8 @@ bool __np_network_module_periodic_capacity_reset(
   }
   TSP_SCOPE(np_module(network)->__msgs_per_sec_out) {
     last_msgs_per_sec_out = np_module(network)->__msgs_per_sec_out;
-    np_module(network)->__msgs_per_sec_out = 0;
+    np_module(network)->__msgs_per_sec_out  = 0;
+    np_module(network)->__capacity_reset_at = np_time_now();
   }
   if (last_msgs_per_sec_in > 0 || last_msgs_per_sec_out > 0)
     log_info(LOG_EXPERIMENT,
@@ -108,11 +114,13 @@ bool _np_network_module_init(np_state_t *context) {
 
     TSP_INITD(_module->__msgs_per_sec_in, 0);
     TSP_INITD(_module->__msgs_per_sec_out, 0);
+    TSP_INITD(_module->__blocked_subjects, np_tree_create());
     if (context->settings->max_msgs_per_sec > 0) {
       _module->max_msgs_per_sec = context->settings->max_msgs_per_sec;
     } else {
       _module->max_msgs_per_sec = NP_NETWORK_DEFAULT_MAX_MSGS_PER_SEC;
     }
+    _module->__capacity_reset_at = np_time_now();
 
     np_jobqueue_submit_event_periodic(
         context,
@@ -131,6 +139,8 @@ void _np_network_module_destroy(np_state_t *context) {
     np_module_var(network);
     TSP_DESTROY(_module->__msgs_per_sec_in);
     TSP_DESTROY(_module->__msgs_per_sec_out);
+    np_tree_free(_module->__blocked_subjects);
+    TSP_DESTROY(_module->__blocked_subjects);
 
     np_module_free(route);
   }
@@ -190,6 +200,8 @@ void __np_network_close(np_network_t *self) {
                 self,
                 self->socket);
   close(self->socket);
+  for (uint8_t i = 0; i < self->shard_count; i++)
+    close(self->shard_watchers[i].fd);
 }
 
 /** network_address:
@@ -244,11 +256,13 @@ bool _np_network_get_address(np_state_t       *context,
 
 bool _np_network_send_data(np_state_t   *context,
                            np_network_t *network,
-                           void         *data_to_send) {
-  ssize_t write_per_data   = 0;
-  uint8_t retry            = 3;
-  bool    node_at_capacity = false;
-  bool    ret              = false;
+                           void         *data_to_send,
+                           bool         *would_block) {
+  ssize_t write_per_data = 0;
+  uint8_t retry          = 3;
+  bool    ret            = false;
+
+  if (would_block != NULL) *would_block = false;
 
 #ifdef DEBUG
   unsigned char hash[crypto_generichash_BYTES] = {0};
@@ -274,90 +288,422 @@ bool _np_network_send_data(np_state_t   *context,
             hex);
 #endif // DEBUG
 
-  size_t msgs_per_sec_out;
-  if (np_module_initiated(network) &&
-      np_module(network)->max_msgs_per_sec > 0) {
-    TSP_SCOPE(np_module(network)->__msgs_per_sec_out) {
-      node_at_capacity = np_module(network)->__msgs_per_sec_out >
-                         np_module(network)->max_msgs_per_sec;
-      if (np_module(network)->__msgs_per_sec_out < SIZE_MAX)
-        msgs_per_sec_out = np_module(network)->__msgs_per_sec_out++;
-    }
-  }
-  if (node_at_capacity) {
-    log_warn(LOG_NETWORK,
-             "Dropping data package due to msgs per sec constraint (%" PRIsizet
-             " / %" PRIsizet " | OUT)",
-             msgs_per_sec_out,
-             np_module(network)->max_msgs_per_sec);
-  } else {
-
-    do {
-      ssize_t current_write_per_data = 0;
-      if (FLAG_CMP(network->socket_type, PASSIVE)) {
-        current_write_per_data =
-            sendto(network->socket,
-                   (((unsigned char *)data_to_send)) + write_per_data,
-                   MSG_CHUNK_SIZE_1024 - write_per_data,
+  int send_errno = 0;
+  do {
+    ssize_t current_write_per_data = 0;
+    if (FLAG_CMP(network->socket_type, PASSIVE)) {
+      current_write_per_data =
+          sendto(network->socket,
+                 (((unsigned char *)data_to_send)) + write_per_data,
+                 MSG_CHUNK_SIZE_1024 - write_per_data,
 #ifdef MSG_NOSIGNAL
-                   MSG_NOSIGNAL,
+                 MSG_NOSIGNAL,
 #else
-                   0,
+                 0,
 #endif
-                   network->remote_addr,
-                   network->remote_addr_len);
-      } else {
-        current_write_per_data =
-            send(network->socket,
-                 (((unsigned char *)data_to_send)) + write_per_data,
-                 MSG_CHUNK_SIZE_1024 - write_per_data,
+                 network->remote_addr,
+                 network->remote_addr_len);
+    } else {
+      current_write_per_data =
+          send(network->socket,
+               (((unsigned char *)data_to_send)) + write_per_data,
+               MSG_CHUNK_SIZE_1024 - write_per_data,
 #ifdef MSG_NOSIGNAL
-                 MSG_NOSIGNAL
+               MSG_NOSIGNAL
 #else
-                 0
+               0
 #endif
-            );
+          );
+    }
+
+    if (current_write_per_data >= 0) {
+      write_per_data += current_write_per_data;
+    } else {
+      send_errno = errno;
+      // the socket buffer is full, nothing has been written yet: let the
+      // caller keep the package until the next write event
+      if (write_per_data == 0 &&
+          (send_errno == EAGAIN || send_errno == EWOULDBLOCK ||
+           send_errno == ENOBUFS)) {
+        if (would_block != NULL) *would_block = true;
+        log_debug(LOG_NETWORK,
+                  "deferring package %p via %p -> %d: %s",
+                  data_to_send,
+                  network,
+                  network->socket,
+                  strerror(send_errno));
+        return false;
       }
+    }
+  } while (write_per_data < MSG_CHUNK_SIZE_1024 && --retry > 0);
+
+  _np_debug_log_bin(data_to_send,
+                    MSG_CHUNK_SIZE_1024,
+                    LOG_NETWORK,
+                    "Did send    data (%" PRIsizet
+                    " bytes / %p) via fd: %d: %s",
+                    write_per_data,
+                    data_to_send,
+                    network->socket);
+
+  if (write_per_data == MSG_CHUNK_SIZE_1024) {
+    _np_statistics_add_send_bytes(write_per_data);
+
+    network->last_send_date = np_time_now();
+    ret                     = true;
+    log_debug(LOG_NETWORK,
+              "Did send package %p via %p -> %d",
+              data_to_send,
+              network,
+              network->socket);
+  } else {
+    log_error("Could not send package %p (%zd/%d) over fd: %d msg: %s (%d)",
+              data_to_send,
+              write_per_data,
+              MSG_CHUNK_SIZE_1024,
+              network->socket,
+              strerror(send_errno),
+              send_errno);
+  }
+  return ret;
+}
 
-      if (current_write_per_data >= 0) {
-        write_per_data += current_write_per_data;
-      } else {
-        np_time_sleep(NP_PI / 1000);
+static double __np_network_pacing_srtt(struct np_network_pacing_s *pacing) {
+  return pacing->srtt > 0.0 ? pacing->srtt : NP_NETWORK_PACING_INITIAL_RTT;
+}
+
+static void __np_network_pacing_set_rate(struct np_network_pacing_s *pacing) {
+  pacing->rate =
+      NP_NETWORK_PACING_GAIN * pacing->cwnd / __np_network_pacing_srtt(pacing);
+}
+
+// multiplicative decrease, a burst of losses only counts once per round trip
+static void __np_network_pacing_decrease(struct np_network_pacing_s *pacing,
+                                         double                      now) {
+  if ((now - pacing->decreased_at) < __np_network_pacing_srtt(pacing)) return;
+
+  pacing->decreased_at = now;
+  pacing->ssthresh     = pacing->cwnd / 2.0;
+  if (pacing->ssthresh < NP_NETWORK_PACING_MIN_CWND)
+    pacing->ssthresh = NP_NETWORK_PACING_MIN_CWND;
+  pacing->cwnd = pacing->ssthresh;
+  __np_network_pacing_set_rate(pacing);
+}
+
+// additive increase: grow by one chunk per ack in slow start, by one chunk
+// per window afterwards
+static void __np_network_pacing_increase(struct np_network_pacing_s *pacing) {
+  if (pacing->cwnd < pacing->ssthresh) pacing->cwnd += 1.0;
+  else pacing->cwnd += 1.0 / pacing->cwnd;
+  if (pacing->cwnd > NP_NETWORK_PACING_MAX_CWND)
+    pacing->cwnd = NP_NETWORK_PACING_MAX_CWND;
+  __np_network_pacing_set_rate(pacing);
+}
+
+void _np_network_pacing_update(np_network_t *network, double rtt, bool lost) {
+  np_ctx_memory(network);
+
+  _LOCK_ACCESS(&network->access_lock) {
+    struct np_network_pacing_s *pacing = &network->pacing;
+    if (lost) {
+      __np_network_pacing_decrease(pacing, np_time_now());
+    } else if (rtt > 0.0) {
+      pacing->srtt =
+          (pacing->srtt > 0.0) ? (0.875 * pacing->srtt + 0.125 * rtt) : rtt;
+      __np_network_pacing_increase(pacing);
+    }
+  }
+}
+
+void _np_network_pacing_unacked(np_network_t *network) {
+  __np_network_pacing_increase(&network->pacing);
+}
+
+/**
+ * refills the token bucket of the network and returns how long the out loop
+ * has to wait before the next chunk may be sent (0.0 if it can be sent now).
+ * The node wide max_msgs_per_sec limit is applied on top.
+ */
+static double __np_network_pacing_delay(np_state_t   *context,
+                                        np_network_t *network,
+                                        double        now) {
+  struct np_network_pacing_s *pacing = &network->pacing;
+  double                      delay  = 0.0;
+
+  if (np_module_initiated(network) &&
+      np_module(network)->max_msgs_per_sec > 0) {
+    TSP_SCOPE(np_module(network)->__msgs_per_sec_out) {
+      if (np_module(network)->__msgs_per_sec_out >=
+          np_module(network)->max_msgs_per_sec) {
+        delay = np_module(network)->__capacity_reset_at + 1.0 - now;
+        if (delay < NP_NETWORK_PACING_MIN_DELAY_SEC)
+          delay = NP_NETWORK_PACING_MIN_DELAY_SEC;
       }
-    } while (write_per_data < MSG_CHUNK_SIZE_1024 && --retry > 0);
-
-    _np_debug_log_bin(data_to_send,
-                      MSG_CHUNK_SIZE_1024,
-                      LOG_NETWORK,
-                      "Did send    data (%" PRIsizet
-                      " bytes / %p) via fd: %d: %s",
-                      write_per_data,
-                      data_to_send,
-                      network->socket);
-
-    if (write_per_data == MSG_CHUNK_SIZE_1024) {
-      _np_statistics_add_send_bytes(write_per_data);
-
-      network->last_send_date = np_time_now();
-      ret                     = true;
-      log_debug(LOG_NETWORK,
-                "Did send package %p via %p -> %d",
-                data_to_send,
-                network,
-                network->socket);
-    } else {
-      log_error("Could not send package %p (%zd/%d) over fd: %d msg: %s (%d)",
-                data_to_send,
-                write_per_data,
-                MSG_CHUNK_SIZE_1024,
-                network->socket,
-                strerror(errno),
-                errno);
     }
   }
+
+  pacing->tokens += (now - pacing->refilled_at) * pacing->rate;
+  pacing->refilled_at = now;
+  // bursts are limited to one congestion window
+  if (pacing->tokens > pacing->cwnd) pacing->tokens = pacing->cwnd;
+
+  if (pacing->tokens < 1.0) {
+    double token_delay = (1.0 - pacing->tokens) / pacing->rate;
+    if (token_delay < NP_NETWORK_PACING_MIN_DELAY_SEC)
+      token_delay = NP_NETWORK_PACING_MIN_DELAY_SEC;
+    if (token_delay > delay) delay = token_delay;
+  }
+  return delay;
+}
+
+// the data chunks of one subject in the send queue of a network
+typedef struct __np_network_flow_s {
+  np_dhkey_t subject;
+  int32_t    deficit; // in chunks, all chunks have the same size
+  bool       blocked; // counted in the blocked subjects of the module
+  np_sll_t(void_ptr, chunks);
+} __np_network_flow_t;
+
+static void __np_network_flow_block(np_state_t          *context,
+                                    __np_network_flow_t *flow,
+                                    bool                 blocked) {
+  if (!np_module_initiated(network) || flow->blocked == blocked) return;
+  flow->blocked = blocked;
+
+  TSP_SCOPE(np_module(network)->__blocked_subjects) {
+    np_tree_t      *subjects = np_module(network)->__blocked_subjects;
+    np_tree_elem_t *elem     = np_tree_find_dhkey(subjects, flow->subject);
+    if (blocked && elem == NULL) {
+      np_tree_insert_dhkey(subjects, flow->subject, np_treeval_new_ul(1));
+    } else if (blocked) {
+      elem->val.value.ul++;
+    } else if (elem != NULL && --elem->val.value.ul == 0) {
+      np_tree_del_dhkey(subjects, flow->subject);
+    }
+  }
+}
+
+bool _np_network_is_congested(np_state_t *context, np_dhkey_t subject) {
+  if (!np_module_initiated(network)) return false;
+
+  bool ret = false;
+  TSP_SCOPE(np_module(network)->__blocked_subjects) {
+    ret = NULL != np_tree_find_dhkey(np_module(network)->__blocked_subjects,
+                                     subject);
+  }
   return ret;
 }
 
+np_network_send_class_e _np_network_send_class(np_network_t *network,
+                                               np_dhkey_t    subject) {
+  np_ctx_memory(network);
+  np_tree_elem_t *elem =
+      np_tree_find_dhkey(network->out_queue.send_classes, subject);
+  if (elem != NULL) return elem->val.value.ush;
+
+  // internal messages are sent ahead of user data
+  np_network_send_class_e send_class = np_network_send_data;
+  np_msgproperty_conf_t  *property =
+      _np_msgproperty_conf_get(context, DEFAULT_MODE, subject);
+  if (property != NULL && property->is_internal)
+    send_class = np_network_send_control;
+
+  np_tree_insert_dhkey(network->out_queue.send_classes,
+                       subject,
+                       np_treeval_new_ush(send_class));
+  return send_class;
+}
+
+enum np_return _np_network_enqueue(np_network_t           *network,
+                                   void                   *chunk,
+                                   np_network_send_class_e send_class,
+                                   np_dhkey_t              subject) {
+  np_ctx_memory(network);
+  struct np_network_send_queue_s *queue = &network->out_queue;
+
+  if (send_class == np_network_send_control) {
+    if (sll_size(queue->control) >= NP_NETWORK_SEND_QUEUE_MAX_CONTROL)
+      return np_operation_would_block;
+    sll_append(void_ptr, queue->control, chunk);
+    return np_ok;
+  }
+
+  __np_network_flow_t *flow = NULL;
+  np_tree_elem_t      *elem = np_tree_find_dhkey(queue->flows, subject);
+  if (elem != NULL) {
+    flow = elem->val.value.v;
+  } else if (queue->data_size < NP_NETWORK_SEND_QUEUE_MAX_DATA) {
+    flow = calloc(1, sizeof(__np_network_flow_t));
+    CHECK_MALLOC(flow);
+    flow->subject = subject;
+    sll_init(void_ptr, flow->chunks);
+    np_tree_insert_dhkey(queue->flows, subject, np_treeval_new_v(flow));
+    sll_append(void_ptr, queue->active, flow);
+  }
+
+  if (queue->data_size >= NP_NETWORK_SEND_QUEUE_HIGH_WATERMARK &&
+      flow != NULL)
+    __np_network_flow_block(context, flow, true);
+
+  if (queue->data_size >= NP_NETWORK_SEND_QUEUE_MAX_DATA)
+    return np_operation_would_block;
+
+  sll_append(void_ptr, flow->chunks, chunk);
+  queue->data_size++;
+
+  return np_ok;
+}
+
+void *_np_network_dequeue(np_network_t *network) {
+  np_ctx_memory(network);
+  struct np_network_send_queue_s *queue = &network->out_queue;
+  void                           *chunk = NULL;
+
+  if (queue->retry != NULL) {
+    chunk        = queue->retry;
+    queue->retry = NULL;
+  } else if (sll_size(queue->control) > 0) {
+    chunk = sll_head(void_ptr, queue->control);
+  } else if (sll_size(queue->active) > 0) {
+    // deficit round robin: the flow at the head of the round earns a quantum
+    // and keeps its turn until the quantum has been spent
+    __np_network_flow_t *flow = sll_first(queue->active)->val;
+    if (flow->deficit < 1) flow->deficit += NP_NETWORK_SEND_QUEUE_QUANTUM;
+
+    chunk = sll_head(void_ptr, flow->chunks);
+    flow->deficit--;
+    queue->data_size--;
+
+    if (queue->data_size < NP_NETWORK_SEND_QUEUE_LOW_WATERMARK ||
+        sll_size(flow->chunks) == 0)
+      __np_network_flow_block(context, flow, false);
+
+    if (sll_size(flow->chunks) == 0) {
+      sll_head(void_ptr, queue->active);
+      np_tree_del_dhkey(queue->flows, flow->subject);
+      sll_free(void_ptr, flow->chunks);
+      free(flow);
+    } else if (flow->deficit < 1) {
+      sll_head(void_ptr, queue->active);
+      sll_append(void_ptr, queue->active, flow);
+    }
+  }
+  return chunk;
+}
+
+uint32_t _np_network_queue_size(np_network_t *network) {
+  struct np_network_send_queue_s *queue = &network->out_queue;
+  return (queue->retry != NULL ? 1 : 0) + sll_size(queue->control) +
+         queue->data_size;
+}
+
+// an encrypted chunk waiting for space in the send queue of a network
+typedef struct __np_network_deferred_s {
+  void                   *chunk;
+  np_dhkey_t              subject;
+  np_network_send_class_e send_class;
+  uint16_t                attempts;
+  double                  expires_at;
+} __np_network_deferred_t;
+
+static bool __np_network_retry_deferred_job(np_state_t     *context,
+                                            np_util_event_t event);
+
+static void __np_network_schedule_deferred(np_state_t   *context,
+                                           np_network_t *network) {
+  np_util_event_t retry_event = {.user_data = network};
+  network->out_queue.deferred_pending =
+      np_jobqueue_submit_event_callback(context,
+                                        NP_NETWORK_SEND_QUEUE_RETRY_SEC,
+                                        retry_event,
+                                        __np_network_retry_deferred_job,
+                                        "retry: full send queue");
+  if (!network->out_queue.deferred_pending)
+    log_warn(LOG_NETWORK | LOG_ROUTING,
+             "unable to schedule the retry of %" PRIu32
+             " deferred chunks to %s:%s",
+             sll_size(network->out_queue.deferred),
+             network->ip,
+             network->port);
+}
+
+void _np_network_defer(np_network_t           *network,
+                       void                   *chunk,
+                       np_network_send_class_e send_class,
+                       np_dhkey_t              subject,
+                       double                  expires_at) {
+  np_ctx_memory(network);
+  __np_network_deferred_t *deferred =
+      calloc(1, sizeof(__np_network_deferred_t));
+  CHECK_MALLOC(deferred);
+  deferred->chunk      = chunk;
+  deferred->subject    = subject;
+  deferred->send_class = send_class;
+  deferred->expires_at = expires_at;
+  sll_append(void_ptr, network->out_queue.deferred, deferred);
+
+  if (!network->out_queue.deferred_pending)
+    __np_network_schedule_deferred(context, network);
+}
+
+bool _np_network_retry_deferred(np_network_t *network) {
+  np_ctx_memory(network);
+  struct np_network_send_queue_s *queue = &network->out_queue;
+  double                          now   = np_time_now();
+
+  // the remaining chunks keep their order
+  for (uint32_t i = sll_size(queue->deferred); i > 0; i--) {
+    __np_network_deferred_t *deferred = sll_head(void_ptr, queue->deferred);
+
+    if (deferred->expires_at > now &&
+        np_ok == _np_network_enqueue(network,
+                                     deferred->chunk,
+                                     deferred->send_class,
+                                     deferred->subject)) {
+      free(deferred);
+    } else if (deferred->expires_at <= now ||
+               ++deferred->attempts >= NP_NETWORK_SEND_QUEUE_RETRY_MAX) {
+      log_info(LOG_NETWORK | LOG_ROUTING,
+               "Dropping data package to %s:%s after %" PRIu16
+               " attempts to queue it",
+               network->ip,
+               network->port,
+               deferred->attempts);
+      np_unref_obj(BLOB_1024, deferred->chunk, ref_obj_creation);
+      free(deferred);
+    } else {
+      sll_append(void_ptr, queue->deferred, deferred);
+    }
+  }
+  return !sll_empty(queue->deferred);
+}
+
+// the job holds a reference on the network until all deferred chunks are
+// queued or dropped
+static bool __np_network_retry_deferred_job(np_state_t     *context,
+                                            np_util_event_t event) {
+  NP_CAST(event.user_data, np_network_t, network);
+
+  _LOCK_ACCESS(&network->access_lock) {
+    network->out_queue.deferred_pending = false;
+    if (_np_network_retry_deferred(network))
+      __np_network_schedule_deferred(context, network);
+  }
+  _np_network_start(network, false);
+  _np_event_invoke_out(context);
+  return true;
+}
+
+static void __np_network_pacing_resume(struct ev_loop *loop,
+                                       ev_timer       *timer,
+                                       NP_UNUSED int   revents) {
+  if (timer->data == NULL) return;
+  np_network_t *network = ((_np_network_data_t *)timer->data)->network;
+
+  if (FLAG_CMP(network->is_running, np_network_client_started))
+    ev_io_start(EV_A_ & network->watcher_out);
+}
+
 void _np_network_write(struct ev_loop *loop, ev_io *event, int revents) {
   np_ctx_decl(ev_userdata(loop));
 
@@ -370,38 +716,66 @@ void _np_network_write(struct ev_loop *loop, ev_io *event, int revents) {
   np_network_t *network = ((_np_network_data_t *)event->data)->network;
 
   _TRYLOCK_ACCESS(&network->access_lock) {
-    uint8_t send_items_counter = 0;
-    // do {
-    void *data_to_send = NULL;
-    // if a data packet is available, try to send it
-    data_to_send = sll_head(void_ptr, network->out_events);
-    if (data_to_send != NULL) {
-      send_items_counter++;
-      _np_network_send_data(context, network, data_to_send);
-
-      np_unref_obj(BLOB_1024, data_to_send, ref_obj_creation);
-    }
-#ifdef DEBUG
-    if (sll_size(network->out_events) > 0) {
-      log_debug(LOG_NETWORK,
-                "%" PRIu32 " packages still in delivery",
-                sll_size(network->out_events));
-    }
-#endif
-    //} while(sll_size(network->out_events) > 0 && send_items_counter <
-    // NP_NETWORK_MAX_MSGS_PER_SCAN_OUT );
+    double now   = np_time_now();
+    double delay = __np_network_pacing_delay(context, network, now);
 
-    if (sll_size(network->out_events) == 0) {
-      EV_P;
-      loop = _np_event_get_loop_out(context);
+    if (delay > 0.0) {
+      // out of tokens: park the writer until the bucket has been refilled
       ev_io_stop(EV_A_ & network->watcher_out);
+      if (!ev_is_active(&network->pacing_timer)) {
+        ev_timer_set(&network->pacing_timer, delay, 0.0);
+        ev_timer_start(EV_A_ & network->pacing_timer);
+      }
       log_debug(LOG_NETWORK,
-                "network (%s) has been stopped for sending: %d:%s:%s",
+                "network (%s) paced for %f sec (cwnd: %f / rate: %f)",
                 np_memory_get_id(network),
-                network->type,
-                network->ip,
-                network->port);
-      network->is_running &= np_network_server_started;
+                delay,
+                network->pacing.cwnd,
+                network->pacing.rate);
+    } else {
+      // if a data packet is available, try to send it
+      void *data_to_send = _np_network_dequeue(network);
+      if (data_to_send != NULL) {
+        bool would_block = false;
+        if (_np_network_send_data(context,
+                                  network,
+                                  data_to_send,
+                                  &would_block)) {
+          network->pacing.tokens -= 1.0;
+          if (np_module_initiated(network) &&
+              np_module(network)->max_msgs_per_sec > 0) {
+            TSP_SCOPE(np_module(network)->__msgs_per_sec_out) {
+              np_module(network)->__msgs_per_sec_out++;
+            }
+          }
+          np_unref_obj(BLOB_1024, data_to_send, ref_obj_creation);
+        } else if (would_block) {
+          // keep the package for the next write event and treat the full
+          // socket buffer as a congestion signal
+          network->out_queue.retry = data_to_send;
+          __np_network_pacing_decrease(&network->pacing, now);
+        } else {
+          np_unref_obj(BLOB_1024, data_to_send, ref_obj_creation);
+        }
+      }
+#ifdef DEBUG
+      if (_np_network_queue_size(network) > 0) {
+        log_debug(LOG_NETWORK,
+                  "%" PRIu32 " packages still in delivery",
+                  _np_network_queue_size(network));
+      }
+#endif
+
+      if (_np_network_queue_size(network) == 0) {
+        ev_io_stop(EV_A_ & network->watcher_out);
+        log_debug(LOG_NETWORK,
+                  "network (%s) has been stopped for sending: %d:%s:%s",
+                  np_memory_get_id(network),
+                  network->type,
+                  network->ip,
+                  network->port);
+        network->is_running &= np_network_server_started;
+      }
     }
   }
 }
@@ -415,6 +789,26 @@ struct __np_network_data {
   np_network_t           *ng_tcp_host;
 };
 
+// returns the ingress shard of the listening socket behind watcher
+static uint8_t __np_network_shard_of(np_network_t *ng, ev_io *watcher) {
+  if (watcher == &ng->watcher_in) return ng->shard;
+  return (uint8_t)(watcher - ng->shard_watchers) + 1;
+}
+
+static void __np_network_shards_switch(np_state_t   *context,
+                                       np_network_t *network,
+                                       bool          start) {
+  for (uint8_t i = 0; i < network->shard_count; i++) {
+    uint8_t         shard = i + 1;
+    struct ev_loop *loop  = _np_event_get_loop_in_shard(context, shard);
+    _np_event_suspend_loop_in_shard(context, shard);
+    if (start) ev_io_start(EV_A_ & network->shard_watchers[i]);
+    else ev_io_stop(EV_A_ & network->shard_watchers[i]);
+    _np_event_reconfigure_loop_in_shard(context, shard);
+    _np_event_resume_loop_in_shard(context, shard);
+  }
+}
+
 void __np_network_get_ip_and_port(struct __np_network_data *network_data) {
   if (network_data->from.ss_family == AF_INET) {
     // AF_INET
@@ -482,13 +876,13 @@ void _np_network_accept(struct ev_loop *loop, ev_io *event, int revents) {
   np_network_t *ng    = ((_np_network_data_t *)event->data)->network;
 
   int client_fd =
-      accept(ng->socket, (struct sockaddr *)&data_container.from, &fromlen);
+      accept(event->fd, (struct sockaddr *)&data_container.from, &fromlen);
 
   if (client_fd < 0) {
     if (errno != EWOULDBLOCK && errno != EAGAIN) {
       log_msg(LOG_ERROR,
               "Could not accept socket connection on client fd %d. %s (%d)",
-              ng->socket,
+              event->fd,
               strerror(errno),
               errno);
     }
@@ -497,7 +891,7 @@ void _np_network_accept(struct ev_loop *loop, ev_io *event, int revents) {
 
     log_debug_msg(LOG_NETWORK | LOG_DEBUG,
                   "accept socket from %d -> client fd: %d -> %s:%s",
-                  ng->socket,
+                  event->fd,
                   client_fd,
                   data_container.ipstr,
                   data_container.port);
@@ -513,6 +907,7 @@ void _np_network_accept(struct ev_loop *loop, ev_io *event, int revents) {
                          client_fd,
                          UNKNOWN_PROTO)) {
       new_network->is_multiuse_socket = false;
+      new_network->shard              = __np_network_shard_of(ng, event);
       // it could be a passive socket
 
       np_dhkey_t search_key =
@@ -827,13 +1222,14 @@ void _np_network_stop(np_network_t *network, bool force) {
         log_debug_msg(LOG_NETWORK | LOG_DEBUG,
                       "stopping server network %p",
                       network);
-        loop = _np_event_get_loop_in(context);
-        _np_event_suspend_loop_in(context);
+        loop = _np_event_get_loop_in_shard(context, network->shard);
+        _np_event_suspend_loop_in_shard(context, network->shard);
         ev_io_stop(EV_A_ & network->watcher_in);
         // ev_io_set(&network->watcher, network->socket, EV_NONE);
         // ev_io_start(EV_A_ &network->watcher);
-        _np_event_reconfigure_loop_in(context);
-        _np_event_resume_loop_in(context);
+        _np_event_reconfigure_loop_in_shard(context, network->shard);
+        _np_event_resume_loop_in_shard(context, network->shard);
+        __np_network_shards_switch(context, network, false);
         network->is_running &= np_network_client_started;
       }
     }
@@ -846,6 +1242,7 @@ void _np_network_stop(np_network_t *network, bool force) {
         loop = _np_event_get_loop_out(context);
         _np_event_suspend_loop_out(context);
         ev_io_stop(EV_A_ & network->watcher_out);
+        ev_timer_stop(EV_A_ & network->pacing_timer);
         // ev_io_set(&network->watcher, network->socket, EV_NONE);
         // ev_io_start(EV_A_ &network->watcher);
         _np_event_reconfigure_loop_out(context);
@@ -871,13 +1268,14 @@ void _np_network_start(np_network_t *network, bool force) {
           log_debug_msg(LOG_NETWORK | LOG_DEBUG,
                         "starting server network %p",
                         network);
-          loop = _np_event_get_loop_in(context);
-          _np_event_suspend_loop_in(context);
+          loop = _np_event_get_loop_in_shard(context, network->shard);
+          _np_event_suspend_loop_in_shard(context, network->shard);
           ev_io_start(EV_A_ & network->watcher_in);
           // ev_io_set(&network->watcher, network->socket, EV_NONE);
           // ev_io_start(EV_A_ &network->watcher);
-          _np_event_reconfigure_loop_in(context);
-          _np_event_resume_loop_in(context);
+          _np_event_reconfigure_loop_in_shard(context, network->shard);
+          _np_event_resume_loop_in_shard(context, network->shard);
+          __np_network_shards_switch(context, network, true);
           network->is_running |= np_network_server_started;
         }
       }
@@ -914,28 +1312,51 @@ void _np_network_t_del(np_state_t       *context,
   //_np_network_stop(network, true);
   // network->watcher.data = NULL;
   _LOCK_ACCESS(&network->access_lock) {
-    if (NULL != network->out_events) {
-      if (0 < sll_size(network->out_events)) {
-        do {
-          void *drop_package = sll_head(void_ptr, network->out_events);
-          log_info(LOG_NETWORK | LOG_ROUTING | LOG_EXPERIMENT,
-                   "Dropping data package due to network cleanup");
-          np_unref_obj(BLOB_1024, drop_package, ref_obj_creation);
-
-        } while (0 < sll_size(network->out_events));
-      }
-      sll_free(void_ptr, network->out_events);
+    // a paced network may still have its timer on the out loop
+    if (ev_is_active(&network->pacing_timer)) {
+      EV_P = _np_event_get_loop_out(context);
+      _np_event_suspend_loop_out(context);
+      ev_timer_stop(EV_A_ & network->pacing_timer);
+      _np_event_resume_loop_out(context);
+    }
+
+    void *drop_package = NULL;
+    while (NULL != (drop_package = _np_network_dequeue(network))) {
+      log_info(LOG_NETWORK | LOG_ROUTING | LOG_EXPERIMENT,
+               "Dropping data package due to network cleanup");
+      np_unref_obj(BLOB_1024, drop_package, ref_obj_creation);
+    }
+    while (!sll_empty(network->out_queue.deferred)) {
+      __np_network_deferred_t *deferred =
+          sll_head(void_ptr, network->out_queue.deferred);
+      np_unref_obj(BLOB_1024, deferred->chunk, ref_obj_creation);
+      free(deferred);
     }
+    sll_free(void_ptr, network->out_queue.control);
+    sll_free(void_ptr, network->out_queue.active);
+    sll_free(void_ptr, network->out_queue.deferred);
+    np_tree_free(network->out_queue.flows);
+    np_tree_free(network->out_queue.send_classes);
   }
 
   free(network->watcher_in.data);
   free(network->watcher_out.data);
   free(network->remote_addr);
 
+  // the shard watchers must not stay on their loops when they are freed
+  for (uint8_t i = 0; i < network->shard_count; i++) {
+    if (ev_is_active(&network->shard_watchers[i])) {
+      __np_network_shards_switch(context, network, false);
+      break;
+    }
+  }
   if ((network->socket >= 0) && !network->is_multiuse_socket) {
     log_info(LOG_NETWORK, "Closing network %p due to object deletion", network);
     __np_network_close(network);
   }
+  free(network->shard_watchers);
+  network->shard_watchers = NULL;
+  network->shard_count    = 0;
 
   freeaddrinfo(network->addr_in);
   network->initialized = false;
@@ -954,7 +1375,6 @@ void _np_network_t_new(np_state_t       *context,
   ng->is_multiuse_socket = false;
   ng->socket             = -1;
   ng->addr_in            = NULL;
-  ng->out_events         = NULL;
   ng->initialized        = false;
   ng->is_running         = np_network_stopped;
   ng->watcher_in.data    = NULL;
@@ -967,11 +1387,34 @@ void _np_network_t_new(np_state_t       *context,
   ng->ip[0]   = 0;
   ng->port[0] = 0;
 
+  ng->shard          = 0;
+  ng->shard_count    = 0;
+  ng->shard_watchers = NULL;
+
   ng->watcher_in.data = calloc(1, sizeof(_np_network_data_t));
   CHECK_MALLOC(ng->watcher_in.data);
   ng->watcher_out.data = calloc(1, sizeof(_np_network_data_t));
   CHECK_MALLOC(ng->watcher_out.data);
 
+  ng->out_queue.retry        = NULL;
+  ng->out_queue.flows        = np_tree_create();
+  ng->out_queue.send_classes = np_tree_create();
+  ng->out_queue.data_size    = 0;
+  sll_init(void_ptr, ng->out_queue.control);
+  sll_init(void_ptr, ng->out_queue.active);
+  sll_init(void_ptr, ng->out_queue.deferred);
+  ng->out_queue.deferred_pending = false;
+
+  ng->pacing.cwnd         = NP_NETWORK_PACING_INITIAL_CWND;
+  ng->pacing.ssthresh     = NP_NETWORK_PACING_MAX_CWND;
+  ng->pacing.srtt         = 0.0;
+  ng->pacing.tokens       = NP_NETWORK_PACING_INITIAL_CWND;
+  ng->pacing.refilled_at  = np_time_now();
+  ng->pacing.decreased_at = 0.0;
+  __np_network_pacing_set_rate(&ng->pacing);
+  ev_timer_init(&ng->pacing_timer, __np_network_pacing_resume, 0.0, 0.0);
+  ng->pacing_timer.data = ng->watcher_out.data;
+
   char mutex_str[64];
   snprintf(mutex_str, 63, "%s:%p", "urn:np:network:access", ng);
   _np_threads_mutex_init(context, &ng->access_lock, "network access_lock");
@@ -1017,6 +1460,73 @@ void __set_keepalive(int socket) {
  * if "prepared_socket_fd" > 0 no new connection will be created, instead the
  *client_fd will be set to "prepared_socket_fd"
  **/
+/**
+ * opens a socket for each additional ingress shard on the address of the
+ * listening socket of ng. A shard which cannot be opened is logged and
+ * skipped, the main socket keeps receiving in any case.
+ */
+static void __np_network_open_shards(np_state_t      *context,
+                                     np_network_t    *ng,
+                                     enum socket_type type) {
+#ifdef SO_REUSEPORT
+  uint8_t shards = _np_event_in_shard_count(context);
+  if (shards < 2) return;
+
+  // use the bound address, the port of the main socket could be ephemeral
+  struct sockaddr_storage addr     = {0};
+  socklen_t               addr_len = sizeof(addr);
+  if (0 != getsockname(ng->socket, (struct sockaddr *)&addr, &addr_len)) {
+    log_error("network: %p getsockname failed: %s", ng, strerror(errno));
+    return;
+  }
+
+  ng->shard_watchers = calloc(shards - 1, sizeof(ev_io));
+  CHECK_MALLOC(ng->shard_watchers);
+
+  int one = 1;
+  for (uint8_t i = 1; i < shards; i++) {
+    int fd = socket(ng->addr_in->ai_family,
+                    ng->addr_in->ai_socktype,
+                    ng->addr_in->ai_protocol);
+    if (0 > fd) {
+      log_error("could not create socket: %s", strerror(errno));
+      break;
+    }
+    if (FLAG_CMP(type, IPv6)) {
+      __set_v6_only_false(fd);
+    }
+    if (-1 == setsockopt(fd,
+                         SOL_SOCKET,
+                         SO_REUSEPORT,
+                         (void *)&one,
+                         sizeof(one)) ||
+        0 > bind(fd, (struct sockaddr *)&addr, addr_len) ||
+        (FLAG_CMP(type, TCP) && 0 > listen(fd, 10))) {
+      log_error("network: %p could not open ingress shard %" PRIu8 ": %s",
+                ng,
+                i,
+                strerror(errno));
+      close(fd);
+      break;
+    }
+    __set_non_blocking(fd);
+
+    ev_io *watcher = &ng->shard_watchers[ng->shard_count];
+    ev_io_init(watcher,
+               FLAG_CMP(type, TCP) ? _np_network_accept : _np_network_read,
+               fd,
+               EV_READ);
+    watcher->data = ng->watcher_in.data;
+    ng->shard_count++;
+  }
+  log_debug_msg(LOG_NETWORK,
+                "%p -> %d network is receiving on %" PRIu8 " shards",
+                ng,
+                ng->socket,
+                ng->shard_count + 1);
+#endif
+}
+
 bool _np_network_init(np_network_t    *ng,
                       bool             create_server,
                       enum socket_type type,
@@ -1045,9 +1555,6 @@ bool _np_network_init(np_network_t    *ng,
 
   log_debug_msg(LOG_NETWORK | LOG_DEBUG, "done get_network_address");
 
-  // only need for client setup, but initialize to have zero size of list
-  if (ng->out_events == NULL) sll_init(void_ptr, ng->out_events);
-
   // create an inbound socket - happens only once per target_node
   if (true == create_server) {
     log_debug_msg(LOG_NETWORK | LOG_DEBUG, "creating receiving network");
@@ -1082,6 +1589,21 @@ bool _np_network_init(np_network_t    *ng,
         __np_network_close(ng);
         return false;
       }
+#ifdef SO_REUSEPORT
+      // all ingress shards listen on the same port
+      if (_np_event_in_shard_count(context) > 1 &&
+          -1 == setsockopt(ng->socket,
+                           SOL_SOCKET,
+                           SO_REUSEPORT,
+                           (void *)&one,
+                           sizeof(one))) {
+        log_error("network: %p setsockopt (SO_REUSEPORT): %s: ",
+                  ng,
+                  strerror(errno));
+        __np_network_close(ng);
+        return false;
+      }
+#endif
       if (0 > bind(ng->socket, ng->addr_in->ai_addr, ng->addr_in->ai_addrlen)) {
         // UDP note: not using a connected socket for sending messages to a
         // different target_node leads to unreliable delivery. The sending
@@ -1103,6 +1625,7 @@ bool _np_network_init(np_network_t    *ng,
         __np_network_close(ng);
         return false;
       }
+      __np_network_open_shards(context, ng, type);
     }
 
     if (FLAG_CMP(type, IPv6)) {
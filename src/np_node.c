@@ -69,6 +69,7 @@ void _np_node_t_new(np_state_t       *context,
   entry->join_send_at        = 0.0;
   entry->joined_network      = false;
   entry->handshake_priority  = randombytes_random();
+  entry->capabilities        = np_node_capability_none;
   entry->connection_attempts = 0;
 
   entry->next_routing_table_update =
@@ -463,6 +464,19 @@ int _np_node_cmp(np_node_t *a, np_node_t *b) {
   return ret;
 }
 
+bool _np_node_has_capability(np_state_t             *context,
+                             np_dhkey_t              node_dhkey,
+                             enum np_node_capability capability) {
+  bool      ret      = false;
+  np_key_t *node_key = _np_keycache_find(context, node_dhkey);
+  if (node_key != NULL) {
+    np_node_t *node = _np_key_get_node(node_key);
+    if (node != NULL) ret = FLAG_CMP(node->capabilities, capability);
+    np_unref_obj(np_key_t, node_key, "_np_keycache_find");
+  }
+  return ret;
+}
+
 void _np_node_update(np_node_t       *node,
                      enum socket_type proto,
                      char            *hn,
@@ -33,6 +33,19 @@
 #include "np_types.h"
 #include "np_util.h"
 
+// contiguous copy of the leafset (right leafset first) followed by the routing
+// table entries ordered by row, rebuilt by the next lookup after a change
+struct __np_route_snapshot_s {
+  bool        dirty;
+  uint32_t    size;
+  uint32_t    leaf_count;
+  uint32_t    row_start[__MAX_ROW + 1];
+  np_dhkey_t *dhkeys;
+  np_key_t  **keys;
+  // link quality of the table entries, only valid within a single lookup
+  uint8_t    *good_link;
+};
+
 np_module_struct(route) {
   np_state_t *context;
   np_key_t   *my_key;
@@ -50,6 +63,8 @@ np_module_struct(route) {
 
   TSP(uint32_t, leafset_left_count);
   TSP(uint32_t, leafset_right_count);
+
+  struct __np_route_snapshot_s snapshot;
 };
 
 void _np_route_append_leafset_to_sll(np_key_ptr_sll_t *left_leafset,
@@ -98,6 +113,8 @@ bool _np_route_init(np_state_t *context, np_key_t *me) {
 
     _module->leafset_size = context->settings->leafset_size;
 
+    _module->snapshot.dirty = true;
+
     sll_init(np_key_ptr, _module->left_leafset);
     sll_init(np_key_ptr, _module->right_leafset);
 
@@ -169,6 +186,10 @@ void _np_route_destroy(np_state_t *context) {
     sll_free(np_key_ptr, _module->left_leafset);
     sll_free(np_key_ptr, _module->right_leafset);
 
+    free(_module->snapshot.dhkeys);
+    free(_module->snapshot.keys);
+    free(_module->snapshot.good_link);
+
     np_module_free(route);
   }
 }
@@ -298,6 +319,7 @@ void _np_route_leafset_update(np_key_t  *node_key,
 
     if (deleted_from != NULL || add_to != NULL) {
       _np_route_leafset_range_update(context);
+      np_module(route)->snapshot.dirty = true;
     }
 
     if (add_to != NULL) {
@@ -453,6 +475,165 @@ void _np_route_append_leafset_to_sll(np_key_ptr_sll_t *leafset,
   }
 }
 
+// rebuilds the contiguous copy of leafset and routing table if required, the
+// route module lock has to be held by the caller
+static void __np_route_snapshot_update(np_state_t *context) {
+  struct __np_route_snapshot_s *snapshot = &np_module(route)->snapshot;
+  if (!snapshot->dirty) return;
+
+  uint32_t size = sll_size(np_module(route)->right_leafset) +
+                  sll_size(np_module(route)->left_leafset);
+  for (uint16_t index = 0; index < NP_ROUTES_TABLE_SIZE; index++) {
+    if (np_module(route)->table[index] != NULL) size++;
+  }
+
+  if (size > snapshot->size) {
+    snapshot->dhkeys    = realloc(snapshot->dhkeys, size * sizeof(np_dhkey_t));
+    snapshot->keys      = realloc(snapshot->keys, size * sizeof(np_key_t *));
+    snapshot->good_link = realloc(snapshot->good_link, size);
+    CHECK_MALLOC(snapshot->dhkeys);
+    CHECK_MALLOC(snapshot->keys);
+    CHECK_MALLOC(snapshot->good_link);
+    snapshot->size = size;
+  }
+
+  uint32_t pos = 0;
+  // same order as _np_route_lookup builds its list of candidates
+  np_key_ptr_sll_t *leafsets[2] = {np_module(route)->right_leafset,
+                                   np_module(route)->left_leafset};
+  for (uint8_t l = 0; l < 2; l++) {
+    sll_iterator(np_key_ptr) iter = sll_first(leafsets[l]);
+    while (iter != NULL) {
+      if (iter->val != NULL) {
+        snapshot->dhkeys[pos] = iter->val->dhkey;
+        snapshot->keys[pos++] = iter->val;
+      }
+      sll_next(iter);
+    }
+  }
+  snapshot->leaf_count = pos;
+
+  for (uint16_t i = 0; i < __MAX_ROW; i++) {
+    snapshot->row_start[i] = pos;
+    for (uint16_t index = i * __MAX_COL * __MAX_ENTRY;
+         index < (i + 1) * __MAX_COL * __MAX_ENTRY;
+         index++) {
+      np_key_t *key = np_module(route)->table[index];
+      if (key != NULL) {
+        snapshot->dhkeys[pos] = key->dhkey;
+        snapshot->keys[pos++] = key;
+      }
+    }
+  }
+  snapshot->row_start[__MAX_ROW] = pos;
+  snapshot->dirty                = false;
+}
+
+// the single next hop for #key#, the same choice as _np_route_lookup with a
+// count of one. checked_rows marks the rows with an up to date link quality.
+// The route module lock has to be held by the caller.
+static np_key_t *__np_route_next_hop(np_state_t       *context,
+                                     const np_dhkey_t *key,
+                                     uint64_t         *checked_rows) {
+  struct __np_route_snapshot_s *snapshot = &np_module(route)->snapshot;
+  np_dhkey_t                    leaf_dif, row_dif;
+  uint32_t                      leaf_min = snapshot->leaf_count;
+
+  if (_np_dhkey_between(key,
+                        &np_module(route)->Lrange,
+                        &np_module(route)->Rrange,
+                        true)) {
+    leaf_min = _np_dhkey_closest(key,
+                                 snapshot->dhkeys,
+                                 NULL,
+                                 snapshot->leaf_count,
+                                 &leaf_dif);
+    return (leaf_min < snapshot->leaf_count) ? snapshot->keys[leaf_min] : NULL;
+  }
+
+  uint16_t i = _np_dhkey_index(&np_module(route)->my_key->dhkey, key);
+  ASSERT(i < __MAX_ROW, "index out of routing table bounds.");
+
+  // a matching next hop with a good link (fast routing)
+  uint8_t   match_col = _np_dhkey_hexalpha_at(context, key, i);
+  int       index     = __MAX_ENTRY * (match_col + (__MAX_COL * (i)));
+  np_key_t *hop       = NULL;
+  for (uint8_t k = 0; k < __MAX_ENTRY; k++) {
+    np_key_t *entry = np_module(route)->table[index + k];
+    if (entry != NULL && _np_key_get_node(entry)->success_avg > BAD_LINK) {
+      hop = entry;
+      break;
+    }
+  }
+  if (hop != NULL) {
+    for (uint8_t k = 0; k < __MAX_ENTRY; k++) {
+      np_key_t *entry = np_module(route)->table[index + k];
+      if (entry == NULL || _np_dhkey_equal(&entry->dhkey, &hop->dhkey))
+        continue;
+      np_node_t *hop_node   = _np_key_get_node(hop);
+      np_node_t *entry_node = _np_key_get_node(entry);
+      // normalize values
+      double metric_1 = 1.0 - hop_node->success_avg + hop_node->latency;
+      double metric_2 = 1.0 - entry_node->success_avg + entry_node->latency;
+      if (metric_1 > metric_2) hop = entry;
+    }
+    return hop;
+  }
+
+  // the closest key of leafset and the good links of the matching row
+  leaf_min = _np_dhkey_closest(key,
+                               snapshot->dhkeys,
+                               NULL,
+                               snapshot->leaf_count,
+                               &leaf_dif);
+
+  uint32_t row_start = snapshot->row_start[i];
+  uint32_t row_count = snapshot->row_start[i + 1] - row_start;
+  if ((*checked_rows & (1ULL << i)) == 0) {
+    for (uint32_t pos = row_start; pos < row_start + row_count; pos++) {
+      snapshot->good_link[pos] =
+          _np_key_get_node(snapshot->keys[pos])->success_avg > BAD_LINK;
+    }
+    *checked_rows |= (1ULL << i);
+  }
+  uint32_t row_min = _np_dhkey_closest(key,
+                                       &snapshot->dhkeys[row_start],
+                                       &snapshot->good_link[row_start],
+                                       row_count,
+                                       &row_dif);
+
+  if (row_min < row_count && (leaf_min == snapshot->leaf_count ||
+                              _np_dhkey_cmp(&row_dif, &leaf_dif) <= 0)) {
+    return snapshot->keys[row_start + row_min];
+  }
+  return (leaf_min < snapshot->leaf_count) ? snapshot->keys[leaf_min] : NULL;
+}
+
+uint32_t _np_route_lookup_batch(np_state_t       *context,
+                                const np_dhkey_t *targets,
+                                uint32_t          count,
+                                np_key_t        **next_hops) {
+  uint32_t found        = 0;
+  uint64_t checked_rows = 0;
+
+  _LOCK_MODULE(np_routeglobal_t) {
+    __np_route_snapshot_update(context);
+
+    for (uint32_t t = 0; t < count; t++) {
+      next_hops[t] = __np_route_next_hop(context, &targets[t], &checked_rows);
+      if (next_hops[t] != NULL) {
+        np_ref_obj(np_key_t, next_hops[t]);
+        found++;
+      }
+    }
+  }
+  log_debug_msg(LOG_ROUTING,
+                "resolved %" PRIu32 " of %" PRIu32 " targets",
+                found,
+                count);
+  return found;
+}
+
 /** _np_route_lookup:
  ** returns an array of #count# keys that are acceptable next hops for a
  ** message being routed to #key#.
@@ -483,6 +664,24 @@ sll_return(np_key_ptr)
     _np_dhkey_str(&key, key_as_str);
     log_debug_msg(LOG_ROUTING | LOG_DEBUG, "TARGET: %s", key_as_str);
 #endif
+
+    // a single next hop is picked from the contiguous copy of the table
+    if (count == 1) {
+      uint64_t checked_rows = 0;
+      __np_route_snapshot_update(context);
+      min = __np_route_next_hop(context, &key, &checked_rows);
+      if (NULL != min) {
+        np_ref_obj(np_key_t, min);
+        sll_append(np_key_ptr, return_list, min);
+        log_debug_msg(LOG_ROUTING | LOG_DEBUG,
+                      "++NEXT_HOP = %s",
+                      _np_key_as_str(min));
+      }
+      sll_free(np_key_ptr, key_list);
+      _np_threads_unlock_module(context, np_routeglobal_t_lock);
+      log_trace_msg(LOG_TRACE | LOG_ROUTING, ".end  .route_lookup");
+      return (return_list);
+    }
     /*calculate the leafset and table size */
     Lsize = sll_size(np_module(route)->left_leafset);
     Rsize = sll_size(np_module(route)->right_leafset);
@@ -927,6 +1126,10 @@ void _np_route_update(np_key_t  *key,
       TSP_SET(np_module(route)->route_count, np_module(route)->route_count - 1);
     }
 
+    if (add_to != NULL || deleted_from != NULL) {
+      np_module(route)->snapshot.dirty = true;
+    }
+
 #ifdef DEBUG
     if (add_to != NULL && deleted_from != NULL) {
       log_debug_msg(LOG_ROUTING | LOG_DEBUG,
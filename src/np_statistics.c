@@ -7,6 +7,7 @@
 
 #include <inttypes.h>
 #include <math.h>
+#include <sched.h>
 #include <stdint.h>
 
 #include "prometheus/prometheus.h"
@@ -129,11 +130,54 @@ bool __np_statistics_gather_data_clb(np_state_t               *context,
 
   return true;
 }
+static void __np_statistics_release_metrics(char *body, void *user_arg) {
+  np_state_t *context = user_arg;
+  if (np_module_initiated(statistics) &&
+      body == np_module(statistics)->_prometheus_buffer)
+    __atomic_store_n(&np_module(statistics)->_prometheus_buffer_busy,
+                     false,
+                     __ATOMIC_RELEASE);
+  else free(body);
+}
+
 int _np_http_handle_metrics(ht_request_t  *request,
                             ht_response_t *ret,
-                            void          *context) {
-  ret->ht_body   = np_statistics_prometheus_export(context);
-  ret->ht_status = HTTP_CODE_OK;
+                            void          *user_arg) {
+  np_state_t *context = user_arg;
+  np_module_var(statistics);
+
+  char  *body   = NULL;
+  size_t length = 0;
+  bool   busy   = false; // stays false if this scrape claims the buffer
+  if (__atomic_compare_exchange_n(&_module->_prometheus_buffer_busy,
+                                  &busy,
+                                  true,
+                                  false,
+                                  __ATOMIC_ACQ_REL,
+                                  __ATOMIC_ACQUIRE)) {
+    length = prometheus_format_into(_module->_prometheus_context,
+                                    &_module->_prometheus_buffer,
+                                    &_module->_prometheus_buffer_size);
+    body   = _module->_prometheus_buffer;
+  } else {
+    size_t body_size = 0;
+    length =
+        prometheus_format_into(_module->_prometheus_context, &body, &body_size);
+  }
+  // a failed render is not answered with an empty exposition
+  if (length == 0) {
+    if (!busy)
+      __atomic_store_n(&_module->_prometheus_buffer_busy,
+                       false,
+                       __ATOMIC_RELEASE);
+    else free(body);
+    return HTTP_CODE_INTERNAL_SERVER_ERROR;
+  }
+
+  ret->ht_body      = body;
+  ret->release_body = __np_statistics_release_metrics;
+  ret->release_arg  = context;
+  ret->ht_status    = HTTP_CODE_OK;
   np_tree_insert_str(ret->ht_header,
                      "Content-Type",
                      np_treeval_new_s("text/plain; version=0.0.4"));
@@ -143,6 +187,12 @@ bool _np_statistics_init(np_state_t *context) {
 
   if (!np_module_initiated(statistics)) {
     np_module_malloc(statistics);
+#ifdef NP_BENCHMARKING
+    // performance points are active as soon as the module exists
+    pthread_key_create(&_module->__performance_key, NULL);
+    np_spinlock_init(&_module->__performance_lock, PTHREAD_PROCESS_PRIVATE);
+    _module->__performance_shards = NULL;
+#endif
 
     uint32_t cache_size = SIMPLE_CACHE_NR_BUCKETS;
     char     random_seed[crypto_shorthash_KEYBYTES];
@@ -152,9 +202,16 @@ bool _np_statistics_init(np_state_t *context) {
 
     sll_init(np_dhkey_t, _module->__watched_subjects);
 
-    _module->_per_subject_metrics = np_tree_create();
-    _module->_per_dhkey_metrics   = np_tree_create();
-    _module->startup_time         = np_time_now();
+    _module->_per_subject_metrics =
+        calloc(NP_STATISTICS_METRICS_SLOTS,
+               sizeof(np_statistics_metrics_slot_t));
+    _module->_per_dhkey_metrics =
+        calloc(NP_STATISTICS_METRICS_SLOTS,
+               sizeof(np_statistics_metrics_slot_t));
+    CHECK_MALLOC(_module->_per_subject_metrics);
+    CHECK_MALLOC(_module->_per_dhkey_metrics);
+    np_spinlock_init(&_module->_metrics_lock, PTHREAD_PROCESS_PRIVATE);
+    _module->startup_time = np_time_now();
 
     _module->_prometheus_context = prometheus_create_context(get_timestamp);
     _module->_prometheus_metrics[np_prometheus_exposed_metrics_uptime] =
@@ -205,6 +262,16 @@ bool _np_statistics_init(np_state_t *context) {
         prometheus_register_metric(_module->_prometheus_context,
                                    NP_STATISTICS_PROMETHEUS_PREFIX
                                    "pheromones_exhale");
+    _module->_prometheus_metrics
+        [np_prometheus_exposed_metrics_control_saved_chunks] =
+        prometheus_register_metric(_module->_prometheus_context,
+                                   NP_STATISTICS_PROMETHEUS_PREFIX
+                                   "control_saved_chunks");
+    _module->_prometheus_metrics
+        [np_prometheus_exposed_metrics_event_loop_wakeups] =
+        prometheus_register_metric(_module->_prometheus_context,
+                                   NP_STATISTICS_PROMETHEUS_PREFIX
+                                   "event_loop_wakeups");
 
     _module->_prometheus_metrics
         [np_prometheus_exposed_metrics_network_in_per_sec] =
@@ -218,6 +285,18 @@ bool _np_statistics_init(np_state_t *context) {
             _module->_prometheus_metrics
                 [np_prometheus_exposed_metrics_network_out],
             1);
+    _module->_prometheus_metrics
+        [np_prometheus_exposed_metrics_control_saved_chunks_per_sec] =
+        prometheus_register_sub_metric_time(
+            _module->_prometheus_metrics
+                [np_prometheus_exposed_metrics_control_saved_chunks],
+            1);
+    _module->_prometheus_metrics
+        [np_prometheus_exposed_metrics_event_loop_wakeups_per_sec] =
+        prometheus_register_sub_metric_time(
+            _module->_prometheus_metrics
+                [np_prometheus_exposed_metrics_event_loop_wakeups],
+            1);
 
     prometheus_label label;
     strncpy(label.name, "version", 255);
@@ -241,25 +320,6 @@ bool _np_statistics_init(np_state_t *context) {
     _np_statistics_update_prometheus_labels(context, NULL);
 #ifdef DEBUG_CALLBACKS
     sll_init(void_ptr, _module->__np_debug_statistics);
-#endif
-#ifdef NP_BENCHMARKING
-    for (int container_idx = 0;
-         container_idx < np_statistics_performance_point_END;
-         container_idx++) {
-      np_statistics_performance_point_t *container =
-          &_module->performance_points[container_idx];
-      container->durations_idx   = 0;
-      container->durations_count = 0;
-      container->hit_count       = 0;
-      char mutex_str[64];
-      snprintf(mutex_str,
-               63,
-               "urn:np:statistics:%s:%s",
-               "perfpoint",
-               np_statistics_performance_point_str[container_idx]);
-      _np_threads_mutex_init(context, &container->access, mutex_str);
-      container->name = np_statistics_performance_point_str[container_idx];
-    }
 #endif
     _np_add_http_callback(context,
                           "metrics",
@@ -284,88 +344,301 @@ bool _np_statistics_enable(np_state_t *context) {
 
   return true;
 }
+static const double __np_statistics_latency_buckets[] =
+    NP_STATISTICS_LATENCY_BUCKETS;
+#define __NP_STATISTICS_LATENCY_BUCKET_COUNT                                   \
+  (sizeof(__np_statistics_latency_buckets) / sizeof(double))
+
+// the per subject and per peer metric structs consist of prometheus metrics
+// only. A released slot keeps its metrics and hands them to the next key.
+typedef struct np_statistics_metrics_type_s {
+  size_t metrics_count;
+  void (*label)(np_dhkey_t key, prometheus_label *label);
+  void *(*create)(np_state_t *context, prometheus_label label);
+} np_statistics_metrics_type_t;
+
+static void __np_statistics_metrics_reuse(void             *metrics,
+                                          size_t            metrics_count,
+                                          prometheus_label *label) {
+  prometheus_metric **metric = metrics;
+  for (size_t i = 0; i < metrics_count; i++) {
+    prometheus_metric_replace_label(metric[i], *label);
+    prometheus_metric_reset(metric[i]);
+    prometheus_enable_value_output(metric[i]);
+  }
+}
+
+// returns the metrics of key, creates them on first sight. Returns NULL if
+// the table is full. Known keys are found without a lock, slots are only
+// claimed and released under the metrics lock. A lookup racing with the reuse
+// of a released slot may miss it and takes the locked path.
+static void *
+__np_statistics_metrics_lookup(np_state_t                         *context,
+                               np_statistics_metrics_slot_t       *table,
+                               np_dhkey_t                          key,
+                               const np_statistics_metrics_type_t *type) {
+  np_module_var(statistics);
+  uint32_t slot = key.t[0] & (NP_STATISTICS_METRICS_SLOTS - 1);
+
+  for (uint32_t i = 0; i < NP_STATISTICS_METRICS_SLOTS; i++) {
+    np_statistics_metrics_slot_t *current =
+        &table[(slot + i) & (NP_STATISTICS_METRICS_SLOTS - 1)];
+
+    uint8_t state = __atomic_load_n(&current->state, __ATOMIC_ACQUIRE);
+    while (state == np_statistics_metrics_slot_claimed) {
+      sched_yield();
+      state = __atomic_load_n(&current->state, __ATOMIC_ACQUIRE);
+    }
+    // released slots keep the probe sequence of later keys intact
+    if (state == np_statistics_metrics_slot_empty) break;
+    if (state == np_statistics_metrics_slot_ready &&
+        _np_dhkey_equal(&current->key, &key))
+      return current->metrics;
+  }
+
+  void                         *ret       = NULL;
+  np_statistics_metrics_slot_t *free_slot = NULL;
+  np_spinlock_lock(&_module->_metrics_lock);
+  for (uint32_t i = 0; i < NP_STATISTICS_METRICS_SLOTS; i++) {
+    np_statistics_metrics_slot_t *current =
+        &table[(slot + i) & (NP_STATISTICS_METRICS_SLOTS - 1)];
+
+    uint8_t state = __atomic_load_n(&current->state, __ATOMIC_ACQUIRE);
+    if (state == np_statistics_metrics_slot_ready &&
+        _np_dhkey_equal(&current->key, &key)) {
+      ret = current->metrics;
+      break;
+    }
+    if (state != np_statistics_metrics_slot_ready && free_slot == NULL)
+      free_slot = current;
+    if (state == np_statistics_metrics_slot_empty) break;
+  }
+
+  if (ret == NULL && free_slot != NULL) {
+    __atomic_store_n(&free_slot->state,
+                     np_statistics_metrics_slot_claimed,
+                     __ATOMIC_RELEASE);
+    prometheus_label label = {0};
+    type->label(key, &label);
+    free_slot->key = key;
+    if (free_slot->metrics == NULL)
+      free_slot->metrics = type->create(context, label);
+    else
+      __np_statistics_metrics_reuse(free_slot->metrics,
+                                    type->metrics_count,
+                                    &label);
+    __atomic_store_n(&free_slot->state,
+                     np_statistics_metrics_slot_ready,
+                     __ATOMIC_RELEASE);
+    ret = free_slot->metrics;
+  }
+  np_spinlock_unlock(&_module->_metrics_lock);
+  return ret;
+}
+
+// leaves the metrics of key out of the exposition and releases their slot
+static void
+__np_statistics_metrics_release(np_state_t                         *context,
+                                np_statistics_metrics_slot_t       *table,
+                                np_dhkey_t                          key,
+                                const np_statistics_metrics_type_t *type) {
+  np_module_var(statistics);
+  uint32_t slot = key.t[0] & (NP_STATISTICS_METRICS_SLOTS - 1);
+
+  np_spinlock_lock(&_module->_metrics_lock);
+  for (uint32_t i = 0; i < NP_STATISTICS_METRICS_SLOTS; i++) {
+    np_statistics_metrics_slot_t *current =
+        &table[(slot + i) & (NP_STATISTICS_METRICS_SLOTS - 1)];
+
+    uint8_t state = __atomic_load_n(&current->state, __ATOMIC_ACQUIRE);
+    if (state == np_statistics_metrics_slot_empty) break;
+    if (state == np_statistics_metrics_slot_ready &&
+        _np_dhkey_equal(&current->key, &key)) {
+      prometheus_metric **metric = current->metrics;
+      for (size_t m = 0; m < type->metrics_count; m++)
+        prometheus_disable_value_output(metric[m]);
+      __atomic_store_n(&current->state,
+                       np_statistics_metrics_slot_released,
+                       __ATOMIC_RELEASE);
+      break;
+    }
+  }
+  np_spinlock_unlock(&_module->_metrics_lock);
+}
+
+static prometheus_metric *
+__np_statistics_add_labels(np_state_t        *context,
+                           prometheus_metric *metric,
+                           prometheus_label   label) {
+  prometheus_metric_add_label(metric, label);
+  _np_statistics_update_prometheus_labels(context, metric);
+  return metric;
+}
+
 typedef struct np_statistics_per_subject_metrics_s {
   prometheus_metric *received_msgs;
   prometheus_metric *send_msgs;
+  prometheus_metric *msgcache_size;
+  prometheus_metric *msgcache_dropped;
+  prometheus_metric *end_to_end_latency;
+  prometheus_metric *reassembly_time;
 } np_statistics_per_subject_metrics;
 
-np_statistics_per_subject_metrics *
-__np_statistics_get_subject_metrics(np_state_t *context,
-                                    np_dhkey_t  subject_dhkey) {
-  np_statistics_per_subject_metrics *ret;
+static void __np_statistics_subject_label(np_dhkey_t        subject_dhkey,
+                                          prometheus_label *label) {
+  strncpy(label->name, "subject", 255);
+  sodium_bin2hex(label->value, 65, &subject_dhkey, 32);
+}
 
+static void *__np_statistics_create_subject_metrics(np_state_t      *context,
+                                                    prometheus_label label) {
   np_module_var(statistics);
-  np_tree_elem_t *element =
-      np_tree_find_dhkey(_module->_per_subject_metrics, subject_dhkey);
+  prometheus_context *prometheus = _module->_prometheus_context;
 
-  if (element == NULL) {
-    prometheus_label label;
-    strncpy(label.name, "subject", 255);
-    sodium_bin2hex(label.value, 65, &subject_dhkey, 32);
-    ret = calloc(1, sizeof(np_statistics_per_subject_metrics));
+  np_statistics_per_subject_metrics *ret =
+      calloc(1, sizeof(np_statistics_per_subject_metrics));
+  CHECK_MALLOC(ret);
 
-    ret->received_msgs = prometheus_register_metric(
-        _module->_prometheus_context,
-        NP_STATISTICS_PROMETHEUS_PREFIX "received_msgs");
-    prometheus_metric_add_label(ret->received_msgs, label);
-    _np_statistics_update_prometheus_labels(context, ret->received_msgs);
+  ret->received_msgs = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX
+                                "received_msgs"),
+      label);
+  ret->send_msgs = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX "send_msgs"),
+      label);
+  ret->msgcache_size = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX
+                                "msgcache_size"),
+      label);
+  ret->msgcache_dropped = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX
+                                "msgcache_dropped"),
+      label);
+  ret->end_to_end_latency = __np_statistics_add_labels(
+      context,
+      prometheus_register_histogram(prometheus,
+                                    NP_STATISTICS_PROMETHEUS_PREFIX
+                                    "end_to_end_latency_seconds",
+                                    __np_statistics_latency_buckets,
+                                    __NP_STATISTICS_LATENCY_BUCKET_COUNT),
+      label);
+  ret->reassembly_time = __np_statistics_add_labels(
+      context,
+      prometheus_register_histogram(prometheus,
+                                    NP_STATISTICS_PROMETHEUS_PREFIX
+                                    "reassembly_seconds",
+                                    __np_statistics_latency_buckets,
+                                    __NP_STATISTICS_LATENCY_BUCKET_COUNT),
+      label);
 
-    ret->send_msgs =
-        prometheus_register_metric(_module->_prometheus_context,
-                                   NP_STATISTICS_PROMETHEUS_PREFIX "send_msgs");
-    prometheus_metric_add_label(ret->send_msgs, label);
-    _np_statistics_update_prometheus_labels(context, ret->send_msgs);
+  return ret;
+}
 
-    np_tree_insert_dhkey(np_module(statistics)->_per_subject_metrics,
-                         subject_dhkey,
-                         np_treeval_new_v(ret));
-  } else {
-    ret = element->val.value.v;
-  }
+static const np_statistics_metrics_type_t
+    __np_statistics_subject_metrics_type = {
+        .metrics_count = sizeof(np_statistics_per_subject_metrics) /
+                         sizeof(prometheus_metric *),
+        .label         = __np_statistics_subject_label,
+        .create        = __np_statistics_create_subject_metrics,
+};
 
-  return ret;
+np_statistics_per_subject_metrics *
+__np_statistics_get_subject_metrics(np_state_t *context,
+                                    np_dhkey_t  subject_dhkey) {
+  return __np_statistics_metrics_lookup(
+      context,
+      np_module(statistics)->_per_subject_metrics,
+      subject_dhkey,
+      &__np_statistics_subject_metrics_type);
 }
 
 typedef struct np_statistics_per_dhkey_metrics_s {
   prometheus_metric *latency;
   prometheus_metric *success_avg;
+  prometheus_metric *send_window;
+  prometheus_metric *pacing_rate;
+  prometheus_metric *send_queue_size;
+  prometheus_metric *send_to_ack_latency;
 } np_statistics_per_dhkey_metrics;
 
-np_statistics_per_dhkey_metrics *
-__np_statistics_get_dhkey_metrics(np_state_t *context, np_dhkey_t id) {
-  np_statistics_per_dhkey_metrics *ret;
+static void __np_statistics_dhkey_label(np_dhkey_t        id,
+                                        prometheus_label *label) {
+  strncpy(label->name, "target", 255);
+  _np_dhkey_str(&id, label->value);
+}
 
+static void *__np_statistics_create_dhkey_metrics(np_state_t      *context,
+                                                  prometheus_label label) {
   np_module_var(statistics);
-  np_tree_elem_t *element = np_tree_find_dhkey(_module->_per_dhkey_metrics, id);
+  prometheus_context *prometheus = _module->_prometheus_context;
 
-  if (element == NULL) {
-    prometheus_label label;
-    strncpy(label.name, "target", 255);
-    _np_dhkey_str(&id, label.value);
-    ret = calloc(1, sizeof(np_statistics_per_dhkey_metrics));
+  np_statistics_per_dhkey_metrics *ret =
+      calloc(1, sizeof(np_statistics_per_dhkey_metrics));
+  CHECK_MALLOC(ret);
 
-    ret->latency =
-        prometheus_register_metric(_module->_prometheus_context,
-                                   NP_STATISTICS_PROMETHEUS_PREFIX "latency");
-    prometheus_metric_add_label(ret->latency, label);
-    _np_statistics_update_prometheus_labels(context, ret->latency);
-
-    ret->success_avg = prometheus_register_metric(
-        _module->_prometheus_context,
-        NP_STATISTICS_PROMETHEUS_PREFIX "success_avg");
-    prometheus_metric_add_label(ret->success_avg, label);
-    _np_statistics_update_prometheus_labels(context, ret->success_avg);
-
-    np_tree_insert_dhkey(np_module(statistics)->_per_dhkey_metrics,
-                         id,
-                         np_treeval_new_v(ret));
-  } else {
-    ret = element->val.value.v;
-  }
+  ret->latency = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX "latency"),
+      label);
+  ret->success_avg = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX "success_avg"),
+      label);
+  ret->send_window = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX "send_window"),
+      label);
+  ret->pacing_rate = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX "pacing_rate"),
+      label);
+  ret->send_queue_size = __np_statistics_add_labels(
+      context,
+      prometheus_register_gauge(prometheus,
+                                NP_STATISTICS_PROMETHEUS_PREFIX
+                                "send_queue_size"),
+      label);
+  ret->send_to_ack_latency = __np_statistics_add_labels(
+      context,
+      prometheus_register_histogram(prometheus,
+                                    NP_STATISTICS_PROMETHEUS_PREFIX
+                                    "send_to_ack_latency_seconds",
+                                    __np_statistics_latency_buckets,
+                                    __NP_STATISTICS_LATENCY_BUCKET_COUNT),
+      label);
 
   return ret;
 }
 
+static const np_statistics_metrics_type_t
+    __np_statistics_dhkey_metrics_type = {
+        .metrics_count = sizeof(np_statistics_per_dhkey_metrics) /
+                         sizeof(prometheus_metric *),
+        .label         = __np_statistics_dhkey_label,
+        .create        = __np_statistics_create_dhkey_metrics,
+};
+
+np_statistics_per_dhkey_metrics *
+__np_statistics_get_dhkey_metrics(np_state_t *context, np_dhkey_t id) {
+  return __np_statistics_metrics_lookup(
+      context,
+      np_module(statistics)->_per_dhkey_metrics,
+      id,
+      &__np_statistics_dhkey_metrics_type);
+}
+
 void _np_statistics_update_prometheus_labels(np_state_t        *context,
                                              prometheus_metric *metric) {
   if (np_module_initiated(statistics)) {
@@ -450,23 +723,119 @@ void _np_statistics_destroy(np_state_t *context) {
 
     prometheus_destroy_context(_module->_prometheus_context);
 
-    np_tree_elem_t *tmp = NULL;
-
-    RB_FOREACH (tmp, np_tree_s, _module->_per_dhkey_metrics) {
-      free(tmp->val.value.v);
+    for (uint32_t i = 0; i < NP_STATISTICS_METRICS_SLOTS; i++) {
+      free(_module->_per_dhkey_metrics[i].metrics);
+      free(_module->_per_subject_metrics[i].metrics);
     }
+    free(_module->_per_dhkey_metrics);
+    free(_module->_per_subject_metrics);
+    np_spinlock_destroy(&_module->_metrics_lock);
+    // a body which is still sent is freed once it has been released
+    if (!__atomic_load_n(&_module->_prometheus_buffer_busy, __ATOMIC_ACQUIRE))
+      free(_module->_prometheus_buffer);
 
-    RB_FOREACH (tmp, np_tree_s, _module->_per_subject_metrics) {
-      free(tmp->val.value.v);
+#ifdef NP_BENCHMARKING
+    np_statistics_performance_shard_t *shard = _module->__performance_shards;
+    while (shard != NULL) {
+      np_statistics_performance_shard_t *next = shard->next;
+      free(shard);
+      shard = next;
     }
-
-    np_tree_free(_module->_per_dhkey_metrics);
-    np_tree_free(_module->_per_subject_metrics);
+    pthread_key_delete(_module->__performance_key);
+    np_spinlock_destroy(&_module->__performance_lock);
+#endif
 
     np_module_free(statistics);
   }
 }
 
+#ifdef NP_BENCHMARKING
+np_statistics_performance_shard_t *
+_np_statistics_performance_shard_new(np_state_t *context) {
+  np_module_var(statistics);
+
+  np_statistics_performance_shard_t *shard =
+      calloc(1, sizeof(np_statistics_performance_shard_t));
+  CHECK_MALLOC(shard);
+  shard->thread_id = (unsigned long)pthread_self();
+
+  np_spinlock_lock(&_module->__performance_lock);
+  shard->next                   = _module->__performance_shards;
+  _module->__performance_shards = shard;
+  np_spinlock_unlock(&_module->__performance_lock);
+
+  pthread_setspecific(_module->__performance_key, shard);
+  return shard;
+}
+
+static uint64_t __np_statistics_performance_bucket_value(uint16_t bucket) {
+  if (bucket < NP_PERFORMANCE_SUB_BUCKETS) return bucket;
+
+  // the middle of the range covered by the bucket
+  uint8_t  shift = bucket / NP_PERFORMANCE_SUB_BUCKETS - 1;
+  uint64_t lower = (uint64_t)(NP_PERFORMANCE_SUB_BUCKETS +
+                              bucket % NP_PERFORMANCE_SUB_BUCKETS)
+                   << shift;
+  return lower + ((1ULL << shift) >> 1);
+}
+
+void _np_statistics_performance_get(
+    np_state_t                            *context,
+    enum np_statistics_performance_point_e point,
+    np_statistics_performance_point_t     *result) {
+  np_module_var(statistics);
+
+  uint64_t buckets[NP_PERFORMANCE_BUCKETS] = {0};
+  uint64_t sum = 0, max = 0;
+
+  memset(result, 0, sizeof(np_statistics_performance_point_t));
+  result->name = np_statistics_performance_point_str[point];
+
+  np_spinlock_lock(&_module->__performance_lock);
+  np_statistics_performance_shard_t *shard = _module->__performance_shards;
+  for (; shard != NULL; shard = shard->next) {
+    result->hit_count +=
+        __atomic_load_n(&shard->hit_count[point], __ATOMIC_RELAXED);
+    sum += __atomic_load_n(&shard->sum[point], __ATOMIC_RELAXED);
+    max  = MAX(max, __atomic_load_n(&shard->max[point], __ATOMIC_RELAXED));
+    uint64_t *shard_buckets = shard->buckets[point];
+    for (uint16_t i = 0; i < NP_PERFORMANCE_BUCKETS; i++) {
+      buckets[i] += __atomic_load_n(&shard_buckets[i], __ATOMIC_RELAXED);
+    }
+  }
+  np_spinlock_unlock(&_module->__performance_lock);
+
+  for (uint16_t i = 0; i < NP_PERFORMANCE_BUCKETS; i++)
+    result->durations_count += buckets[i];
+  if (result->durations_count == 0) return;
+
+  uint64_t p50_rank = (result->durations_count + 1) / 2;
+  uint64_t p99_rank = (result->durations_count * 99 + 99) / 100;
+  uint64_t seen     = 0;
+  bool     has_min  = false;
+  for (uint16_t i = 0; i < NP_PERFORMANCE_BUCKETS; i++) {
+    if (buckets[i] == 0) continue;
+
+    double value = __np_statistics_performance_bucket_value(i) / 1e9;
+    if (!has_min) {
+      result->min = value;
+      has_min     = true;
+    }
+    if (seen < p50_rank && seen + buckets[i] >= p50_rank) result->p50 = value;
+    if (seen < p99_rank && seen + buckets[i] >= p99_rank) result->p99 = value;
+    seen += buckets[i];
+  }
+  // sum and buckets are written one after the other, the average may be
+  // slightly off while the point is in use
+  result->avg = (sum / 1e9) / result->durations_count;
+  // the exact maximum also bounds the values taken from the buckets
+  result->max = max / 1e9;
+  result->min = MIN(result->min, result->max);
+  result->p50 = MIN(result->p50, result->max);
+  result->p99 = MIN(result->p99, result->max);
+}
+#endif
+
 char *np_statistics_prometheus_export(np_context *ac) {
   np_ctx_cast(ac);
 
@@ -879,18 +1248,107 @@ void __np_statistics_set_latency(np_state_t *context,
                                  np_dhkey_t  id,
                                  float       value) {
   if (np_module_initiated(statistics)) {
-    prometheus_metric_set(
-        __np_statistics_get_dhkey_metrics(context, id)->latency,
-        value);
+    np_statistics_per_dhkey_metrics *metrics =
+        __np_statistics_get_dhkey_metrics(context, id);
+    if (metrics != NULL) prometheus_gauge_set(metrics->latency, value);
   }
 }
 void __np_statistics_set_success_avg(np_state_t *context,
                                      np_dhkey_t  id,
                                      float       value) {
   if (np_module_initiated(statistics)) {
-    prometheus_metric_set(
-        __np_statistics_get_dhkey_metrics(context, id)->success_avg,
-        value);
+    np_statistics_per_dhkey_metrics *metrics =
+        __np_statistics_get_dhkey_metrics(context, id);
+    if (metrics != NULL) prometheus_gauge_set(metrics->success_avg, value);
+  }
+}
+void __np_statistics_set_send_window(np_state_t *context,
+                                     np_dhkey_t  id,
+                                     float       value) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_dhkey_metrics *metrics =
+        __np_statistics_get_dhkey_metrics(context, id);
+    if (metrics != NULL) prometheus_gauge_set(metrics->send_window, value);
+  }
+}
+void __np_statistics_set_pacing_rate(np_state_t *context,
+                                     np_dhkey_t  id,
+                                     float       value) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_dhkey_metrics *metrics =
+        __np_statistics_get_dhkey_metrics(context, id);
+    if (metrics != NULL) prometheus_gauge_set(metrics->pacing_rate, value);
+  }
+}
+void __np_statistics_set_send_queue_size(np_state_t *context,
+                                         np_dhkey_t  id,
+                                         uint32_t    size) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_dhkey_metrics *metrics =
+        __np_statistics_get_dhkey_metrics(context, id);
+    if (metrics != NULL) prometheus_gauge_set(metrics->send_queue_size, size);
+  }
+}
+void __np_statistics_release_dhkey_metrics(np_state_t *context,
+                                           np_dhkey_t  id) {
+  if (np_module_initiated(statistics)) {
+    __np_statistics_metrics_release(context,
+                                    np_module(statistics)->_per_dhkey_metrics,
+                                    id,
+                                    &__np_statistics_dhkey_metrics_type);
+  }
+}
+void __np_statistics_observe_send_to_ack(np_state_t *context,
+                                         np_dhkey_t  id,
+                                         double      seconds) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_dhkey_metrics *metrics =
+        __np_statistics_get_dhkey_metrics(context, id);
+    if (metrics != NULL)
+      prometheus_histogram_observe(metrics->send_to_ack_latency, seconds);
+  }
+}
+
+void __np_statistics_set_msgcache_size(np_state_t *context,
+                                       np_dhkey_t  subject,
+                                       uint16_t    size) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_subject_metrics *metrics =
+        __np_statistics_get_subject_metrics(context, subject);
+    if (metrics != NULL) prometheus_gauge_set(metrics->msgcache_size, size);
+  }
+}
+
+void __np_increment_msgcache_dropped_counter(np_state_t *context,
+                                             np_dhkey_t  subject) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_subject_metrics *metrics =
+        __np_statistics_get_subject_metrics(context, subject);
+    if (metrics != NULL) prometheus_gauge_inc(metrics->msgcache_dropped, 1);
+  }
+}
+
+void __np_statistics_observe_end_to_end(np_state_t *context,
+                                        np_dhkey_t  subject,
+                                        double      seconds) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_subject_metrics *metrics =
+        __np_statistics_get_subject_metrics(context, subject);
+    // clocks of sender and receiver are not synchronized
+    if (metrics != NULL)
+      prometheus_histogram_observe(metrics->end_to_end_latency,
+                                   fmax(seconds, 0.0));
+  }
+}
+
+void __np_statistics_observe_reassembly(np_state_t *context,
+                                        np_dhkey_t  subject,
+                                        double      seconds) {
+  if (np_module_initiated(statistics)) {
+    np_statistics_per_subject_metrics *metrics =
+        __np_statistics_get_subject_metrics(context, subject);
+    if (metrics != NULL)
+      prometheus_histogram_observe(metrics->reassembly_time, seconds);
   }
 }
 
@@ -930,9 +1388,9 @@ void __np_increment_received_msgs_counter(np_state_t *context,
         np_module(statistics)
             ->_prometheus_metrics[np_prometheus_exposed_metrics_received_msgs],
         1);
-    prometheus_metric_inc(
-        __np_statistics_get_subject_metrics(context, subject)->received_msgs,
-        1);
+    np_statistics_per_subject_metrics *metrics =
+        __np_statistics_get_subject_metrics(context, subject);
+    if (metrics != NULL) prometheus_gauge_inc(metrics->received_msgs, 1);
   }
 }
 void __np_increment_send_msgs_counter(np_state_t *context, np_dhkey_t subject) {
@@ -941,9 +1399,9 @@ void __np_increment_send_msgs_counter(np_state_t *context, np_dhkey_t subject) {
         np_module(statistics)
             ->_prometheus_metrics[np_prometheus_exposed_metrics_send_msgs],
         1);
-    prometheus_metric_inc(
-        __np_statistics_get_subject_metrics(context, subject)->send_msgs,
-        1);
+    np_statistics_per_subject_metrics *metrics =
+        __np_statistics_get_subject_metrics(context, subject);
+    if (metrics != NULL) prometheus_gauge_inc(metrics->send_msgs, 1);
   }
 }
 
@@ -964,6 +1422,27 @@ void __np_statistics_add_received_bytes(np_state_t *context, uint32_t add) {
         add);
   }
 }
+
+void __np_statistics_add_control_saved_chunks(np_state_t *context,
+                                              uint32_t    add) {
+  if (np_module_initiated(statistics)) {
+    prometheus_metric_inc(
+        np_module(statistics)
+            ->_prometheus_metrics
+                [np_prometheus_exposed_metrics_control_saved_chunks],
+        add);
+  }
+}
+
+void __np_statistics_increment_event_loop_wakeups(np_state_t *context) {
+  if (np_module_initiated(statistics)) {
+    prometheus_metric_inc(
+        np_module(statistics)
+            ->_prometheus_metrics
+                [np_prometheus_exposed_metrics_event_loop_wakeups],
+        1);
+  }
+}
 #endif
 
 #ifdef DEBUG_CALLBACKS
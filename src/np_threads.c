@@ -1001,6 +1001,27 @@ np_thread_t *__np_createThread(NP_UNUSED np_state_t *context,
   return new_thread;
 }
 
+np_thread_t *_np_threads_start_eventloop(np_state_t           *context,
+                                         np_threads_worker_run fn) {
+  np_thread_t *ret = NULL;
+
+  np_spinlock_lock(&np_module(threads)->threads_lock);
+  {
+    sll_iterator(np_thread_ptr) iter = sll_first(np_module(threads)->threads);
+    while (iter != NULL && ret == NULL) {
+      if (iter->val->run_fn == fn) ret = iter->val;
+      sll_next(iter);
+    }
+  }
+  np_spinlock_unlock(&np_module(threads)->threads_lock);
+
+  if (ret == NULL) {
+    context->thread_count++;
+    ret = __np_createThread(context, fn, true, np_thread_type_eventloop);
+  }
+  return ret;
+}
+
 void np_threads_shutdown_workers(np_state_t *context) {
   bool shutdown_complete;
   sll_iterator(np_thread_ptr) iter_threads;
@@ -1061,6 +1082,18 @@ void np_threads_shutdown_workers(np_state_t *context) {
                1 /*do not count main thread*/);
 }
 
+// event loops get a thread of the pool if it is large enough, otherwise they
+// are polled by the jobqueue. Only loops with a thread of their own block in
+// the io backend if NP_EVENT_LOOP_EVENT_DRIVEN is set.
+static bool __np_threads_eventloop_thread(uint8_t *pool_size,
+                                          uint8_t  worker_threads) {
+  if (*pool_size > worker_threads) {
+    (*pool_size)--;
+    return true;
+  }
+  return false;
+}
+
 void np_threads_start_workers(NP_UNUSED np_state_t *context,
                               uint8_t               pool_size) {
   log_trace_msg(LOG_TRACE,
@@ -1100,8 +1133,7 @@ void np_threads_start_workers(NP_UNUSED np_state_t *context,
   // start jobs
   np_thread_t *special_thread;
 
-  if (pool_size > worker_threads) {
-    pool_size--;
+  if (__np_threads_eventloop_thread(&pool_size, worker_threads)) {
     special_thread = __np_createThread(context,
                                        _np_event_in_run,
                                        true,
@@ -1119,8 +1151,19 @@ void np_threads_start_workers(NP_UNUSED np_state_t *context,
                                       "_np_events_read_in");
   }
 
-  if (pool_size > worker_threads) {
-    pool_size--;
+  // each additional ingress shard is always served by its own thread
+  for (uint8_t i = 1; i < _np_event_in_shard_count(context); i++) {
+    context->thread_count++;
+    special_thread = __np_createThread(context,
+                                       _np_event_in_shard_run,
+                                       true,
+                                       np_thread_type_eventloop);
+#ifdef DEBUG_CALLBACKS
+    strncpy(special_thread->job.ident, "_np_event_in_shard_run", 255);
+#endif
+  }
+
+  if (__np_threads_eventloop_thread(&pool_size, worker_threads)) {
     special_thread = __np_createThread(context,
                                        _np_event_out_run,
                                        true,
@@ -1137,8 +1180,7 @@ void np_threads_start_workers(NP_UNUSED np_state_t *context,
                                       "_np_events_read_out");
   }
 
-  if (pool_size > worker_threads) {
-    pool_size--;
+  if (__np_threads_eventloop_thread(&pool_size, worker_threads)) {
     special_thread = __np_createThread(context,
                                        _np_event_file_run_triggered,
                                        true,
@@ -346,6 +346,8 @@ _np_token_factory_new_handshake_token(np_state_t *context) {
   strncpy(cfg.key, NP_HS_PRIO, 255);
   cfg.type = NP_DATA_TYPE_UNSIGNED_INT;
   np_set_data(ret->attributes, cfg, (np_data_value)my_node->handshake_priority);
+  strncpy(cfg.key, NP_HS_CAPABILITIES, 255);
+  np_set_data(ret->attributes, cfg, (np_data_value)NP_NODE_CAPABILITIES);
 
   _np_aaatoken_set_signature(ret, NULL);
   _np_aaatoken_update_attributes_signature(ret);
@@ -53,27 +53,112 @@ NP_SLL_GENERATE_IMPLEMENTATION(char_ptr);
 NP_SLL_GENERATE_IMPLEMENTATION_COMPARATOR(np_key_ptr);
 NP_SLL_GENERATE_IMPLEMENTATION(np_key_ptr);
 
-char *np_uuid_create(const char *str, const uint16_t num, char **buffer) {
+// uuid generator state of a thread, the key is drawn once per thread
+typedef struct __np_uuid_generator_s {
+  unsigned char key[crypto_shorthash_siphashx24_KEYBYTES];
+  uint64_t      counter;
+} __np_uuid_generator_t;
+
+static pthread_key_t  __np_uuid_generator_key;
+static pthread_once_t __np_uuid_generator_once = PTHREAD_ONCE_INIT;
+
+// a forked child inherits the key and counter of the forking thread and
+// would repeat the uuids of its parent, draw a new key in the child
+static void __np_uuid_generator_atfork_child() {
+  __np_uuid_generator_t *generator =
+      pthread_getspecific(__np_uuid_generator_key);
+  if (generator != NULL) {
+    randombytes_buf(generator->key, sizeof(generator->key));
+    generator->counter = 0;
+  }
+}
+
+static void __np_uuid_generator_init() {
+  pthread_key_create(&__np_uuid_generator_key, free);
+  pthread_atfork(NULL, NULL, __np_uuid_generator_atfork_child);
+}
+
+void _np_uuid_create_bin(np_uuid_t *uuid, uint16_t num) {
+  pthread_once(&__np_uuid_generator_once, __np_uuid_generator_init);
+
+  __np_uuid_generator_t *generator =
+      pthread_getspecific(__np_uuid_generator_key);
+  if (generator == NULL) {
+    generator = malloc(sizeof(__np_uuid_generator_t));
+    CHECK_MALLOC(generator);
+    randombytes_buf(generator->key, sizeof(generator->key));
+    generator->counter = 0;
+    pthread_setspecific(__np_uuid_generator_key, generator);
+  }
+
+  unsigned char input[sizeof(uint64_t) + sizeof(uint16_t)];
+  generator->counter++;
+  memcpy(input, &generator->counter, sizeof(uint64_t));
+  memcpy(input + sizeof(uint64_t), &num, sizeof(uint16_t));
+  crypto_shorthash_siphashx24(uuid->b, input, sizeof(input), generator->key);
+
+  // the same fixed digits as before: '5' at position 14, '9' at position 19
+  uuid->b[6] = (uuid->b[6] & 0x0f) | 0x50;
+  uuid->b[8] = (uuid->b[8] & 0x0f) | 0x90;
+}
+
+void _np_uuid_to_str(const np_uuid_t *uuid, char uuid_str[NP_UUID_BYTES]) {
+  static const char hex[] = "0123456789abcdef";
+
+  uint8_t pos = 0;
+  for (uint8_t i = 0; i < NP_UUID_BIN_BYTES; i++) {
+    if (i == 4 || i == 6 || i == 8 || i == 10) uuid_str[pos++] = '-';
+    uuid_str[pos++] = hex[uuid->b[i] >> 4];
+    uuid_str[pos++] = hex[uuid->b[i] & 0x0f];
+  }
+  uuid_str[pos] = '\0';
+}
+
+static int8_t __np_uuid_hex_value(char c) {
+  if (c >= '0' && c <= '9') return c - '0';
+  if (c >= 'a' && c <= 'f') return c - 'a' + 10;
+  if (c >= 'A' && c <= 'F') return c - 'A' + 10;
+  return -1;
+}
+
+void _np_uuid_from_str(const char *uuid_str, np_uuid_t *uuid) {
+  uint8_t pos = 0;
+  for (uint8_t i = 0; i < NP_UUID_BIN_BYTES; i++) {
+    if ((i == 4 || i == 6 || i == 8 || i == 10) && uuid_str[pos++] != '-')
+      break;
+
+    int8_t high = __np_uuid_hex_value(uuid_str[pos]);
+    int8_t low  = (high < 0) ? -1 : __np_uuid_hex_value(uuid_str[pos + 1]);
+    if (low < 0) break;
+
+    uuid->b[i] = (high << 4) | low;
+    pos += 2;
+    if (i == NP_UUID_BIN_BYTES - 1 && uuid_str[pos] == '\0') return;
+  }
+
+  // not created by np_uuid_create, fall back to a hash of the whole string
+  crypto_generichash_blake2b(uuid->b,
+                             NP_UUID_BIN_BYTES,
+                             (const unsigned char *)uuid_str,
+                             strnlen(uuid_str, 255),
+                             NULL,
+                             0);
+}
+
+char *np_uuid_create(NP_UNUSED const char *str,
+                     const uint16_t        num,
+                     char                **buffer) {
   char *uuid_out = NULL;
   if (buffer == NULL) {
-    uuid_out = calloc(1, NP_UUID_BYTES);
+    uuid_out = malloc(NP_UUID_BYTES);
     CHECK_MALLOC(uuid_out);
   } else {
     uuid_out = *buffer;
   }
-  char          input[256] = {'\0'};
-  unsigned char out[18]    = {'\0'};
-
-  double now = _np_time_now(NULL);
-  snprintf(input, 255, "%s:%u:%16.16f", str, num, now);
-  // log_debug_msg(LOG_DEBUG, "created input uuid: %s", input);
-  crypto_generichash_blake2b(out, 18, (unsigned char *)input, 256, NULL, 0);
-  sodium_bin2hex(uuid_out, NP_UUID_BYTES, out, 18);
-  // log_debug_msg(LOG_DEBUG, "created raw uuid: %s", uuid_out);
-  uuid_out[8] = uuid_out[13] = uuid_out[18] = uuid_out[23] = '-';
-  uuid_out[14]                                             = '5';
-  uuid_out[19]                                             = '9';
-  // log_debug_msg(LOG_DEBUG, "created new uuid: %s", uuid_out);
+
+  np_uuid_t uuid;
+  _np_uuid_create_bin(&uuid, num);
+  _np_uuid_to_str(&uuid, uuid_out);
 
   return uuid_out;
 }
@@ -4,6 +4,18 @@
 //
 #include "util/np_serialization.h"
 
+// whether the element is part of the pre-serialized prefix of a map
+static bool __np_serializer_is_prefixed(const np_tree_elem_t *elem,
+                                        const char *const    *prefix_keys,
+                                        uint8_t               prefix_count) {
+  if (np_treeval_type_char_ptr != elem->key.type) return false;
+
+  for (uint8_t i = 0; i < prefix_count; i++) {
+    if (0 == strcmp(elem->key.value.s, prefix_keys[i])) return true;
+  }
+  return false;
+}
+
 #ifdef NP_USE_CMP
 
 #include "s11n_impl/np_serialize_cmp.c"
@@ -333,6 +333,32 @@ void np_tree_insert_str(np_tree_t *tree, const char *key, np_treeval_t val) {
   }
 }
 
+void np_tree_insert_str_ref(np_tree_t  *tree,
+                            const char *key,
+                            void       *data,
+                            uint32_t    size) {
+  assert(tree != NULL);
+  assert(key != NULL);
+
+  np_tree_elem_t *found = np_tree_find_str(tree, key);
+  if (found == NULL) { // insert new value, but do not copy data
+    found = (np_tree_elem_t *)malloc(sizeof(np_tree_elem_t));
+    CHECK_MALLOC(found);
+
+    if (tree->attr.in_place == true) {
+      found->key.value.s = (char *)key;
+    } else {
+      found->key.value.s = strndup(key, 255);
+    }
+
+    found->key.type = np_treeval_type_char_ptr;
+    found->key.size = strnlen(found->key.value.s, 255);
+
+    found->val = np_treeval_new_bin_ref(data, size);
+    np_tree_insert_element(tree, found);
+  }
+}
+
 void np_tree_insert_int(np_tree_t *tree, int16_t ikey, np_treeval_t val) {
   assert(tree != NULL);
 
@@ -575,6 +601,7 @@ unsigned char *np_tree_get_hash(np_tree_t *self) {
         if (/*Pointer types*/
             iter_tree->val.type == np_treeval_type_void ||
             iter_tree->val.type == np_treeval_type_bin ||
+            iter_tree->val.type == np_treeval_type_bin_ref ||
             iter_tree->val.type == np_treeval_type_char_ptr ||
             iter_tree->val.type == np_treeval_type_char_array_8 ||
             iter_tree->val.type == np_treeval_type_float_array_2 ||
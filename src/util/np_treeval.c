@@ -116,6 +116,7 @@ np_treeval_t np_treeval_copy_of_val(np_treeval_t from) {
     // np_treeval_type_unsigned_char_array_8: byte_size += 1 +8*sizeof(unsigned
     // char); break;
   case np_treeval_type_bin:
+  case np_treeval_type_bin_ref:
     to.type      = np_treeval_type_bin;
     to.value.bin = malloc(from.size);
     CHECK_MALLOC(to.value.bin);
@@ -293,6 +294,7 @@ char *np_treeval_to_str(np_treeval_t val, bool *freeable) {
     break;
   case np_treeval_type_hash:
   case np_treeval_type_bin:
+  case np_treeval_type_bin_ref:
     hex_len       = val.size * 2 + 1;
     char *hex_str = malloc(hex_len + 2);
     hex_str[0]    = '0';
@@ -454,6 +456,16 @@ np_treeval_t np_treeval_new_bin(void *data, uint32_t ul) {
   return j;
 }
 
+np_treeval_t np_treeval_new_bin_ref(void *data, uint32_t ul) {
+  np_treeval_t j;
+
+  j.value.bin = data;
+  j.size      = ul;
+  j.type      = np_treeval_type_bin_ref;
+
+  return j;
+}
+
 np_treeval_t np_treeval_new_dhkey(np_dhkey_t dhkey) {
   np_treeval_t j;
 
@@ -676,6 +688,7 @@ size_t np_treeval_get_byte_size(np_treeval_t ele) {
     byte_size += 1 + sizeof(void *);
     break;
   case np_treeval_type_bin:
+  case np_treeval_type_bin_ref:
     byte_size += 1 + sizeof(uint32_t) + ele.size;
     break;
   case np_treeval_type_hash:
@@ -802,6 +815,7 @@ size_t np_treeval_get_byte_size(np_treeval_t ele) {
     byte_size += sizeof(uint8_t) + sizeof(void *);
     break;
   case np_treeval_type_bin:
+  case np_treeval_type_bin_ref:
     if (ele.size > UINT16_MAX) byte_size += sizeof(uint32_t);
     else if (ele.size > UINT8_MAX) byte_size += sizeof(uint16_t);
     else if (ele.size >= 24) byte_size += sizeof(uint8_t);
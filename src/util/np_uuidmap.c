@@ -0,0 +1,134 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include "util/np_uuidmap.h"
+
+#include <stdlib.h>
+#include <string.h>
+
+#include "sodium.h"
+
+#include "np_memory.h"
+#include "np_util.h"
+
+#define NP_UUIDMAP_MIN_CAPACITY 16
+
+static uint32_t __np_uuidmap_slot(const np_uuidmap_t *map,
+                                  const np_uuid_t    *key) {
+  uint64_t hash = 0;
+  crypto_shorthash_siphash24((unsigned char *)&hash,
+                             key->b,
+                             NP_UUID_BIN_BYTES,
+                             map->_seed);
+  return (uint32_t)hash & (map->capacity - 1);
+}
+
+static np_uuidmap_entry_t *__np_uuidmap_lookup(const np_uuidmap_t *map,
+                                               const np_uuid_t    *key) {
+  uint32_t slot = __np_uuidmap_slot(map, key);
+  // the table always keeps empty slots, so the probing terminates
+  while (map->_entries[slot].state != np_uuidmap_slot_empty) {
+    np_uuidmap_entry_t *entry = &map->_entries[slot];
+    if (entry->state == np_uuidmap_slot_used &&
+        0 == memcmp(entry->key.b, key->b, NP_UUID_BIN_BYTES))
+      return entry;
+    slot = (slot + 1) & (map->capacity - 1);
+  }
+  return NULL;
+}
+
+static void __np_uuidmap_resize(np_uuidmap_t *map, uint32_t capacity) {
+  np_uuidmap_entry_t *old_entries  = map->_entries;
+  uint32_t            old_capacity = map->capacity;
+
+  map->_entries = calloc(capacity, sizeof(np_uuidmap_entry_t));
+  CHECK_MALLOC(map->_entries);
+  map->capacity = capacity;
+  map->deleted  = 0;
+
+  for (uint32_t i = 0; i < old_capacity; i++) {
+    if (old_entries[i].state != np_uuidmap_slot_used) continue;
+
+    uint32_t slot = __np_uuidmap_slot(map, &old_entries[i].key);
+    while (map->_entries[slot].state != np_uuidmap_slot_empty)
+      slot = (slot + 1) & (map->capacity - 1);
+    map->_entries[slot] = old_entries[i];
+  }
+  free(old_entries);
+}
+
+np_uuidmap_t *np_uuidmap_create(uint32_t initial_capacity) {
+  np_uuidmap_t *map = calloc(1, sizeof(np_uuidmap_t));
+  CHECK_MALLOC(map);
+
+  map->capacity = NP_UUIDMAP_MIN_CAPACITY;
+  while (map->capacity < initial_capacity)
+    map->capacity <<= 1;
+
+  map->_entries = calloc(map->capacity, sizeof(np_uuidmap_entry_t));
+  CHECK_MALLOC(map->_entries);
+  randombytes_buf(map->_seed, crypto_shorthash_KEYBYTES);
+
+  return map;
+}
+
+void np_uuidmap_free(np_uuidmap_t *map) {
+  if (map == NULL) return;
+  free(map->_entries);
+  free(map);
+}
+
+bool np_uuidmap_insert(np_uuidmap_t    *map,
+                       const np_uuid_t *key,
+                       np_treeval_t     val) {
+  if (__np_uuidmap_lookup(map, key) != NULL) return false;
+
+  // keep the load (including tombstones) below 3/4, tombstones are dropped
+  // by a rehash with the same capacity if the table itself is not full
+  if (4 * (map->size + map->deleted + 1) > 3 * map->capacity) {
+    uint32_t capacity = map->capacity;
+    if (2 * (map->size + 1) > capacity) capacity <<= 1;
+    __np_uuidmap_resize(map, capacity);
+  }
+
+  uint32_t slot = __np_uuidmap_slot(map, key);
+  while (map->_entries[slot].state == np_uuidmap_slot_used)
+    slot = (slot + 1) & (map->capacity - 1);
+
+  np_uuidmap_entry_t *entry = &map->_entries[slot];
+  if (entry->state == np_uuidmap_slot_deleted) map->deleted--;
+  memcpy(entry->key.b, key->b, NP_UUID_BIN_BYTES);
+  entry->val   = val;
+  entry->state = np_uuidmap_slot_used;
+  map->size++;
+
+  return true;
+}
+
+np_treeval_t *np_uuidmap_find(const np_uuidmap_t *map, const np_uuid_t *key) {
+  np_uuidmap_entry_t *entry = __np_uuidmap_lookup(map, key);
+  return (entry != NULL) ? &entry->val : NULL;
+}
+
+void np_uuidmap_del_entry(np_uuidmap_t *map, np_uuidmap_entry_t *entry) {
+  entry->state = np_uuidmap_slot_deleted;
+  map->size--;
+  map->deleted++;
+}
+
+bool np_uuidmap_del(np_uuidmap_t *map, const np_uuid_t *key) {
+  np_uuidmap_entry_t *entry = __np_uuidmap_lookup(map, key);
+  if (entry == NULL) return false;
+
+  np_uuidmap_del_entry(map, entry);
+  return true;
+}
+
+np_uuidmap_entry_t *np_uuidmap_next(np_uuidmap_t *map, uint32_t *pos) {
+  while (*pos < map->capacity) {
+    np_uuidmap_entry_t *entry = &map->_entries[(*pos)++];
+    if (entry->state == np_uuidmap_slot_used) return entry;
+  }
+  return NULL;
+}
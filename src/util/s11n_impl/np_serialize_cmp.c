@@ -192,6 +192,7 @@ void __np_tree_serialize_write_type(np_state_t  *context,
             val.type);
     break;
   case np_treeval_type_bin:
+  case np_treeval_type_bin_ref:
     cmp_write_bin32(cmp, val.value.bin, val.size);
     break;
   case np_treeval_type_dhkey:
@@ -542,6 +543,59 @@ void np_serializer_write_map(np_state_t            *context,
             i);
 }
 
+void np_serializer_write_elements(np_state_t            *context,
+                                  np_serialize_buffer_t *buffer,
+                                  const np_tree_t       *tree) {
+  buffer->_tree = tree;
+
+  cmp_ctx_t cmp_context = {0};
+  cmp_init(&cmp_context,
+           buffer->_target_buffer,
+           NULL,
+           __np_buffer_skipper,
+           __np_buffer_writer);
+
+  np_tree_elem_t *tmp = NULL;
+  RB_FOREACH (tmp, np_tree_s, buffer->_tree) {
+    __np_tree_serialize_write_type(context, tmp->key, &cmp_context);
+    __np_tree_serialize_write_type(context, tmp->val, &cmp_context);
+  }
+
+  buffer->_bytes_written = cmp_context.buf - buffer->_target_buffer;
+  buffer->_error         = cmp_context.error;
+}
+
+void np_serializer_write_map_prefixed(np_state_t            *context,
+                                      np_serialize_buffer_t *buffer,
+                                      const np_tree_t       *tree,
+                                      const char *const     *prefix_keys,
+                                      uint8_t                prefix_count,
+                                      const void            *prefix,
+                                      size_t                 prefix_size) {
+  buffer->_tree = tree;
+
+  cmp_ctx_t cmp_context = {0};
+  cmp_init(&cmp_context,
+           buffer->_target_buffer,
+           NULL,
+           __np_buffer_skipper,
+           __np_buffer_writer);
+
+  if (!cmp_write_map32(&cmp_context, buffer->_tree->size * 2)) return;
+  __np_buffer_writer(&cmp_context, prefix, prefix_size);
+
+  np_tree_elem_t *tmp = NULL;
+  RB_FOREACH (tmp, np_tree_s, buffer->_tree) {
+    if (__np_serializer_is_prefixed(tmp, prefix_keys, prefix_count)) continue;
+
+    __np_tree_serialize_write_type(context, tmp->key, &cmp_context);
+    __np_tree_serialize_write_type(context, tmp->val, &cmp_context);
+  }
+
+  buffer->_bytes_written = cmp_context.buf - buffer->_target_buffer;
+  buffer->_error         = cmp_context.error;
+}
+
 void np_serializer_read_map(np_state_t              *context,
                             np_deserialize_buffer_t *buffer,
                             np_tree_t               *tree) {
@@ -445,6 +445,7 @@ void __np_tree_serialize_write_type(np_state_t         *context,
     break;
 
   case np_treeval_type_bin:
+  case np_treeval_type_bin_ref:
     QCBOREncode_AddBytes(qcbor_ctx,
                          (UsefulBufC){.ptr = val.value.bin, .len = val.size});
     break;
@@ -723,6 +724,76 @@ void np_serializer_write_map(np_state_t            *context,
             i);
 }
 
+void np_serializer_write_elements(np_state_t            *context,
+                                  np_serialize_buffer_t *buffer,
+                                  const np_tree_t       *tree) {
+  buffer->_tree = tree;
+
+  struct q_useful_buf qmp       = {.ptr = buffer->_target_buffer,
+                                   .len = buffer->_buffer_size};
+  QCBOREncodeContext  qcbor_ctx = {0};
+  QCBOREncode_Init(&qcbor_ctx, qmp);
+
+  // the elements are written as a sequence of top level items
+  np_tree_elem_t *tmp = NULL;
+  RB_FOREACH (tmp, np_tree_s, buffer->_tree) {
+    __np_tree_serialize_write_type(context, tmp->key, &qcbor_ctx);
+    __np_tree_serialize_write_type(context, tmp->val, &qcbor_ctx);
+  }
+
+  struct q_useful_buf_c qmp_out  = {0};
+  QCBORError            cbor_err = QCBOREncode_Finish(&qcbor_ctx, &qmp_out);
+
+  if (cbor_err == QCBOR_SUCCESS || cbor_err == QCBOR_ERR_EXTRA_BYTES) {
+    buffer->_bytes_written = qmp_out.len;
+    buffer->_error         = qcbor_ctx.uError;
+  } else {
+    buffer->_error = cbor_err;
+  }
+}
+
+void np_serializer_write_map_prefixed(np_state_t            *context,
+                                      np_serialize_buffer_t *buffer,
+                                      const np_tree_t       *tree,
+                                      const char *const     *prefix_keys,
+                                      uint8_t                prefix_count,
+                                      const void            *prefix,
+                                      size_t                 prefix_size) {
+  buffer->_tree = tree;
+
+  struct q_useful_buf qmp       = {.ptr = buffer->_target_buffer,
+                                   .len = buffer->_buffer_size};
+  QCBOREncodeContext  qcbor_ctx = {0};
+  QCBOREncode_Init(&qcbor_ctx, qmp);
+
+  QCBOREncode_AddTag(&qcbor_ctx,
+                     (NP_CBOR_REGISTRY_ENTRIES + np_treeval_type_jrb_tree));
+  QCBOREncode_OpenMap(&qcbor_ctx);
+
+  // the pre-serialized key/value pairs count as two items each
+  UsefulOutBuf_AppendData(&qcbor_ctx.OutBuf, prefix, prefix_size);
+  qcbor_ctx.nesting.pCurrentNesting->uCount += 2 * prefix_count;
+
+  np_tree_elem_t *tmp = NULL;
+  RB_FOREACH (tmp, np_tree_s, buffer->_tree) {
+    if (__np_serializer_is_prefixed(tmp, prefix_keys, prefix_count)) continue;
+
+    __np_tree_serialize_write_type(context, tmp->key, &qcbor_ctx);
+    __np_tree_serialize_write_type(context, tmp->val, &qcbor_ctx);
+  }
+  QCBOREncode_CloseMap(&qcbor_ctx);
+
+  struct q_useful_buf_c qmp_out  = {0};
+  QCBORError            cbor_err = QCBOREncode_Finish(&qcbor_ctx, &qmp_out);
+
+  if (cbor_err == QCBOR_SUCCESS || cbor_err == QCBOR_ERR_EXTRA_BYTES) {
+    buffer->_bytes_written = qmp_out.len;
+    buffer->_error         = qcbor_ctx.uError;
+  } else {
+    buffer->_error = cbor_err;
+  }
+}
+
 enum np_data_return np_serializer_write_object(np_kv_buffer_t *to_write) {
   size_t write_len = to_write->buffer_end - to_write->buffer_start;
 
@@ -246,3 +246,153 @@ Test(np_dhkey_t, _dhkey_hamming_distance, .description = "test the hamming dista
         cr_expect(true == (result_1  < result_3), "expected the result to be key_1");
     }
 }
+
+// plain limb / byte loops as reference for the vectorized dhkey functions
+static int8_t __test_dhkey_cmp(const np_dhkey_t* k1, const np_dhkey_t* k2)
+{
+	for (uint8_t i = 0; i < 8; i++) {
+		if (k1->t[i] > k2->t[i]) return 1;
+		if (k1->t[i] < k2->t[i]) return -1;
+	}
+	return 0;
+}
+
+static void __test_dhkey_distance(np_dhkey_t* diff, const np_dhkey_t* k1, const np_dhkey_t* k2)
+{
+	np_dhkey_t half;
+	for (uint8_t i = 0; i < 8; i++) half.t[i] = 0x80000000;
+
+	for (uint8_t i = 0; i < 8; i++)
+		diff->t[i] = (__test_dhkey_cmp(k1, k2) > 0) ? k1->t[i] - k2->t[i] : k2->t[i] - k1->t[i];
+
+	if (__test_dhkey_cmp(&half, diff) < 0)
+		for (uint8_t i = 0; i < 8; i++) diff->t[i] = UINT32_MAX - diff->t[i];
+}
+
+static uint16_t __test_dhkey_index(const np_dhkey_t* a, const np_dhkey_t* b)
+{
+	uint8_t* _pos_a = (uint8_t*) a;
+	uint8_t* _pos_b = (uint8_t*) b;
+	uint16_t ret = 0;
+	for (uint8_t k = 0; k < sizeof(np_dhkey_t); k++) {
+		if ((_pos_a[k] & 0xf0) != (_pos_b[k] & 0xf0)) break;
+		ret++;
+		if ((_pos_a[k] & 0x0f) != (_pos_b[k] & 0x0f)) break;
+		ret++;
+	}
+	return ret;
+}
+
+// random keys, keys sharing a prefix, single bit flips and sign bit patterns
+static void __test_dhkey_pair(uint32_t n, np_dhkey_t* a, np_dhkey_t* b)
+{
+	randombytes_buf(a, sizeof(np_dhkey_t));
+	randombytes_buf(b, sizeof(np_dhkey_t));
+
+	switch (n % 5) {
+	case 0:
+		break;
+	case 1:
+		*b = *a;
+		break;
+	case 2:
+		*b = *a;
+		((uint8_t*) b)[randombytes_uniform(sizeof(np_dhkey_t))] ^= 1 << randombytes_uniform(8);
+		break;
+	case 3:
+		memcpy(b, a, randombytes_uniform(sizeof(np_dhkey_t)));
+		break;
+	case 4:
+		for (uint8_t i = 0; i < 8; i++) {
+			a->t[i] = (randombytes_uniform(3) > 0) ? 0x80000000 : 0x7fffffff;
+			b->t[i] = (randombytes_uniform(3) > 0) ? 0x80000000 : 0x00000000;
+		}
+		break;
+	}
+}
+
+Test(np_dhkey_t, _dhkey_kernels, .description = "test the dhkey functions against plain limb by limb loops")
+{
+	CTX() {
+		np_dhkey_t a, b, result, expected;
+		uint8_t hamming;
+
+		for (uint32_t n = 0; n < 100000; n++) {
+			__test_dhkey_pair(n, &a, &b);
+
+			int8_t cmp = __test_dhkey_cmp(&a, &b);
+			cr_assert(cmp == _np_dhkey_cmp(&a, &b), "expected the comparison to match");
+			cr_assert((cmp == 0) == _np_dhkey_equal(&a, &b), "expected the equality to match");
+			cr_assert(__test_dhkey_index(&a, &b) == _np_dhkey_index(&a, &b), "expected the common prefix to match");
+
+			__test_dhkey_distance(&expected, &a, &b);
+			_np_dhkey_distance(&result, &a, &b);
+			cr_assert_arr_eq(result.t, expected.t, sizeof(np_dhkey_t), "expected the distance to match");
+
+			uint8_t expected_hamming = 0;
+			_np_dhkey_hamming_distance_each(&result, &a, &b);
+			for (uint8_t i = 0; i < 8; i++) {
+				cr_assert(__builtin_popcount(a.t[i] ^ b.t[i]) == result.t[i], "expected the hamming distance of each limb to match");
+				expected_hamming += __builtin_popcount(a.t[i] ^ b.t[i]);
+			}
+			_np_dhkey_hamming_distance(&hamming, &a, &b);
+			cr_assert(expected_hamming == hamming, "expected the hamming distance to match");
+
+			_np_dhkey_add(&result, &a, &b);
+			for (uint8_t i = 0; i < 8; i++) cr_assert(a.t[i] + b.t[i] == result.t[i]);
+			_np_dhkey_sub(&result, &a, &b);
+			for (uint8_t i = 0; i < 8; i++) cr_assert(a.t[i] - b.t[i] == result.t[i]);
+			_np_dhkey_xor(&result, &a, &b);
+			for (uint8_t i = 0; i < 8; i++) cr_assert((a.t[i] ^ b.t[i]) == result.t[i]);
+			_np_dhkey_and(&result, &a, &b);
+			for (uint8_t i = 0; i < 8; i++) cr_assert((a.t[i] & b.t[i]) == result.t[i]);
+			_np_dhkey_or(&result, &a, &b);
+			for (uint8_t i = 0; i < 8; i++) cr_assert((a.t[i] | b.t[i]) == result.t[i]);
+		}
+	}
+}
+
+#define __TEST_DHKEY_ROUNDS 1000
+#define __TEST_DHKEY_OPS 1000
+
+Test(np_dhkey_t, _dhkey_kernels_performance, .description = "measure the dhkey functions against plain limb by limb loops")
+{
+	CTX() {
+		np_dhkey_t keys[__TEST_DHKEY_OPS + 1], result;
+		for (uint16_t i = 0; i <= __TEST_DHKEY_OPS; i++) __test_dhkey_pair(i, &keys[i], &keys[(i + 1) % (__TEST_DHKEY_OPS + 1)]);
+
+		double ref_cmp[__TEST_DHKEY_ROUNDS], cmp[__TEST_DHKEY_ROUNDS];
+		double ref_distance[__TEST_DHKEY_ROUNDS], distance[__TEST_DHKEY_ROUNDS];
+		double ref_index[__TEST_DHKEY_ROUNDS], prefix_index[__TEST_DHKEY_ROUNDS];
+		volatile int32_t sink = 0;
+
+		for (uint16_t r = 0; r < __TEST_DHKEY_ROUNDS; r++) {
+			MEASURE_TIME(ref_cmp, r, {
+				for (uint16_t i = 0; i < __TEST_DHKEY_OPS; i++) sink += __test_dhkey_cmp(&keys[i], &keys[i + 1]);
+			});
+			MEASURE_TIME(cmp, r, {
+				for (uint16_t i = 0; i < __TEST_DHKEY_OPS; i++) sink += _np_dhkey_cmp(&keys[i], &keys[i + 1]);
+			});
+			MEASURE_TIME(ref_distance, r, {
+				for (uint16_t i = 0; i < __TEST_DHKEY_OPS; i++) { __test_dhkey_distance(&result, &keys[i], &keys[i + 1]); sink += result.t[0]; }
+			});
+			MEASURE_TIME(distance, r, {
+				for (uint16_t i = 0; i < __TEST_DHKEY_OPS; i++) { _np_dhkey_distance(&result, &keys[i], &keys[i + 1]); sink += result.t[0]; }
+			});
+			MEASURE_TIME(ref_index, r, {
+				for (uint16_t i = 0; i < __TEST_DHKEY_OPS; i++) sink += __test_dhkey_index(&keys[i], &keys[i + 1]);
+			});
+			MEASURE_TIME(prefix_index, r, {
+				for (uint16_t i = 0; i < __TEST_DHKEY_OPS; i++) sink += _np_dhkey_index(&keys[i], &keys[i + 1]);
+			});
+		}
+
+		cr_log_info("###########\n");
+		CALC_AND_PRINT_STATISTICS("dhkey cmp (loop)      :", ref_cmp, __TEST_DHKEY_ROUNDS);
+		CALC_AND_PRINT_STATISTICS("dhkey cmp             :", cmp, __TEST_DHKEY_ROUNDS);
+		CALC_AND_PRINT_STATISTICS("dhkey distance (loop) :", ref_distance, __TEST_DHKEY_ROUNDS);
+		CALC_AND_PRINT_STATISTICS("dhkey distance        :", distance, __TEST_DHKEY_ROUNDS);
+		CALC_AND_PRINT_STATISTICS("dhkey index (loop)    :", ref_index, __TEST_DHKEY_ROUNDS);
+		CALC_AND_PRINT_STATISTICS("dhkey index           :", prefix_index, __TEST_DHKEY_ROUNDS);
+	}
+}
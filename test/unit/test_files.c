@@ -0,0 +1,382 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <ctype.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sodium.h"
+
+#include "../test_macros.c"
+
+#include "../framework/files/file.h"
+
+#include "np_legacy.h"
+#include "np_util.h"
+
+// the local chunk store and manifest layout of the files module
+#define __TEST_FILES_CHUNK_DIR       "np_chunks"
+#define __TEST_FILES_MANIFEST_HEADER 12
+#define __TEST_FILES_MANIFEST_ENTRY  (12 + crypto_generichash_BYTES)
+#define __TEST_FILES_CHUNKS          3
+#define __TEST_FILES_HAVE_TIMEOUT    3.1415
+
+bool __np_files_stream_pump(np_state_t *context, np_util_event_t event);
+
+TestSuite(np_files_t);
+
+static const uint32_t __test_files_lengths[__TEST_FILES_CHUNKS] = {5000,
+                                                                    3000,
+                                                                    100};
+
+static void __test_files_put_u32(unsigned char *buf, uint32_t value) {
+  for (uint8_t i = 0; i < 4; i++) buf[i] = (value >> (24 - 8 * i)) & 0xFF;
+}
+
+static void __test_files_put_u64(unsigned char *buf, uint64_t value) {
+  __test_files_put_u32(buf, value >> 32);
+  __test_files_put_u32(buf + 4, value & 0xFFFFFFFF);
+}
+
+// serializes the tree and hands it over to the receive callback
+static void __test_files_deliver(np_state_t *context, np_tree_t *tree) {
+  size_t         buffer_size = np_tree_get_byte_size(tree);
+  unsigned char *buffer      = malloc(buffer_size);
+  np_tree2buffer(context, tree, buffer);
+
+  struct np_message msg = {.data = buffer, .data_length = buffer_size};
+  cr_expect(np_files_store_cb(context, &msg), "expect the callback to pass");
+
+  free(buffer);
+  np_tree_free(tree);
+}
+
+// a manifest of chunks with the given lengths, all taken from content
+static void __test_files_send_manifest(np_state_t          *context,
+                                       const char          *file_id,
+                                       uint64_t             file_size,
+                                       const unsigned char *content,
+                                       const uint32_t      *lengths,
+                                       uint32_t             chunks) {
+  size_t manifest_size =
+      __TEST_FILES_MANIFEST_HEADER + chunks * __TEST_FILES_MANIFEST_ENTRY;
+  unsigned char *manifest = malloc(manifest_size);
+  __test_files_put_u64(manifest, file_size);
+  __test_files_put_u32(manifest + 8, chunks);
+
+  uint64_t       offset = 0;
+  unsigned char *entry  = manifest + __TEST_FILES_MANIFEST_HEADER;
+  for (uint32_t i = 0; i < chunks; i++) {
+    __test_files_put_u64(entry, offset);
+    __test_files_put_u32(entry + 8, lengths[i]);
+    crypto_generichash(entry + 12,
+                       crypto_generichash_BYTES,
+                       content + offset,
+                       lengths[i],
+                       NULL,
+                       0);
+    offset += lengths[i];
+    entry  += __TEST_FILES_MANIFEST_ENTRY;
+  }
+
+  np_tree_t *tree = np_tree_create();
+  np_tree_insert_str(tree, "np_id", np_treeval_new_s((char *)file_id));
+  np_tree_insert_str(tree, "name", np_treeval_new_s("test.bin"));
+  np_tree_insert_str(tree,
+                     "manifest",
+                     np_treeval_new_bin(manifest, manifest_size));
+  __test_files_deliver(context, tree);
+  free(manifest);
+}
+
+static void __test_files_send_segment(np_state_t          *context,
+                                      const char          *file_id,
+                                      uint32_t             segment,
+                                      const unsigned char *content,
+                                      uint32_t             length) {
+  unsigned char hash[crypto_generichash_BYTES];
+  crypto_generichash(hash, sizeof(hash), content, length, NULL, 0);
+
+  np_tree_t *tree = np_tree_create();
+  np_tree_insert_str(tree, "np_id", np_treeval_new_s((char *)file_id));
+  np_tree_insert_str(tree, "segment", np_treeval_new_ul(segment));
+  np_tree_insert_str(tree,
+                     "segments",
+                     np_treeval_new_ul(__TEST_FILES_CHUNKS));
+  np_tree_insert_str(tree,
+                     "segment_hash",
+                     np_treeval_new_bin(hash, sizeof(hash)));
+  np_tree_insert_str(tree,
+                     "content",
+                     np_treeval_new_bin((void *)content, length));
+  __test_files_deliver(context, tree);
+}
+
+static bool __test_files_chunk_exists(const unsigned char *content,
+                                      uint32_t             length) {
+  unsigned char hash[crypto_generichash_BYTES];
+  char          hash_str[crypto_generichash_BYTES * 2 + 1];
+  char          path[PATH_MAX];
+  crypto_generichash(hash, sizeof(hash), content, length, NULL, 0);
+  sodium_bin2hex(hash_str, sizeof(hash_str), hash, sizeof(hash));
+  snprintf(path, PATH_MAX, "%s/%s", __TEST_FILES_CHUNK_DIR, hash_str);
+  return 0 == access(path, F_OK);
+}
+
+static bool __test_files_equals(const char          *path,
+                                const unsigned char *content,
+                                size_t               size) {
+  unsigned char *buffer = malloc(size + 1);
+  int            fd     = open(path, O_RDONLY);
+  bool           ret    = (-1 != fd) &&
+             ((ssize_t)size == read(fd, buffer, size + 1)) &&
+             0 == memcmp(buffer, content, size);
+  if (-1 != fd) close(fd);
+  free(buffer);
+  return ret;
+}
+
+static void __test_files_random_id(char id_str[65]) {
+  np_id id;
+  randombytes_buf(id, NP_FINGERPRINT_BYTES);
+  np_id_str(id_str, id);
+}
+
+Test(np_files_t,
+     _files_chunk_store_and_manifest,
+     .description = "test the chunk store, the manifest entries and the have "
+                    "bitmap of streamed files") {
+  CTX() {
+    // random content, chunks of former runs must not be in the chunk store
+    uint32_t      file_size = 0;
+    unsigned char content[8100];
+    for (uint8_t i = 0; i < __TEST_FILES_CHUNKS; i++)
+      file_size += __test_files_lengths[i];
+    randombytes_buf(content, file_size);
+
+    char file_id[65], manifest_path[PATH_MAX];
+    __test_files_random_id(file_id);
+    snprintf(manifest_path,
+             PATH_MAX,
+             "%s/%s.manifest",
+             __TEST_FILES_CHUNK_DIR,
+             file_id);
+
+    __test_files_send_manifest(context,
+                               file_id,
+                               file_size,
+                               content,
+                               __test_files_lengths,
+                               __TEST_FILES_CHUNKS);
+    cr_expect(0 == access(manifest_path, F_OK), "expect a stored manifest");
+    cr_expect(0 != access(file_id, F_OK), "expect the file to be incomplete");
+
+    // a valid chunk at the wrong index is not accepted
+    __test_files_send_segment(context, file_id, 1, content, 5000);
+    cr_expect(!__test_files_chunk_exists(content, 5000),
+              "expect a chunk to match its manifest entry");
+    __test_files_send_segment(context, file_id, 3, content + 8000, 100);
+    cr_expect(!__test_files_chunk_exists(content + 8000, 100),
+              "expect an index beyond the manifest to be rejected");
+
+    // chunks in any order complete the file
+    uint32_t offsets[__TEST_FILES_CHUNKS] = {0, 5000, 8000};
+    for (int8_t i = __TEST_FILES_CHUNKS - 1; i >= 0; i--) {
+      __test_files_send_segment(context,
+                                file_id,
+                                i,
+                                content + offsets[i],
+                                __test_files_lengths[i]);
+      cr_expect(__test_files_chunk_exists(content + offsets[i],
+                                          __test_files_lengths[i]),
+                "expect chunk %" PRIi8 " in the chunk store",
+                i);
+    }
+    cr_expect(__test_files_equals(file_id, content, file_size),
+              "expect the file to be assembled from its chunks");
+
+    // all chunks of a second file are already held, the have bitmap is full
+    char copy_id[65];
+    __test_files_random_id(copy_id);
+    __test_files_send_manifest(context,
+                               copy_id,
+                               file_size,
+                               content,
+                               __test_files_lengths,
+                               __TEST_FILES_CHUNKS);
+    cr_expect(__test_files_equals(copy_id, content, file_size),
+              "expect a file of held chunks to be assembled at once");
+
+    char copy_target[PATH_MAX];
+    snprintf(copy_target, PATH_MAX, "%s.copy", file_id);
+    cr_expect(np_files_materialize(context, file_id, copy_target),
+              "expect the file to be assembled again");
+    cr_expect(__test_files_equals(copy_target, content, file_size),
+              "expect the same content");
+
+    unlink(file_id);
+    unlink(copy_id);
+    unlink(copy_target);
+  }
+}
+
+Test(np_files_t,
+     _files_reject_peer_paths,
+     .description = "test that the peer supplied np_id and manifest entries "
+                    "can not reach outside of the chunk store") {
+  CTX() {
+    unsigned char content[100];
+    randombytes_buf(content, sizeof(content));
+    uint32_t length = sizeof(content);
+
+    // the manifest would end up in the cwd instead of the chunk store
+    const char *escape = "../np_test_files_escape";
+    unlink("np_test_files_escape.manifest");
+    __test_files_send_manifest(context, escape, length, content, &length, 1);
+    cr_expect(0 != access("np_test_files_escape.manifest", F_OK),
+              "expect a np_id with a path to be rejected");
+
+    // 64 characters, but not a hex encoded np_id
+    char file_id[65], escape_path[PATH_MAX];
+    __test_files_random_id(file_id);
+    memcpy(file_id, "../", 3);
+    snprintf(escape_path, PATH_MAX, "%s.manifest", file_id + 3);
+    __test_files_send_manifest(context, file_id, length, content, &length, 1);
+    cr_expect(0 != access(escape_path, F_OK), "expect a non hex id to fail");
+
+    np_tree_t *tree = np_tree_create();
+    np_tree_insert_str(tree, "np_id", np_treeval_new_ul(42));
+    np_tree_insert_str(tree, "content", np_treeval_new_bin(content, length));
+    __test_files_deliver(context, tree);
+
+    np_tree_t *single = np_tree_create();
+    np_tree_insert_str(single, "np_id", np_treeval_new_s((char *)escape));
+    np_tree_insert_str(single, "content", np_treeval_new_bin(content, length));
+    __test_files_deliver(context, single);
+    cr_expect(0 != access(escape, F_OK),
+              "expect a single file not to be written outside of the cwd");
+
+    // segments of files without a manifest are not stored
+    __test_files_random_id(file_id);
+    __test_files_send_segment(context, file_id, 0, content, length);
+    cr_expect(!__test_files_chunk_exists(content, length),
+              "expect a segment of an unknown file to be dropped");
+    cr_expect(!np_files_materialize(context, escape, "np_test_files_target"),
+              "expect materialize to reject a np_id with a path");
+
+    // upper case ids are stored by their re-encoded lower case form
+    char upper_id[65], manifest_path[PATH_MAX];
+    for (uint8_t i = 0; i < 64; i++) upper_id[i] = toupper(file_id[i]);
+    upper_id[64] = '\0';
+    __test_files_send_manifest(context, upper_id, length, content, &length, 1);
+    snprintf(manifest_path,
+             PATH_MAX,
+             "%s/%s.manifest",
+             __TEST_FILES_CHUNK_DIR,
+             file_id);
+    cr_expect(0 == access(manifest_path, F_OK),
+              "expect the manifest to be stored by the re-encoded id");
+    __test_files_send_segment(context, upper_id, 0, content, length);
+    cr_expect(__test_files_equals(file_id, content, length),
+              "expect the file to be assembled by the re-encoded id");
+    unlink(file_id);
+
+    // a chunk must not be written beyond the size of the file
+    char short_id[65];
+    __test_files_random_id(short_id);
+    __test_files_send_manifest(context, short_id, 10, content, &length, 1);
+    cr_expect(!np_files_materialize(context, short_id, short_id),
+              "expect a chunk beyond the file size to be rejected");
+    unlink(short_id);
+  }
+}
+
+Test(np_files_t,
+     _files_stream_pump,
+     .description = "test that streamed files are chunked by the stream pump "
+                    "and that it paces the segments of a transfer") {
+  CTX() {
+    // at least 16 chunks, the segment size is the upper bound of a chunk
+    const char    *filename = "np_test_files_stream.bin";
+    size_t         size     = 16 * NP_FILE_SEGMENT_SIZE;
+    unsigned char *content  = malloc(size);
+    randombytes_buf(content, size);
+    int fd = open(filename, O_CREAT | O_TRUNC | O_WRONLY, 0600);
+    cr_assert(-1 != fd, "expect the test file to be created");
+    cr_assert((ssize_t)size == write(fd, content, size));
+    close(fd);
+    free(content);
+
+    np_id seed;
+    randombytes_buf(seed, NP_FINGERPRINT_BYTES);
+    np_files_open(context, seed, filename);
+
+    np_subject subject_id;
+    char       id_str[65];
+    np_generate_subject(&subject_id, filename, strlen(filename));
+    struct np_token token = {0};
+    snprintf(token.subject,
+             sizeof(token.subject),
+             "files/%s",
+             np_id_str(id_str, subject_id));
+
+    // no worker threads are running, each message handed over to the
+    // library stays in the jobqueue
+    unsigned char probe[1] = {0};
+    np_send(context, (unsigned char *)token.subject, probe, 1);
+    uint32_t jobs = np_jobqueue_count(context);
+    np_send(context, (unsigned char *)token.subject, probe, 1);
+    uint32_t per_send = np_jobqueue_count(context) - jobs;
+    cr_assert(0 < per_send, "expect np_send to submit a job");
+
+    jobs = np_jobqueue_count(context);
+    np_files_send_authorized(context, &token);
+    cr_expect(jobs + 1 == np_jobqueue_count(context),
+              "expect only the stream pump to be started by a request");
+
+    np_util_event_t event = {0};
+    jobs                  = np_jobqueue_count(context);
+    __np_files_stream_pump(context, event);
+    cr_expect(jobs + per_send == np_jobqueue_count(context),
+              "expect the stream pump to send the manifest");
+
+    jobs = np_jobqueue_count(context);
+    __np_files_stream_pump(context, event);
+    cr_expect(jobs == np_jobqueue_count(context),
+              "expect no segments before the have reports timed out");
+
+    np_time_sleep(__TEST_FILES_HAVE_TIMEOUT);
+    uint32_t segments = 0;
+    uint32_t sent     = 0;
+    do {
+      jobs = np_jobqueue_count(context);
+      __np_files_stream_pump(context, event);
+      sent = (np_jobqueue_count(context) - jobs) / per_send;
+      cr_expect(sent <= NP_FILE_SEGMENTS_PER_INTERVAL,
+                "expect at most %" PRIu32 " segments per interval",
+                (uint32_t)NP_FILE_SEGMENTS_PER_INTERVAL);
+      if (segments == 0)
+        cr_expect(NP_FILE_SEGMENTS_PER_INTERVAL == sent,
+                  "expect the first interval to use the full quota");
+      segments += sent;
+    } while (sent > 0 && segments <= size);
+    cr_expect(16 <= segments, "expect all chunks of the file to be sent");
+
+    // the finished transfer is removed, a new request chunks the file again
+    np_files_send_authorized(context, &token);
+    jobs = np_jobqueue_count(context);
+    __np_files_stream_pump(context, event);
+    cr_expect(jobs + per_send == np_jobqueue_count(context),
+              "expect a new transfer to start with a manifest");
+
+    unlink(filename);
+  }
+}
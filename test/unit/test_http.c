@@ -0,0 +1,375 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <netdb.h>
+#include <poll.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/socket.h>
+#include <unistd.h>
+
+#include "../test_macros.c"
+
+#include "../framework/http/np_http.h"
+#include "../framework/sysinfo/np_sysinfo.h"
+
+#include "neuropil_log.h"
+
+#include "np_evloop.h"
+#include "np_legacy.h"
+#include "np_log.h"
+#include "np_settings.h"
+#include "np_types.h"
+#include "np_util.h"
+
+#define __TEST_HTTP_PORT           "31480"
+#define __TEST_HTTP_ROUNDS         200
+#define __TEST_HTTP_LATENCY_ROUNDS 100
+#define __TEST_HTTP_MAX_RESPONSES  256
+#define __TEST_HTTP_STATUS         "HTTP/1.1 "
+#define __TEST_HTTP_CONTENT_LENGTH "Content-Length: "
+#define __TEST_HTTP_HEADER_END     "\r\n\r\n"
+
+TestSuite(np_http_t);
+
+static int __test_http_handle_echo(ht_request_t  *request,
+                                   ht_response_t *response,
+                                   void          *user_arg) {
+  uint32_t *count = user_arg;
+  (*count)++;
+
+  char body[64];
+  snprintf(body, 64, "{\"count\":%" PRIu32 "}", *count);
+  response->ht_body = strdup(body);
+  return HTTP_CODE_OK;
+}
+
+static int __test_http_connect(const char *port) {
+  struct addrinfo  hints = {.ai_family = AF_INET, .ai_socktype = SOCK_STREAM};
+  struct addrinfo *addr  = NULL;
+  cr_assert(0 == getaddrinfo("localhost", port, &hints, &addr),
+            "expect localhost to be resolved");
+
+  int fd = socket(addr->ai_family, addr->ai_socktype, addr->ai_protocol);
+  cr_assert(0 <= fd, "expect a client socket");
+  cr_assert(0 == connect(fd, addr->ai_addr, addr->ai_addrlen),
+            "expect the http server to accept the connection");
+  freeaddrinfo(addr);
+  return fd;
+}
+
+static void __test_http_send(int fd, const char *data, size_t len) {
+  size_t sent = 0;
+  while (sent < len) {
+    ssize_t ret = send(fd, data + sent, len - sent, 0);
+    cr_assert(0 < ret, "expect the request to be sent");
+    sent += ret;
+  }
+}
+
+// reads complete responses into statuses until the expected number of
+// responses has been received. Each response is parsed by its status line and
+// content length. The http loop runs in its own thread, a polled loop is run
+// here. Returns the number of responses.
+static uint32_t __test_http_receive(np_state_t *context,
+                                    int         fd,
+                                    uint32_t    expected,
+                                    int        *statuses,
+                                    bool       *closed) {
+  size_t          size      = 16384;
+  size_t          len       = 0;
+  char           *buffer    = malloc(size + 1);
+  uint32_t        responses = 0;
+  np_util_event_t noop      = {0};
+  double          timeout   = np_time_now() + 10.0;
+  CHECK_MALLOC(buffer);
+
+  *closed = false;
+  while (responses < expected && !*closed && np_time_now() < timeout) {
+    if (!NP_EVENT_LOOP_EVENT_DRIVEN) _np_events_read_http(context, noop);
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (0 >= poll(&pfd, 1, 10)) continue;
+
+    if (len == size) {
+      size *= 2;
+      buffer = realloc(buffer, size + 1);
+      CHECK_MALLOC(buffer);
+    }
+    ssize_t ret = recv(fd, buffer + len, size - len, MSG_DONTWAIT);
+    if (0 == ret) *closed = true;
+    if (0 >= ret) continue;
+    len += ret;
+    buffer[len] = '\0';
+
+    // a response may be split between two reads
+    char *header_end = NULL;
+    while (responses < expected &&
+           NULL != (header_end = strstr(buffer, __TEST_HTTP_HEADER_END))) {
+      int status = 0;
+      cr_assert(1 == sscanf(buffer, __TEST_HTTP_STATUS "%3d", &status),
+                "expect a response to start with a status line");
+
+      size_t content_length = 0;
+      char  *field          = strstr(buffer, __TEST_HTTP_CONTENT_LENGTH);
+      if (field != NULL && field < header_end)
+        content_length =
+            strtoul(field + strlen(__TEST_HTTP_CONTENT_LENGTH), NULL, 10);
+
+      size_t response_len =
+          (header_end - buffer) + strlen(__TEST_HTTP_HEADER_END) +
+          content_length;
+      if (response_len > len) break;
+
+      if (responses < __TEST_HTTP_MAX_RESPONSES) statuses[responses] = status;
+      responses++;
+      len -= response_len;
+      memmove(buffer, buffer + response_len, len);
+      buffer[len] = '\0';
+    }
+  }
+  free(buffer);
+  return responses;
+}
+
+Test(np_http_t,
+     _http_keep_alive_pipelining,
+     .description = "test pipelined requests on a keep alive connection and "
+                    "the closing of http/1.0 connections") {
+  CTX() {
+    uint32_t handled = 0;
+    cr_assert(_np_http_init(context, "localhost", __TEST_HTTP_PORT),
+              "expect the http server to start");
+    _np_add_http_callback(context,
+                          "test/echo",
+                          htp_method_GET,
+                          &handled,
+                          __test_http_handle_echo);
+
+    int  statuses[__TEST_HTTP_MAX_RESPONSES] = {0};
+    bool closed                              = false;
+    int  fd = __test_http_connect(__TEST_HTTP_PORT);
+
+    const char pipeline[] = "GET /test/echo HTTP/1.1\r\nHost: localhost\r\n\r\n"
+                            "GET /test/echo?a=b HTTP/1.1\r\n\r\n"
+                            "GET /test//echo/ HTTP/1.1\r\n\r\n";
+    __test_http_send(fd, pipeline, sizeof(pipeline) - 1);
+    cr_expect(3 == __test_http_receive(context, fd, 3, statuses, &closed),
+              "expect a response to each pipelined request");
+    for (uint8_t i = 0; i < 3; i++)
+      cr_expect(200 == statuses[i], "expect response %" PRIu8 " to be ok", i);
+    cr_expect(!closed, "expect the connection to be kept alive");
+    cr_expect(3 == handled, "expect the requests to be routed to the callback");
+
+    // http/1.0 without keep alive, the second request is not answered
+    const char http10[] = "GET /unknown HTTP/1.0\r\n\r\n"
+                          "GET /test/echo HTTP/1.1\r\n\r\n";
+    __test_http_send(fd, http10, sizeof(http10) - 1);
+    cr_expect(1 == __test_http_receive(context, fd, 2, statuses, &closed),
+              "expect a single response");
+    cr_expect(404 == statuses[0], "expect the response to be not found");
+    cr_expect(closed, "expect the connection to be closed by the server");
+    cr_expect(3 == handled, "expect no further request to be routed");
+
+    close(fd);
+    _np_http_destroy(context);
+  }
+}
+
+Test(np_http_t,
+     _http_load,
+     .description = "measure the request rate of the sysinfo, metrics and a "
+                    "test endpoint with pipelined requests against loopback") {
+  CTX() {
+    uint32_t handled = 0;
+    cr_assert(_np_http_init(context, "localhost", __TEST_HTTP_PORT),
+              "expect the http server to start");
+    np_sysinfo_enable_local(context);
+    _np_add_http_callback(context,
+                          "test/echo",
+                          htp_method_GET,
+                          &handled,
+                          __test_http_handle_echo);
+
+    const char *paths[] = {"/sysinfo", "/metrics", "/test/echo"};
+    for (uint8_t p = 0; p < ARRAY_SIZE(paths); p++) {
+      char request[128];
+      int  len = snprintf(request,
+                         128,
+                         "GET %s HTTP/1.1\r\nHost: localhost\r\n\r\n",
+                         paths[p]);
+
+      int  statuses[__TEST_HTTP_MAX_RESPONSES] = {0};
+      bool closed                              = false;
+      int  fd = __test_http_connect(__TEST_HTTP_PORT);
+
+      double start = np_time_now();
+      for (uint16_t r = 0; r < __TEST_HTTP_ROUNDS; r++)
+        __test_http_send(fd, request, len);
+      uint32_t responses = __test_http_receive(context,
+                                               fd,
+                                               __TEST_HTTP_ROUNDS,
+                                               statuses,
+                                               &closed);
+      double   duration  = np_time_now() - start;
+
+      cr_expect(__TEST_HTTP_ROUNDS == responses,
+                "expect a response to each request of %s",
+                paths[p]);
+      for (uint16_t r = 0; r < responses; r++)
+        cr_expect(200 == statuses[r],
+                  "expect response %" PRIu16 " of %s to be ok",
+                  r,
+                  paths[p]);
+      cr_expect(!closed, "expect the connection to be kept alive");
+      cr_log_info("http %-10s: %5" PRIu32 " requests in %.6f sec (%.0f/s)\n",
+                  paths[p],
+                  responses,
+                  duration,
+                  responses / duration);
+      close(fd);
+    }
+    cr_expect(__TEST_HTTP_ROUNDS == handled,
+              "expect each test request to be routed to the callback");
+    _np_http_destroy(context);
+  }
+}
+
+static int __test_http_double_cmp(const void *a, const void *b) {
+  double da = *(const double *)a, db = *(const double *)b;
+  return (da > db) - (da < db);
+}
+
+Test(np_http_t,
+     _http_keep_alive_latency,
+     .description = "measure the latency of single requests on a keep alive "
+                    "connection, each request waits for its response") {
+  CTX() {
+    uint32_t handled = 0;
+    cr_assert(_np_http_init(context, "localhost", __TEST_HTTP_PORT),
+              "expect the http server to start");
+    _np_add_http_callback(context,
+                          "test/echo",
+                          htp_method_GET,
+                          &handled,
+                          __test_http_handle_echo);
+
+    const char request[] = "GET /test/echo HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    int        statuses[__TEST_HTTP_MAX_RESPONSES]   = {0};
+    double     latencies[__TEST_HTTP_LATENCY_ROUNDS] = {0};
+    bool       closed                                = false;
+    int        fd = __test_http_connect(__TEST_HTTP_PORT);
+
+    for (uint16_t r = 0; r < __TEST_HTTP_LATENCY_ROUNDS; r++) {
+      double start = np_time_now();
+      __test_http_send(fd, request, sizeof(request) - 1);
+      cr_assert(1 == __test_http_receive(context, fd, 1, statuses, &closed),
+                "expect a response to request %" PRIu16,
+                r);
+      latencies[r] = np_time_now() - start;
+      cr_expect(200 == statuses[0], "expect the response to be ok");
+      cr_assert(!closed, "expect the connection to be kept alive");
+    }
+    cr_expect(__TEST_HTTP_LATENCY_ROUNDS == handled,
+              "expect each request to be routed to the callback");
+
+    qsort(latencies,
+          __TEST_HTTP_LATENCY_ROUNDS,
+          sizeof(double),
+          __test_http_double_cmp);
+    double p50 = latencies[__TEST_HTTP_LATENCY_ROUNDS / 2];
+    double p99 = latencies[(__TEST_HTTP_LATENCY_ROUNDS * 99) / 100];
+    cr_log_info("http keep alive latency: p50 %.6f sec p99 %.6f sec\n",
+                p50,
+                p99);
+    // a loop polled every MISC_READ_HTTP_SEC would add half of the interval
+    if (NP_EVENT_LOOP_EVENT_DRIVEN)
+      cr_expect(p50 < (MISC_READ_HTTP_SEC / 10),
+                "expect a request not to wait for a polled http loop");
+
+    close(fd);
+    _np_http_destroy(context);
+  }
+}
+
+// polls the http loop until the server closes the connection or until the
+// time until has passed. Returns true if the connection has been closed.
+static bool
+__test_http_wait_closed(np_state_t *context, int fd, double until) {
+  np_util_event_t noop = {0};
+  char            data[64];
+
+  while (np_time_now() < until) {
+    if (!NP_EVENT_LOOP_EVENT_DRIVEN) _np_events_read_http(context, noop);
+
+    struct pollfd pfd = {.fd = fd, .events = POLLIN};
+    if (0 >= poll(&pfd, 1, 10)) continue;
+    if (0 == recv(fd, data, sizeof(data), MSG_DONTWAIT)) return true;
+  }
+  return false;
+}
+
+Test(np_http_t,
+     _http_idle_timeout,
+     .description = "test that idle and slow clients are closed after "
+                    "NP_HTTP_TIMEOUT_SEC") {
+  CTX() {
+    uint32_t handled = 0;
+    cr_assert(_np_http_init(context, "localhost", __TEST_HTTP_PORT),
+              "expect the http server to start");
+    _np_add_http_callback(context,
+                          "test/echo",
+                          htp_method_GET,
+                          &handled,
+                          __test_http_handle_echo);
+
+    const char request[] = "GET /test/echo HTTP/1.1\r\nHost: localhost\r\n\r\n";
+    int        statuses[__TEST_HTTP_MAX_RESPONSES] = {0};
+    bool       closed                              = false;
+
+    // an idle connection is kept open until the timeout, a request restarts it
+    int fd = __test_http_connect(__TEST_HTTP_PORT);
+    cr_expect(!__test_http_wait_closed(context,
+                                       fd,
+                                       np_time_now() +
+                                           NP_HTTP_TIMEOUT_SEC / 2),
+              "expect the connection to be open before the timeout");
+    __test_http_send(fd, request, sizeof(request) - 1);
+    cr_expect(1 == __test_http_receive(context, fd, 1, statuses, &closed),
+              "expect a response to the request");
+    cr_expect(200 == statuses[0], "expect the response to be ok");
+
+    double start = np_time_now();
+    cr_expect(__test_http_wait_closed(context,
+                                      fd,
+                                      start + NP_HTTP_TIMEOUT_SEC + 2.0),
+              "expect the idle connection to be closed by the server");
+    cr_expect(np_time_now() - start >= NP_HTTP_TIMEOUT_SEC * 0.9,
+              "expect the timeout to be restarted by the request");
+    close(fd);
+
+    // an incomplete request does not restart the timeout
+    fd    = __test_http_connect(__TEST_HTTP_PORT);
+    start = np_time_now();
+    for (uint8_t i = 0; i < 4; i++) {
+      __test_http_send(fd, request + i, 1);
+      __test_http_wait_closed(context,
+                              fd,
+                              np_time_now() + NP_HTTP_TIMEOUT_SEC / 8);
+    }
+    cr_expect(__test_http_wait_closed(context,
+                                      fd,
+                                      start + NP_HTTP_TIMEOUT_SEC + 2.0),
+              "expect the slow connection to be closed by the server");
+    cr_expect(np_time_now() - start < NP_HTTP_TIMEOUT_SEC + 1.0,
+              "expect the partial request not to restart the timeout");
+    cr_expect(1 == handled, "expect no partial request to be routed");
+
+    close(fd);
+    _np_http_destroy(context);
+  }
+}
@@ -370,3 +370,41 @@ Test(np_tree_t,
               "expect element to be changed");
   }
 }
+
+Test(np_tree_t,
+     tree_node_insert_ref,
+     .description = "test insertion of borrowed binary data into a tree") {
+  CTX() {
+    unsigned char payload[64];
+    memset(payload, 0x2a, sizeof(payload));
+
+    np_tree_t *test_tree_1 = np_tree_create();
+    np_tree_insert_str_ref(test_tree_1, "payload", payload, sizeof(payload));
+    np_tree_insert_str(test_tree_1,
+                       "copy",
+                       np_treeval_new_bin(payload, sizeof(payload)));
+
+    np_tree_elem_t *ref_elem  = np_tree_find_str(test_tree_1, "payload");
+    np_tree_elem_t *copy_elem = np_tree_find_str(test_tree_1, "copy");
+    cr_expect(NULL != ref_elem, "expect element to be present");
+    cr_expect(payload == ref_elem->val.value.bin,
+              "expect borrowed data not to be copied");
+    cr_expect(payload != copy_elem->val.value.bin,
+              "expect inserted data to be copied");
+    cr_expect(np_treeval_get_byte_size(ref_elem->val) ==
+                  np_treeval_get_byte_size(copy_elem->val),
+              "expect borrowed and copied data to have the same size");
+
+    np_tree_t      *test_tree_2 = np_tree_clone(test_tree_1);
+    np_tree_elem_t *clone_elem  = np_tree_find_str(test_tree_2, "payload");
+    cr_expect(np_treeval_type_bin == clone_elem->val.type,
+              "expect the clone to own its data");
+    cr_expect(payload != clone_elem->val.value.bin,
+              "expect the clone to own its data");
+    cr_expect(0 == memcmp(payload, clone_elem->val.value.bin, sizeof(payload)),
+              "expect the clone to contain the same data");
+
+    np_tree_free(test_tree_2);
+    np_tree_free(test_tree_1);
+  }
+}
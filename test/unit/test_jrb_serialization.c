@@ -540,6 +540,96 @@ Test(test_serialization,
   }
 }
 
+Test(test_serialization,
+     serialize_map_prefixed,
+     .description = "test the serialization of a map with a pre-serialized "
+                    "static part") {
+  CTX() {
+    np_dhkey_t subject = {0}, to = {0}, from = {0};
+    randombytes_buf(&subject, sizeof(np_dhkey_t));
+    randombytes_buf(&to, sizeof(np_dhkey_t));
+    randombytes_buf(&from, sizeof(np_dhkey_t));
+
+    np_tree_t *prefix_tree = np_tree_create();
+    np_tree_insert_str(prefix_tree,
+                       _NP_MSG_HEADER_SUBJECT,
+                       np_treeval_new_dhkey(subject));
+
+    unsigned char         prefix[MSG_HEADER_PREFIX_SIZE] = {0};
+    np_serialize_buffer_t prefix_serializer = {._tree          = prefix_tree,
+                                               ._target_buffer = prefix,
+                                               ._buffer_size =
+                                                   MSG_HEADER_PREFIX_SIZE,
+                                               ._bytes_written = 0,
+                                               ._error         = 0};
+    np_serializer_write_elements(context, &prefix_serializer, prefix_tree);
+    cr_assert(0 == prefix_serializer._error,
+              "expect the prefix to be serialized");
+    cr_expect(0 < prefix_serializer._bytes_written &&
+                  prefix_serializer._bytes_written <
+                      np_tree_get_byte_size(prefix_tree),
+              "expect the prefix to hold the elements without the map");
+
+    np_tree_t *header = np_tree_create();
+    np_tree_copy(prefix_tree, header);
+    np_tree_insert_str(header, _NP_MSG_HEADER_TO, np_treeval_new_dhkey(to));
+    np_tree_insert_str(header,
+                       _NP_MSG_HEADER_FROM,
+                       np_treeval_new_dhkey(from));
+
+    size_t                header_size = np_tree_get_byte_size(header);
+    unsigned char         plain[header_size], prefixed[header_size];
+    np_serialize_buffer_t plain_serializer    = {._tree          = header,
+                                                 ._target_buffer = plain,
+                                                 ._buffer_size   = header_size,
+                                                 ._bytes_written = 0,
+                                                 ._error         = 0};
+    np_serialize_buffer_t prefixed_serializer = {._tree          = header,
+                                                 ._target_buffer = prefixed,
+                                                 ._buffer_size   = header_size,
+                                                 ._bytes_written = 0,
+                                                 ._error         = 0};
+    np_serializer_write_map(context, &plain_serializer, header);
+    np_serializer_write_map_prefixed(context,
+                                     &prefixed_serializer,
+                                     header,
+                                     &_NP_MSG_HEADER_SUBJECT,
+                                     1,
+                                     prefix,
+                                     prefix_serializer._bytes_written);
+    cr_assert(0 == prefixed_serializer._error,
+              "expect the prefixed map to be serialized");
+    cr_expect(plain_serializer._bytes_written ==
+                  prefixed_serializer._bytes_written,
+              "expect the prefixed map to have the size of the plain map");
+
+    np_tree_t              *out_tree     = np_tree_create();
+    np_deserialize_buffer_t deserializer = {
+        ._target_tree = out_tree,
+        ._buffer      = prefixed,
+        ._buffer_size = prefixed_serializer._bytes_written,
+        ._bytes_read  = 0,
+        ._error       = 0};
+    np_serializer_read_map(context, &deserializer, out_tree);
+    cr_assert(0 == deserializer._error, "expect the map to be deserialized");
+    cr_expect(3 == out_tree->size, "expect all elements to be deserialized");
+
+    np_tree_elem_t *elem = np_tree_find_str(out_tree, _NP_MSG_HEADER_SUBJECT);
+    cr_expect(NULL != elem && _np_dhkey_equal(&elem->val.value.dhkey, &subject),
+              "expect the subject to be read from the prefix");
+    elem = np_tree_find_str(out_tree, _NP_MSG_HEADER_TO);
+    cr_expect(NULL != elem && _np_dhkey_equal(&elem->val.value.dhkey, &to),
+              "expect the receiver to be read");
+    elem = np_tree_find_str(out_tree, _NP_MSG_HEADER_FROM);
+    cr_expect(NULL != elem && _np_dhkey_equal(&elem->val.value.dhkey, &from),
+              "expect the sender to be read");
+
+    np_tree_free(out_tree);
+    np_tree_free(header);
+    np_tree_free(prefix_tree);
+  }
+}
+
 Test(neuropil_h,
      np_encrypted_container_serialization,
      .description = "test the serialization of a np_token") {
@@ -0,0 +1,340 @@
+//
+// SPDX-FileCopyrightText: 2016-2023 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <fcntl.h>
+#include <limits.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdlib.h>
+#include <string.h>
+#include <sys/stat.h>
+#include <unistd.h>
+
+#include "sodium.h"
+
+#include "../test_macros.c"
+
+#include "../framework/identity/np_identity.h"
+#include "../framework/identity/np_keystore.h"
+#include "util/np_event.h"
+#include "util/np_serialization.h"
+
+#include "np_legacy.h"
+
+// the on disk layout of the keystore
+#define __TEST_KEYSTORE_RECORD_SIZE                                            \
+  (crypto_secretbox_NONCEBYTES + crypto_secretbox_MACBYTES + 1 +               \
+   NP_FINGERPRINT_BYTES)
+#define __TEST_KEYSTORE_IDENTITIES 8
+
+bool __np_keystore_save(np_state_t *context, np_util_event_t args);
+
+TestSuite(np_keystore_t);
+
+struct __test_keystore {
+  char          dirname[PATH_MAX];
+  np_id         keystore_id;
+  unsigned char passphrase[NP_KEY_BYTES];
+
+  struct np_token tokens[__TEST_KEYSTORE_IDENTITIES];
+  np_id           fingerprints[__TEST_KEYSTORE_IDENTITIES];
+};
+
+static void __test_keystore_setup(np_state_t             *context,
+                                  struct __test_keystore *keystore) {
+  mkdir("tmp", S_IRWXU | S_IRWXG | S_IROTH | S_IXOTH);
+  snprintf(keystore->dirname, PATH_MAX, "tmp/keystore_XXXXXX");
+  cr_assert(NULL != mkdtemp(keystore->dirname),
+            "expect a new keystore directory");
+
+  randombytes_buf(keystore->keystore_id, NP_FINGERPRINT_BYTES);
+  randombytes_buf(keystore->passphrase, NP_KEY_BYTES);
+
+  for (uint8_t i = 0; i < __TEST_KEYSTORE_IDENTITIES; i++) {
+    keystore->tokens[i] = np_new_identity(context, np_time_now() + 3600, NULL);
+    np_token_fingerprint(context,
+                         keystore->tokens[i],
+                         false,
+                         &keystore->fingerprints[i]);
+  }
+}
+
+static void __test_keystore_path(struct __test_keystore *keystore,
+                                 const char             *filename,
+                                 char (*path)[PATH_MAX]) {
+  snprintf(*path, PATH_MAX, "%s/%s", keystore->dirname, filename);
+}
+
+static off_t __test_keystore_log_size(struct __test_keystore *keystore) {
+  char        path[PATH_MAX];
+  struct stat info;
+  __test_keystore_path(keystore, ".npks.log", &path);
+  return (0 == stat(path, &info)) ? info.st_size : -1;
+}
+
+static void __test_keystore_init(np_state_t             *context,
+                                 struct __test_keystore *keystore) {
+  cr_assert(np_ok == np_keystore_init(context,
+                                      keystore->keystore_id,
+                                      keystore->dirname,
+                                      keystore->passphrase),
+            "expect the keystore to be initialized");
+}
+
+// identities [0, removed) have been removed, the others are part of the store
+static void __test_keystore_expect(np_state_t             *context,
+                                   struct __test_keystore *keystore,
+                                   uint8_t                 removed) {
+  for (uint8_t i = 0; i < __TEST_KEYSTORE_IDENTITIES; i++) {
+    enum np_return ret = np_keystore_check_identity(context,
+                                                    keystore->keystore_id,
+                                                    &keystore->tokens[i]);
+    if (i < removed)
+      cr_expect(np_ok != ret, "expect identity %" PRIu8 " to be removed", i);
+    else
+      cr_expect(np_ok == ret, "expect identity %" PRIu8 " to be known", i);
+  }
+}
+
+static void __test_keystore_store(np_state_t             *context,
+                                  struct __test_keystore *keystore,
+                                  uint8_t                 removed) {
+  for (uint8_t i = 0; i < __TEST_KEYSTORE_IDENTITIES; i++)
+    cr_expect(np_ok == np_keystore_store_identity(context,
+                                                  keystore->keystore_id,
+                                                  &keystore->tokens[i]),
+              "expect identity %" PRIu8 " to be stored",
+              i);
+  for (uint8_t i = 0; i < removed; i++)
+    cr_expect(np_ok == np_keystore_remove_identity(context,
+                                                   keystore->keystore_id,
+                                                   keystore->fingerprints[i]),
+              "expect identity %" PRIu8 " to be removed",
+              i);
+}
+
+Test(np_keystore_t,
+     _keystore_log_index_and_replay,
+     .description = "test the record log and its index, and the replay of "
+                    "the log into a missing index") {
+  CTX() {
+    struct __test_keystore keystore = {0};
+    __test_keystore_setup(context, &keystore);
+    __test_keystore_init(context, &keystore);
+
+    __test_keystore_store(context, &keystore, 0);
+    __test_keystore_expect(context, &keystore, 0);
+    cr_expect(__TEST_KEYSTORE_IDENTITIES * __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect a record per stored identity");
+
+    // a stored identity is not appended again
+    cr_expect(np_ok == np_keystore_store_identity(context,
+                                                  keystore.keystore_id,
+                                                  &keystore.tokens[0]),
+              "expect a known identity to be accepted");
+    cr_expect(__TEST_KEYSTORE_IDENTITIES * __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect no record for a known identity");
+
+    // removals append tombstones
+    uint8_t removed = __TEST_KEYSTORE_IDENTITIES / 4;
+    for (uint8_t i = 0; i < removed; i++)
+      cr_expect(np_ok == np_keystore_remove_identity(context,
+                                                     keystore.keystore_id,
+                                                     keystore.fingerprints[i]),
+                "expect identity %" PRIu8 " to be removed",
+                i);
+    __test_keystore_expect(context, &keystore, removed);
+    cr_expect((__TEST_KEYSTORE_IDENTITIES + removed) *
+                      __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect a tombstone record per removed identity");
+
+    struct np_token loaded = {0};
+    cr_expect(np_ok == np_keystore_load_identity(context,
+                                                 keystore.keystore_id,
+                                                 keystore.fingerprints[removed],
+                                                 &loaded),
+              "expect a known identity to be loaded");
+    cr_expect(0 == memcmp(loaded.public_key,
+                          keystore.tokens[removed].public_key,
+                          NP_PUBLIC_KEY_BYTES),
+              "expect the stored token");
+    cr_expect(np_ok != np_keystore_load_identity(context,
+                                                 keystore.keystore_id,
+                                                 keystore.fingerprints[0],
+                                                 &loaded),
+              "expect a removed identity not to be loaded");
+
+    // the index of the previous run is used as it is
+    np_keystore_destroy(context, keystore.keystore_id);
+    __test_keystore_init(context, &keystore);
+    __test_keystore_expect(context, &keystore, removed);
+    cr_expect(np_ok == np_keystore_load_identities(context,
+                                                   keystore.keystore_id),
+              "expect all identities to be loaded");
+
+    // a missing index is rebuilt from the log, a torn record is ignored
+    np_keystore_destroy(context, keystore.keystore_id);
+    char path[PATH_MAX];
+    __test_keystore_path(&keystore, ".npks.idx", &path);
+    cr_expect(0 == unlink(path), "expect the index to be removed");
+
+    __test_keystore_path(&keystore, ".npks.log", &path);
+    int           fd = open(path, O_WRONLY | O_APPEND);
+    unsigned char torn[__TEST_KEYSTORE_RECORD_SIZE / 2];
+    randombytes_buf(torn, sizeof(torn));
+    cr_expect(sizeof(torn) == write(fd, torn, sizeof(torn)),
+              "expect a torn record at the end of the log");
+    close(fd);
+
+    __test_keystore_init(context, &keystore);
+    __test_keystore_expect(context, &keystore, removed);
+    unsigned char *replayed = keystore.fingerprints[removed];
+    cr_expect(np_ok == np_keystore_remove_identity(context,
+                                                   keystore.keystore_id,
+                                                   replayed),
+              "expect a replayed identity to be removed");
+    __test_keystore_expect(context, &keystore, removed + 1);
+    np_keystore_destroy(context, keystore.keystore_id);
+  }
+}
+
+Test(np_keystore_t,
+     _keystore_compaction,
+     .description = "test that the compaction drops removed identities from "
+                    "the log") {
+  CTX() {
+    struct __test_keystore keystore = {0};
+    __test_keystore_setup(context, &keystore);
+    __test_keystore_init(context, &keystore);
+
+    // as many dead records (add and tombstone) as live records
+    uint8_t removed = __TEST_KEYSTORE_IDENTITIES / 2;
+    __test_keystore_store(context, &keystore, removed);
+    cr_expect((__TEST_KEYSTORE_IDENTITIES + removed) *
+                      __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect add and tombstone records in the log");
+
+    np_util_event_t noop = {0};
+    cr_expect(__np_keystore_save(context, noop), "expect the save to pass");
+    cr_expect((__TEST_KEYSTORE_IDENTITIES - removed) *
+                      __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect only the live records in the compacted log");
+    __test_keystore_expect(context, &keystore, removed);
+
+    char path[PATH_MAX];
+    __test_keystore_path(&keystore, ".npks.log.tmp", &path);
+    cr_expect(0 != access(path, F_OK), "expect no temporary log");
+    __test_keystore_path(&keystore, ".npks.idx.tmp", &path);
+    cr_expect(0 != access(path, F_OK), "expect no temporary index");
+
+    // the compacted log is appended to and reopened with its index
+    cr_expect(np_ok == np_keystore_store_identity(context,
+                                                  keystore.keystore_id,
+                                                  &keystore.tokens[0]),
+              "expect an identity to be stored after the compaction");
+    np_keystore_destroy(context, keystore.keystore_id);
+
+    __test_keystore_init(context, &keystore);
+    for (uint8_t i = 0; i < __TEST_KEYSTORE_IDENTITIES; i++)
+      cr_expect((i == 0 || i >= removed) ==
+                    (np_ok ==
+                     np_keystore_check_identity(context,
+                                                keystore.keystore_id,
+                                                &keystore.tokens[i])),
+                "expect identity %" PRIu8 " to survive the compaction",
+                i);
+    np_keystore_destroy(context, keystore.keystore_id);
+  }
+}
+
+Test(np_keystore_t,
+     _keystore_migration,
+     .description = "test the conversion of a keystore file of the previous "
+                    "format into log records") {
+  CTX() {
+    struct __test_keystore keystore = {0};
+    __test_keystore_setup(context, &keystore);
+
+    // the previous format: tokens in their own files, the fingerprints in
+    // one encrypted array which may be padded with zeros
+    uint64_t subkey_id = 0;
+    for (uint8_t i = 0; i < __TEST_KEYSTORE_IDENTITIES; i++) {
+      unsigned char subkey[NP_FINGERPRINT_BYTES];
+      memcpy(&subkey_id, keystore.fingerprints[i], sizeof(uint64_t));
+      crypto_kdf_derive_from_key(subkey,
+                                 NP_FINGERPRINT_BYTES,
+                                 subkey_id,
+                                 (char *)keystore.keystore_id,
+                                 keystore.passphrase);
+      cr_assert(np_ok == np_identity_save_token(context,
+                                                keystore.dirname,
+                                                subkey,
+                                                &keystore.tokens[i]),
+                "expect the token file of identity %" PRIu8,
+                i);
+    }
+
+    size_t data_size = (__TEST_KEYSTORE_IDENTITIES + 1) * NP_FINGERPRINT_BYTES;
+    size_t cbor_size = 8 + crypto_box_NONCEBYTES;
+    size_t full_size = cbor_size + crypto_secretbox_MACBYTES + data_size;
+    unsigned char *region = calloc(1, full_size);
+    for (uint8_t i = 0; i < __TEST_KEYSTORE_IDENTITIES; i++)
+      memcpy(region + cbor_size + i * NP_FINGERPRINT_BYTES,
+             keystore.fingerprints[i],
+             NP_FINGERPRINT_BYTES);
+
+    unsigned char key[NP_KEY_BYTES];
+    unsigned char nonce[crypto_box_NONCEBYTES];
+    memcpy(&subkey_id, keystore.keystore_id, sizeof(uint64_t));
+    crypto_kdf_derive_from_key(key,
+                               NP_KEY_BYTES,
+                               subkey_id,
+                               (char *)keystore.keystore_id,
+                               keystore.passphrase);
+    randombytes_buf(nonce, sizeof(nonce));
+    cr_assert(0 == crypto_secretbox_easy(region + cbor_size,
+                                         region + cbor_size,
+                                         data_size,
+                                         nonce,
+                                         key));
+    cr_assert(np_serializer_write_encrypted(region,
+                                            &full_size,
+                                            nonce,
+                                            region + cbor_size,
+                                            data_size +
+                                                crypto_secretbox_MACBYTES));
+
+    char path[PATH_MAX];
+    __test_keystore_path(&keystore, ".npks", &path);
+    int fd = open(path, O_CREAT | O_WRONLY | O_TRUNC, S_IRUSR | S_IWUSR);
+    cr_assert(-1 != fd, "expect a keystore file of the previous format");
+    cr_assert((ssize_t)full_size == write(fd, region, full_size));
+    close(fd);
+    free(region);
+
+    __test_keystore_init(context, &keystore);
+    __test_keystore_expect(context, &keystore, 0);
+    cr_expect(__TEST_KEYSTORE_IDENTITIES * __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect a record per migrated identity, padding is skipped");
+    cr_expect(0 != access(path, F_OK), "expect the previous file to be moved");
+    __test_keystore_path(&keystore, ".npks.migrated", &path);
+    cr_expect(0 == access(path, F_OK), "expect the migrated file to be kept");
+
+    // the migration is not repeated
+    np_keystore_destroy(context, keystore.keystore_id);
+    __test_keystore_init(context, &keystore);
+    __test_keystore_expect(context, &keystore, 0);
+    cr_expect(__TEST_KEYSTORE_IDENTITIES * __TEST_KEYSTORE_RECORD_SIZE ==
+                  __test_keystore_log_size(&keystore),
+              "expect no records of a repeated migration");
+    np_keystore_destroy(context, keystore.keystore_id);
+  }
+}
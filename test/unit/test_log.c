@@ -0,0 +1,176 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <inttypes.h>
+#include <stdarg.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <string.h>
+
+#include "../test_macros.c"
+
+#include "np_legacy.h"
+#include "np_log.h"
+#include "np_settings.h"
+
+#define __TEST_LOG_MESSAGE "test log callback %d"
+
+TestSuite(np_log_t);
+
+static void
+__test_log_pack(struct np_log_record *record, const char *format, ...) {
+  va_list ap;
+  va_start(ap, format);
+  memset(record, 0, sizeof(struct np_log_record));
+  record->format = format;
+  __np_log_pack(record, format, ap);
+  va_end(ap);
+}
+
+Test(np_log_t,
+     _log_record_pack,
+     .description = "test that packed records format like snprintf") {
+  struct np_log_record record;
+  char                 expected[NP_LOG_LINE_MAX];
+  char                 line[NP_LOG_LINE_MAX];
+
+#define __TEST_LOG_FORMAT(...)                                                 \
+  {                                                                            \
+    __test_log_pack(&record, __VA_ARGS__);                                     \
+    cr_expect(record.complete, "expect all arguments to be packed");           \
+    size_t length = __np_log_unpack(&record, line, NP_LOG_LINE_MAX);           \
+    snprintf(expected, NP_LOG_LINE_MAX, __VA_ARGS__);                          \
+    cr_expect_str_eq(line, expected, "expect the same line as snprintf");      \
+    cr_expect(strlen(expected) == length, "expect the length of the line");    \
+  }
+
+  __TEST_LOG_FORMAT("no conversion");
+  __TEST_LOG_FORMAT("%d %i %c %%", -42, 4711, 'x');
+  __TEST_LOG_FORMAT("%" PRIu8 " %" PRIu16 " %" PRIu32 " %" PRIu64,
+                    (uint8_t)255,
+                    (uint16_t)65535,
+                    UINT32_MAX,
+                    UINT64_MAX);
+  __TEST_LOG_FORMAT("%" PRIi64 " %zu %zd %lx %X",
+                    INT64_MIN,
+                    (size_t)123456,
+                    (ssize_t)-1,
+                    0xdeadbeefUL,
+                    0xcafeU);
+  __TEST_LOG_FORMAT("%s|%-10s|%.3s|%5.2s", "abc", "left", "truncated", "xyz");
+  __TEST_LOG_FORMAT("%*d|%-*.*s|%.*f", 6, 42, 8, 2, "stars", 3, 3.14159);
+  __TEST_LOG_FORMAT("%f %e %g %10.4f %Lf", 0.5, 1e-9, 2.5e10, -1.0, 1.25L);
+  __TEST_LOG_FORMAT("%p", (void *)&record);
+#undef __TEST_LOG_FORMAT
+}
+
+Test(np_log_t,
+     _log_record_pack_incomplete,
+     .description = "test records with more arguments than args bytes") {
+  struct np_log_record record;
+  char                 line[NP_LOG_LINE_MAX];
+  char                 large[2 * NP_LOG_RECORD_ARGS_BYTES];
+
+  memset(large, 'a', sizeof(large) - 1);
+  large[sizeof(large) - 1] = '\0';
+
+  // a long string is stored as far as possible
+  __test_log_pack(&record, "%d %s %d", 1, large, 2);
+  cr_expect(!record.complete, "expect the record to be incomplete");
+  cr_expect(2 == record.specs, "expect the number and the string prefix");
+  cr_expect(NP_LOG_RECORD_ARGS_BYTES >= record.args_length,
+            "expect the args to stay within their bytes");
+
+  size_t length = __np_log_unpack(&record, line, NP_LOG_LINE_MAX);
+  cr_expect(0 == strncmp(line, "1 aaaa", 6), "expect the packed prefix");
+  cr_expect(0 == strcmp(line + length - 4, " ..."),
+            "expect the line to mark the missing arguments");
+
+  // fixed size arguments that do not fit end the record
+  __test_log_pack(&record,
+                  "%" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                  " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                  " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                  " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                  " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64
+                  " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64 " %" PRIu64,
+                  1ULL, 2ULL, 3ULL, 4ULL, 5ULL, 6ULL, 7ULL, 8ULL, 9ULL, 10ULL,
+                  11ULL, 12ULL, 13ULL, 14ULL, 15ULL, 16ULL, 17ULL, 18ULL,
+                  19ULL, 20ULL, 21ULL, 22ULL, 23ULL, 24ULL, 25ULL, 26ULL,
+                  27ULL, 28ULL, 29ULL, 30ULL);
+  cr_expect(!record.complete, "expect the record to be incomplete");
+  cr_expect(NP_LOG_RECORD_ARGS_BYTES / sizeof(uint64_t) == record.specs,
+            "expect as many numbers as fit into the args");
+
+  length = __np_log_unpack(&record, line, NP_LOG_LINE_MAX);
+  cr_expect(0 == strncmp(line, "1 2 3 4 5 ", 10), "expect the first numbers");
+  cr_expect(0 == strcmp(line + length - 4, " ..."),
+            "expect the line to mark the missing arguments");
+
+  // the buffer size limits the formatted message
+  __test_log_pack(&record, "%s", "0123456789");
+  length = __np_log_unpack(&record, line, 5);
+  cr_expect(4 == length, "expect the line to be cut at the buffer size");
+  cr_expect_str_eq(line, "0123", "expect a terminated prefix");
+}
+
+static uint32_t __test_log_callbacks = 0;
+static bool     __test_log_found     = false;
+
+static void __test_log_write(np_context *ac, struct np_log_entry entry) {
+  np_ctx_cast(ac);
+  __test_log_callbacks++;
+  if (0 == strcmp(entry.string, "test log callback 42")) {
+    __test_log_found = true;
+    cr_expect(0 == strncmp(entry.level, "ERROR", 5), "expect the level");
+    cr_expect(strlen(entry.string) == entry.string_length,
+              "expect the length of the entry");
+  }
+  // a callback may log and flush again without blocking the log writer
+  if (__test_log_callbacks == 1) _np_log_fflush(context, true);
+}
+
+Test(np_log_t,
+     _log_record_format,
+     .description = "test the formatted line of a record and the callback") {
+  struct np_settings *settings = np_default_settings(NULL);
+  snprintf(settings->log_file, 256, "logs/neuropil_test_log_record.log");
+  settings->log_write_fn = __test_log_write;
+
+  np_context *ac = np_new_context(settings);
+  cr_assert(NULL != ac, "expect a new context");
+  np_ctx_cast(ac);
+
+  struct np_log_record record;
+  char                 line[NP_LOG_LINE_MAX];
+  __test_log_pack(&record, "formatted %s", "line");
+  record.tv_sec  = 1700000000;
+  record.tv_nsec = 123456789;
+  record.level   = LOG_WARNING | LOG_NETWORK;
+
+  // a log_write_fn receives the plain message
+  size_t length = __np_log_format_record(context, &record, 4711, line);
+  cr_expect_str_eq(line, "formatted line", "expect only the message");
+  cr_expect(strlen(line) == length, "expect the length of the line");
+
+  // a log file receives timestamp, thread id, level and module
+  settings->log_write_fn = NULL;
+  length = __np_log_format_record(context, &record, 4711, line);
+  settings->log_write_fn = __test_log_write;
+  cr_expect(strlen(line) == length, "expect the length of the line");
+  cr_expect(NULL != strstr(line, ".123456 4711 "),
+            "expect the microseconds and the thread id");
+  cr_expect(NULL != strstr(line, "WARNING"), "expect the level");
+  cr_expect(NULL != strstr(line, " formatted line\n"),
+            "expect the message and a line break");
+
+  // errors are flushed right away, the flush in the callback must not block
+  log_msg(LOG_ERROR, __TEST_LOG_MESSAGE, 42);
+  _np_log_fflush(context, true);
+  cr_expect(__test_log_found, "expect the record to reach the callback");
+
+  np_destroy(ac, false);
+}
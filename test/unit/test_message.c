@@ -4,6 +4,7 @@
 //
 #include <assert.h>
 #include <criterion/criterion.h>
+#include <math.h>
 #include <stdbool.h>
 #include <stddef.h>
 #include <stdint.h>
@@ -17,12 +18,21 @@
 
 #include "../src/np_jobqueue.c"
 #include "util/np_list.h"
+#include "util/np_serialization.h"
 #include "util/np_tree.h"
 
+#include "core/np_comp_msgproperty.h"
+
+#include "np_axon.h"
+#include "np_dendrit.h"
 #include "np_dhkey.h"
+#include "np_eventqueue.h"
+#include "np_keycache.h"
 #include "np_log.h"
 #include "np_memory.h"
 #include "np_message.h"
+#include "np_node.h"
+#include "np_route.h"
 #include "np_threads.h"
 #include "np_token_factory.h"
 #include "np_types.h"
@@ -495,3 +505,1064 @@ Test(np_message_t,
     sll_free(np_aaatoken_ptr, token_list);
   }
 }
+
+Test(np_message_t,
+     decrypt_messagepart_in_place,
+     .description = "test the in place decryption of an encrypted part") {
+  CTX() {
+    unsigned char payload[512];
+    memset(payload, 0x2a, sizeof(payload));
+
+    np_tree_t *source = np_tree_create();
+    np_tree_insert_str(source,
+                       "payload",
+                       np_treeval_new_bin(payload, sizeof(payload)));
+    np_tree_insert_str(source, "name", np_treeval_new_s("in place"));
+
+    unsigned char nonce[crypto_secretbox_NONCEBYTES];
+    unsigned char key[crypto_secretbox_KEYBYTES];
+    unsigned char wrong_key[crypto_secretbox_KEYBYTES];
+    randombytes_buf(nonce, sizeof(nonce));
+    crypto_secretbox_keygen(key);
+    crypto_secretbox_keygen(wrong_key);
+    cr_assert(_np_messagepart_encrypt(context, source, nonce, key, NULL),
+              "expect the part to be encrypted");
+
+    np_tree_elem_t *enc_elem = np_tree_find_str(source, NP_ENCRYPTED);
+    cr_assert(NULL != enc_elem, "expect the encrypted element");
+    unsigned char *enc_start = enc_elem->val.value.bin;
+    unsigned char *enc_end   = enc_start + enc_elem->val.size;
+
+    // a wrong key neither decrypts nor touches the encrypted buffer
+    unsigned char enc_copy[enc_elem->val.size];
+    memcpy(enc_copy, enc_start, enc_elem->val.size);
+    np_tree_t *failed = np_tree_create();
+    failed->attr.in_place = true;
+    cr_expect(!_np_messagepart_decrypt(context,
+                                       source,
+                                       nonce,
+                                       wrong_key,
+                                       NULL,
+                                       failed),
+              "expect the decryption with a wrong key to fail");
+    cr_expect(0 == memcmp(enc_copy, enc_start, enc_elem->val.size),
+              "expect the encrypted buffer to be unchanged");
+    np_tree_free(failed);
+
+    // a regular target tree owns copies of the decrypted values
+    np_tree_t *copy = np_tree_create();
+    cr_assert(
+        _np_messagepart_decrypt(context, source, nonce, key, NULL, copy),
+        "expect the part to be decrypted");
+    np_tree_elem_t *elem = np_tree_find_str(copy, "payload");
+    cr_assert(NULL != elem, "expect the payload to be present");
+    cr_expect(0 == memcmp(payload, elem->val.value.bin, sizeof(payload)),
+              "expect the decrypted payload");
+    cr_expect((unsigned char *)elem->val.value.bin < enc_start ||
+                  (unsigned char *)elem->val.value.bin >= enc_end,
+              "expect the copied payload outside of the encrypted buffer");
+    cr_expect(0 == memcmp(enc_copy, enc_start, enc_elem->val.size),
+              "expect the encrypted buffer to be unchanged");
+    np_tree_free(copy);
+
+    // an in place target tree borrows its values from the encrypted buffer,
+    // which now holds the plain text
+    np_tree_t *view = np_tree_create();
+    view->attr.in_place = true;
+    cr_assert(
+        _np_messagepart_decrypt(context, source, nonce, key, NULL, view),
+        "expect the part to be decrypted in place");
+    elem = np_tree_find_str(view, "payload");
+    cr_assert(NULL != elem, "expect the payload to be present");
+    cr_expect((unsigned char *)elem->val.value.bin >= enc_start &&
+                  (unsigned char *)elem->val.value.bin + sizeof(payload) <=
+                      enc_end,
+              "expect the payload to point into the encrypted buffer");
+    cr_expect(0 == memcmp(payload, elem->val.value.bin, sizeof(payload)),
+              "expect the decrypted payload");
+    elem = np_tree_find_str(view, "name");
+    cr_assert(NULL != elem, "expect the name to be present");
+    cr_expect((unsigned char *)elem->val.value.s >= enc_start &&
+                  (unsigned char *)elem->val.value.s < enc_end,
+              "expect the name to point into the encrypted buffer");
+    cr_expect(0 == strncmp("in place", elem->val.value.s, elem->val.size),
+              "expect the decrypted name");
+    np_tree_free(view);
+
+    np_tree_free(source);
+  }
+}
+
+static uint8_t              __test_release_calls  = 0;
+static const unsigned char *__test_release_data   = NULL;
+static size_t               __test_release_length = 0;
+static void                *__test_release_arg    = NULL;
+
+static void __test_release(np_context          *ac,
+                           const unsigned char *message,
+                           size_t               length,
+                           void                *release_arg) {
+  __test_release_calls++;
+  __test_release_data   = message;
+  __test_release_length = length;
+  __test_release_arg    = release_arg;
+}
+
+static np_message_t *__test_zerocopy_message(np_state_t          *context,
+                                             const unsigned char *payload,
+                                             size_t               length,
+                                             void                *release_arg) {
+  np_dhkey_t _test_dhkey = {.t[0] = 1, .t[1] = 2, .t[2] = 3, .t[3] = 4};
+
+  // the same borrowed body as np_send_zerocopy creates it
+  np_tree_t *body = np_tree_create();
+  np_tree_insert_str_ref(body,
+                         NP_SERIALISATION_USERDATA,
+                         (void *)payload,
+                         length);
+
+  np_message_t *msg = NULL;
+  np_new_obj(np_message_t, msg);
+  _np_message_create(msg, _test_dhkey, _test_dhkey, _test_dhkey, body);
+  msg->release_cb     = __test_release;
+  msg->release_data   = payload;
+  msg->release_length = length;
+  msg->release_arg    = release_arg;
+
+  __test_release_calls  = 0;
+  __test_release_data   = NULL;
+  __test_release_length = 0;
+  __test_release_arg    = NULL;
+  return msg;
+}
+
+Test(np_message_t,
+     zerocopy_release_after_send,
+     .description = "test the release callback of a sent zerocopy message") {
+  CTX() {
+    unsigned char payload[3000];
+    memset(payload, 'z', sizeof(payload));
+    int           arg = 0;
+    np_message_t *msg =
+        __test_zerocopy_message(context, payload, sizeof(payload), &arg);
+
+    _np_message_calculate_chunking(msg);
+    cr_assert(_np_message_serialize_chunked(context, msg),
+              "expect the chunks to be serialized");
+    cr_assert(pll_size(msg->msg_chunks) > 1, "expect more than one chunk");
+
+    // the network keeps the serialized chunks of a sent message
+    np_messagepart_ptr part = pll_first(msg->msg_chunks)->val;
+    np_ref_obj(np_messagepart_t, part, "test_zerocopy");
+    cr_expect(0 == __test_release_calls,
+              "expect the payload to be borrowed while the message exists");
+
+    np_unref_obj(np_message_t, msg, ref_obj_creation);
+    cr_expect(1 == __test_release_calls, "expect exactly one release");
+    cr_expect(payload == __test_release_data, "expect the borrowed payload");
+    cr_expect(sizeof(payload) == __test_release_length,
+              "expect the length of the payload");
+    cr_expect(&arg == __test_release_arg, "expect the release argument");
+
+    np_unref_obj(np_messagepart_t, part, "test_zerocopy");
+    cr_expect(1 == __test_release_calls,
+              "expect no release once the chunks are gone");
+  }
+}
+
+Test(np_message_t,
+     zerocopy_release_on_drop,
+     .description = "test the release callback of a dropped zerocopy message") {
+  CTX() {
+    unsigned char payload[64];
+    memset(payload, 'd', sizeof(payload));
+
+    np_subject subject = {0};
+    np_generate_subject(&subject, "urn:np:test:zerocopy", 20);
+    cr_expect(np_invalid_argument == np_send_zerocopy(context,
+                                                      subject,
+                                                      payload,
+                                                      sizeof(payload),
+                                                      NULL,
+                                                      NULL),
+              "expect a release callback to be required");
+
+    np_message_t *msg =
+        __test_zerocopy_message(context, payload, sizeof(payload), NULL);
+
+    // the clone kept for a redelivery owns a copy of the payload
+    np_tree_t      *clone = np_tree_clone(msg->body);
+    np_tree_elem_t *elem  = np_tree_find_str(clone, NP_SERIALISATION_USERDATA);
+    cr_expect(payload != elem->val.value.bin, "expect a copied payload");
+    np_tree_free(clone);
+    cr_expect(0 == __test_release_calls, "expect no release of a copy");
+
+    // a message that is never sent is released by its destructor
+    np_unref_obj(np_message_t, msg, ref_obj_creation);
+    cr_expect(1 == __test_release_calls, "expect exactly one release");
+    cr_expect(payload == __test_release_data, "expect the borrowed payload");
+    cr_expect(sizeof(payload) == __test_release_length,
+              "expect the length of the payload");
+  }
+}
+
+NP_API_INTERN
+bool __np_receive_view_converter(np_context               *ac,
+                                 const np_message_t *const msg,
+                                 np_tree_t                *body,
+                                 void                     *localdata);
+
+static uint8_t                __test_view_calls = 0;
+static struct np_message_view __test_view;
+
+static bool __test_receive_view(np_context                   *ac,
+                                const struct np_message_view *message) {
+  __test_view_calls++;
+  memcpy(&__test_view, message, sizeof(struct np_message_view));
+  return true;
+}
+
+Test(np_message_t,
+     receive_view_callback,
+     .description = "test that receive views point into the message") {
+  CTX() {
+    np_subject subject = {0};
+    np_generate_subject(&subject, "urn:np:test:receive:view", 24);
+    cr_expect(np_invalid_argument ==
+                  np_add_receive_view_cb(context, NULL, __test_receive_view),
+              "expect a subject to be required");
+    cr_expect(np_invalid_argument ==
+                  np_add_receive_view_cb(context, subject, NULL),
+              "expect a callback to be required");
+    cr_expect(np_ok ==
+                  np_add_receive_view_cb(context, subject, __test_receive_view),
+              "expect the view callback to be added");
+
+    unsigned char payload[128];
+    unsigned char attributes[64];
+    memset(payload, 'v', sizeof(payload));
+    memset(attributes, 'a', sizeof(attributes));
+
+    np_dhkey_t subject_dhkey = {0};
+    memcpy(&subject_dhkey, subject, NP_FINGERPRINT_BYTES);
+
+    np_tree_t *body = np_tree_create();
+    np_tree_insert_str(body,
+                       NP_SERIALISATION_USERDATA,
+                       np_treeval_new_bin(payload, sizeof(payload)));
+    np_tree_insert_str(body,
+                       NP_SERIALISATION_ATTRIBUTES,
+                       np_treeval_new_bin(attributes, sizeof(attributes)));
+
+    np_message_t *msg = NULL;
+    np_new_obj(np_message_t, msg);
+    _np_message_create(msg,
+                       context->my_node_key->dhkey,
+                       context->my_node_key->dhkey,
+                       subject_dhkey,
+                       body);
+
+    np_aaatoken_t *peer = _np_key_get_token(context->my_identity);
+    strncpy(peer->issuer, _np_key_as_str(context->my_identity), 64);
+    np_ref_obj(np_aaatoken_t, peer, "np_message_t.decryption_token");
+    msg->decryption_token = peer;
+
+    __test_view_calls = 0;
+    cr_expect(__np_receive_view_converter(context,
+                                          msg,
+                                          msg->body,
+                                          __test_receive_view),
+              "expect the message to be handled");
+    cr_assert(1 == __test_view_calls, "expect exactly one callback");
+
+    np_tree_elem_t *data =
+        np_tree_find_str(msg->body, NP_SERIALISATION_USERDATA);
+    np_tree_elem_t *attr =
+        np_tree_find_str(msg->body, NP_SERIALISATION_ATTRIBUTES);
+    cr_expect(data->val.value.bin == __test_view.data,
+              "expect the data to point into the message body");
+    cr_expect(sizeof(payload) == __test_view.data_length,
+              "expect the length of the data");
+    cr_expect(attr->val.value.bin == __test_view.attributes,
+              "expect the attributes to point into the message body");
+    cr_expect(sizeof(attributes) == __test_view.attributes_length,
+              "expect the length of the attributes");
+    cr_expect(msg->uuid == __test_view.uuid, "expect the uuid of the message");
+    cr_expect(0 == memcmp(subject, __test_view.subject, NP_FINGERPRINT_BYTES),
+              "expect the subject of the message");
+
+    np_id from = {0};
+    np_str_id(&from, peer->issuer);
+    cr_expect(0 == memcmp(from, __test_view.from, NP_FINGERPRINT_BYTES),
+              "expect the sender of the message");
+
+    // a message without userdata is not handed to the callback
+    np_tree_del_str(msg->body, NP_SERIALISATION_USERDATA);
+    cr_expect(__np_receive_view_converter(context,
+                                          msg,
+                                          msg->body,
+                                          __test_receive_view),
+              "expect the message to be handled");
+    cr_expect(1 == __test_view_calls, "expect no callback without userdata");
+
+    np_unref_obj(np_message_t, msg, ref_obj_creation);
+  }
+}
+
+Test(np_message_t,
+     reassemble_chunked_message,
+     .description = "test the reassembly of message parts in any order") {
+  CTX() {
+    np_message_t *msg_out = NULL;
+    np_new_obj(np_message_t, msg_out);
+    np_dhkey_t _test_dhkey = {.t[0] = 1,
+                              .t[1] = 1,
+                              .t[2] = 2,
+                              .t[3] = 3,
+                              .t[4] = 4,
+                              .t[5] = 5,
+                              .t[6] = 6,
+                              .t[7] = 7};
+
+    char body_payload[4000];
+    memset(body_payload, 'r', 4000);
+    np_tree_t *test_tree = np_tree_create();
+    np_tree_insert_str(test_tree,
+                       "test",
+                       np_treeval_new_bin(body_payload, 4000));
+    _np_message_create(msg_out,
+                       _test_dhkey,
+                       _test_dhkey,
+                       _test_dhkey,
+                       test_tree);
+
+    _np_message_calculate_chunking(msg_out);
+    bool write_ret = _np_message_serialize_chunked(context, msg_out);
+    cr_assert(true == write_ret,
+              "Expected positive result in chunk serialisation");
+
+    uint32_t chunks = pll_size(msg_out->msg_chunks);
+    cr_assert(chunks > 2, "Expected more than two chunks for message");
+
+    np_messagepart_ptr parts[chunks];
+    pll_iterator(np_messagepart_ptr) iter = pll_first(msg_out->msg_chunks);
+    for (uint32_t i = 0; i < chunks; i++, pll_next(iter)) parts[i] = iter->val;
+
+    // feed the parts from the last to the first one, the last part twice
+    uint32_t order[chunks + 1];
+    order[0] = chunks - 1;
+    for (uint32_t i = 1; i <= chunks; i++) order[i] = chunks - i;
+
+    np_message_t *complete = NULL;
+    uint16_t      received = 0;
+    for (uint32_t i = 0; i <= chunks; i++) {
+      char *packet;
+      np_new_obj(BLOB_1024, packet, ref_obj_creation);
+      memcpy(packet,
+             parts[order[i]]->msg_part,
+             MSG_CHUNK_SIZE_1024 - MSG_ENCRYPTION_BYTES_40);
+
+      np_message_t *msg_in = NULL;
+      np_new_obj(np_message_t, msg_in);
+      cr_assert(_np_message_deserialize_header_and_instructions(msg_in,
+                                                                packet),
+                "Expected positive result in deserialisation");
+
+      complete = _np_messagepart_cache_add(context,
+                                           context->msg_part_cache,
+                                           _test_dhkey,
+                                           msg_in,
+                                           chunks,
+                                           &received);
+      np_unref_obj(np_message_t, msg_in, ref_obj_creation);
+
+      if (i < chunks) {
+        cr_expect(NULL == complete, "Expected message to be incomplete");
+        cr_expect(received == (i == 0 ? 1 : i),
+                  "Expected duplicate parts to be ignored");
+      }
+    }
+    cr_assert(NULL != complete, "Expected message to be complete");
+    cr_expect(received == chunks, "Expected all parts to be received");
+    cr_expect(pll_size(complete->msg_chunks) == chunks,
+              "Expected all parts to be attached to the message");
+    cr_expect(0 == _np_messagepart_cache_size(context, context->msg_part_cache),
+              "Expected the reassembly cache to be empty");
+
+    cr_assert(true == _np_message_deserialize_chunked(complete),
+              "Expected positive result in de-serialisation");
+    np_tree_elem_t *elem = np_tree_find_str(complete->body, "test");
+    cr_assert(elem != NULL, "expected tree element to be present");
+    cr_expect(0 == memcmp(elem->val.value.bin, body_payload, 4000),
+              "expected body to be reassembled");
+
+    np_unref_obj(np_message_t, complete, ref_msgpartcache);
+  }
+}
+
+Test(np_message_t,
+     redelivery_schedule_under_loss,
+     .description = "test the redelivery schedule with a lossy loopback") {
+  CTX() {
+    uint16_t rounds = 32, message_count = 2000;
+    double   round_arr[rounds];
+
+    uint32_t      loss_percent    = 30;
+    double        resend_interval = 1.0;
+    double        now             = np_time_now();
+    np_dhkey_t    target          = {0};
+    np_message_t *msg             = NULL;
+
+    np_msgproperty_run_t *run = NULL;
+    np_new_obj(np_msgproperty_run_t, run);
+
+    for (uint16_t i = 0; i < message_count; i++) {
+      np_new_obj(np_message_t, msg);
+      cr_assert(_np_msgproperty_redelivery_add(context,
+                                               run,
+                                               msg,
+                                               target,
+                                               now + resend_interval),
+                "expect the message to be scheduled");
+      cr_expect(!_np_msgproperty_redelivery_add(context,
+                                                run,
+                                                msg,
+                                                target,
+                                                now + resend_interval),
+                "expect a duplicate uuid to be ignored");
+      np_unref_obj(np_message_t, msg, ref_obj_creation);
+    }
+    cr_expect(NULL == _np_msgproperty_redelivery_next(context,
+                                                      run,
+                                                      now,
+                                                      resend_interval,
+                                                      NULL),
+              "expect no message to be due yet");
+
+    uint16_t j = 0;
+    for (; j < rounds && run->redelivery_messages->size > 0; j++) {
+      now += resend_interval + 0.1;
+      MEASURE_TIME(round_arr, j, {
+        while (NULL != (msg = _np_msgproperty_redelivery_next(context,
+                                                              run,
+                                                              now,
+                                                              resend_interval,
+                                                              NULL))) {
+          // the loopback drops loss_percent of all messages, every delivered
+          // message is acknowledged immediately
+          if (randombytes_uniform(100) >= loss_percent)
+            _np_msgproperty_redelivery_remove(context,
+                                              run,
+                                              &msg->uuid_key,
+                                              NULL);
+        }
+      });
+    }
+    cr_expect(0 == run->redelivery_messages->size,
+              "expect all messages to be acknowledged");
+
+    cr_log_info("###########\n");
+    CALC_AND_PRINT_STATISTICS("redelivery round (2000 msgs, 30% loss): ",
+                              round_arr,
+                              j);
+    np_unref_obj(np_msgproperty_run_t, run, ref_obj_creation);
+  }
+}
+
+Test(np_message_t,
+     redelivery_resend_hops,
+     .description = "test that a resend is sent to the original target past "
+                    "the forward filter") {
+  CTX() {
+    np_sll_t(np_key_ptr, my_keys);
+    sll_init(np_key_ptr, my_keys);
+    for (uint16_t i = 0; i < 4; i++) {
+      np_dhkey_t my_dhkey = {0};
+      randombytes_buf(&my_dhkey, sizeof(np_dhkey_t));
+
+      np_key_t  *insert_key = _np_keycache_create(context, my_dhkey);
+      np_node_t *new_node   = NULL;
+      np_new_obj(np_node_t, new_node);
+      insert_key->entity_array[2] = new_node;
+      sll_append(np_key_ptr, my_keys, insert_key);
+    }
+    np_dhkey_t target    = sll_first(my_keys)->val->dhkey;
+    np_dhkey_t first_hop = sll_last(my_keys)->val->dhkey;
+
+    np_dhkey_t from = {0}, subject = {0};
+    randombytes_buf(&from, sizeof(np_dhkey_t));
+    np_generate_subject(&subject, "urn:np:test:redelivery:resend", 29);
+
+    np_message_t *msg = NULL;
+    np_new_obj(np_message_t, msg);
+    _np_message_create(msg, target, from, subject, np_tree_create());
+    _np_dhkey_assign(&msg->hop_dhkey, &first_hop);
+
+    // the stored target of the original send is preferred
+    np_sll_t(np_dhkey_t, hops);
+    sll_init(np_dhkey_t, hops);
+    _np_axon_redelivery_hops(context, msg, target, hops);
+    cr_assert(1 == sll_size(hops), "expect a single hop for the resend");
+    cr_expect(_np_dhkey_equal(&target, &sll_first(hops)->val),
+              "expect the resend to use the original target");
+    sll_clear(np_dhkey_t, hops);
+
+    // without a stored target the first hop of the original send is used
+    np_dhkey_t zero = {0};
+    _np_axon_redelivery_hops(context, msg, zero, hops);
+    cr_assert(1 == sll_size(hops), "expect a single hop for the resend");
+    cr_expect(_np_dhkey_equal(&first_hop, &sll_first(hops)->val),
+              "expect the resend to use the first hop");
+
+    // the first send passes the forward filter, a second one is suppressed
+    _np_axon_filter_hops(context, msg, from, target, false, hops);
+    cr_expect(1 == sll_size(hops), "expect the first send to pass");
+    _np_axon_filter_hops(context, msg, from, target, false, hops);
+    cr_expect(0 == sll_size(hops), "expect a duplicate send to be dropped");
+
+    // a resend is emitted despite the forward filter
+    sll_append(np_dhkey_t, hops, first_hop);
+    _np_axon_filter_hops(context, msg, from, target, true, hops);
+    cr_expect(1 == sll_size(hops), "expect the resend to pass the filter");
+
+    // but never back to the source or to a hop without a connection
+    _np_axon_filter_hops(context, msg, first_hop, target, true, hops);
+    cr_expect(0 == sll_size(hops), "expect no resend to the source");
+    sll_append(np_dhkey_t, hops, from);
+    _np_axon_filter_hops(context, msg, target, target, true, hops);
+    cr_expect(0 == sll_size(hops), "expect no resend to an unknown hop");
+
+    sll_free(np_dhkey_t, hops);
+    np_unref_obj(np_message_t, msg, ref_obj_creation);
+
+    sll_iterator(np_key_ptr) iter = sll_first(my_keys);
+    while (NULL != iter) {
+      np_unref_obj(np_key_t, iter->val, "_np_keycache_create");
+      sll_next(iter);
+    }
+    sll_free(np_key_ptr, my_keys);
+  }
+}
+
+static uint16_t    __test_msgcache_discarded      = 0;
+static const char *__test_msgcache_discarded_uuid = NULL;
+
+static void __test_msgcache_discard(np_context                   *ac,
+                                    const struct np_message_view *message) {
+  __test_msgcache_discarded++;
+  __test_msgcache_discarded_uuid = message->uuid;
+}
+
+// a msgproperty key with a msg_cache of cache_size messages, the handlers of
+// the msg_cache only need the conf and run entities of the key
+static np_key_t *__test_msgcache_key(np_state_t *context,
+                                     uint16_t    cache_size,
+                                     uint8_t     cache_policy) {
+  np_dhkey_t subject = {0};
+  randombytes_buf(&subject, sizeof(np_dhkey_t));
+
+  np_msgproperty_conf_t *property_conf = NULL;
+  np_new_obj(np_msgproperty_conf_t, property_conf);
+  property_conf->msg_subject   = strdup("urn:np:test:msgcache");
+  property_conf->subject_dhkey = subject;
+  property_conf->cache_size    = cache_size;
+  property_conf->cache_policy  = cache_policy;
+
+  np_msgproperty_run_t *property_run = NULL;
+  np_new_obj(np_msgproperty_run_t, property_run);
+  property_run->discard_cb = __test_msgcache_discard;
+
+  np_key_t *key        = _np_keycache_create(context, subject);
+  key->entity_array[0] = property_conf;
+  key->entity_array[1] = property_run;
+  return key;
+}
+
+static void __test_msgcache_key_free(np_key_t *key) {
+  np_msgproperty_conf_t *property_conf = key->entity_array[0];
+  np_msgproperty_run_t  *property_run  = key->entity_array[1];
+  key->entity_array[0]                 = NULL;
+  key->entity_array[1]                 = NULL;
+  np_unref_obj(np_msgproperty_run_t, property_run, ref_obj_creation);
+  np_unref_obj(np_msgproperty_conf_t, property_conf, ref_obj_creation);
+  np_unref_obj(np_key_t, key, "_np_keycache_create");
+}
+
+Test(np_message_t,
+     msgcache_overflow_and_order,
+     .description = "test the overflow policies and the delivery order of the "
+                    "msg_cache") {
+  CTX() {
+    const uint8_t policies[] = {FIFO | OVERFLOW_PURGE,
+                                LIFO | OVERFLOW_PURGE,
+                                FIFO | OVERFLOW_REJECT,
+                                LIFO | OVERFLOW_REJECT};
+    for (uint8_t p = 0; p < ARRAY_SIZE(policies); p++) {
+      np_key_t *key = __test_msgcache_key(context, 3, policies[p]);
+      np_msgproperty_conf_t *property_conf = key->entity_array[0];
+      np_msgproperty_run_t  *property_run  = key->entity_array[1];
+      bool                   purge = FLAG_CMP(policies[p], OVERFLOW_PURGE);
+      bool                   lifo  = FLAG_CMP(policies[p], LIFO);
+
+      __test_msgcache_discarded = 0;
+      np_message_t *msgs[5];
+      for (uint8_t i = 0; i < 5; i++) {
+        np_new_obj(np_message_t, msgs[i]);
+        _np_message_create(msgs[i],
+                           key->dhkey,
+                           key->dhkey,
+                           key->dhkey,
+                           np_tree_create());
+        np_util_event_t add_event = {.type      = (evt_internal | evt_message),
+                                     .user_data = msgs[i]};
+        __np_property_add_msg_to_cache(&key->sm, add_event);
+      }
+      cr_expect(3 == property_run->msg_cache.count,
+                "expect the msg_cache to be bounded by its cache_size");
+      cr_expect(2 == __test_msgcache_discarded,
+                "expect each dropped message to be reported");
+      // purge drops the oldest messages, reject the newest ones
+      cr_expect(msgs[purge ? 1 : 4]->uuid == __test_msgcache_discarded_uuid,
+                "expect the last discarded message to depend on the policy");
+
+      // purge keeps messages 2..4, reject 0..2, FIFO delivers the oldest first
+      uint8_t first = purge ? 2 : 0;
+      for (uint8_t i = 0; i < 3; i++) {
+        uint8_t       expected = lifo ? (first + 2 - i) : (first + i);
+        np_message_t *peek =
+            _np_msgproperty_msgcache_next(property_conf, property_run, false);
+        np_message_t *msg =
+            _np_msgproperty_msgcache_next(property_conf, property_run, true);
+        cr_expect(peek == msg, "expect peek and take to agree");
+        cr_expect(msgs[expected] == msg,
+                  "expect message %" PRIu8 " in the order of policy %" PRIu8,
+                  expected,
+                  policies[p]);
+        np_unref_obj(np_message_t, msg, ref_msgproperty_msgcache);
+      }
+      cr_expect(NULL == _np_msgproperty_msgcache_next(property_conf,
+                                                      property_run,
+                                                      true),
+                "expect the msg_cache to be empty");
+
+      for (uint8_t i = 0; i < 5; i++)
+        np_unref_obj(np_message_t, msgs[i], ref_obj_creation);
+      __test_msgcache_key_free(key);
+    }
+  }
+}
+
+Test(np_message_t,
+     msgcache_discard_expired,
+     .description = "test that expired messages are discarded from the "
+                    "msg_cache") {
+  CTX() {
+    np_key_t *key = __test_msgcache_key(context, 4, FIFO | OVERFLOW_PURGE);
+    np_msgproperty_conf_t *property_conf = key->entity_array[0];
+    np_msgproperty_run_t  *property_run  = key->entity_array[1];
+
+    __test_msgcache_discarded = 0;
+    np_message_t *msgs[3];
+    for (uint8_t i = 0; i < 3; i++) {
+      np_new_obj(np_message_t, msgs[i]);
+      _np_message_create(msgs[i],
+                         key->dhkey,
+                         key->dhkey,
+                         key->dhkey,
+                         np_tree_create());
+      np_util_event_t add_event = {.type      = (evt_internal | evt_message),
+                                   .user_data = msgs[i]};
+      __np_property_add_msg_to_cache(&key->sm, add_event);
+    }
+    np_tree_replace_str(msgs[1]->instructions,
+                        _NP_MSG_INST_TTL,
+                        np_treeval_new_d(1.0));
+    np_tree_replace_str(msgs[1]->instructions,
+                        _NP_MSG_INST_TSTAMP,
+                        np_treeval_new_d(np_time_now() - 2.0));
+
+    np_util_event_t noop = {0};
+    _np_msgproperty_cleanup_cache(&key->sm, noop);
+    cr_expect(2 == property_run->msg_cache.count,
+              "expect the expired message to be removed");
+    cr_expect(1 == __test_msgcache_discarded,
+              "expect the expired message to be reported");
+    cr_expect(msgs[1]->uuid == __test_msgcache_discarded_uuid,
+              "expect the expired message to be discarded");
+
+    // the remaining messages keep their order
+    for (uint8_t i = 0; i < 3; i += 2) {
+      np_message_t *msg =
+          _np_msgproperty_msgcache_next(property_conf, property_run, true);
+      cr_expect(msgs[i] == msg, "expect message %" PRIu8 " to be kept", i);
+      np_unref_obj(np_message_t, msg, ref_msgproperty_msgcache);
+    }
+
+    // the discard hook can only be set for a known subject
+    np_subject unknown = {0};
+    randombytes_buf(unknown, sizeof(np_subject));
+    cr_expect(np_invalid_operation ==
+                  np_set_mx_discard_cb(context,
+                                       unknown,
+                                       __test_msgcache_discard),
+              "expect an unknown subject to be rejected");
+
+    for (uint8_t i = 0; i < 3; i++)
+      np_unref_obj(np_message_t, msgs[i], ref_obj_creation);
+    __test_msgcache_key_free(key);
+  }
+}
+
+Test(np_message_t,
+     ack_batch_encode_decode,
+     .description = "test the encoding of single and batched acks") {
+  CTX() {
+    char   uuids[NP_ACK_BATCH_MAX_SIZE][NP_UUID_BYTES] = {{0}};
+    double holds[NP_ACK_BATCH_MAX_SIZE];
+    for (uint16_t i = 0; i < NP_ACK_BATCH_MAX_SIZE; i++) {
+      char *buffer = uuids[i];
+      np_uuid_create("ack batch", i, &buffer);
+      holds[i] = 0.000250 * i;
+    }
+
+    char   uuid[NP_UUID_BYTES];
+    double hold = -1.0;
+
+    // a single ack without hold time, as sent to older nodes
+    np_tree_t *body = np_tree_create();
+    _np_ack_encode(body, uuids, NULL, 1);
+    cr_expect(NULL != np_tree_find_str(body, _NP_MSG_INST_RESPONSE_UUID),
+              "expect a single ack to use the old format");
+    cr_expect(NULL == np_tree_find_str(body, _NP_MSG_INST_RESPONSE_UUIDS),
+              "expect a single ack to have no batch");
+    cr_expect(NULL == np_tree_find_str(body, _NP_MSG_INST_RESPONSE_HOLDS),
+              "expect no hold times");
+    cr_expect(1 == _np_ack_count(body), "expect one acknowledged uuid");
+    cr_expect(_np_ack_get(body, 0, uuid, &hold), "expect the uuid to be read");
+    cr_expect(0 == strncmp(uuids[0], uuid, NP_UUID_BYTES),
+              "expect the same uuid");
+    cr_expect(0.0 == hold, "expect no hold time");
+    cr_expect(!_np_ack_get(body, 1, uuid, &hold), "expect no second uuid");
+    np_tree_free(body);
+
+    // a full batch survives the serialization of the message body
+    body = np_tree_create();
+    _np_ack_encode(body, uuids, holds, NP_ACK_BATCH_MAX_SIZE);
+    size_t buffer_size = 65536;
+    char   buffer[buffer_size];
+    np_serialize_buffer_t serializer = {
+        ._tree          = body,
+        ._target_buffer = buffer,
+        ._buffer_size   = buffer_size,
+        ._error         = 0,
+        ._bytes_written = 0,
+    };
+    np_serializer_write_map(context, &serializer, body);
+    cr_assert(0 == serializer._error, "expect the body to be serialized");
+    np_tree_free(body);
+
+    body = np_tree_create();
+    np_deserialize_buffer_t deserializer = {
+        ._target_tree = body,
+        ._buffer      = buffer,
+        ._buffer_size = buffer_size,
+        ._bytes_read  = 0,
+        ._error       = 0,
+    };
+    np_serializer_read_map(context, &deserializer, body);
+    cr_assert(0 == deserializer._error, "expect the body to be deserialized");
+
+    cr_expect(NP_ACK_BATCH_MAX_SIZE == _np_ack_count(body),
+              "expect all uuids of the batch");
+    for (uint16_t i = 0; i < NP_ACK_BATCH_MAX_SIZE; i++) {
+      cr_expect(_np_ack_get(body, i, uuid, &hold), "expect uuid %" PRIu16, i);
+      cr_expect(0 == strncmp(uuids[i], uuid, NP_UUID_BYTES),
+                "expect the same uuid at %" PRIu16,
+                i);
+      cr_expect(fabs(holds[i] - hold) < 0.000001,
+                "expect the hold time in microseconds at %" PRIu16,
+                i);
+    }
+    cr_expect(!_np_ack_get(body, NP_ACK_BATCH_MAX_SIZE, uuid, &hold),
+              "expect no uuid beyond the batch");
+
+    // hold times which do not match the batch are ignored
+    np_tree_replace_str(body,
+                        _NP_MSG_INST_RESPONSE_HOLDS,
+                        np_treeval_new_bin(holds, 3));
+    cr_expect(_np_ack_get(body, 1, uuid, &hold), "expect the uuid to be read");
+    cr_expect(0.0 == hold, "expect a malformed hold time to be ignored");
+    np_tree_free(body);
+
+    // a body without uuids
+    body = np_tree_create();
+    cr_expect(0 == _np_ack_count(body), "expect no acknowledged uuid");
+    cr_expect(!_np_ack_get(body, 0, uuid, &hold), "expect no uuid");
+    np_tree_free(body);
+  }
+}
+
+Test(np_message_t,
+     control_bundle_round_trip,
+     .description = "test the packing and unpacking of a control bundle") {
+  CTX() {
+    np_dhkey_t my_dhkey    = context->my_node_key->dhkey;
+    np_dhkey_t hop_dhkey   = np_dhkey_create_from_hostport("bundle", "4711");
+    np_dhkey_t other_dhkey = np_dhkey_create_from_hostport("bundle", "4712");
+    np_dhkey_t subject     = {0};
+    np_generate_subject(&subject,
+                        _NP_MSG_PIGGY_REQUEST,
+                        strnlen(_NP_MSG_PIGGY_REQUEST, 256));
+
+    // the first message is addressed to the hop, the second one is relayed
+    np_dhkey_t    targets[2] = {hop_dhkey, other_dhkey};
+    np_message_t *msgs[2]    = {NULL};
+    np_tree_t    *bundle     = np_tree_create();
+    for (uint8_t i = 0; i < 2; i++) {
+      np_tree_t *body = np_tree_create();
+      np_tree_insert_str(body, "_np.test", np_treeval_new_ui(i));
+      np_new_obj(np_message_t, msgs[i]);
+      _np_message_create(msgs[i], targets[i], my_dhkey, subject, body);
+
+      np_tree_t *entry =
+          _np_control_bundle_entry_create(context, msgs[i], hop_dhkey);
+      np_tree_t *entry_header =
+          np_tree_find_str(entry, NP_MSG_BUNDLE_HEADER)->val.value.tree;
+      cr_expect(NULL == np_tree_find_str(entry_header, _NP_MSG_HEADER_FROM),
+                "expect the sender to be shared with the bundle");
+      cr_expect((i == 0) == (NULL == np_tree_find_str(entry_header,
+                                                      _NP_MSG_HEADER_TO)),
+                "expect only the target of the hop to be left out");
+      np_tree_insert_int(bundle, i, np_treeval_new_tree(entry));
+      np_tree_free(entry);
+    }
+    // a malformed entry is skipped by the receiver
+    np_tree_t *empty = np_tree_create();
+    np_tree_insert_int(bundle, 2, np_treeval_new_tree(empty));
+    np_tree_free(empty);
+
+    size_t buffer_size = 65536;
+    char   buffer[buffer_size];
+    np_serialize_buffer_t serializer = {
+        ._tree          = bundle,
+        ._target_buffer = buffer,
+        ._buffer_size   = buffer_size,
+        ._error         = 0,
+        ._bytes_written = 0,
+    };
+    np_serializer_write_map(context, &serializer, bundle);
+    cr_assert(0 == serializer._error, "expect the bundle to be serialized");
+    np_tree_free(bundle);
+
+    bundle                               = np_tree_create();
+    np_deserialize_buffer_t deserializer = {
+        ._target_tree = bundle,
+        ._buffer      = buffer,
+        ._buffer_size = buffer_size,
+        ._bytes_read  = 0,
+        ._error       = 0,
+    };
+    np_serializer_read_map(context, &deserializer, bundle);
+    cr_assert(0 == deserializer._error, "expect the bundle to be deserialized");
+    cr_assert(3 == bundle->size, "expect all entries of the bundle");
+
+    for (uint8_t i = 0; i < 3; i++) {
+      np_tree_elem_t *entry = np_tree_find_int(bundle, i);
+      cr_assert(NULL != entry, "expect entry %" PRIu8, i);
+
+      np_message_t *msg_in = NULL;
+      np_new_obj(np_message_t, msg_in);
+      bool ret = _np_control_bundle_entry_read(entry->val.value.tree,
+                                               np_treeval_new_dhkey(hop_dhkey),
+                                               np_treeval_new_dhkey(my_dhkey),
+                                               msg_in);
+      if (i == 2) {
+        cr_expect(!ret, "expect the malformed entry to be rejected");
+        np_unref_obj(np_message_t, msg_in, ref_obj_creation);
+        continue;
+      }
+      cr_assert(ret, "expect entry %" PRIu8 " to be read", i);
+
+      np_dhkey_t to =
+          np_tree_find_str(msg_in->header, _NP_MSG_HEADER_TO)->val.value.dhkey;
+      np_dhkey_t from = np_tree_find_str(msg_in->header, _NP_MSG_HEADER_FROM)
+                            ->val.value.dhkey;
+      np_dhkey_t in_subject =
+          np_tree_find_str(msg_in->header, _NP_MSG_HEADER_SUBJECT)
+              ->val.value.dhkey;
+      cr_expect(0 == strncmp(msgs[i]->uuid, msg_in->uuid, NP_UUID_BYTES),
+                "expect the uuid of the message");
+      cr_expect(_np_dhkey_equal(&targets[i], &to), "expect the same target");
+      cr_expect(_np_dhkey_equal(&my_dhkey, &from), "expect the same sender");
+      cr_expect(_np_dhkey_equal(&subject, &in_subject),
+                "expect the same subject");
+      cr_expect(i == np_tree_find_str(msg_in->body, "_np.test")->val.value.ui,
+                "expect the same body");
+      np_unref_obj(np_message_t, msg_in, ref_obj_creation);
+    }
+
+    np_tree_free(bundle);
+    np_unref_obj(np_message_t, msgs[0], ref_obj_creation);
+    np_unref_obj(np_message_t, msgs[1], ref_obj_creation);
+  }
+}
+
+Test(np_message_t,
+     forward_cut_through_expired,
+     .description = "test that expired messages are not relayed directly") {
+  CTX() {
+    np_sll_t(np_key_ptr, my_keys);
+    sll_init(np_key_ptr, my_keys);
+    for (uint16_t i = 0; i < 16; i++) {
+      np_dhkey_t my_dhkey = {0};
+      randombytes_buf(&my_dhkey, sizeof(np_dhkey_t));
+
+      np_key_t  *insert_key = _np_keycache_create(context, my_dhkey);
+      np_node_t *new_node   = NULL;
+      np_new_obj(np_node_t, new_node);
+      insert_key->entity_array[2] = new_node;
+      sll_append(np_key_ptr, my_keys, insert_key);
+
+      np_key_t *added = NULL, *deleted = NULL;
+      _np_route_update(insert_key, true, &deleted, &added);
+      _np_route_leafset_update(insert_key, true, &deleted, &added);
+    }
+    cr_assert(_np_route_my_key_has_connection(context),
+              "expect the node to have a route for the message");
+
+    // a message for another node without a local receiver
+    np_dhkey_t to = {0}, subject = {0};
+    randombytes_buf(&to, sizeof(np_dhkey_t));
+    np_generate_subject(&subject, "urn:np:test:forward:expired", 27);
+
+    np_message_t *msg = NULL;
+    np_new_obj(np_message_t, msg);
+    _np_message_create(msg,
+                       to,
+                       sll_first(my_keys)->val->dhkey,
+                       subject,
+                       np_tree_create());
+    np_tree_replace_str(msg->instructions,
+                        _NP_MSG_INST_TTL,
+                        np_treeval_new_d(1.0));
+    np_tree_replace_str(msg->instructions,
+                        _NP_MSG_INST_TSTAMP,
+                        np_treeval_new_d(np_time_now() - 2.0));
+    cr_assert(_np_message_is_expired(msg), "expect the message to expire");
+
+    cr_expect(!_np_out_forward_cut_through(context, NULL, msg),
+              "expect an expired message to take the regular way");
+
+    // a forward property above its threshold throttles the relaying as well
+    np_tree_replace_str(msg->instructions,
+                        _NP_MSG_INST_TSTAMP,
+                        np_treeval_new_d(np_time_now()));
+    np_dhkey_t forward_dhkey = {0};
+    np_generate_subject(&forward_dhkey, _FORWARD, strnlen(_FORWARD, 256));
+    np_msgproperty_conf_t *forward_conf =
+        _np_msgproperty_conf_get(context, OUTBOUND, forward_dhkey);
+    np_msgproperty_run_t *forward_run =
+        _np_msgproperty_run_get(context, OUTBOUND, forward_dhkey);
+    cr_assert(NULL != forward_conf && NULL != forward_run,
+              "expect the forward property");
+
+    uint32_t old_threshold     = forward_run->msg_threshold;
+    forward_run->msg_threshold = forward_conf->max_threshold + 1;
+    cr_expect(!_np_out_forward_cut_through(context, NULL, msg),
+              "expect a busy forward property to take the regular way");
+    forward_run->msg_threshold = old_threshold;
+
+    np_unref_obj(np_message_t, msg, ref_obj_creation);
+
+    sll_iterator(np_key_ptr) iter = sll_first(my_keys);
+    while (NULL != iter) {
+      np_unref_obj(np_key_t, iter->val, "_np_keycache_create");
+      sll_next(iter);
+    }
+    sll_free(np_key_ptr, my_keys);
+  }
+}
+
+Test(np_message_t,
+     forward_cut_through_relay,
+     .description = "test that a part for another node is relayed once") {
+  CTX() {
+    np_sll_t(np_key_ptr, my_keys);
+    sll_init(np_key_ptr, my_keys);
+    for (uint16_t i = 0; i < 16; i++) {
+      np_dhkey_t my_dhkey = {0};
+      randombytes_buf(&my_dhkey, sizeof(np_dhkey_t));
+
+      np_key_t  *insert_key = _np_keycache_create(context, my_dhkey);
+      np_node_t *new_node   = NULL;
+      np_new_obj(np_node_t, new_node);
+      insert_key->entity_array[2] = new_node;
+      sll_append(np_key_ptr, my_keys, insert_key);
+
+      np_key_t *added = NULL, *deleted = NULL;
+      _np_route_update(insert_key, true, &deleted, &added);
+      _np_route_leafset_update(insert_key, true, &deleted, &added);
+    }
+    cr_assert(_np_route_my_key_has_connection(context),
+              "expect the node to have a route for the message");
+
+    // a message for one of the known nodes from a node further away
+    np_dhkey_t to = sll_last(my_keys)->val->dhkey;
+    np_dhkey_t from = {0}, subject = {0};
+    randombytes_buf(&from, sizeof(np_dhkey_t));
+    np_generate_subject(&subject, "urn:np:test:forward:relay", 25);
+
+    np_tree_t *body = np_tree_create();
+    np_tree_insert_str(body, "test", np_treeval_new_s("relay"));
+    np_message_t *msg_out = NULL;
+    np_new_obj(np_message_t, msg_out);
+    _np_message_create(msg_out, to, from, subject, body);
+    _np_message_calculate_chunking(msg_out);
+    cr_assert(_np_message_serialize_chunked(context, msg_out),
+              "expect the message to be serialized");
+    cr_assert(1 == pll_size(msg_out->msg_chunks), "expect a single chunk");
+
+    // the part as it arrives from the network
+    char *packet;
+    np_new_obj(BLOB_1024, packet, ref_obj_creation);
+    memcpy(packet,
+           pll_first(msg_out->msg_chunks)->val->msg_part,
+           MSG_CHUNK_SIZE_1024 - MSG_ENCRYPTION_BYTES_40);
+    np_message_t *msg_in = NULL;
+    np_new_obj(np_message_t, msg_in);
+    cr_assert(_np_message_deserialize_header_and_instructions(msg_in, packet),
+              "expect the part to be deserialized");
+
+    np_event_runtime_t run = {0};
+    cr_expect(_np_out_forward_cut_through(context, &run, msg_in),
+              "expect the part to be relayed directly");
+    cr_assert(1 == run.__chained_events_size,
+              "expect exactly one send event for the part");
+
+    np_util_event_t send_event = run.__chained_events[0];
+    cr_expect(msg_in == send_event.user_data, "expect the received part");
+    cr_expect(_np_dhkey_equal(&to, &send_event.__source_dhkey),
+              "expect the part to be sent to the next hop");
+    cr_expect(_np_dhkey_equal(&to, &send_event.target_dhkey),
+              "expect the target of the part");
+    cr_expect(FLAG_CMP(send_event.type, evt_message),
+              "expect a message event");
+    np_unref_obj(np_unknown_t, send_event.user_data, "_np_event_runtime");
+
+    // a duplicate of the part is caught by the forward filter
+    np_event_runtime_t duplicate_run = {0};
+    _np_out_forward_cut_through(context, &duplicate_run, msg_in);
+    cr_expect(0 == duplicate_run.__chained_events_size,
+              "expect a duplicate of the part not to be relayed again");
+
+    np_unref_obj(np_message_t, msg_in, ref_obj_creation);
+    np_unref_obj(np_message_t, msg_out, ref_obj_creation);
+
+    sll_iterator(np_key_ptr) iter = sll_first(my_keys);
+    while (NULL != iter) {
+      np_unref_obj(np_key_t, iter->val, "_np_keycache_create");
+      sll_next(iter);
+    }
+    sll_free(np_key_ptr, my_keys);
+  }
+}
@@ -0,0 +1,611 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <arpa/inet.h>
+#include <criterion/criterion.h>
+#include <errno.h>
+#include <fcntl.h>
+#include <math.h>
+#include <netinet/in.h>
+#include <poll.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stddef.h>
+#include <stdint.h>
+#include <stdlib.h>
+
+#include "../test_macros.c"
+
+#include "neuropil_log.h"
+
+#include "np_dhkey.h"
+#include "np_evloop.h"
+#include "np_legacy.h"
+#include "np_log.h"
+#include "np_memory.h"
+#include "np_network.h"
+#include "np_settings.h"
+#include "np_types.h"
+#include "np_util.h"
+
+TestSuite(np_network_t);
+
+static void *__test_network_chunk(np_state_t *context, char marker) {
+  char *chunk = NULL;
+  np_new_obj(BLOB_1024, chunk, ref_obj_creation);
+  chunk[0] = marker;
+  return chunk;
+}
+
+Test(np_network_t,
+     send_queue_head_of_line_blocking,
+     .description = "test that a bulk subject does not block control messages "
+                    "and other subjects towards the same peer") {
+  CTX() {
+    uint16_t bulk_count = 512, small_count = 8, control_count = 4;
+    uint16_t total = bulk_count + small_count + control_count;
+    double   dequeue_arr[total];
+
+    np_dhkey_t bulk_subject = {0}, small_subject = {0};
+    np_generate_subject((np_subject *)&bulk_subject, "bulk", 4);
+    np_generate_subject((np_subject *)&small_subject, "small", 5);
+
+    np_network_t *network = NULL;
+    np_new_obj(np_network_t, network);
+
+    // the bulk transfer is queued first, the small subject and the control
+    // messages arrive later
+    for (uint16_t i = 0; i < bulk_count; i++) {
+      cr_assert(np_ok == _np_network_enqueue(
+                             network,
+                             __test_network_chunk(context, 'B'),
+                             np_network_send_data,
+                             bulk_subject),
+                "expect the bulk chunk to be queued");
+    }
+    for (uint16_t i = 0; i < small_count; i++) {
+      cr_assert(np_ok == _np_network_enqueue(
+                             network,
+                             __test_network_chunk(context, 'S'),
+                             np_network_send_data,
+                             small_subject),
+                "expect the small chunk to be queued");
+    }
+    for (uint16_t i = 0; i < control_count; i++) {
+      cr_assert(np_ok == _np_network_enqueue(
+                             network,
+                             __test_network_chunk(context, 'C'),
+                             np_network_send_control,
+                             bulk_subject),
+                "expect the control chunk to be queued");
+    }
+    cr_expect(total == _np_network_queue_size(network),
+              "expect all chunks to be queued");
+
+    uint16_t last_control = 0, first_small = total, last_small = 0;
+    uint16_t j     = 0;
+    char    *chunk = NULL;
+    for (; j < total; j++) {
+      MEASURE_TIME(dequeue_arr, j, { chunk = _np_network_dequeue(network); });
+      cr_assert(NULL != chunk, "expect a chunk to be dequeued");
+
+      if (chunk[0] == 'C') last_control = j;
+      if (chunk[0] == 'S') {
+        if (first_small == total) first_small = j;
+        last_small = j;
+      }
+      np_unref_obj(BLOB_1024, chunk, ref_obj_creation);
+    }
+    cr_expect(NULL == _np_network_dequeue(network),
+              "expect the queue to be empty");
+    cr_expect(0 == _np_network_queue_size(network),
+              "expect the queue to be empty");
+
+    cr_expect(control_count - 1 == last_control,
+              "expect control chunks to be sent before any data chunk");
+    cr_expect(first_small <= control_count + NP_NETWORK_SEND_QUEUE_QUANTUM,
+              "expect the small subject to be served in the first round");
+    cr_expect(last_small <
+                  control_count + 2 * small_count +
+                      NP_NETWORK_SEND_QUEUE_QUANTUM,
+              "expect the small subject not to wait for the bulk subject");
+
+    cr_log_info("###########\n");
+    cr_log_info("small subject done after %" PRIu16 " of %" PRIu16
+                " chunks (fifo: %" PRIu16 ")\n",
+                last_small + 1,
+                total,
+                control_count + bulk_count + small_count);
+    CALC_AND_PRINT_STATISTICS("send queue dequeue: ", dequeue_arr, j);
+
+    np_unref_obj(np_network_t, network, ref_obj_creation);
+  }
+}
+
+Test(np_network_t,
+     send_queue_bounded,
+     .description = "test that the send queue of a peer reports a full queue "
+                    "and blocks only the subjects queued towards this peer") {
+  CTX() {
+    np_dhkey_t subject = {0}, other_subject = {0};
+    np_generate_subject((np_subject *)&subject, "bounded", 7);
+    np_generate_subject((np_subject *)&other_subject, "other", 5);
+
+    np_network_t *network = NULL, *other_network = NULL;
+    np_new_obj(np_network_t, network);
+    np_new_obj(np_network_t, other_network);
+
+    void          *chunk  = NULL;
+    uint32_t       queued = 0;
+    enum np_return ret    = np_ok;
+    while (np_ok == ret) {
+      chunk = __test_network_chunk(context, 'B');
+      ret = _np_network_enqueue(network, chunk, np_network_send_data, subject);
+      if (np_ok == ret) queued++;
+    }
+    np_unref_obj(BLOB_1024, chunk, ref_obj_creation);
+
+    cr_expect(np_operation_would_block == ret,
+              "expect a full data class to be reported to the caller");
+    cr_expect(NP_NETWORK_SEND_QUEUE_MAX_DATA == queued,
+              "expect the data class to be bounded");
+    cr_expect(_np_network_is_congested(context, subject),
+              "expect the subject of the full queue to be blocked");
+
+    // a second peer is not affected by the slow peer
+    cr_expect(np_ok == _np_network_enqueue(other_network,
+                                           __test_network_chunk(context, 'O'),
+                                           np_network_send_data,
+                                           other_subject),
+              "expect the queue of another peer to accept chunks");
+    cr_expect(!_np_network_is_congested(context, other_subject),
+              "expect other subjects not to be blocked by the slow peer");
+
+    unsigned char payload[64] = {0};
+    cr_expect(np_operation_would_block ==
+                  np_send(context, (uint8_t *)&subject, payload, 64),
+              "expect np_send to report the full queue");
+    cr_expect(np_ok == np_send(context, (uint8_t *)&other_subject, payload, 64),
+              "expect np_send to accept messages of other subjects");
+
+    chunk = __test_network_chunk(context, 'C');
+    cr_expect(np_ok == _np_network_enqueue(network,
+                                           chunk,
+                                           np_network_send_control,
+                                           subject),
+              "expect control chunks to be accepted with a full data class");
+
+    // the subject stays blocked until the queue drained below the low mark
+    while (NULL != (chunk = _np_network_dequeue(network)) &&
+           _np_network_queue_size(network) >=
+               NP_NETWORK_SEND_QUEUE_LOW_WATERMARK) {
+      cr_expect(_np_network_is_congested(context, subject),
+                "expect the subject to be blocked above the low watermark");
+      np_unref_obj(BLOB_1024, chunk, ref_obj_creation);
+    }
+    if (NULL != chunk) np_unref_obj(BLOB_1024, chunk, ref_obj_creation);
+    cr_expect(!_np_network_is_congested(context, subject),
+              "expect the subject to be released below the low watermark");
+
+    // remaining chunks are released together with the network
+    np_unref_obj(np_network_t, network, ref_obj_creation);
+    np_unref_obj(np_network_t, other_network, ref_obj_creation);
+  }
+}
+
+Test(np_network_t,
+     send_queue_deferred,
+     .description = "test that chunks rejected by a full send queue are kept "
+                    "until they fit, expire or run out of attempts") {
+  CTX() {
+    np_dhkey_t subject = {0};
+    np_generate_subject((np_subject *)&subject, "deferred", 8);
+
+    np_network_t *network = NULL;
+    np_new_obj(np_network_t, network);
+
+    for (uint32_t i = 0; i < NP_NETWORK_SEND_QUEUE_MAX_DATA; i++)
+      _np_network_enqueue(network,
+                          __test_network_chunk(context, 'B'),
+                          np_network_send_data,
+                          subject);
+
+    double now = np_time_now();
+    _np_network_defer(network,
+                      __test_network_chunk(context, 'E'),
+                      np_network_send_data,
+                      subject,
+                      now - 1.0);
+    _np_network_defer(network,
+                      __test_network_chunk(context, 'D'),
+                      np_network_send_data,
+                      subject,
+                      now + 60.0);
+    cr_expect(network->out_queue.deferred_pending,
+              "expect a retry of the deferred chunks to be scheduled");
+    cr_expect(_np_network_retry_deferred(network),
+              "expect the chunk of a valid message to stay deferred");
+    cr_expect(1 == sll_size(network->out_queue.deferred),
+              "expect the chunk of an expired message to be dropped");
+
+    // a deferred chunk is queued (without being encrypted again) once the
+    // queue has space
+    void *chunk = _np_network_dequeue(network);
+    np_unref_obj(BLOB_1024, chunk, ref_obj_creation);
+    cr_expect(!_np_network_retry_deferred(network),
+              "expect no deferred chunk to remain");
+    cr_expect(NP_NETWORK_SEND_QUEUE_MAX_DATA == _np_network_queue_size(network),
+              "expect the deferred chunk in the send queue");
+
+    // a peer that stays congested does not keep the chunk forever
+    _np_network_defer(network,
+                      __test_network_chunk(context, 'A'),
+                      np_network_send_data,
+                      subject,
+                      now + 60.0);
+    uint16_t attempts = 0;
+    while (_np_network_retry_deferred(network) &&
+           attempts < NP_NETWORK_SEND_QUEUE_RETRY_MAX)
+      attempts++;
+    cr_expect(NP_NETWORK_SEND_QUEUE_RETRY_MAX - 1 == attempts,
+              "expect the chunk to be dropped after %" PRIu16 " attempts",
+              (uint16_t)NP_NETWORK_SEND_QUEUE_RETRY_MAX);
+    cr_expect(sll_empty(network->out_queue.deferred),
+              "expect no deferred chunk to remain");
+
+    np_unref_obj(np_network_t, network, ref_obj_creation);
+  }
+}
+
+Test(np_network_t,
+     pacing_window_on_ack,
+     .description = "test the growth of the send window and the pacing rate "
+                    "with acknowledged messages") {
+  CTX() {
+    np_network_t *network = NULL;
+    np_new_obj(np_network_t, network);
+    struct np_network_pacing_s *pacing = &network->pacing;
+
+    cr_expect(NP_NETWORK_PACING_INITIAL_CWND == pacing->cwnd,
+              "expect the initial send window");
+
+    // slow start: one chunk per ack
+    _np_network_pacing_update(network, 0.1, false);
+    cr_expect(NP_NETWORK_PACING_INITIAL_CWND + 1.0 == pacing->cwnd,
+              "expect the window to grow by one chunk in slow start");
+    cr_expect(0.1 == pacing->srtt, "expect the first sample to set the srtt");
+    double rate = NP_NETWORK_PACING_GAIN * pacing->cwnd / 0.1;
+    cr_expect(fabs(pacing->rate - rate) < 1e-9,
+              "expect the rate to follow window and srtt");
+
+    _np_network_pacing_update(network, 0.2, false);
+    cr_expect(fabs(pacing->srtt - (0.875 * 0.1 + 0.125 * 0.2)) < 1e-9,
+              "expect the srtt to be smoothed");
+
+    // congestion avoidance: one chunk per window
+    pacing->ssthresh = pacing->cwnd;
+    double cwnd      = pacing->cwnd;
+    _np_network_pacing_update(network, 0.1, false);
+    cr_expect(fabs(pacing->cwnd - (cwnd + 1.0 / cwnd)) < 1e-9,
+              "expect the window to grow by 1/cwnd after slow start");
+
+    // samples without a round trip time do not change the window
+    cwnd = pacing->cwnd;
+    _np_network_pacing_update(network, 0.0, false);
+    cr_expect(cwnd == pacing->cwnd, "expect an empty sample to be ignored");
+
+    pacing->ssthresh = NP_NETWORK_PACING_MAX_CWND;
+    for (uint16_t i = 0; i < 2 * NP_NETWORK_PACING_MAX_CWND; i++)
+      _np_network_pacing_update(network, 0.1, false);
+    cr_expect(NP_NETWORK_PACING_MAX_CWND == pacing->cwnd,
+              "expect the window to be bounded");
+
+    np_unref_obj(np_network_t, network, ref_obj_creation);
+  }
+}
+
+Test(np_network_t,
+     pacing_window_on_unacked,
+     .description = "test that fire and forget traffic is not held at the "
+                    "initial send window") {
+  CTX() {
+    np_network_t *network = NULL;
+    np_new_obj(np_network_t, network);
+    struct np_network_pacing_s *pacing = &network->pacing;
+
+    // a ping sets the srtt, no acks follow for the bulk chunks
+    _np_network_pacing_update(network, NP_NETWORK_PACING_INITIAL_RTT, false);
+    double rate = pacing->rate;
+
+    for (uint16_t i = 0; i < 2 * NP_NETWORK_PACING_MAX_CWND; i++)
+      _np_network_pacing_unacked(network);
+    cr_expect(NP_NETWORK_PACING_MAX_CWND == pacing->cwnd,
+              "expect the window to grow with each unacknowledged chunk");
+    cr_expect(pacing->rate > 32 * rate,
+              "expect the pacing rate to grow with the window");
+
+    // losses still slow the sender down
+    double cwnd = pacing->cwnd;
+    _np_network_pacing_update(network, 0.0, true);
+    cr_expect(cwnd / 2.0 == pacing->cwnd, "expect the window to be halved");
+
+    np_unref_obj(np_network_t, network, ref_obj_creation);
+  }
+}
+
+Test(np_network_t,
+     pacing_window_on_loss,
+     .description = "test the decrease of the send window on lost messages") {
+  CTX() {
+    np_network_t *network = NULL;
+    np_new_obj(np_network_t, network);
+    struct np_network_pacing_s *pacing = &network->pacing;
+
+    for (uint8_t i = 0; i < 16; i++)
+      _np_network_pacing_update(network, 0.5, false);
+    double cwnd = pacing->cwnd;
+
+    _np_network_pacing_update(network, 0.0, true);
+    cr_expect(cwnd / 2.0 == pacing->cwnd, "expect the window to be halved");
+    cr_expect(pacing->cwnd == pacing->ssthresh,
+              "expect slow start to end at the halved window");
+    double rate = NP_NETWORK_PACING_GAIN * pacing->cwnd / pacing->srtt;
+    cr_expect(fabs(pacing->rate - rate) < 1e-9,
+              "expect the rate to follow the window");
+
+    // a burst of losses within one round trip counts once
+    _np_network_pacing_update(network, 0.0, true);
+    cr_expect(cwnd / 2.0 == pacing->cwnd,
+              "expect a second loss within one round trip to be ignored");
+
+    // later losses shrink the window down to its minimum
+    for (uint8_t i = 0; i < 16; i++) {
+      pacing->decreased_at -= pacing->srtt;
+      _np_network_pacing_update(network, 0.0, true);
+    }
+    cr_expect(NP_NETWORK_PACING_MIN_CWND == pacing->cwnd,
+              "expect the window not to shrink below its minimum");
+
+    np_unref_obj(np_network_t, network, ref_obj_creation);
+  }
+}
+
+#define __TEST_NETWORK_PROBES 64
+
+// a standalone event loop blocking in the io backend on its own thread, the
+// loop lock and the async watcher are used like the loops of a node do if
+// NP_EVENT_LOOP_EVENT_DRIVEN is set
+struct __test_network_probe {
+  struct ev_loop *loop;
+  pthread_mutex_t lock;
+  ev_async        async;
+  ev_io           watchers[2];
+  double          latencies[__TEST_NETWORK_PROBES];
+  uint16_t        received;
+  bool            stop;
+};
+
+static void __test_network_probe_acquire(struct ev_loop *loop) {
+  struct __test_network_probe *probe = ev_userdata(loop);
+  pthread_mutex_lock(&probe->lock);
+}
+
+static void __test_network_probe_release(struct ev_loop *loop) {
+  struct __test_network_probe *probe = ev_userdata(loop);
+  pthread_mutex_unlock(&probe->lock);
+}
+
+static void
+__test_network_probe_async(struct ev_loop *loop, ev_async *w, int revents) {
+  struct __test_network_probe *probe = ev_userdata(loop);
+  if (probe->stop) ev_break(loop, EVBREAK_ALL);
+}
+
+static void
+__test_network_probe_read(struct ev_loop *loop, ev_io *event, int revents) {
+  np_state_t                  *context = NULL; // no node is running
+  struct __test_network_probe *probe   = ev_userdata(loop);
+  double                       sent_at = 0.0;
+
+  while (sizeof(sent_at) == recv(event->fd, &sent_at, sizeof(sent_at), 0)) {
+    if (probe->received < __TEST_NETWORK_PROBES)
+      probe->latencies[probe->received++] = np_time_now() - sent_at;
+  }
+}
+
+static void *__test_network_probe_loop(void *arg) {
+  struct __test_network_probe *probe = arg;
+  pthread_mutex_lock(&probe->lock);
+  ev_run(probe->loop, 0);
+  pthread_mutex_unlock(&probe->lock);
+  return NULL;
+}
+
+static int __test_network_probe_socket(int *tx) {
+  int                rx   = socket(AF_INET, SOCK_DGRAM | SOCK_NONBLOCK, 0);
+  struct sockaddr_in addr = {.sin_family = AF_INET};
+  socklen_t          len  = sizeof(addr);
+  addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+  cr_assert(0 == bind(rx, (struct sockaddr *)&addr, len));
+  cr_assert(0 == getsockname(rx, (struct sockaddr *)&addr, &len));
+
+  *tx = socket(AF_INET, SOCK_DGRAM, 0);
+  cr_assert(0 == connect(*tx, (struct sockaddr *)&addr, len));
+  return rx;
+}
+
+// sends the probes one by one to the idle loop and waits for each of them
+static void __test_network_probe_send(struct __test_network_probe *probe,
+                                      int                          tx,
+                                      uint16_t                     count) {
+  np_state_t *context  = NULL; // no node is running
+  uint16_t    received = 0;
+  for (uint16_t i = 0; i < count; i++) {
+    // let the loop fall idle before every probe
+    np_time_sleep(NP_PI / 500);
+
+    pthread_mutex_lock(&probe->lock);
+    uint16_t expected = probe->received + 1;
+    pthread_mutex_unlock(&probe->lock);
+
+    double sent_at = np_time_now();
+    cr_assert(sizeof(sent_at) == send(tx, &sent_at, sizeof(sent_at), 0));
+    do {
+      np_time_sleep(0.0001);
+      pthread_mutex_lock(&probe->lock);
+      received = probe->received;
+      pthread_mutex_unlock(&probe->lock);
+    } while (received < expected && np_time_now() - sent_at < 5.0);
+    cr_assert(received == expected,
+              "expect the idle loop to be woken up by probe %" PRIu16,
+              i);
+  }
+}
+
+Test(np_network_t,
+     idle_loop_wakeup_latency,
+     .description = "test that an event loop blocking in the io backend is "
+                    "woken up by incoming datagrams and by watchers added "
+                    "from another thread") {
+  struct __test_network_probe probe = {0};
+  pthread_mutex_init(&probe.lock, NULL);
+
+  probe.loop = ev_loop_new(EVFLAG_AUTO);
+  cr_assert(NULL != probe.loop, "expect a standalone event loop");
+  ev_set_userdata(probe.loop, &probe);
+  ev_set_loop_release_cb(probe.loop,
+                         __test_network_probe_release,
+                         __test_network_probe_acquire);
+  ev_async_init(&probe.async, __test_network_probe_async);
+  ev_async_start(probe.loop, &probe.async);
+
+  int tx[2] = {-1, -1};
+  int rx    = __test_network_probe_socket(&tx[0]);
+  ev_io_init(&probe.watchers[0], __test_network_probe_read, rx, EV_READ);
+  ev_io_start(probe.loop, &probe.watchers[0]);
+
+  pthread_t loop_thread;
+  cr_assert(0 == pthread_create(&loop_thread,
+                                NULL,
+                                __test_network_probe_loop,
+                                &probe));
+
+  // datagrams arriving at the idle loop
+  __test_network_probe_send(&probe, tx[0], __TEST_NETWORK_PROBES / 2);
+
+  // a watcher added while the loop is blocked, the async watcher lets the
+  // loop pick up the new file descriptor
+  rx = __test_network_probe_socket(&tx[1]);
+  pthread_mutex_lock(&probe.lock);
+  ev_io_init(&probe.watchers[1], __test_network_probe_read, rx, EV_READ);
+  ev_io_start(probe.loop, &probe.watchers[1]);
+  ev_async_send(probe.loop, &probe.async);
+  pthread_mutex_unlock(&probe.lock);
+  __test_network_probe_send(&probe, tx[1], __TEST_NETWORK_PROBES / 2);
+
+  pthread_mutex_lock(&probe.lock);
+  probe.stop = true;
+  ev_async_send(probe.loop, &probe.async);
+  pthread_mutex_unlock(&probe.lock);
+  cr_assert(0 == pthread_join(loop_thread, NULL),
+            "expect the loop to be stopped by the async watcher");
+
+  for (uint8_t i = 0; i < 2; i++) {
+    ev_io_stop(probe.loop, &probe.watchers[i]);
+    close(probe.watchers[i].fd);
+    close(tx[i]);
+  }
+  ev_loop_destroy(probe.loop);
+  pthread_mutex_destroy(&probe.lock);
+
+  cr_expect(__TEST_NETWORK_PROBES == probe.received,
+            "expect all probes to be received");
+  cr_log_info("###########\n");
+  CALC_AND_PRINT_STATISTICS("idle loop wakeup: ",
+                            probe.latencies,
+                            probe.received);
+}
+
+#define __TEST_NETWORK_SHARDS        4
+#define __TEST_NETWORK_SHARD_PORT    31490
+#define __TEST_NETWORK_SHARD_CLIENTS 64
+
+Test(np_network_t,
+     ingress_shards_setup_and_close,
+     .description = "test that each SO_REUSEPORT ingress shard receives "
+                    "datagrams and that closing the network releases all "
+                    "shard sockets") {
+  struct np_settings *settings = np_default_settings(NULL);
+  snprintf(settings->log_file,
+           256,
+           "logs/neuropil_test_network_ingress_shards.log");
+  settings->log_level     |= LOG_GLOBAL;
+  settings->n_threads      = 1;
+  settings->ingress_shards = __TEST_NETWORK_SHARDS;
+  np_state_t *context      = np_new_context(settings);
+  cr_assert(NULL != context, "expect a context with ingress shards");
+
+#ifdef SO_REUSEPORT
+  cr_assert(__TEST_NETWORK_SHARDS == _np_event_in_shard_count(context),
+            "expect the configured number of ingress shards");
+
+  np_network_t *network = NULL;
+  np_new_obj(np_network_t, network);
+  cr_assert(_np_network_init(network,
+                             true,
+                             UDP | IPv4,
+                             "127.0.0.1",
+                             TO_STRING(__TEST_NETWORK_SHARD_PORT),
+                             -1,
+                             UNKNOWN_PROTO),
+            "expect the listening network to be created");
+  cr_assert(__TEST_NETWORK_SHARDS - 1 == network->shard_count,
+            "expect a socket for each additional shard");
+
+  // the network is not started, the datagrams stay in the socket buffers
+  struct pollfd fds[__TEST_NETWORK_SHARDS] = {0};
+  fds[0].fd                                = network->socket;
+  for (uint8_t i = 1; i < __TEST_NETWORK_SHARDS; i++)
+    fds[i].fd = network->shard_watchers[i - 1].fd;
+  for (uint8_t i = 0; i < __TEST_NETWORK_SHARDS; i++) fds[i].events = POLLIN;
+
+  // the kernel hashes the flow of each client onto one of the shards
+  struct sockaddr_in addr = {.sin_family = AF_INET};
+  addr.sin_port           = htons(__TEST_NETWORK_SHARD_PORT);
+  addr.sin_addr.s_addr    = htonl(INADDR_LOOPBACK);
+  int clients[__TEST_NETWORK_SHARD_CLIENTS];
+  for (uint8_t i = 0; i < __TEST_NETWORK_SHARD_CLIENTS; i++) {
+    clients[i] = socket(AF_INET, SOCK_DGRAM, 0);
+    cr_assert(0 <= clients[i], "expect a client socket");
+    cr_assert(0 ==
+              connect(clients[i], (struct sockaddr *)&addr, sizeof(addr)));
+    cr_assert(1 == send(clients[i], &i, 1, 0), "expect a datagram to be sent");
+  }
+
+  uint8_t receiving = 0;
+  double  timeout   = np_time_now() + 5.0;
+  while (receiving < __TEST_NETWORK_SHARDS && np_time_now() < timeout) {
+    poll(fds, __TEST_NETWORK_SHARDS, 10);
+    receiving = 0;
+    for (uint8_t i = 0; i < __TEST_NETWORK_SHARDS; i++)
+      if (FLAG_CMP(fds[i].revents, POLLIN)) receiving++;
+  }
+  for (uint8_t i = 0; i < __TEST_NETWORK_SHARDS; i++)
+    cr_expect(FLAG_CMP(fds[i].revents, POLLIN),
+              "expect ingress shard %" PRIu8 " to receive datagrams",
+              i);
+
+  for (uint8_t i = 0; i < __TEST_NETWORK_SHARD_CLIENTS; i++)
+    close(clients[i]);
+
+  // deleting the network closes the main socket and all shard sockets
+  np_unref_obj(np_network_t, network, ref_obj_creation);
+  for (uint8_t i = 0; i < __TEST_NETWORK_SHARDS; i++)
+    cr_expect(-1 == fcntl(fds[i].fd, F_GETFD) && EBADF == errno,
+              "expect the socket of ingress shard %" PRIu8 " to be closed",
+              i);
+#endif
+
+  np_destroy(context, false);
+}
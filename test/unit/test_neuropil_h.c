@@ -58,3 +58,51 @@ Test(neuropil_h,
     log_msg(LOG_INFO, "new fp: %s ### %s: old fp", fp_str, old_fp_str);
   }
 }
+
+Test(neuropil_h,
+     np_send_many,
+     .description = "compare np_send_many against a loop of np_send") {
+  CTX() {
+    uint16_t rounds = 20, batch_size = 100;
+    double   send_arr[rounds], send_many_arr[rounds];
+
+    np_subject subject_id = {0};
+    np_generate_subject(&subject_id, "urn:np:test:send_many", 21);
+
+    unsigned char   payload[64] = {0};
+    struct np_iovec messages[batch_size];
+    for (uint16_t i = 0; i < batch_size; i++) {
+      messages[i].data   = payload;
+      messages[i].length = sizeof(payload);
+    }
+
+    for (uint16_t j = 0; j < rounds; j++) {
+      MEASURE_TIME(send_arr, j, {
+        for (uint16_t i = 0; i < batch_size; i++)
+          np_send(context, subject_id, payload, sizeof(payload));
+      });
+      np_run(context, 0.1);
+    }
+
+    for (uint16_t j = 0; j < rounds; j++) {
+      MEASURE_TIME(send_many_arr, j, {
+        cr_expect(np_ok ==
+                      np_send_many(context, subject_id, messages, batch_size),
+                  "expect the batch to be accepted");
+      });
+      np_run(context, 0.1);
+    }
+
+    cr_expect(np_ok == np_send_many(context, subject_id, messages, 0),
+              "expect an empty batch to be accepted");
+    cr_expect(np_invalid_argument ==
+                  np_send_many(context, subject_id, NULL, batch_size),
+              "expect missing messages to be rejected");
+
+    cr_log_info("###########\n");
+    CALC_AND_PRINT_STATISTICS("np_send (100 msgs)     : ", send_arr, rounds);
+    CALC_AND_PRINT_STATISTICS("np_send_many (100 msgs): ",
+                              send_many_arr,
+                              rounds);
+  }
+}
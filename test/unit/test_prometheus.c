@@ -0,0 +1,186 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <inttypes.h>
+#include <pthread.h>
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include <stdlib.h>
+#include <string.h>
+
+#include "../framework/prometheus/prometheus.h"
+
+#include "np_constants.h"
+#include "np_legacy.h"
+
+#define __TEST_PROMETHEUS_METRICS       10000
+#define __TEST_PROMETHEUS_SCRAPE_ROUNDS 20
+#define __TEST_PROMETHEUS_REGISTRATIONS 1000
+
+TestSuite(np_prometheus_t);
+
+static uint64_t __test_prometheus_time() { return 1700000000000; }
+
+static void __test_prometheus_register(prometheus_context *prometheus,
+                                       uint32_t            count,
+                                       const char         *prefix) {
+  for (uint32_t i = 0; i < count; i++) {
+    char name[255];
+    snprintf(name, 255, "%s_%" PRIu32, prefix, i);
+    prometheus_metric *metric = prometheus_register_metric(prometheus, name);
+
+    prometheus_label label = {.name = "subject"};
+    snprintf(label.value, 255, "%064" PRIu32, i);
+    prometheus_metric_add_label(metric, label);
+    prometheus_metric_inc(metric, i);
+  }
+}
+
+Test(np_prometheus_t,
+     _prometheus_scrape,
+     .description = "measure the scrape of labeled metrics into a reused "
+                    "buffer") {
+  prometheus_context *prometheus =
+      prometheus_create_context(__test_prometheus_time);
+  __test_prometheus_register(prometheus,
+                             __TEST_PROMETHEUS_METRICS,
+                             "np_test_metric");
+
+  char  *buffer      = NULL;
+  size_t buffer_size = 0;
+  size_t length = prometheus_format_into(prometheus, &buffer, &buffer_size);
+  cr_assert(length > 0, "expect the metrics to be exposed");
+  cr_expect(buffer_size > length, "expect the exposition to be terminated");
+
+  char  *first_buffer = buffer;
+  double start        = _np_time_now(NULL);
+  for (uint16_t r = 0; r < __TEST_PROMETHEUS_SCRAPE_ROUNDS; r++) {
+    cr_expect(length ==
+                  prometheus_format_into(prometheus, &buffer, &buffer_size),
+              "expect each scrape to expose the same metrics");
+  }
+  double duration =
+      (_np_time_now(NULL) - start) / __TEST_PROMETHEUS_SCRAPE_ROUNDS;
+  cr_expect(first_buffer == buffer,
+            "expect the buffer of the first scrape to be reused");
+  cr_log_info("prometheus scrape of %d metrics: %.6f sec (%" PRIsizet
+              " bytes)\n",
+              __TEST_PROMETHEUS_METRICS,
+              duration,
+              length);
+
+  char expected[255];
+  snprintf(expected,
+           255,
+           "np_test_metric_42{subject=\"%064d\"} 42 1700000000000\n",
+           42);
+  char *copy = prometheus_format(prometheus);
+  cr_expect(0 == strcmp(copy, buffer),
+            "expect a formatted copy to match the reused buffer");
+  cr_expect(NULL != strstr(buffer, expected),
+            "expect the labels, value and timestamp of a counter");
+  free(copy);
+  free(buffer);
+  prometheus_destroy_context(prometheus);
+}
+
+static void *__test_prometheus_scrape_loop(void *arg) {
+  prometheus_context *prometheus  = arg;
+  char               *buffer      = NULL;
+  size_t              buffer_size = 0;
+  for (uint16_t r = 0; r < __TEST_PROMETHEUS_SCRAPE_ROUNDS; r++)
+    prometheus_format_into(prometheus, &buffer, &buffer_size);
+  free(buffer);
+  return NULL;
+}
+
+Test(np_prometheus_t,
+     _prometheus_register_while_scraping,
+     .description = "register labeled metrics while scrapes are running") {
+  prometheus_context *prometheus =
+      prometheus_create_context(__test_prometheus_time);
+  __test_prometheus_register(prometheus,
+                             __TEST_PROMETHEUS_METRICS,
+                             "np_test_metric");
+
+  pthread_t scraper;
+  cr_assert(0 == pthread_create(&scraper,
+                                NULL,
+                                __test_prometheus_scrape_loop,
+                                prometheus),
+            "expect the scrape thread to start");
+  double start = _np_time_now(NULL);
+  __test_prometheus_register(prometheus,
+                             __TEST_PROMETHEUS_REGISTRATIONS,
+                             "np_test_registered");
+  double duration =
+      (_np_time_now(NULL) - start) / __TEST_PROMETHEUS_REGISTRATIONS;
+  pthread_join(scraper, NULL);
+  cr_log_info("prometheus registration while scraping: %.9f sec\n", duration);
+
+  char *exposition = prometheus_format(prometheus);
+  for (uint32_t i = 0; i < __TEST_PROMETHEUS_REGISTRATIONS; i++) {
+    char name[255];
+    snprintf(name, 255, "np_test_registered_%" PRIu32 "{", i);
+    cr_expect(NULL != strstr(exposition, name),
+              "expect metric %" PRIu32 " to be part of the next scrape",
+              i);
+  }
+  free(exposition);
+  prometheus_destroy_context(prometheus);
+}
+
+Test(np_prometheus_t,
+     _prometheus_histogram_exposition,
+     .description = "test the cumulative buckets, sum and count of a labeled "
+                    "histogram") {
+  prometheus_context *prometheus =
+      prometheus_create_context(__test_prometheus_time);
+
+  const double       bounds[] = {0.001, 0.01, 0.1};
+  prometheus_metric *histogram =
+      prometheus_register_histogram(prometheus,
+                                    "np_test_latency_seconds",
+                                    bounds,
+                                    ARRAY_SIZE(bounds));
+  prometheus_label   label    = {.name = "subject", .value = "a"};
+  prometheus_metric_add_label(histogram, label);
+
+  // a value equal to a bound is counted into the bucket of that bound
+  const double observations[] = {0.0005, 0.005, 0.01, 0.05, 1.0};
+  for (uint8_t i = 0; i < ARRAY_SIZE(observations); i++)
+    prometheus_histogram_observe(histogram, observations[i]);
+
+  const char expected[] =
+      "np_test_latency_seconds_bucket{subject=\"a\",le=\"0.001\"} 1\n"
+      "np_test_latency_seconds_bucket{subject=\"a\",le=\"0.01\"} 3\n"
+      "np_test_latency_seconds_bucket{subject=\"a\",le=\"0.1\"} 4\n"
+      "np_test_latency_seconds_bucket{subject=\"a\",le=\"+Inf\"} 5\n"
+      "np_test_latency_seconds_sum{subject=\"a\"} 1.0655\n"
+      "np_test_latency_seconds_count{subject=\"a\"} 5\n";
+  char *exposition = prometheus_format(prometheus);
+  cr_expect_str_eq(exposition, expected, "expect the histogram exposition");
+  free(exposition);
+
+  // released per peer metrics are hidden and reset before they are reused
+  prometheus_disable_value_output(histogram);
+  exposition = prometheus_format(prometheus);
+  cr_expect_str_eq(exposition, "", "expect a disabled metric to be hidden");
+  free(exposition);
+
+  prometheus_metric_reset(histogram);
+  prometheus_enable_value_output(histogram);
+  exposition = prometheus_format(prometheus);
+  cr_expect(NULL != strstr(exposition,
+                           "np_test_latency_seconds_bucket{subject=\"a\","
+                           "le=\"+Inf\"} 0\n"),
+            "expect the buckets of a reset histogram to be empty");
+  cr_expect(NULL != strstr(exposition,
+                           "np_test_latency_seconds_sum{subject=\"a\"} 0\n"),
+            "expect the sum of a reset histogram to be zero");
+  free(exposition);
+  prometheus_destroy_context(prometheus);
+}
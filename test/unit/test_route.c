@@ -16,7 +16,11 @@
 #include "np_threads.h"
 #include "np_constants.h"
 
+#include "np_dhkey.h"
+#include "np_key.h"
+#include "np_node.h"
 #include "np_route.h"
+#include "np_settings.h"
 
 #include "../test_macros.c"
 
@@ -165,3 +169,177 @@ Test(np_route_t, _route_create, .description = "test the insert of keys into the
 		}
 	}
 }
+
+#define __TEST_ROUTE_TARGETS 64
+#define __TEST_ROUTE_ROUNDS 100
+
+static np_key_t* __test_route_closest(np_sll_t(np_key_ptr, keys), np_dhkey_t target, bool good_links_only)
+{
+	np_key_t* closest = NULL;
+	np_dhkey_t min_dif = {0}, dif = {0};
+
+	sll_iterator(np_key_ptr) iter = sll_first(keys);
+	for (; iter != NULL; sll_next(iter))
+	{
+		if (good_links_only && _np_key_get_node(iter->val)->success_avg <= BAD_LINK) continue;
+
+		_np_dhkey_distance(&dif, &target, &iter->val->dhkey);
+		if (closest == NULL || _np_dhkey_cmp(&dif, &min_dif) < 0)
+		{
+			closest = iter->val;
+			min_dif = dif;
+		}
+	}
+	return closest;
+}
+
+// brute force reference of the next hop: the closest key of the leafset when
+// the target is in its range, the most stable and fastest key of the matching
+// table cell, otherwise the closest key of leafset and the matching table row
+static np_key_t* __test_route_reference_hop(np_state_t* context, np_sll_t(np_key_ptr, leafset), np_sll_t(np_key_ptr, table), np_dhkey_t target)
+{
+	np_dhkey_t me = _np_route_get_key(context)->dhkey;
+	np_dhkey_t half = np_dhkey_half(context), inverse = {0};
+	np_dhkey_t left_range = me, right_range = me, left_max = {0}, right_max = {0}, dif = {0};
+	_np_dhkey_add(&inverse, &me, &half);
+
+	sll_iterator(np_key_ptr) iter = sll_first(leafset);
+	for (; iter != NULL; sll_next(iter))
+	{
+		bool is_right = _np_dhkey_between(&iter->val->dhkey, &me, &inverse, true);
+		_np_dhkey_distance(&dif, &me, &iter->val->dhkey);
+		if (is_right && _np_dhkey_cmp(&dif, &right_max) > 0) { right_max = dif; right_range = iter->val->dhkey; }
+		if (!is_right && _np_dhkey_cmp(&dif, &left_max) > 0) { left_max = dif; left_range = iter->val->dhkey; }
+	}
+	if (_np_dhkey_between(&target, &left_range, &right_range, true))
+		return __test_route_closest(leafset, target, false);
+
+	uint16_t row = _np_dhkey_index(&me, &target);
+	uint8_t col = _np_dhkey_hexalpha_at(context, &target, row);
+
+	np_sll_t(np_key_ptr, cell);
+	sll_init(np_key_ptr, cell);
+	np_sll_t(np_key_ptr, candidates);
+	sll_init(np_key_ptr, candidates);
+	np_key_t* hop = NULL;
+
+	for (iter = sll_first(table); iter != NULL; sll_next(iter))
+	{
+		if (_np_dhkey_index(&me, &iter->val->dhkey) != row) continue;
+
+		sll_append(np_key_ptr, candidates, iter->val);
+		if (_np_dhkey_hexalpha_at(context, &iter->val->dhkey, row) != col) continue;
+
+		sll_append(np_key_ptr, cell, iter->val);
+		if (hop == NULL && _np_key_get_node(iter->val)->success_avg > BAD_LINK) hop = iter->val;
+	}
+
+	if (hop != NULL)
+	{
+		for (iter = sll_first(cell); iter != NULL; sll_next(iter))
+		{
+			np_node_t* hop_node = _np_key_get_node(hop);
+			np_node_t* node = _np_key_get_node(iter->val);
+			if (1.0 - hop_node->success_avg + hop_node->latency > 1.0 - node->success_avg + node->latency)
+				hop = iter->val;
+		}
+	}
+	else
+	{
+		np_key_t* leaf_hop = __test_route_closest(leafset, target, false);
+		np_key_t* row_hop = __test_route_closest(candidates, target, true);
+		hop = leaf_hop;
+		if (row_hop != NULL)
+		{
+			np_dhkey_t leaf_dif = {0}, row_dif = {0};
+			if (leaf_hop != NULL) _np_dhkey_distance(&leaf_dif, &target, &leaf_hop->dhkey);
+			_np_dhkey_distance(&row_dif, &target, &row_hop->dhkey);
+			if (leaf_hop == NULL || _np_dhkey_cmp(&row_dif, &leaf_dif) <= 0) hop = row_hop;
+		}
+	}
+	sll_free(np_key_ptr, cell);
+	sll_free(np_key_ptr, candidates);
+	return hop;
+}
+
+Test(np_route_t, _route_lookup_batch, .description = "test the batched lookup of next hops against a brute force reference")
+{
+	CTX() {
+		np_sll_t(np_key_ptr, my_keys);
+		sll_init(np_key_ptr, my_keys);
+
+		for (uint16_t i = 0; i < 2000; i++)
+		{
+			np_dhkey_t my_dhkey = {0};
+			randombytes_buf(&my_dhkey, sizeof(np_dhkey_t));
+
+			np_key_t *insert_key = _np_keycache_create(context, my_dhkey);
+			np_node_t *new_node = NULL;
+			np_new_obj(np_node_t, new_node);
+			new_node->latency = randombytes_uniform(1000) / 1000.0;
+			new_node->success_avg = randombytes_uniform(1000) / 1000.0;
+			insert_key->entity_array[2] = new_node;
+			sll_append(np_key_ptr, my_keys, insert_key);
+
+			np_key_t *added = NULL, *deleted = NULL;
+			_np_route_update(insert_key, true, &deleted, &added);
+			_np_route_leafset_update(insert_key, true, &deleted, &added);
+		}
+
+		np_dhkey_t targets[__TEST_ROUTE_TARGETS];
+		np_key_t* next_hops[__TEST_ROUTE_TARGETS];
+		double batch_arr[__TEST_ROUTE_ROUNDS], single_arr[__TEST_ROUTE_ROUNDS];
+
+		np_sll_t(np_key_ptr, leafset) = _np_route_neighbors(context);
+		np_sll_t(np_key_ptr, table) = _np_route_get_table(context);
+
+		for (uint16_t r = 0; r < __TEST_ROUTE_ROUNDS; r++)
+		{
+			randombytes_buf(targets, sizeof(targets));
+			// some targets share a prefix with known keys
+			sll_iterator(np_key_ptr) iter = sll_first(my_keys);
+			for (uint16_t t = 0; t < __TEST_ROUTE_TARGETS && iter != NULL; t += 4, sll_next(iter))
+				memcpy(&targets[t], &iter->val->dhkey, randombytes_uniform(sizeof(np_dhkey_t)));
+
+			uint32_t found = 0;
+			MEASURE_TIME(batch_arr, r, {
+				found = _np_route_lookup_batch(context, targets, __TEST_ROUTE_TARGETS, next_hops);
+			});
+
+			np_sll_t(np_key_ptr, single_hops[__TEST_ROUTE_TARGETS]);
+			MEASURE_TIME(single_arr, r, {
+				for (uint16_t t = 0; t < __TEST_ROUTE_TARGETS; t++)
+					single_hops[t] = _np_route_lookup(context, targets[t], 1);
+			});
+
+			uint32_t reference_found = 0;
+			for (uint16_t t = 0; t < __TEST_ROUTE_TARGETS; t++)
+			{
+				np_key_t* reference_hop = __test_route_reference_hop(context, leafset, table, targets[t]);
+				cr_expect(next_hops[t] == reference_hop, "expected the batch lookup to find the reference next hop");
+				if (reference_hop != NULL) reference_found++;
+
+				np_key_unref_list(single_hops[t], "_np_route_lookup");
+				sll_free(np_key_ptr, single_hops[t]);
+				if (next_hops[t] != NULL) np_unref_obj(np_key_t, next_hops[t], "_np_route_lookup_batch");
+			}
+			cr_expect(reference_found == found, "expected the batch lookup to find the same number of next hops");
+		}
+		np_key_unref_list(leafset, "_np_route_neighbors");
+		sll_free(np_key_ptr, leafset);
+		np_key_unref_list(table, "_np_route_get_table");
+		sll_free(np_key_ptr, table);
+
+		cr_log_info("###########\n");
+		CALC_AND_PRINT_STATISTICS("route lookup 64 targets (single):", single_arr, __TEST_ROUTE_ROUNDS);
+		CALC_AND_PRINT_STATISTICS("route lookup 64 targets (batch) :", batch_arr, __TEST_ROUTE_ROUNDS);
+
+		sll_iterator(np_key_ptr) iter = sll_first(my_keys);
+		while (NULL != iter)
+		{
+			np_unref_obj(np_key_t, iter->val, "_np_keycache_create");
+			sll_next(iter);
+		}
+		sll_free(np_key_ptr, my_keys);
+	}
+}
@@ -0,0 +1,132 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <inttypes.h>
+#include <math.h>
+#include <stdbool.h>
+#include <stdint.h>
+
+#include "../test_macros.c"
+
+#include "np_legacy.h"
+#include "np_settings.h"
+#include "np_statistics.h"
+
+TestSuite(np_statistics_t);
+
+#ifdef NP_BENCHMARKING
+Test(np_statistics_t,
+     _performance_bucket_boundaries,
+     .description = "test the log-linear bucket index of performance points") {
+  // durations below NP_PERFORMANCE_SUB_BUCKETS nsec are counted exactly
+  for (uint64_t nsec = 0; nsec < NP_PERFORMANCE_SUB_BUCKETS; nsec++)
+    cr_expect(nsec == _np_statistics_performance_bucket(nsec),
+              "expect %" PRIu64 " nsec to have its own bucket",
+              nsec);
+
+  // each power of two starts a new set of NP_PERFORMANCE_SUB_BUCKETS buckets
+  for (uint8_t bits = NP_PERFORMANCE_SUB_BUCKET_BITS;
+       bits < NP_PERFORMANCE_MAX_BITS;
+       bits++) {
+    uint64_t lower = 1ULL << bits;
+    uint16_t first = (bits - NP_PERFORMANCE_SUB_BUCKET_BITS + 1) *
+                     NP_PERFORMANCE_SUB_BUCKETS;
+    cr_expect(first == _np_statistics_performance_bucket(lower),
+              "expect 2^%" PRIu8 " nsec to start bucket %" PRIu16,
+              bits,
+              first);
+    cr_expect(first - 1 == _np_statistics_performance_bucket(lower - 1),
+              "expect 2^%" PRIu8 "-1 nsec to end the previous buckets",
+              bits);
+    cr_expect(first + NP_PERFORMANCE_SUB_BUCKETS - 1 ==
+                  _np_statistics_performance_bucket(2 * lower - 1),
+              "expect 2^%" PRIu8 " sub buckets to cover the power of two",
+              bits);
+
+    // the linear sub buckets have a width of 2^(bits - SUB_BUCKET_BITS)
+    uint64_t width = lower >> NP_PERFORMANCE_SUB_BUCKET_BITS;
+    for (uint16_t sub = 0; sub < NP_PERFORMANCE_SUB_BUCKETS; sub++) {
+      cr_expect(first + sub ==
+                    _np_statistics_performance_bucket(lower + sub * width),
+                "expect sub bucket %" PRIu16 " of 2^%" PRIu8 " to start at "
+                "its lower bound",
+                sub,
+                bits);
+      cr_expect(first + sub == _np_statistics_performance_bucket(
+                                   lower + (sub + 1) * width - 1),
+                "expect sub bucket %" PRIu16 " of 2^%" PRIu8 " to end before "
+                "the next one",
+                sub,
+                bits);
+    }
+  }
+
+  // longer durations are collected in the last bucket
+  uint64_t overflow = 1ULL << NP_PERFORMANCE_MAX_BITS;
+  cr_expect(NP_PERFORMANCE_BUCKETS - 1 ==
+                _np_statistics_performance_bucket(overflow - 1),
+            "expect the largest regular duration in the last bucket");
+  cr_expect(NP_PERFORMANCE_BUCKETS - 1 ==
+                _np_statistics_performance_bucket(overflow),
+            "expect 2^NP_PERFORMANCE_MAX_BITS nsec in the last bucket");
+  cr_expect(NP_PERFORMANCE_BUCKETS - 1 ==
+                _np_statistics_performance_bucket(UINT64_MAX),
+            "expect the maximum duration in the last bucket");
+}
+
+Test(np_statistics_t,
+     _performance_point_merge,
+     .description = "test the merged view of a recorded performance point") {
+  CTX() {
+    // the handshake point is not used by the library itself
+    enum np_statistics_performance_point_e point =
+        np_statistics_performance_point_tokenfactory_new_handshake;
+    np_statistics_performance_shard_t *shard =
+        _np_statistics_performance_shard(context);
+
+    // 99 fast and one slow duration
+    for (uint8_t i = 0; i < 99; i++)
+      _np_statistics_performance_record(shard, point, 1000);
+    _np_statistics_performance_record(shard, point, 1000000);
+
+    np_statistics_performance_point_t result;
+    _np_statistics_performance_get(context, point, &result);
+    cr_expect(100 == result.durations_count, "expect all durations");
+    cr_expect(fabs(result.p50 - 1000e-9) <=
+                  1000e-9 / NP_PERFORMANCE_SUB_BUCKETS,
+              "expect the median within the error of a sub bucket");
+    cr_expect(fabs(result.p99 - 1000e-9) <=
+                  1000e-9 / NP_PERFORMANCE_SUB_BUCKETS,
+              "expect the 99th percentile within the error of a sub bucket");
+    cr_expect(0.001 == result.max, "expect the exact maximum");
+  }
+}
+
+Test(np_statistics_t,
+     _performance_bucket_overflow,
+     .description = "test buckets with more than 2^32 durations") {
+  CTX() {
+    enum np_statistics_performance_point_e point =
+        np_statistics_performance_point_tokenfactory_new_handshake;
+    np_statistics_performance_shard_t *shard =
+        _np_statistics_performance_shard(context);
+
+    // a bucket of a hot point that has already counted 2^32 - 1 durations
+    uint16_t bucket = _np_statistics_performance_bucket(1000);
+    shard->buckets[point][bucket] = UINT32_MAX;
+    _np_statistics_performance_record(shard, point, 1000);
+    cr_expect((uint64_t)UINT32_MAX + 1 == shard->buckets[point][bucket],
+              "expect the bucket not to wrap");
+
+    np_statistics_performance_point_t result;
+    _np_statistics_performance_get(context, point, &result);
+    cr_expect((uint64_t)UINT32_MAX + 1 == result.durations_count,
+              "expect all durations of the bucket");
+    cr_expect(fabs(result.p50 - 1000e-9) <=
+                  1000e-9 / NP_PERFORMANCE_SUB_BUCKETS,
+              "expect the median within the error of a sub bucket");
+  }
+}
+#endif
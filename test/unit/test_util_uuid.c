@@ -3,6 +3,11 @@
 // SPDX-License-Identifier: OSL-3.0
 //
 #include <criterion/criterion.h>
+#include <ctype.h>
+#include <sys/wait.h>
+#include <unistd.h>
+
+#include "sodium.h"
 
 #include "np_evloop.h"
 #include "util/np_event.h"
@@ -10,6 +15,8 @@
 #include "neuropil_log.h"
 #include "np_log.h"
 
+#include "../test_macros.c"
+
 TestSuite(np_uuid_t );
 
 Test(np_uuid_t, _uuid_create, .description="test the creation of unique uuid's")
@@ -37,3 +44,141 @@ Test(np_uuid_t, _uuid_create, .description="test the creation of unique uuid's")
 		}
 	}
 }
+
+// the former uuid generation, a blake2b hash of a formatted string
+static void __test_uuid_create_blake2b(const char* str, uint16_t num, char* uuid_out)
+{
+	char input[256] = {'\0'};
+	unsigned char out[18] = {'\0'};
+
+	snprintf(input, 255, "%s:%u:%16.16f", str, num, _np_time_now(NULL));
+	crypto_generichash_blake2b(out, 18, (unsigned char*)input, 256, NULL, 0);
+	sodium_bin2hex(uuid_out, NP_UUID_BYTES, out, 18);
+	uuid_out[8] = uuid_out[13] = uuid_out[18] = uuid_out[23] = '-';
+	uuid_out[14] = '5';
+	uuid_out[19] = '9';
+}
+
+Test(np_uuid_t, _uuid_create_bin, .description="test the binary uuid and its text form")
+{
+	np_uuid_t uuid_1, uuid_2;
+	char uuid_str[NP_UUID_BYTES];
+	char uuid_hex[2 * NP_UUID_BIN_BYTES + 1];
+
+	_np_uuid_create_bin(&uuid_1, 0);
+	_np_uuid_create_bin(&uuid_2, 0);
+	cr_expect(0 != memcmp(uuid_1.b, uuid_2.b, NP_UUID_BIN_BYTES), "expect the binary uuid to be unique");
+
+	_np_uuid_to_str(&uuid_1, uuid_str);
+	cr_expect(36 == strlen(uuid_str), "expect the size of the uuid to be 36");
+
+	// without the dashes the text form is the plain hex encoding
+	sodium_bin2hex(uuid_hex, sizeof(uuid_hex), uuid_1.b, NP_UUID_BIN_BYTES);
+	cr_expect(0 == strncmp(uuid_str, uuid_hex, 8));
+	cr_expect(0 == strncmp(uuid_str + 9, uuid_hex + 8, 4));
+	cr_expect(0 == strncmp(uuid_str + 14, uuid_hex + 12, 4));
+	cr_expect(0 == strncmp(uuid_str + 19, uuid_hex + 16, 4));
+	cr_expect(0 == strncmp(uuid_str + 24, uuid_hex + 20, 12));
+}
+
+Test(np_uuid_t, _uuid_from_str, .description="test the parsing of the text form of an uuid")
+{
+	np_uuid_t uuid, parsed, hashed_1, hashed_2;
+	char uuid_str[NP_UUID_BYTES];
+
+	for (uint16_t i = 0; i < 999; i++)
+	{
+		_np_uuid_create_bin(&uuid, i);
+		_np_uuid_to_str(&uuid, uuid_str);
+		_np_uuid_from_str(uuid_str, &parsed);
+		cr_expect(0 == memcmp(uuid.b, parsed.b, NP_UUID_BIN_BYTES), "expect the uuid to survive the text form");
+	}
+
+	// upper case hex digits are accepted as well
+	for (uint8_t i = 0; i < NP_UUID_BYTES - 1; i++) uuid_str[i] = toupper(uuid_str[i]);
+	_np_uuid_from_str(uuid_str, &parsed);
+	cr_expect(0 == memcmp(uuid.b, parsed.b, NP_UUID_BIN_BYTES), "expect upper case hex digits to be parsed");
+
+	// other strings are hashed to a stable binary form
+	_np_uuid_from_str("this.is.not.an.uuid", &hashed_1);
+	_np_uuid_from_str("this.is.not.an.uuid", &hashed_2);
+	cr_expect(0 == memcmp(hashed_1.b, hashed_2.b, NP_UUID_BIN_BYTES), "expect the same binary form for the same string");
+
+	uuid_str[NP_UUID_BYTES - 2] = '\0';
+	_np_uuid_from_str(uuid_str, &hashed_2);
+	cr_expect(0 != memcmp(hashed_1.b, hashed_2.b, NP_UUID_BIN_BYTES), "expect different strings to differ");
+	cr_expect(0 != memcmp(uuid.b, hashed_2.b, NP_UUID_BIN_BYTES), "expect a truncated uuid not to be parsed");
+}
+
+Test(np_uuid_t, _uuid_create_after_fork, .description="test that a forked child does not repeat the uuids of its parent")
+{
+	np_uuid_t parent_uuid, child_uuid;
+	int fds[2];
+
+	// the generator of this thread exists before the fork
+	_np_uuid_create_bin(&parent_uuid, 0);
+	cr_assert(0 == pipe(fds), "expect a pipe to the child");
+
+	pid_t pid = fork();
+	cr_assert(0 <= pid, "expect the child to be forked");
+	if (pid == 0)
+	{
+		_np_uuid_create_bin(&child_uuid, 0);
+		ssize_t ret = write(fds[1], child_uuid.b, NP_UUID_BIN_BYTES);
+		_exit(ret == NP_UUID_BIN_BYTES ? 0 : 1);
+	}
+
+	_np_uuid_create_bin(&parent_uuid, 0);
+	cr_assert(NP_UUID_BIN_BYTES == read(fds[0], child_uuid.b, NP_UUID_BIN_BYTES), "expect the uuid of the child");
+	int status = 0;
+	waitpid(pid, &status, 0);
+	close(fds[0]);
+	close(fds[1]);
+
+	cr_expect(WIFEXITED(status) && 0 == WEXITSTATUS(status), "expect the child to send its uuid");
+	cr_expect(0 != memcmp(parent_uuid.b, child_uuid.b, NP_UUID_BIN_BYTES), "expect the child to use its own generator key");
+}
+
+#define __TEST_UUID_ROUNDS 100
+#define __TEST_UUID_COUNT 10000
+
+Test(np_uuid_t, _uuid_create_performance, .description="measure the uuids created per second")
+{
+	char uuid[NP_UUID_BYTES];
+	char* uuid_ptr = uuid;
+	np_uuid_t uuid_bin;
+
+	double blake2b_arr[__TEST_UUID_ROUNDS], create_arr[__TEST_UUID_ROUNDS], bin_arr[__TEST_UUID_ROUNDS];
+
+	for (uint16_t r = 0; r < __TEST_UUID_ROUNDS; r++)
+	{
+		MEASURE_TIME(blake2b_arr, r, {
+			for (uint16_t i = 0; i < __TEST_UUID_COUNT; i++) __test_uuid_create_blake2b("msg", 0, uuid);
+		});
+		MEASURE_TIME(create_arr, r, {
+			for (uint16_t i = 0; i < __TEST_UUID_COUNT; i++) np_uuid_create("msg", 0, &uuid_ptr);
+		});
+		MEASURE_TIME(bin_arr, r, {
+			for (uint16_t i = 0; i < __TEST_UUID_COUNT; i++) _np_uuid_create_bin(&uuid_bin, 0);
+		});
+	}
+
+	double blake2b_sum = 0.0, create_sum = 0.0, bin_sum = 0.0;
+	for (uint16_t r = 0; r < __TEST_UUID_ROUNDS; r++)
+	{
+		blake2b_sum += blake2b_arr[r];
+		create_sum += create_arr[r];
+		bin_sum += bin_arr[r];
+	}
+	double total = (double) __TEST_UUID_ROUNDS * __TEST_UUID_COUNT;
+
+	cr_log_info("###########\n");
+	cr_log_info("uuid blake2b     : %12.0f uuids/sec\n", total / blake2b_sum);
+	cr_log_info("uuid create      : %12.0f uuids/sec\n", total / create_sum);
+	cr_log_info("uuid create (bin): %12.0f uuids/sec\n", total / bin_sum);
+	CALC_AND_PRINT_STATISTICS("uuid blake2b (10000)     :", blake2b_arr, __TEST_UUID_ROUNDS);
+	CALC_AND_PRINT_STATISTICS("uuid create (10000)      :", create_arr, __TEST_UUID_ROUNDS);
+	CALC_AND_PRINT_STATISTICS("uuid create (bin, 10000) :", bin_arr, __TEST_UUID_ROUNDS);
+
+	cr_expect(create_sum < blake2b_sum, "expect the uuid creation to be faster than hashing 256 bytes");
+}
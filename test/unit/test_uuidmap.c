@@ -0,0 +1,132 @@
+//
+// SPDX-FileCopyrightText: 2016-2022 by pi-lar GmbH
+// SPDX-License-Identifier: OSL-3.0
+//
+#include <criterion/criterion.h>
+#include <inttypes.h>
+
+#include "sodium.h"
+
+#include "util/np_tree.h"
+#include "util/np_uuidmap.h"
+#include "np_util.h"
+#include "neuropil_log.h"
+#include "np_log.h"
+
+#include "../test_macros.c"
+
+#define __TEST_UUIDMAP_COUNT 4096
+
+TestSuite(np_uuidmap_t);
+
+Test(np_uuidmap_t, _uuidmap_insert_find_del, .description="test the insertion, lookup and removal of binary uuids")
+{
+	np_uuid_t* uuids = calloc(__TEST_UUIDMAP_COUNT, sizeof(np_uuid_t));
+	np_uuidmap_t* map = np_uuidmap_create(0);
+
+	cr_expect(0 == map->size, "expect the map to be empty");
+
+	for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++)
+	{
+		_np_uuid_create_bin(&uuids[i], 0);
+		cr_expect(np_uuidmap_insert(map, &uuids[i], np_treeval_new_ui(i)), "expect a new uuid to be inserted");
+		cr_expect(!np_uuidmap_insert(map, &uuids[i], np_treeval_new_ui(0)), "expect a known uuid to be rejected");
+	}
+	cr_expect(__TEST_UUIDMAP_COUNT == map->size, "expect all uuids to be in the map");
+	cr_expect(2 * map->size <= map->capacity, "expect the map to have grown");
+
+	for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++)
+	{
+		np_treeval_t* val = np_uuidmap_find(map, &uuids[i]);
+		cr_assert(NULL != val, "expect the uuid to be found");
+		cr_expect(i == val->value.ui, "expect the value of the uuid to be returned");
+	}
+
+	np_uuid_t unknown;
+	_np_uuid_create_bin(&unknown, 0);
+	cr_expect(NULL == np_uuidmap_find(map, &unknown), "expect an unknown uuid not to be found");
+	cr_expect(!np_uuidmap_del(map, &unknown), "expect an unknown uuid not to be removed");
+
+	// remove every odd uuid while iterating over the map
+	uint32_t pos = 0, visited = 0;
+	np_uuidmap_entry_t* entry = NULL;
+	while ((entry = np_uuidmap_next(map, &pos)))
+	{
+		visited++;
+		if (entry->val.value.ui % 2) np_uuidmap_del_entry(map, entry);
+	}
+	cr_expect(__TEST_UUIDMAP_COUNT == visited, "expect the iteration to visit all uuids");
+	cr_expect(__TEST_UUIDMAP_COUNT / 2 == map->size, "expect half of the uuids to be removed");
+
+	for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++)
+	{
+		cr_expect((i % 2 == 0) == (NULL != np_uuidmap_find(map, &uuids[i])), "expect only even uuids to be found");
+	}
+	for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i += 2)
+	{
+		cr_expect(np_uuidmap_del(map, &uuids[i]), "expect the uuid to be removed");
+	}
+	cr_expect(0 == map->size, "expect the map to be empty");
+
+	// tombstones are reused, the map must not grow any further
+	uint32_t capacity = map->capacity;
+	for (uint32_t round = 0; round < 8; round++)
+	{
+		for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_uuidmap_insert(map, &uuids[i], np_treeval_new_ui(i));
+		for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_uuidmap_del(map, &uuids[i]);
+	}
+	cr_expect(capacity == map->capacity, "expect removed slots to be reused");
+	cr_expect(0 == map->size, "expect the map to be empty");
+
+	np_uuidmap_free(map);
+	free(uuids);
+}
+
+#define __TEST_UUIDMAP_ROUNDS 50
+
+Test(np_uuidmap_t, _uuidmap_performance, .description="compare lookups in the uuid map with the string keyed tree")
+{
+	np_uuid_t* uuids = calloc(__TEST_UUIDMAP_COUNT, sizeof(np_uuid_t));
+	char (*uuid_strs)[NP_UUID_BYTES] = calloc(__TEST_UUIDMAP_COUNT, NP_UUID_BYTES);
+
+	for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++)
+	{
+		_np_uuid_create_bin(&uuids[i], 0);
+		_np_uuid_to_str(&uuids[i], uuid_strs[i]);
+	}
+
+	double tree_arr[__TEST_UUIDMAP_ROUNDS], map_arr[__TEST_UUIDMAP_ROUNDS];
+	for (uint16_t r = 0; r < __TEST_UUIDMAP_ROUNDS; r++)
+	{
+		MEASURE_TIME(tree_arr, r, {
+			np_tree_t* tree = np_tree_create();
+			for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++)
+				if (np_tree_find_str(tree, uuid_strs[i]) == NULL) np_tree_insert_str(tree, uuid_strs[i], np_treeval_new_d(1.0));
+			for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_tree_find_str(tree, uuid_strs[i]);
+			for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_tree_del_str(tree, uuid_strs[i]);
+			np_tree_free(tree);
+		});
+		MEASURE_TIME(map_arr, r, {
+			np_uuidmap_t* map = np_uuidmap_create(0);
+			for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_uuidmap_insert(map, &uuids[i], np_treeval_new_d(1.0));
+			for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_uuidmap_find(map, &uuids[i]);
+			for (uint32_t i = 0; i < __TEST_UUIDMAP_COUNT; i++) np_uuidmap_del(map, &uuids[i]);
+			np_uuidmap_free(map);
+		});
+	}
+
+	double tree_sum = 0.0, map_sum = 0.0;
+	for (uint16_t r = 0; r < __TEST_UUIDMAP_ROUNDS; r++)
+	{
+		tree_sum += tree_arr[r];
+		map_sum += map_arr[r];
+	}
+
+	cr_log_info("###########\n");
+	CALC_AND_PRINT_STATISTICS("uuid tree (str, 4096) :", tree_arr, __TEST_UUIDMAP_ROUNDS);
+	CALC_AND_PRINT_STATISTICS("uuid map  (bin, 4096) :", map_arr, __TEST_UUIDMAP_ROUNDS);
+	cr_expect(map_sum < tree_sum, "expect the binary uuid map to be faster than the string keyed tree");
+
+	free(uuid_strs);
+	free(uuids);
+}